@@ -0,0 +1,96 @@
+/* This file is part of the KDE libraries
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "highlightingcode.h"
+
+/**
+ * Repeat a chunk of lines, drop the incomplete last repetition
+ */
+static QString repeatChunk(const QString &chunk, int chunkLines, int lines)
+{
+    QString text;
+    text.reserve(lines / chunkLines * chunk.size());
+    for (int i = 0; i < lines / chunkLines; ++i) {
+        text += chunk;
+    }
+
+    return text;
+}
+
+QString HighlightingCode::cppCode(int lines)
+{
+    const QString chunk = QStringLiteral(
+                              "/**\n"
+                              " * Compute something.\n"
+                              " */\n"
+                              "int compute(const QVector<int> &values, int factor)\n"
+                              "{\n"
+                              "    int sum = 0; // the result\n"
+                              "    for (int i = 0; i < values.size(); ++i) {\n"
+                              "        sum += values.at(i) * factor + 0x10;\n"
+                              "    }\n"
+                              "    return sum > 42 ? sum : qMax(sum, -1);\n"
+                              "}\n"
+                              "\n"
+                              "#define MAXIMUM \"some string\"\n"
+                              "static const char *name = \"compute\";\n"
+                              "\n"
+                              "class Computer : public QObject\n"
+                              "{\n"
+                              "public:\n"
+                              "    explicit Computer(QObject *parent = nullptr);\n"
+                              "};\n");
+    return repeatChunk(chunk, 20, lines);
+}
+
+QString HighlightingCode::sqlCode(int lines)
+{
+    const QString chunk = QStringLiteral(
+                              "SELECT id, name, count(*) AS total FROM customers\n"
+                              "  WHERE created BETWEEN '2015-01-01' AND '2015-12-31' AND NOT deleted\n"
+                              "  GROUP BY id, name HAVING count(*) > 10 ORDER BY total DESC;\n"
+                              "insert into orders (id, customer, amount) values (1, 2, 3.5);\n"
+                              "update orders set amount = amount * 2 where customer in (select id from customers);\n"
+                              "CREATE TABLE IF NOT EXISTS items (id INTEGER PRIMARY KEY, label VARCHAR(20) NOT NULL);\n"
+                              "delete from items where label is null or label like 'x%';\n"
+                              "selectx Distinct label From items Left Outer Join orders On items.id = orders.id;\n");
+    return repeatChunk(chunk, 8, lines);
+}
+
+QString HighlightingCode::latexCode(int lines)
+{
+    const QString chunk = QStringLiteral(
+                              "\\section{Results} \\label{sec:results}\n"
+                              "As shown in \\cite{knuth84} and \\ref{fig:plot}, the values grow with $n^2$.\n"
+                              "\\begin{itemize}\n"
+                              "  \\item The \\textbf{first} item, see \\eqref{eq:sum} % a comment\n"
+                              "  \\item The \\emph{second} item with \\verb|code| and \\hspace*{1cm} space\n"
+                              "\\end{itemize}\n"
+                              "\\begin{equation} \\sum_{i=0}^{n} x_i = \\frac{a}{b} \\end{equation}\n"
+                              "Plain text without any commands, just words and numbers like 42.\n");
+    return repeatChunk(chunk, 8, lines);
+}
+
+QString HighlightingCode::commentedCode(int lines)
+{
+    QString text;
+    for (int i = 0; i < lines / 4; ++i) {
+        text += QStringLiteral("int a%1 = 0;\n/* comment\n   comment */\nint b;\n").arg(i);
+    }
+    return text;
+}
@@ -0,0 +1,53 @@
+/* This file is part of the KDE libraries
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef KATE_HIGHLIGHTING_CODE_H
+#define KATE_HIGHLIGHTING_CODE_H
+
+#include <QString>
+
+/**
+ * Inputs for highlighting tests and benchmarks, built from repeated chunks of lines.
+ * The tests use a few lines of them, the benchmarks many.
+ */
+namespace HighlightingCode
+{
+
+/**
+ * C++ code, in chunks of 20 lines
+ */
+QString cppCode(int lines);
+
+/**
+ * C++ code with a block comment every four lines
+ */
+QString commentedCode(int lines);
+
+/**
+ * Keyword heavy SQL, in chunks of 8 lines, its keywords are case insensitive
+ */
+QString sqlCode(int lines);
+
+/**
+ * LaTeX, most of its rules are regular expressions, in chunks of 8 lines
+ */
+QString latexCode(int lines);
+
+}
+
+#endif // KATE_HIGHLIGHTING_CODE_H
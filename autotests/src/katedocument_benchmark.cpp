@@ -0,0 +1,150 @@
+/* This file is part of the KDE libraries
+   Copyright (C) 2010 Dominik Haumann <dhaumann kde org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "katedocument_benchmark.h"
+#include "highlightingcode.h"
+
+#include <katedocument.h>
+#include <kateglobal.h>
+#include <katebuffer.h>
+
+#include <QtTestWidgets>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+QTEST_MAIN(KateDocumentBenchmark)
+
+KateDocumentBenchmark::KateDocumentBenchmark()
+    : QObject()
+{
+}
+
+KateDocumentBenchmark::~KateDocumentBenchmark()
+{
+}
+
+void KateDocumentBenchmark::initTestCase()
+{
+    KTextEditor::EditorPrivate::enableUnitTestMode();
+}
+
+#ifdef Q_OS_LINUX
+/**
+ * resident memory of the process, 0 if unknown
+ */
+static qint64 residentMemory()
+{
+    QFile statm(QStringLiteral("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.size() < 2) {
+        return 0;
+    }
+
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+}
+#endif
+
+void KateDocumentBenchmark::highlightingMemoryBenchmark()
+{
+#ifdef Q_OS_LINUX
+    if (!residentMemory()) {
+        QSKIP("no /proc/self/statm, can't measure memory usage");
+    }
+
+    // 500k lines of C++
+    QString text = HighlightingCode::cppCode(500000);
+
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(text);
+    text.clear();
+    QVERIFY(doc.setHighlightingMode(QStringLiteral("C++")));
+
+    // memory needed for attributes + context stacks of all lines
+    const qint64 before = residentMemory();
+    doc.buffer().ensureHighlighted(doc.lines() - 1);
+    const qint64 after = residentMemory();
+
+    QTest::setBenchmarkResult(qMax(qint64(0), after - before), QTest::BytesAllocated);
+#else
+    QSKIP("resident memory is only measured on Linux");
+#endif
+}
+
+void KateDocumentBenchmark::highlightingBenchmark()
+{
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(HighlightingCode::cppCode(100000));
+    QVERIFY(doc.setHighlightingMode(QStringLiteral("C++")));
+
+    // highlight all lines from scratch
+    QBENCHMARK {
+        doc.buffer().invalidateHighlighting();
+        doc.buffer().ensureHighlighted(doc.lines() - 1);
+    }
+}
+
+void KateDocumentBenchmark::highlightingConvergenceBenchmark()
+{
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(HighlightingCode::commentedCode(100000));
+    QVERIFY(doc.setHighlightingMode(QStringLiteral("C++")));
+    doc.buffer().ensureHighlighted(doc.lines() - 1);
+
+    // open and close a comment in the middle, keep all highlighted
+    QBENCHMARK {
+        doc.insertText(KTextEditor::Cursor(50000, 0), QStringLiteral("/"));
+        doc.insertText(KTextEditor::Cursor(50000, 1), QStringLiteral("*"));
+        doc.buffer().ensureHighlighted(doc.lines() - 1);
+        doc.removeText(KTextEditor::Range(50000, 1, 50000, 2));
+        doc.removeText(KTextEditor::Range(50000, 0, 50000, 1));
+        doc.buffer().ensureHighlighted(doc.lines() - 1);
+    }
+}
+
+void KateDocumentBenchmark::keywordHighlightingBenchmark()
+{
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(HighlightingCode::sqlCode(100000));
+    QVERIFY(doc.setHighlightingMode(QStringLiteral("SQL")));
+
+    // highlight all lines from scratch, most words are keywords to look up
+    QBENCHMARK {
+        doc.buffer().invalidateHighlighting();
+        doc.buffer().ensureHighlighted(doc.lines() - 1);
+    }
+}
+
+void KateDocumentBenchmark::regExpHighlightingBenchmark()
+{
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(HighlightingCode::latexCode(100000));
+    QVERIFY(doc.setHighlightingMode(QStringLiteral("LaTeX")));
+
+    // highlight all lines from scratch, most rules are regular expressions
+    QBENCHMARK {
+        doc.buffer().invalidateHighlighting();
+        doc.buffer().ensureHighlighted(doc.lines() - 1);
+    }
+}
@@ -25,6 +25,11 @@
 #include <kateconfig.h>
 #include <kateview.h>
 #include <kateglobal.h>
+#include <katebuffer.h>
+#include <katehighlight.h>
+#include <katehighlighthelpers.h>
+
+#include "highlightingcode.h"
 
 #include <QtTestWidgets>
 #include <QTemporaryFile>
@@ -385,6 +390,59 @@ void KateDocumentTest::testInsertNewline()
     doc.editWrapLine(1, 4);
 }
 
+void KateDocumentTest::testInsertRemoveManyLines()
+{
+    KTextEditor::DocumentPrivate doc;
+    doc.setText("first\n"
+                "last");
+
+    QStringList lines;
+    for (int i = 0; i < 10000; ++i) {
+        lines << QString::number(i);
+    }
+
+    // the lines in between are inserted at once, one undo step
+    doc.insertText(Cursor(0, 2), lines.join(QLatin1Char('\n')));
+    QCOMPARE(doc.lines(), 10001);
+    QCOMPARE(doc.line(0), QStringLiteral("fi0"));
+    QCOMPARE(doc.line(5000), QStringLiteral("5000"));
+    QCOMPARE(doc.line(9999), QStringLiteral("9999rst"));
+    QCOMPARE(doc.line(10000), QStringLiteral("last"));
+
+    doc.undo();
+    QCOMPARE(doc.text(), QStringLiteral("first\nlast"));
+    doc.redo();
+    QCOMPARE(doc.lines(), 10001);
+    QCOMPARE(doc.line(5000), QStringLiteral("5000"));
+
+    // the lines in between are removed at once
+    doc.removeText(Range(1, 0, 9999, 0));
+    QCOMPARE(doc.text(), QStringLiteral("fi0\n9999rst\nlast"));
+    doc.undo();
+    QCOMPARE(doc.lines(), 10001);
+    QCOMPARE(doc.line(1), QStringLiteral("1"));
+    QCOMPARE(doc.line(9998), QStringLiteral("9998"));
+
+    // remove up to the end, the last line can't be removed as a whole
+    doc.editRemoveLines(5000, doc.lastLine());
+    QCOMPARE(doc.lines(), 5000);
+    QCOMPARE(doc.line(4999), QStringLiteral("4999"));
+    doc.undo();
+    QCOMPARE(doc.lines(), 10001);
+    QCOMPARE(doc.line(10000), QStringLiteral("last"));
+
+    // the low level signals of the single lines follow the complete edit, the document holds all lines already
+    QList<int> linesAtSignal;
+    const QMetaObject::Connection connection = connect(&doc, &KTextEditor::Document::lineWrapped, [&doc, &linesAtSignal]() {
+        linesAtSignal << doc.lines();
+    });
+    doc.insertLines(1, lines);
+    disconnect(connection);
+    QCOMPARE(linesAtSignal.size(), lines.size());
+    QCOMPARE(linesAtSignal.first(), 20001);
+    QCOMPARE(linesAtSignal.last(), 20001);
+}
+
 // we have two different ways of creating the checksum:
 // in KateFileLoader and KTextEditor::DocumentPrivate::createDigest. Make
 // sure, these two implementations result in the same checksum.
@@ -413,4 +471,346 @@ void KateDocumentTest::testDefStyleNum()
     QCOMPARE(doc.defStyleNum(0, 0), 0);
 }
 
+void KateDocumentTest::testContextStackSharing()
+{
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(QStringLiteral("/* first\ncomment\n*/\nint a;\n/* second\ncomment\n*/\nint b;\n"));
+    QVERIFY(doc.setHighlightingMode(QStringLiteral("C++")));
+    doc.buffer().ensureHighlighted(doc.lines() - 1);
+
+    // equal stacks of different lines share their data
+    const Kate::TextLine firstComment = doc.buffer().plainLine(1);
+    const Kate::TextLine secondComment = doc.buffer().plainLine(5);
+    QVERIFY(!firstComment->contextStack().isEmpty());
+    QCOMPARE(firstComment->contextStack(), secondComment->contextStack());
+    QVERIFY(firstComment->contextStack().constData() == secondComment->contextStack().constData());
+    QVERIFY(doc.buffer().plainLine(3)->contextStack() != firstComment->contextStack());
+
+    // a second document shares them, too
+    KTextEditor::DocumentPrivate otherDoc;
+    otherDoc.setText(doc.text());
+    QVERIFY(otherDoc.setHighlightingMode(QStringLiteral("C++")));
+    otherDoc.buffer().ensureHighlighted(otherDoc.lines() - 1);
+    QVERIFY(otherDoc.buffer().plainLine(1)->contextStack().constData() == firstComment->contextStack().constData());
+
+    // editing inside the comment keeps the stacks, highlighting stops at once
+    doc.insertText(KTextEditor::Cursor(1, 0), QStringLiteral("x"));
+    doc.buffer().ensureHighlighted(1);
+    QVERIFY(doc.buffer().plainLine(1)->contextStack().constData() == secondComment->contextStack().constData());
+}
+
+void KateDocumentTest::testHighlightingMemory()
+{
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(HighlightingCode::cppCode(2000));
+    QVERIFY(doc.setHighlightingMode(QStringLiteral("C++")));
+    doc.buffer().ensureHighlighted(doc.lines() - 1);
+
+    // lines with a few attributes store them inline
+    QVERIFY(!doc.buffer().plainLine(4)->attributesList().isEmpty());
+    QCOMPARE(doc.buffer().plainLine(4)->highlightingMemoryUsage(), qint64(0));
+
+    // the attributes of a line need less than a heap block on average
+    qint64 text = 0;
+    qint64 highlighting = 0;
+    qint64 history = 0;
+    qint64 movingRanges = 0;
+    doc.buffer().memoryUsage(text, highlighting, history, movingRanges);
+    QVERIFY(highlighting > 0);
+    QVERIFY(highlighting / doc.lines() < 32);
+}
+
+void KateDocumentTest::testMemoryUsage()
+{
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(HighlightingCode::cppCode(200));
+    const KTextEditor::DocumentPrivate::MemoryUsage small = doc.memoryUsage();
+    QVERIFY(small.text > 0);
+
+    // more text, more memory, the edit is recorded for undo
+    doc.insertText(KTextEditor::Cursor(doc.lines() - 1, 0), HighlightingCode::cppCode(2000));
+    const KTextEditor::DocumentPrivate::MemoryUsage large = doc.memoryUsage();
+    QVERIFY(large.text > small.text + qint64(HighlightingCode::cppCode(1000).size()) * qint64(sizeof(QChar)));
+    QVERIFY(large.undo > small.undo + qint64(HighlightingCode::cppCode(1000).size()) * qint64(sizeof(QChar)));
+    QCOMPARE(large.total(), large.text + large.highlighting + large.layouts + large.undo + large.history + large.movingRanges);
+
+    // a clone shares the lines, both together count them about once
+    KTextEditor::DocumentPrivate clone;
+    QVERIFY(clone.cloneFrom(&doc));
+    QCOMPARE(clone.text(), doc.text());
+    const qint64 sharedText = doc.memoryUsage().text + clone.memoryUsage().text;
+    QVERIFY(sharedText < large.text + large.text / 4);
+
+    // editing all lines of the clone copies them
+    clone.setText(doc.text());
+    QVERIFY(doc.memoryUsage().text + clone.memoryUsage().text > large.text + large.text / 2);
+
+    // the report sums up all documents, then lists the largest ones
+    const QStringList report = KTextEditor::EditorPrivate::self()->memoryUsageReport(1);
+    QCOMPARE(report.size(), 2);
+    QVERIFY(KTextEditor::EditorPrivate::self()->memoryUsageReport().size() >= 3);
+}
+
+void KateDocumentTest::testCompactStorageHighlighting()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.write(HighlightingCode::cppCode(2000).toUtf8());
+    file.close();
+
+    KTextEditor::DocumentPrivate doc;
+    doc.config()->setCompactLineStorage(true);
+    QVERIFY(doc.openUrl(QUrl::fromLocalFile(file.fileName())));
+    QCOMPARE(doc.lines(), 2001);
+    QVERIFY(doc.buffer().isLineCompact(0));
+
+    // highlighting all lines keeps them in compact storage
+    QVERIFY(doc.setHighlightingMode(QStringLiteral("C++")));
+    doc.buffer().ensureHighlighted(doc.lines() - 1);
+    for (int line = 0; line < doc.lines(); line += 100) {
+        QVERIFY(doc.buffer().isLineCompact(line));
+    }
+    const Kate::TextLine comment = doc.buffer().plainLine(1);
+    QVERIFY(!comment->attributesList().isEmpty());
+    QVERIFY(!comment->contextStack().isEmpty());
+
+    // editing leaves compact storage, the accessed lines keep their highlighting
+    doc.insertText(KTextEditor::Cursor(3, 0), QStringLiteral(" "));
+    QVERIFY(!doc.buffer().isLineCompact(3));
+    QVERIFY(doc.buffer().plainLine(1) == comment);
+    QVERIFY(doc.buffer().isLineCompact(doc.lines() - 1));
+}
+
+void KateDocumentTest::testBackgroundHighlighting()
+{
+    QString text;
+    for (int i = 0; i < 5000; ++i) {
+        text += QStringLiteral("int a%1; // comment\n").arg(i);
+    }
+
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(text);
+    QVERIFY(doc.setHighlightingMode(QStringLiteral("C++")));
+
+    // lines near the highlighted ones are done at once
+    QVERIFY(doc.buffer().ensureHighlightedForPainting(10));
+
+    // far away ones in the background, they get tagged once done
+    QSignalSpy tagSpy(&doc.buffer(), SIGNAL(tagLines(int,int)));
+    QVERIFY(!doc.buffer().ensureHighlightedForPainting(4000));
+    QTRY_VERIFY(doc.buffer().ensureHighlightedForPainting(4000));
+    QVERIFY(!tagSpy.isEmpty());
+    QCOMPARE(tagSpy.last().at(0).toInt(), 4000);
+    QCOMPARE(tagSpy.last().at(1).toInt(), 4000);
+
+    // opening a comment at the top restarts the highlighting from there
+    doc.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("/*"));
+    QVERIFY(!doc.buffer().ensureHighlightedForPainting(4000));
+    QTRY_VERIFY(doc.buffer().ensureHighlightedForPainting(4000));
+    QVERIFY(!doc.buffer().plainLine(4000)->contextStack().isEmpty());
+    QCOMPARE(doc.buffer().plainLine(4000)->contextStack(), doc.buffer().plainLine(1)->contextStack());
+}
+
+void KateDocumentTest::testHighlightingConvergence()
+{
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(HighlightingCode::commentedCode(2000));
+    QVERIFY(doc.setHighlightingMode(QStringLiteral("C++")));
+    doc.buffer().ensureHighlighted(doc.lines() - 1);
+
+    // opening a comment only changes the lines up to the next comment end, only they get tagged
+    QSignalSpy tagSpy(&doc.buffer(), SIGNAL(tagLines(int,int)));
+    doc.insertText(KTextEditor::Cursor(1000, 0), QStringLiteral("/*"));
+    QVERIFY(!tagSpy.isEmpty());
+    QCOMPARE(tagSpy.last().at(0).toInt(), 1000);
+    QVERIFY(tagSpy.last().at(1).toInt() < 1010);
+
+    // disabling the code behind changes all lines, removing that again converges to them
+    doc.insertText(KTextEditor::Cursor(1100, 0), QStringLiteral("#if 0\n"));
+    doc.buffer().ensureHighlighted(1200);
+    doc.removeLine(1100);
+    doc.buffer().ensureHighlighted(doc.lines() - 1);
+
+    // the result is the same as highlighting all lines again
+    KTextEditor::DocumentPrivate otherDoc;
+    otherDoc.setText(doc.text());
+    QVERIFY(otherDoc.setHighlightingMode(QStringLiteral("C++")));
+    otherDoc.buffer().ensureHighlighted(otherDoc.lines() - 1);
+    for (int line = 0; line < doc.lines(); ++line) {
+        const Kate::TextLine textLine = doc.buffer().plainLine(line);
+        const Kate::TextLine otherTextLine = otherDoc.buffer().plainLine(line);
+        QCOMPARE(textLine->contextStack(), otherTextLine->contextStack());
+
+        const QVector<Kate::TextLineData::Attribute> attributes = textLine->attributesList();
+        const QVector<Kate::TextLineData::Attribute> otherAttributes = otherTextLine->attributesList();
+        QCOMPARE(attributes.size(), otherAttributes.size());
+        for (int i = 0; i < attributes.size(); ++i) {
+            QCOMPARE(attributes[i].offset, otherAttributes[i].offset);
+            QCOMPARE(attributes[i].length, otherAttributes[i].length);
+            QCOMPARE(attributes[i].attributeValue, otherAttributes[i].attributeValue);
+            QCOMPARE(attributes[i].foldingValue, otherAttributes[i].foldingValue);
+        }
+    }
+}
+
+/**
+ * Attributes of a line, as text, to compare them
+ */
+static QString attributesOf(const Kate::TextLine &line)
+{
+    QString result;
+    foreach (const Kate::TextLineData::Attribute &attribute, line->attributesList()) {
+        result += QStringLiteral("%1+%2:%3/%4 ").arg(attribute.offset).arg(attribute.length).arg(attribute.attributeValue).arg(attribute.foldingValue);
+    }
+    return result;
+}
+
+void KateDocumentTest::testKeywordHighlighting()
+{
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(HighlightingCode::sqlCode(16));
+    QVERIFY(doc.setHighlightingMode(QStringLiteral("SQL")));
+    doc.buffer().ensureHighlighted(doc.lines() - 1);
+
+    // keywords match ignoring case, but only as whole words
+    const short select = doc.buffer().plainLine(0)->attribute(0);
+    QCOMPARE(doc.buffer().plainLine(3)->attribute(0), select);
+    QCOMPARE(doc.buffer().plainLine(7)->attribute(8), select);
+    QVERIFY(doc.buffer().plainLine(7)->attribute(0) != select);
+    QVERIFY(doc.buffer().plainLine(0)->attribute(7) != select);
+
+    // the second chunk is highlighted like the first one
+    for (int line = 0; line < 8; ++line) {
+        QCOMPARE(attributesOf(doc.buffer().plainLine(line + 8)), attributesOf(doc.buffer().plainLine(line)));
+    }
+}
+
+void KateDocumentTest::testFirstCharDispatch_data()
+{
+    QTest::addColumn<QString>("mode");
+    QTest::addColumn<QString>("text");
+
+    // keywords, chars, strings, numbers, escapes, comments, preprocessor, line continuation
+    QTest::newRow("C++") << QStringLiteral("C++") << HighlightingCode::cppCode(20) + QStringLiteral(
+                             "const char c = '\\n', d = 'x'; const char *e = \"a\\tb\\\"c\";\n"
+                             "double f = 1.5e-3 + .5f + 07 + 0xFFul + 12u; /* block\n"
+                             "   comment */ int g = f > 1 ? 1 : 0;\n"
+                             "#define LONG_MACRO(x) \\\n"
+                             "    ((x) * 2)\n"
+                             "#if 0\n"
+                             "disabled code\n"
+                             "#endif\n"
+                             "\t  \u00e4\u00f6\u00fc identifier_with_umlauts_\u00e4 = u8\"\u00df\";\n"
+                             "R\"delim(raw \" string)delim\" L\"wide\" 'ab' // comment \\\n"
+                             "continued comment\n");
+
+    // regular expressions with literal starts and char classes
+    QTest::newRow("LaTeX") << QStringLiteral("LaTeX") << HighlightingCode::latexCode(8);
+
+    // case insensitive keywords
+    QTest::newRow("SQL") << QStringLiteral("SQL") << QStringLiteral(
+                             "SELECT id, name, count(*) AS total FROM customers\n"
+                             "  WHERE created BETWEEN '2015-01-01' AND '2015-12-31' AND NOT deleted\n"
+                             "selectx Distinct label From items Left Outer Join orders On items.id = orders.id;\n"
+                             "-- comment \u00c4\u00d6\u00dc select\n");
+}
+
+void KateDocumentTest::testFirstCharDispatch()
+{
+    QFETCH(QString, mode);
+    QFETCH(QString, text);
+
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(text);
+    QVERIFY(doc.setHighlightingMode(mode));
+    KateHighlighting *highlighting = doc.highlight();
+    QVERIFY(highlighting->contextCount() > 0);
+
+    // in all contexts, at all positions, the dispatched items match first where trying all items does
+    for (int context = 0; context < highlighting->contextCount(); ++context) {
+        KateHlContext *hlContext = highlighting->contextNum(context);
+        for (int line = 0; line < doc.lines(); ++line) {
+            const QString lineText = doc.line(line);
+            for (int offset = 0; offset < lineText.size(); ++offset) {
+                QCOMPARE(hlContext->firstMatchingItem(lineText, offset, false), hlContext->firstMatchingItem(lineText, offset, true));
+            }
+        }
+    }
+}
+
+void KateDocumentTest::testRegExpLiteralPrefix_data()
+{
+    QTest::addColumn<QString>("pattern");
+    QTest::addColumn<bool>("startDerivable");
+    QTest::addColumn<QString>("literalPrefix");
+
+    QTest::newRow("alternatives in group") << QStringLiteral("\\\\(cite|ref)") << true << QStringLiteral("\\");
+    QTest::newRow("repeated char") << QStringLiteral("a+b") << true << QStringLiteral("a");
+    QTest::newRow("repeated second char") << QStringLiteral("ab+c") << true << QStringLiteral("ab");
+    QTest::newRow("optional char") << QStringLiteral("a?b") << true << QString();
+    QTest::newRow("optional second char") << QStringLiteral("ab*c") << true << QStringLiteral("a");
+    QTest::newRow("counted char") << QStringLiteral("ab{2}") << true << QStringLiteral("a");
+    QTest::newRow("line start") << QStringLiteral("^#!/") << true << QStringLiteral("#!/");
+    QTest::newRow("bar in class") << QStringLiteral("[|]x") << true << QString();
+    QTest::newRow("bar in class and alternatives") << QStringLiteral("[|]x|y") << false << QString();
+    QTest::newRow("alternatives") << QStringLiteral("ab|cd") << false << QString();
+    QTest::newRow("quoted") << QStringLiteral("\\Qa.b\\E") << false << QString();
+    QTest::newRow("match start reset") << QStringLiteral("ab\\Kc") << false << QString();
+    QTest::newRow("escaped punctuation") << QStringLiteral("\\.\\$x") << true << QStringLiteral(".$x");
+    QTest::newRow("escaped letter") << QStringLiteral("\\w+") << true << QString();
+    QTest::newRow("escaped letter behind") << QStringLiteral("ab\\d") << true << QStringLiteral("ab");
+    QTest::newRow("back reference") << QStringLiteral("(a)\\1") << true << QString();
+}
+
+void KateDocumentTest::testRegExpLiteralPrefix()
+{
+    QFETCH(QString, pattern);
+    QFETCH(bool, startDerivable);
+    QFETCH(QString, literalPrefix);
+
+    QCOMPARE(KateHlRegExpr::startDerivable(pattern), startDerivable);
+    QCOMPARE(KateHlRegExpr::literalPrefix(pattern), literalPrefix);
+
+    // all matches must start with the prefix
+    const QRegularExpressionMatch match = QRegularExpression(pattern).match(QStringLiteral("#!/ \\cite ab abbc ab2 .$x aab"));
+    if (match.hasMatch()) {
+        QVERIFY(match.captured().startsWith(literalPrefix));
+    }
+}
+
+void KateDocumentTest::testRegExpLiteralPrefixSkipping()
+{
+    // the LaTeX rules are regular expressions starting with a backslash
+    const QString text = HighlightingCode::latexCode(16);
+    KTextEditor::DocumentPrivate doc;
+    doc.setText(text);
+    QVERIFY(doc.setHighlightingMode(QStringLiteral("LaTeX")));
+    doc.buffer().ensureHighlighted(doc.lines() - 1);
+
+    // plain words in front move the next backslash away from the offsets tried, PCRE is skipped up to it
+    const QString words = QStringLiteral("Some words in front ");
+    KTextEditor::DocumentPrivate shiftedDoc;
+    shiftedDoc.setText(QString(text).replace(QLatin1Char('\n'), QLatin1Char('\n') + words).prepend(words));
+    QVERIFY(shiftedDoc.setHighlightingMode(QStringLiteral("LaTeX")));
+    shiftedDoc.buffer().ensureHighlighted(shiftedDoc.lines() - 1);
+
+    // the commands are highlighted the same, just shifted
+    for (int line = 0; line < doc.lines(); ++line) {
+        const Kate::TextLine textLine = doc.buffer().plainLine(line);
+        const Kate::TextLine shiftedLine = shiftedDoc.buffer().plainLine(line);
+        QVERIFY(shiftedLine->text().startsWith(words));
+        for (int column = 0; column < textLine->length(); ++column) {
+            QCOMPARE(shiftedLine->attribute(column + words.size()), textLine->attribute(column));
+        }
+    }
+
+    // lines without a backslash have no commands
+    const short plain = doc.buffer().plainLine(7)->attribute(0);
+    QVERIFY(doc.buffer().plainLine(0)->attribute(0) != plain);
+    QVERIFY(doc.buffer().plainLine(1)->attribute(12) != plain);
+    for (int column = 0; column < doc.buffer().plainLine(7)->length(); ++column) {
+        QCOMPARE(doc.buffer().plainLine(7)->attribute(column), plain);
+    }
+}
+
 #include "katedocument_test.moc"
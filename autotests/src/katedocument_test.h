@@ -45,12 +45,26 @@ private Q_SLOTS:
 
     void testRemoveMultipleLines();
     void testInsertNewline();
+    void testInsertRemoveManyLines();
 
     void testReplaceTabs();
 
     void testDigest();
     
     void testDefStyleNum();
+
+    void testContextStackSharing();
+    void testHighlightingMemory();
+    void testMemoryUsage();
+    void testCompactStorageHighlighting();
+    void testBackgroundHighlighting();
+    void testHighlightingConvergence();
+    void testKeywordHighlighting();
+    void testFirstCharDispatch_data();
+    void testFirstCharDispatch();
+    void testRegExpLiteralPrefix_data();
+    void testRegExpLiteralPrefix();
+    void testRegExpLiteralPrefixSkipping();
 };
 
 #endif // KATE_DOCUMENT_TEST_H
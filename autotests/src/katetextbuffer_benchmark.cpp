@@ -0,0 +1,420 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2016 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "katetextbuffer_benchmark.h"
+#include "katetextbuffer.h"
+#include "katetextcursor.h"
+#include "katetextrange.h"
+
+QTEST_MAIN(KateTextBufferBenchmark)
+
+KateTextBufferBenchmark::KateTextBufferBenchmark()
+    : QObject()
+{
+}
+
+KateTextBufferBenchmark::~KateTextBufferBenchmark()
+{
+}
+
+void KateTextBufferBenchmark::initTestCase_data()
+{
+    // run all benchmarks for both storage backends of loaded lines
+    QTest::addColumn<bool>("compactStorage");
+    QTest::newRow("line storage") << false;
+    QTest::newRow("compact storage") << true;
+}
+
+void KateTextBufferBenchmark::loadThroughputBenchmark_data()
+{
+    QTest::addColumn<QByteArray>("line");
+    QTest::newRow("ascii") << QByteArray("    return m_text.unicode() + offset; // some ascii source code line\n");
+    QTest::newRow("utf-8") << QByteArray("    Gr\xc3\xbc\xc3\x9f" "e aus K\xc3\xb6ln, \xe2\x82\xac, das ist ein Test mit Umlauten\n");
+}
+
+void KateTextBufferBenchmark::loadThroughputBenchmark()
+{
+    QFETCH_GLOBAL(bool, compactStorage);
+
+    QFETCH(QByteArray, line);
+
+    // generate 100 MB file
+    const qint64 size = 100 * 1024 * 1024;
+    QByteArray chunk;
+    while (chunk.size() < 1024 * 1024) {
+        chunk += line;
+    }
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    for (qint64 written = 0; written < size; written += chunk.size()) {
+        QCOMPARE(file.write(chunk), qint64(chunk.size()));
+    }
+    const qint64 fileSize = file.size();
+    file.close();
+
+    Kate::TextBuffer buffer(0);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setCompactStorage(compactStorage);
+    bool encodingErrors = false, tooLongLinesWrapped = false;
+    int longestLine = 0;
+
+    // report the throughput in bytes per second
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, false));
+    const qint64 elapsed = qMax(qint64(1), timer.elapsed());
+    QTest::setBenchmarkResult(qreal(fileSize) * 1000 / elapsed, QTest::BytesPerSecond);
+
+    QVERIFY(!encodingErrors);
+    QCOMPARE(buffer.line(0)->text() + QLatin1Char('\n'), QString::fromUtf8(line));
+}
+
+void KateTextBufferBenchmark::editPositionBenchmark_data()
+{
+    QTest::addColumn<int>("position");
+    QTest::newRow("start") << 0;
+    QTest::newRow("middle") << 50;
+    QTest::newRow("end") << 100;
+}
+
+void KateTextBufferBenchmark::editPositionBenchmark()
+{
+    QFETCH_GLOBAL(bool, compactStorage);
+
+    QFETCH(int, position);
+
+    // buffer with one million lines
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QByteArray chunk;
+    for (int i = 0; i < 1000; ++i) {
+        chunk += "some line of text\n";
+    }
+    for (int i = 0; i < 1000; ++i) {
+        file.write(chunk);
+    }
+    file.close();
+
+    Kate::TextBuffer buffer(0);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setCompactStorage(compactStorage);
+    bool encodingErrors = false, tooLongLinesWrapped = false;
+    int longestLine = 0;
+    QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, true));
+
+    // wrap + unwrap a line, the cost must not depend on the position
+    const int line = qMin(buffer.lines() - 2, buffer.lines() * position / 100);
+    QBENCHMARK {
+        buffer.startEditing();
+        buffer.wrapLine(KTextEditor::Cursor(line, 4));
+        buffer.unwrapLine(line + 1);
+        buffer.finishEditing();
+    }
+    QCOMPARE(buffer.line(line)->text(), QStringLiteral("some line of text"));
+}
+
+void KateTextBufferBenchmark::rangesForLineBenchmark()
+{
+    // 10000 lines with 50000 ranges, most of them spanning multiple lines, like diagnostics or search matches
+    Kate::TextBuffer buffer(0);
+    QStringList lines;
+    for (int l = 1; l < 10000; ++l) {
+        lines << QStringLiteral("some line of text");
+    }
+    buffer.startEditing();
+    buffer.insertLines(0, lines);
+    buffer.finishEditing();
+
+    QList<Kate::TextRange *> ranges;
+    for (int r = 0; r < 50000; ++r) {
+        const int startLine = (r * 7919) % buffer.lines();
+        const int endLine = qMin(buffer.lines() - 1, startLine + r % 50);
+        ranges.append(new Kate::TextRange(buffer, KTextEditor::Range(startLine, 0, endLine, 4), KTextEditor::MovingRange::DoNotExpand));
+    }
+
+    // paint all lines, like the renderer does it
+    int found = 0;
+    QBENCHMARK {
+        found = 0;
+        for (int line = 0; line < buffer.lines(); ++line) {
+            found += buffer.rangesForLine(line, 0, false).size();
+        }
+    }
+
+    // each range is found once per line it spans
+    int expected = 0;
+    foreach (Kate::TextRange *range, ranges) {
+        expected += range->end().line() - range->start().line() + 1;
+    }
+    QCOMPARE(found, expected);
+    qDeleteAll(ranges);
+}
+
+void KateTextBufferBenchmark::typingWithManyCursorsBenchmark()
+{
+    // 1000 lines with 100 cursors each, like search matches or annotations everywhere
+    Kate::TextBuffer buffer(0);
+    QStringList lines;
+    for (int l = 1; l < 1000; ++l) {
+        lines << QString(100, QLatin1Char('x'));
+    }
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), QString(100, QLatin1Char('x')));
+    buffer.insertLines(0, lines);
+    buffer.finishEditing();
+
+    QList<Kate::TextCursor *> cursors;
+    for (int l = 0; l < buffer.lines(); ++l) {
+        for (int c = 0; c < 100; ++c) {
+            cursors << new Kate::TextCursor(buffer, KTextEditor::Cursor(l, c), Kate::TextCursor::MoveOnInsert);
+        }
+    }
+
+    // type and remove a char in the middle of a line, only the cursors behind it move
+    Kate::TextCursor *cursor = cursors.at(500 * 100 + 60);
+    QBENCHMARK {
+        buffer.startEditing();
+        buffer.insertText(KTextEditor::Cursor(500, 50), QStringLiteral("a"));
+        buffer.removeText(KTextEditor::Range(500, 50, 500, 51));
+        buffer.finishEditing();
+    }
+    QCOMPARE(cursor->toCursor(), KTextEditor::Cursor(500, 60));
+    qDeleteAll(cursors);
+}
+
+void KateTextBufferBenchmark::wholeDocumentScanBenchmark_data()
+{
+    QTest::addColumn<int>("method");
+    QTest::newRow("line") << 0;
+    QTest::newRow("visitLines") << 1;
+    QTest::newRow("visitBlocks") << 2;
+}
+
+void KateTextBufferBenchmark::wholeDocumentScanBenchmark()
+{
+    QFETCH_GLOBAL(bool, compactStorage);
+
+    QFETCH(int, method);
+
+    // buffer with one million lines
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QByteArray chunk;
+    for (int i = 0; i < 1000; ++i) {
+        chunk += "  some line of text\n";
+    }
+    for (int i = 0; i < 1000; ++i) {
+        file.write(chunk);
+    }
+    file.close();
+
+    Kate::TextBuffer buffer(0);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setCompactStorage(compactStorage);
+    bool encodingErrors = false, tooLongLinesWrapped = false;
+    int longestLine = 0;
+    QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, true));
+
+    // count the chars that are no spaces, like searches and word completion look at all chars
+    int count = 0;
+    auto countLine = [&count](const QStringRef & text) {
+        for (int i = 0; i < text.size(); ++i) {
+            if (!text.at(i).isSpace()) {
+                ++count;
+            }
+        }
+    };
+    QBENCHMARK {
+        count = 0;
+        if (method == 0) {
+            for (int line = 0; line < buffer.lines(); ++line) {
+                const QString text = buffer.line(line)->string();
+                countLine(QStringRef(&text));
+            }
+        } else if (method == 1) {
+            buffer.visitLines(0, buffer.lines() - 1, [&countLine](int, const QStringRef & text) {
+                countLine(text);
+                return true;
+            });
+        } else {
+            buffer.visitBlocks(0, buffer.lines() - 1, [&countLine](int, const QVector<QStringRef> &texts) {
+                foreach (const QStringRef &text, texts) {
+                    countLine(text);
+                }
+                return true;
+            });
+        }
+    }
+    QCOMPARE(count, 1000000 * 14);
+}
+
+void KateTextBufferBenchmark::corpusEditBenchmark_data()
+{
+    QTest::addColumn<int>("lineLength");
+    QTest::addColumn<int>("lines");
+    QTest::newRow("minified") << 500000 << 20;
+    QTest::newRow("log") << 120 << 100000;
+    QTest::newRow("source") << 30 << 300000;
+}
+
+void KateTextBufferBenchmark::corpusEditBenchmark()
+{
+    QFETCH(int, lineLength);
+    QFETCH(int, lines);
+
+    // about ten million chars, with lines of the given length, every tenth one ten times as long
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    const QByteArray line(lineLength, 'x');
+    for (int i = 0; i < lines; ++i) {
+        file.write(line);
+        if (i % 10 == 0) {
+            for (int j = 0; j < 9; ++j) {
+                file.write(line);
+            }
+        }
+        file.write("\n");
+    }
+    file.close();
+
+    Kate::TextBuffer buffer(0);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setLineLengthLimit(0);
+    bool encodingErrors = false, tooLongLinesWrapped = false;
+    int longestLine = 0;
+    QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, true));
+
+    // split and join a long line in the middle, the block of it gets split and merged
+    const int middle = (lines / 20) * 10;
+    QBENCHMARK {
+        buffer.startEditing();
+        buffer.wrapLine(KTextEditor::Cursor(middle, lineLength));
+        buffer.insertText(KTextEditor::Cursor(middle + 1, 0), QStringLiteral("y"));
+        buffer.removeText(KTextEditor::Range(middle + 1, 0, middle + 1, 1));
+        buffer.unwrapLine(middle + 1);
+        buffer.finishEditing();
+    }
+    QCOMPARE(buffer.line(middle)->length(), 10 * lineLength);
+}
+
+void KateTextBufferBenchmark::textExtractionBenchmark_data()
+{
+    QTest::addColumn<int>("method");
+    QTest::newRow("text") << 0;
+    QTest::newRow("text().toUtf8()") << 1;
+    QTest::newRow("utf8Text") << 2;
+}
+
+void KateTextBufferBenchmark::textExtractionBenchmark()
+{
+    QFETCH_GLOBAL(bool, compactStorage);
+
+    QFETCH(int, method);
+
+    // buffer with one million lines
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QByteArray chunk;
+    for (int i = 0; i < 1000; ++i) {
+        chunk += "  some line of text\n";
+    }
+    for (int i = 0; i < 1000; ++i) {
+        file.write(chunk);
+    }
+    file.close();
+
+    Kate::TextBuffer buffer(0);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setCompactStorage(compactStorage);
+    bool encodingErrors = false, tooLongLinesWrapped = false;
+    int longestLine = 0;
+    QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, true));
+
+    // the file ends with a newline, so the last line is empty
+    int size = 0;
+    QBENCHMARK {
+        if (method == 0) {
+            size = buffer.text().size();
+        } else if (method == 1) {
+            size = buffer.text().toUtf8().size();
+        } else {
+            size = buffer.utf8Text().size();
+        }
+    }
+    QCOMPARE(size, 1000000 * 20);
+}
+
+void KateTextBufferBenchmark::cloneBenchmark_data()
+{
+    QTest::addColumn<bool>("clone");
+    QTest::newRow("insertText") << false;
+    QTest::newRow("cloneFrom") << true;
+}
+
+void KateTextBufferBenchmark::cloneBenchmark()
+{
+    QFETCH_GLOBAL(bool, compactStorage);
+
+    QFETCH(bool, clone);
+
+    // buffer with one million lines
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QByteArray chunk;
+    for (int i = 0; i < 1000; ++i) {
+        chunk += "  some line of text\n";
+    }
+    for (int i = 0; i < 1000; ++i) {
+        file.write(chunk);
+    }
+    file.close();
+
+    Kate::TextBuffer source(0);
+    source.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    source.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    source.setCompactStorage(compactStorage);
+    bool encodingErrors = false, tooLongLinesWrapped = false;
+    int longestLine = 0;
+    QVERIFY(source.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, true));
+
+    // second buffer with the same text, then an edit in the middle, like a preview does
+    Kate::TextBuffer buffer(0);
+    QBENCHMARK {
+        if (clone) {
+            buffer.cloneFrom(source);
+        } else {
+            buffer.clear();
+            buffer.startEditing();
+            buffer.insertText(KTextEditor::Cursor(0, 0), source.text());
+            buffer.finishEditing();
+        }
+
+        buffer.startEditing();
+        buffer.insertText(KTextEditor::Cursor(500000, 0), QStringLiteral("edit"));
+        buffer.finishEditing();
+    }
+    QCOMPARE(buffer.lines(), source.lines());
+    QCOMPARE(buffer.line(500000)->string(), QStringLiteral("edit  some line of text"));
+}
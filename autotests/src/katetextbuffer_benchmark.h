@@ -0,0 +1,57 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2016 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATETEXTBUFFER_BENCHMARK_H
+#define KATETEXTBUFFER_BENCHMARK_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QObject>
+
+/**
+ * Benchmarks for the text buffer, they need large inputs and take long.
+ * Not run as unit tests, start the executable by hand.
+ */
+class KateTextBufferBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    KateTextBufferBenchmark();
+    virtual ~KateTextBufferBenchmark();
+
+private Q_SLOTS:
+    void initTestCase_data();
+    void loadThroughputBenchmark_data();
+    void loadThroughputBenchmark();
+    void editPositionBenchmark_data();
+    void editPositionBenchmark();
+    void rangesForLineBenchmark();
+    void typingWithManyCursorsBenchmark();
+    void wholeDocumentScanBenchmark_data();
+    void wholeDocumentScanBenchmark();
+    void corpusEditBenchmark_data();
+    void corpusEditBenchmark();
+    void textExtractionBenchmark_data();
+    void textExtractionBenchmark();
+    void cloneBenchmark_data();
+    void cloneBenchmark();
+};
+
+#endif // KATETEXTBUFFER_BENCHMARK_H
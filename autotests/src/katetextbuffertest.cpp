@@ -22,8 +22,11 @@
 #include "katetextbuffertest.h"
 #include "katetextbuffer.h"
 #include "katetextcursor.h"
+#include "katetextrange.h"
 #include "katetextfolding.h"
 
+#include <QThread>
+
 QTEST_MAIN(KateTextBufferTest)
 
 KateTextBufferTest::KateTextBufferTest()
@@ -35,6 +38,14 @@ KateTextBufferTest::~KateTextBufferTest()
 {
 }
 
+void KateTextBufferTest::initTestCase_data()
+{
+    // run all tests for both storage backends of loaded lines
+    QTest::addColumn<bool>("compactStorage");
+    QTest::newRow("line storage") << false;
+    QTest::newRow("compact storage") << true;
+}
+
 void KateTextBufferTest::basicBufferTest()
 {
     // construct an empty text buffer
@@ -208,6 +219,82 @@ void KateTextBufferTest::cursorTest()
     }
 }
 
+void KateTextBufferTest::insertRemoveLinesTest()
+{
+    // test with different block sizes
+    for (int i = 1; i <= 4; ++i) {
+        // lines 0 to 9
+        Kate::TextBuffer buffer(0, i);
+        buffer.startEditing();
+        for (int l = 0; l < 10; ++l) {
+            buffer.insertText(KTextEditor::Cursor(l, 0), QString::number(l));
+            if (l < 9) {
+                buffer.wrapLine(KTextEditor::Cursor(l, 1));
+            }
+        }
+        buffer.finishEditing();
+
+        const qint64 revision = buffer.revision();
+        buffer.history().lockRevision(revision);
+
+        Kate::TextCursor stay(buffer, KTextEditor::Cursor(3, 1), Kate::TextCursor::StayOnInsert);
+        Kate::TextCursor move(buffer, KTextEditor::Cursor(3, 1), Kate::TextCursor::MoveOnInsert);
+        Kate::TextCursor behind(buffer, KTextEditor::Cursor(6, 0), Kate::TextCursor::MoveOnInsert);
+        Kate::TextRange range(buffer, KTextEditor::Range(2, 0, 7, 1), KTextEditor::MovingRange::DoNotExpand);
+
+        // insert lines behind line 3
+        QStringList lines;
+        for (int l = 0; l < 10; ++l) {
+            lines << QStringLiteral("new") + QString::number(l);
+        }
+        buffer.startEditing();
+        buffer.insertLines(3, lines);
+        buffer.finishEditing();
+
+        QCOMPARE(buffer.lines(), 20);
+        QCOMPARE(buffer.line(3)->text(), QStringLiteral("3"));
+        for (int l = 0; l < 10; ++l) {
+            QCOMPARE(buffer.line(4 + l)->text(), lines.at(l));
+            QVERIFY(buffer.line(4 + l)->markedAsModified());
+        }
+        QCOMPARE(buffer.line(14)->text(), QStringLiteral("4"));
+        QCOMPARE(buffer.line(19)->text(), QStringLiteral("9"));
+
+        // cursors and ranges behave like for wrapLine + insertText
+        QCOMPARE(stay.toCursor(), KTextEditor::Cursor(3, 1));
+        QCOMPARE(move.toCursor(), KTextEditor::Cursor(13, 4));
+        QCOMPARE(behind.toCursor(), KTextEditor::Cursor(16, 0));
+        QCOMPARE(range.toRange(), KTextEditor::Range(2, 0, 17, 1));
+        QVERIFY(buffer.rangesForLine(10, 0, false).contains(&range));
+
+        // the history maps positions the same way
+        int line = 3, column = 1;
+        buffer.history().transformCursor(line, column, KTextEditor::MovingCursor::MoveOnInsert, revision);
+        QCOMPARE(KTextEditor::Cursor(line, column), move.toCursor());
+
+        // remove the new lines and the line behind them
+        Kate::TextCursor removed(buffer, KTextEditor::Cursor(8, 2), Kate::TextCursor::MoveOnInsert);
+        buffer.startEditing();
+        buffer.removeLines(4, 14);
+        buffer.finishEditing();
+
+        QCOMPARE(buffer.lines(), 9);
+        QCOMPARE(buffer.text(), QStringLiteral("0\n1\n2\n3\n5\n6\n7\n8\n9"));
+        QCOMPARE(stay.toCursor(), KTextEditor::Cursor(3, 1));
+        QCOMPARE(move.toCursor(), KTextEditor::Cursor(4, 0));
+        QCOMPARE(removed.toCursor(), KTextEditor::Cursor(4, 0));
+        QCOMPARE(behind.toCursor(), KTextEditor::Cursor(5, 0));
+        QCOMPARE(range.toRange(), KTextEditor::Range(2, 0, 6, 1));
+        QVERIFY(buffer.rangesForLine(6, 0, false).contains(&range));
+
+        line = 6;
+        column = 0;
+        buffer.history().transformCursor(line, column, KTextEditor::MovingCursor::MoveOnInsert, revision);
+        QCOMPARE(KTextEditor::Cursor(line, column), behind.toCursor());
+        buffer.history().unlockRevision(revision);
+    }
+}
+
 void KateTextBufferTest::foldingTest()
 {
     // construct an empty text buffer & folding info
@@ -429,6 +516,8 @@ void KateTextBufferTest::nestedFoldingTest()
 
 void KateTextBufferTest::saveFileInUnwritableFolder()
 {
+    QFETCH_GLOBAL(bool, compactStorage);
+
     // create temp dir and get file name inside
     QTemporaryDir dir;
     QVERIFY(dir.isValid());
@@ -446,6 +535,7 @@ void KateTextBufferTest::saveFileInUnwritableFolder()
     Kate::TextBuffer buffer(0, 1);
     buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
     buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setCompactStorage(compactStorage);
     bool a, b;
     int c;
     buffer.load(file_path, a, b, c, true);
@@ -464,3 +554,1117 @@ void KateTextBufferTest::saveFileInUnwritableFolder()
     QVERIFY(f.remove());
     QVERIFY(dir.remove());
 }
+
+void KateTextBufferTest::largeFileLoadTest()
+{
+    QFETCH_GLOBAL(bool, compactStorage);
+
+    // create temp file with some unicode, dos line ends and a too long line
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QByteArray longLine;
+    for (int i = 0; i < 20; ++i) {
+        longLine += "\xc3\xa4" "bc def, ";
+    }
+    for (int i = 0; i < 50; ++i) {
+        file.write(QByteArray::number(i) + " \xc3\xa4\xc3\xb6\xc3\xbc line\r\n");
+        if (i % 7 == 0) {
+            file.write(longLine + "\r\n");
+        }
+    }
+    file.write("last line");
+    file.close();
+
+    // load normally and memory mapped, results must be equal
+    Kate::TextBuffer buffer(0, 4);
+    Kate::TextBuffer mappedBuffer(0, 4);
+    foreach (Kate::TextBuffer *b, QList<Kate::TextBuffer *>() << &buffer << &mappedBuffer) {
+        b->setTextCodec(QTextCodec::codecForName("UTF-8"));
+        b->setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+        b->setCompactStorage(compactStorage);
+        b->setLineLengthLimit(20);
+    }
+    mappedBuffer.setLargeFileLimit(1);
+
+    bool encodingErrors = false, tooLongLinesWrapped = false, mappedTooLongLinesWrapped = false;
+    int longestLine = 0;
+    QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, true));
+    QVERIFY(!encodingErrors);
+    QVERIFY(mappedBuffer.load(file.fileName(), encodingErrors, mappedTooLongLinesWrapped, longestLine, true));
+    QVERIFY(!encodingErrors);
+
+    QVERIFY(tooLongLinesWrapped);
+    QVERIFY(mappedTooLongLinesWrapped);
+    QCOMPARE(mappedBuffer.endOfLineMode(), Kate::TextBuffer::eolDos);
+    QCOMPARE(mappedBuffer.lines(), buffer.lines());
+    QCOMPARE(mappedBuffer.line(33)->text(), buffer.line(33)->text());
+    QCOMPARE(mappedBuffer.text(), buffer.text());
+
+    // editing of lazy loaded buffer must work, too
+    mappedBuffer.clear();
+    QVERIFY(mappedBuffer.load(file.fileName(), encodingErrors, mappedTooLongLinesWrapped, longestLine, true));
+    Kate::TextCursor *cursor = new Kate::TextCursor(mappedBuffer, KTextEditor::Cursor(40, 1), Kate::TextCursor::MoveOnInsert);
+    mappedBuffer.startEditing();
+    mappedBuffer.insertText(KTextEditor::Cursor(40, 0), QLatin1String("ABC"));
+    mappedBuffer.unwrapLine(12);
+    mappedBuffer.wrapLine(KTextEditor::Cursor(2, 1));
+    mappedBuffer.finishEditing();
+    QCOMPARE(cursor->toCursor(), KTextEditor::Cursor(40, 4));
+
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(40, 0), QLatin1String("ABC"));
+    buffer.unwrapLine(12);
+    buffer.wrapLine(KTextEditor::Cursor(2, 1));
+    buffer.finishEditing();
+    QCOMPARE(mappedBuffer.lines(), buffer.lines());
+    QCOMPARE(mappedBuffer.text(), buffer.text());
+
+    delete cursor;
+}
+
+/**
+ * git compatible sha1 digest of the given file content
+ */
+static QByteArray gitDigest(const QByteArray &content)
+{
+    QCryptographicHash crypto(QCryptographicHash::Sha1);
+    crypto.addData(QByteArray("blob ") + QByteArray::number(content.size()) + '\0');
+    crypto.addData(content);
+    return crypto.result();
+}
+
+void KateTextBufferTest::truncatedLargeFileTest()
+{
+    QFETCH_GLOBAL(bool, compactStorage);
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QByteArray content;
+    for (int i = 0; i < 100; ++i) {
+        content += "line " + QByteArray::number(i) + "\n";
+    }
+    file.write(content);
+    file.close();
+
+    Kate::TextBuffer buffer(0, 4);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setCompactStorage(compactStorage);
+    buffer.setLargeFileLimit(1);
+    bool encodingErrors = false, tooLongLinesWrapped = false;
+    int longestLine = 0;
+    QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, true));
+
+    // the digest is computed while indexing, like for normal loading
+    QCOMPARE(buffer.digest(), gitDigest(content));
+    QCOMPARE(buffer.line(2)->text(), QStringLiteral("line 2"));
+    QVERIFY(!buffer.fileReadFailed());
+
+    // truncate the file behind the back of the buffer, this must not crash
+    QSignalSpy readErrorSpy(&buffer, SIGNAL(fileReadError()));
+    QVERIFY(file.open());
+    file.resize(content.size() / 2);
+    file.close();
+
+    // the lines behind the new end are gone, the buffer knows that
+    QCOMPARE(buffer.lines(), 101);
+    QCOMPARE(buffer.line(90)->text(), QString());
+    QVERIFY(buffer.fileReadFailed());
+    QCOMPARE(readErrorSpy.count(), 1);
+
+    // saving would write the empty lines over the content, it is refused
+    QTemporaryFile saveFile;
+    QVERIFY(saveFile.open());
+    saveFile.write("keep me");
+    saveFile.close();
+    QVERIFY(!buffer.save(saveFile.fileName()));
+    QVERIFY(saveFile.open());
+    QCOMPARE(saveFile.readAll(), QByteArray("keep me"));
+    saveFile.close();
+
+    // reloading clears the error
+    QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, true));
+    QVERIFY(!buffer.fileReadFailed());
+    QCOMPARE(buffer.text(), QString::fromLatin1(content.left(content.size() / 2)));
+}
+
+void KateTextBufferTest::backgroundLoadTest()
+{
+    QFETCH_GLOBAL(bool, compactStorage);
+
+    // create temp file with enough lines for a lot of blocks
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    for (int i = 0; i < 10000; ++i) {
+        file.write("line " + QByteArray::number(i) + "\n");
+    }
+    file.close();
+
+    // load normally to compare
+    Kate::TextBuffer buffer(0, 4);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setCompactStorage(compactStorage);
+    bool encodingErrors = false, tooLongLinesWrapped = false;
+    int longestLine = 0;
+    QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, false));
+
+    // load in background, cursors must survive that
+    Kate::TextBuffer backgroundBuffer(0, 4);
+    backgroundBuffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    backgroundBuffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    backgroundBuffer.setCompactStorage(compactStorage);
+    Kate::TextCursor *cursor = new Kate::TextCursor(backgroundBuffer, KTextEditor::Cursor(0, 0), Kate::TextCursor::MoveOnInsert);
+    QSignalSpy finishedSpy(&backgroundBuffer, SIGNAL(loadingFinished(bool,bool,bool,int,bool)));
+    QSignalSpy linesLoadedSpy(&backgroundBuffer, SIGNAL(linesLoaded(int)));
+    backgroundBuffer.startLoading(file.fileName(), false);
+    QVERIFY(backgroundBuffer.lines() > 1);
+
+    // the first lines replace the empty line of the cleared buffer
+    QVERIFY(linesLoadedSpy.count() > 0);
+    QCOMPARE(linesLoadedSpy.first().at(0).toInt(), 0);
+
+    // no editing while loading, the edits are refused
+    if (backgroundBuffer.isLoading()) {
+        QVERIFY(!backgroundBuffer.startEditing());
+        QVERIFY(backgroundBuffer.editingRefused());
+        backgroundBuffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("refused"));
+        backgroundBuffer.wrapLine(KTextEditor::Cursor(0, 0));
+        QVERIFY(!backgroundBuffer.finishEditing());
+        QVERIFY(!backgroundBuffer.editingRefused());
+    }
+
+    if (backgroundBuffer.isLoading()) {
+        QVERIFY(finishedSpy.wait());
+    }
+    QVERIFY(!backgroundBuffer.isLoading());
+    QCOMPARE(finishedSpy.count(), 1);
+    QVERIFY(finishedSpy.first().at(0).toBool());
+    QVERIFY(!finishedSpy.first().at(4).toBool());
+    QCOMPARE(backgroundBuffer.lines(), buffer.lines());
+    QCOMPARE(backgroundBuffer.text(), buffer.text());
+    QCOMPARE(backgroundBuffer.endOfLineMode(), Kate::TextBuffer::eolUnix);
+    QCOMPARE(cursor->toCursor(), KTextEditor::Cursor(0, 0));
+
+    // canceled loading keeps the start of the file
+    finishedSpy.clear();
+    backgroundBuffer.startLoading(file.fileName(), false);
+    backgroundBuffer.cancelLoading();
+    QVERIFY(!backgroundBuffer.isLoading());
+    QCOMPARE(finishedSpy.count(), 1);
+    QVERIFY(finishedSpy.first().at(4).toBool());
+    QVERIFY(backgroundBuffer.lines() <= buffer.lines());
+    QCOMPARE(backgroundBuffer.line(0)->text(), QStringLiteral("line 0"));
+
+    // clear stops loading silently
+    finishedSpy.clear();
+    backgroundBuffer.startLoading(file.fileName(), false);
+    backgroundBuffer.clear();
+    QVERIFY(!backgroundBuffer.isLoading());
+    QCOMPARE(backgroundBuffer.lines(), 1);
+    QCOMPARE(finishedSpy.count(), 0);
+
+    delete cursor;
+}
+
+void KateTextBufferTest::backgroundSaveTest()
+{
+    QFETCH_GLOBAL(bool, compactStorage);
+
+    // create temp file with enough lines for a lot of blocks and some non-ascii chars
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QByteArray content;
+    for (int i = 0; i < 10000; ++i) {
+        content += "line \xc3\xa4 " + QByteArray::number(i) + "\n";
+    }
+    file.write(content);
+    file.close();
+
+    Kate::TextBuffer buffer(0, 4);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setCompactStorage(compactStorage);
+    bool encodingErrors = false, tooLongLinesWrapped = false;
+    int longestLine = 0;
+    QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, false));
+
+    // saving computes the digest while writing
+    QTemporaryFile saveFile;
+    QVERIFY(saveFile.open());
+    saveFile.close();
+    QByteArray digest;
+    QVERIFY(buffer.save(saveFile.fileName(), &digest));
+    QFile savedFile(saveFile.fileName());
+    QVERIFY(savedFile.open(QIODevice::ReadOnly));
+    QCOMPARE(savedFile.readAll(), content);
+    savedFile.close();
+    QCOMPARE(digest, gitDigest(content));
+
+    // save in background, edit meanwhile, the file gets the text from the start of the saving
+    QSignalSpy finishedSpy(&buffer, SIGNAL(savingFinished(QString,bool,QByteArray)));
+    const qint64 revision = buffer.revision();
+    QVERIFY(buffer.startSaving(saveFile.fileName()));
+    QVERIFY(buffer.isSaving());
+    QVERIFY(!buffer.startSaving(saveFile.fileName()));
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("new "));
+    buffer.finishEditing();
+    QVERIFY(finishedSpy.wait());
+    QVERIFY(!buffer.isSaving());
+    QCOMPARE(finishedSpy.count(), 1);
+    QCOMPARE(finishedSpy.first().at(0).toString(), saveFile.fileName());
+    QVERIFY(finishedSpy.first().at(1).toBool());
+    QCOMPARE(finishedSpy.first().at(2).toByteArray(), gitDigest(content));
+    QVERIFY(savedFile.open(QIODevice::ReadOnly));
+    QCOMPARE(savedFile.readAll(), content);
+    savedFile.close();
+
+    // the revision at the start is the saved one, the edited line is still unsaved
+    QCOMPARE(buffer.history().lastSavedRevision(), revision);
+    QVERIFY(buffer.line(0)->markedAsModified());
+    QVERIFY(!buffer.line(0)->markedAsSavedOnDisk());
+}
+
+void KateTextBufferTest::loaderDecodingTest()
+{
+    QFETCH_GLOBAL(bool, compactStorage);
+
+    // utf-8 char split by the loader block size, between long ascii runs
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    const QByteArray ascii(256 * 1024 - 1, 'a');
+    file.write(ascii + "\xc3\xa4" + ascii + "\r\nxyz \xe2\x82\xac\r\n");
+    file.close();
+
+    Kate::TextBuffer buffer(0, 4);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setCompactStorage(compactStorage);
+    bool encodingErrors = false, tooLongLinesWrapped = false;
+    int longestLine = 0;
+    QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, true));
+    QVERIFY(!encodingErrors);
+    QCOMPARE(buffer.lines(), 3);
+    QCOMPARE(buffer.lineView(1).toString(), QString::fromUtf8("xyz \xe2\x82\xac"));
+    QCOMPARE(buffer.text(), QString::fromLatin1(ascii) + QChar(0xe4) + QString::fromLatin1(ascii) + QString::fromUtf8("\nxyz \xe2\x82\xac\n"));
+    QCOMPARE(buffer.line(0)->text(), QString::fromLatin1(ascii) + QChar(0xe4) + QString::fromLatin1(ascii));
+    QCOMPARE(buffer.line(1)->text(), QString::fromUtf8("xyz \xe2\x82\xac"));
+    QCOMPARE(buffer.endOfLineMode(), Kate::TextBuffer::eolDos);
+
+    // null bytes in ascii runs are still detected as encoding errors
+    QVERIFY(file.open());
+    file.resize(0);
+    file.write(QByteArray("abc\n") + QByteArray(100, 'a') + '\0' + QByteArray(100, 'b') + "\n");
+    file.close();
+    buffer.clear();
+    QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, true));
+    QVERIFY(encodingErrors);
+    QCOMPARE(buffer.lines(), 3);
+}
+
+void KateTextBufferTest::blockIndexTest()
+{
+    // small blocks, to have a lot of splits and merges
+    Kate::TextBuffer buffer(0, 4);
+    buffer.startEditing();
+    for (int i = 0; i < 100; ++i) {
+        buffer.insertText(KTextEditor::Cursor(i, 0), QString::number(i));
+        buffer.wrapLine(KTextEditor::Cursor(i, buffer.line(i)->length()));
+    }
+    buffer.finishEditing();
+    QCOMPARE(buffer.lines(), 101);
+
+    // join pairs of lines in the first half, lines must still be found
+    buffer.startEditing();
+    for (int i = 1; i < 50; ++i) {
+        buffer.unwrapLine(i);
+    }
+    buffer.finishEditing();
+    QCOMPARE(buffer.lines(), 52);
+    for (int i = 0; i < 49; ++i) {
+        QCOMPARE(buffer.line(i)->text(), QString::number(2 * i) + QString::number(2 * i + 1));
+    }
+    QCOMPARE(buffer.line(49)->text(), QStringLiteral("98"));
+    QCOMPARE(buffer.line(50)->text(), QStringLiteral("99"));
+    QCOMPARE(buffer.line(51)->text(), QString());
+
+    // cursors follow the changed start lines of their blocks
+    Kate::TextCursor cursor(buffer, KTextEditor::Cursor(40, 1), Kate::TextCursor::MoveOnInsert);
+    buffer.startEditing();
+    buffer.wrapLine(KTextEditor::Cursor(0, 1));
+    buffer.wrapLine(KTextEditor::Cursor(20, 0));
+    buffer.finishEditing();
+    QCOMPARE(cursor.toCursor(), KTextEditor::Cursor(42, 1));
+    QCOMPARE(buffer.line(42)->text(), QStringLiteral("8081"));
+
+    // splits and merges of several blocks in one transaction, the index is renumbered lazily
+    QStringList expected;
+    for (int i = 0; i < buffer.lines(); ++i) {
+        expected.append(buffer.line(i)->text());
+    }
+    QStringList inserted;
+    for (int i = 0; i < 30; ++i) {
+        inserted.append(QStringLiteral("new %1").arg(i));
+    }
+    buffer.startEditing();
+    buffer.insertLines(10, inserted);
+    buffer.removeLines(30, 45);
+    buffer.insertLines(0, inserted.mid(0, 5));
+    buffer.finishEditing();
+    for (int i = 0; i < inserted.size(); ++i) {
+        expected.insert(11 + i, inserted.at(i));
+    }
+    expected.erase(expected.begin() + 30, expected.begin() + 46);
+    for (int i = 0; i < 5; ++i) {
+        expected.insert(1 + i, inserted.at(i));
+    }
+    QCOMPARE(buffer.lines(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+        QCOMPARE(buffer.line(i)->text(), expected.at(i));
+    }
+    QCOMPARE(cursor.toCursor(), KTextEditor::Cursor(42 + 30 - 16 + 5, 1));
+}
+
+void KateTextBufferTest::lineAttributesTest()
+{
+    Kate::TextLineData line(QStringLiteral("int main() { return 0; }"));
+    QVERIFY(!line.hasAttributes());
+
+    // contiguous equal attributes without folding are merged
+    line.addAttribute(Kate::TextLineData::Attribute(0, 3, 1, 0));
+    line.addAttribute(Kate::TextLineData::Attribute(3, 1, 1, 0));
+    line.addAttribute(Kate::TextLineData::Attribute(4, 4, 2, 0));
+    line.addAttribute(Kate::TextLineData::Attribute(11, 1, 3, 1));
+    line.addAttribute(Kate::TextLineData::Attribute(23, 1, 3, -1));
+    QVERIFY(line.hasAttributes());
+
+    QVector<Kate::TextLineData::Attribute> attributes = line.attributesList();
+    QCOMPARE(attributes.size(), 4);
+    QCOMPARE(attributes.at(0).offset, 0);
+    QCOMPARE(attributes.at(0).length, 4);
+    QCOMPARE(attributes.at(1).offset, 4);
+    QCOMPARE(attributes.at(1).attributeValue, short(2));
+    QCOMPARE(attributes.at(3).offset, 23);
+    QCOMPARE(attributes.at(3).foldingValue, short(-1));
+
+    QCOMPARE(line.attribute(2), short(1));
+    QCOMPARE(line.attribute(9), short(0));
+    QCOMPARE(line.attribute(11), short(3));
+
+    // many attributes with large values leave the inline storage
+    line.clearAttributes();
+    QVERIFY(!line.hasAttributes());
+    for (int i = 0; i < 1000; ++i) {
+        line.addAttribute(Kate::TextLineData::Attribute(i * 1000, 500, short(i % 300), short((i % 3) - 1)));
+    }
+    attributes = line.attributesList();
+    QCOMPARE(attributes.size(), 1000);
+    for (int i = 0; i < 1000; ++i) {
+        QCOMPARE(attributes.at(i).offset, i * 1000);
+        QCOMPARE(attributes.at(i).length, 500);
+        QCOMPARE(attributes.at(i).attributeValue, short(i % 300));
+        QCOMPARE(attributes.at(i).foldingValue, short((i % 3) - 1));
+    }
+
+    // the iterator decodes the same attributes
+    int count = 0;
+    for (Kate::TextLineData::AttributeIterator it(line); !it.atEnd(); it.next()) {
+        QCOMPARE(it.attribute().offset, attributes.at(count).offset);
+        QCOMPARE(it.attribute().length, attributes.at(count).length);
+        QCOMPARE(it.attribute().attributeValue, attributes.at(count).attributeValue);
+        QCOMPARE(it.attribute().foldingValue, attributes.at(count).foldingValue);
+        ++count;
+    }
+    QCOMPARE(count, 1000);
+    QVERIFY(Kate::TextLineData::AttributeIterator().atEnd());
+    QVERIFY(Kate::TextLineData::AttributeIterator(Kate::TextLineData()).atEnd());
+
+    // merge into a long last attribute
+    line.addAttribute(Kate::TextLineData::Attribute(999500, 100000, 0, 0));
+    line.addAttribute(Kate::TextLineData::Attribute(1099500, 1, 0, 0));
+    QCOMPARE(line.attributesList().size(), 1001);
+    QCOMPARE(line.attributesList().last().length, 100001);
+    QCOMPARE(line.attribute(1099500), short(0));
+    QCOMPARE(line.attribute(999000), short(999 % 300));
+}
+
+/**
+ * reads the complete text of a snapshot in its own thread
+ */
+class SnapshotReader : public QThread
+{
+public:
+    explicit SnapshotReader(const Kate::TextBufferSnapshot &snapshot)
+        : m_snapshot(snapshot)
+    {
+    }
+
+    QString text;
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        for (int i = 0; i < m_snapshot.lines(); ++i) {
+            if (i > 0) {
+                text.append(QLatin1Char('\n'));
+            }
+            text.append(m_snapshot.line(i));
+        }
+    }
+
+private:
+    const Kate::TextBufferSnapshot m_snapshot;
+};
+
+void KateTextBufferTest::snapshotTest()
+{
+    QFETCH_GLOBAL(bool, compactStorage);
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    for (int i = 0; i < 1000; ++i) {
+        file.write("line " + QByteArray::number(i) + " \xc3\xa4\n");
+    }
+    file.close();
+
+    // normally loaded and memory mapped buffer
+    for (int mapped = 0; mapped < 2; ++mapped) {
+        Kate::TextBuffer buffer(0, 16);
+        buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+        buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+        buffer.setCompactStorage(compactStorage);
+        if (mapped) {
+            buffer.setLargeFileLimit(1);
+        }
+        bool encodingErrors = false, tooLongLinesWrapped = false;
+        int longestLine = 0;
+        QVERIFY(buffer.load(file.fileName(), encodingErrors, tooLongLinesWrapped, longestLine, true));
+
+        const QString text = buffer.text();
+        const Kate::TextBufferSnapshot snapshot = buffer.snapshot();
+        QCOMPARE(snapshot.revision(), buffer.revision());
+        QCOMPARE(snapshot.lines(), buffer.lines());
+        QCOMPARE(snapshot.text(), text);
+        QCOMPARE(snapshot.line(500), QString::fromUtf8("line 500 \xc3\xa4"));
+        QCOMPARE(snapshot.lineLength(999), 10);
+        QCOMPARE(snapshot.text(KTextEditor::Range(1, 5, 2, 4)), QString::fromUtf8("1 \xc3\xa4\nline"));
+
+        // read in other thread while editing goes on
+        buffer.history().lockRevision(snapshot.revision());
+        SnapshotReader reader(snapshot);
+        reader.start();
+        for (int i = 0; i < 100; ++i) {
+            buffer.startEditing();
+            buffer.insertText(KTextEditor::Cursor(i * 5, 0), QStringLiteral("new "));
+            buffer.wrapLine(KTextEditor::Cursor(i * 5, 2));
+            buffer.finishEditing();
+        }
+        QVERIFY(reader.wait());
+        QCOMPARE(reader.text, text);
+        QCOMPARE(snapshot.text(), text);
+        QCOMPARE(snapshot.lines(), 1000);
+
+        // map range found in snapshot to the buffer
+        KTextEditor::Range range(10, 0, 10, 4);
+        QCOMPARE(snapshot.text(range), QStringLiteral("line"));
+        buffer.history().transformRange(range, KTextEditor::MovingRange::DoNotExpand, KTextEditor::MovingRange::AllowEmpty, snapshot.revision());
+        QCOMPARE(buffer.line(range.start().line())->text().mid(range.start().column(), range.columnWidth()), QStringLiteral("line"));
+        buffer.history().unlockRevision(snapshot.revision());
+
+        // edited lines are shared, editing them again, splitting or merging their blocks copies them
+        const QString editedText = buffer.text();
+        const Kate::TextBufferSnapshot editedSnapshot = buffer.snapshot();
+        buffer.startEditing();
+        for (int i = 0; i < 100; ++i) {
+            buffer.insertText(KTextEditor::Cursor(i, 0), QStringLiteral("x"));
+            buffer.unwrapLine(i + 1);
+        }
+        buffer.finishEditing();
+        QCOMPARE(editedSnapshot.lines(), 1100);
+        QCOMPARE(editedSnapshot.text(), editedText);
+
+        // empty snapshot
+        QCOMPARE(Kate::TextBufferSnapshot().lines(), 0);
+        QCOMPARE(Kate::TextBufferSnapshot().text(), QString());
+    }
+}
+
+/**
+ * first line for which rangesForLine doesn't return exactly the ranges intersecting it, -1 if none
+ */
+static int wrongRangesForLine(const Kate::TextBuffer &buffer, const QList<Kate::TextRange *> &ranges)
+{
+    for (int line = 0; line < buffer.lines(); ++line) {
+        QSet<Kate::TextRange *> expected;
+        foreach (Kate::TextRange *range, ranges) {
+            if (range->toRange().isValid() && range->start().line() <= line && line <= range->end().line()) {
+                expected.insert(range);
+            }
+        }
+
+        const QList<Kate::TextRange *> found = buffer.rangesForLine(line, 0, false);
+        if (found.size() != expected.size() || found.toSet() != expected) {
+            return line;
+        }
+    }
+
+    return -1;
+}
+
+void KateTextBufferTest::rangesForLineTest()
+{
+    // test with different block sizes, edits move ranges between blocks
+    for (int i = 1; i <= 8; i *= 2) {
+        Kate::TextBuffer buffer(0, i);
+        buffer.startEditing();
+        QStringList lines;
+        for (int l = 1; l < 40; ++l) {
+            lines << QString::number(l);
+        }
+        buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("0"));
+        buffer.insertLines(0, lines);
+        buffer.finishEditing();
+
+        // single-line and multi-line ranges, some of them spanning many blocks
+        QList<Kate::TextRange *> ranges;
+        for (int r = 0; r < 200; ++r) {
+            const int startLine = (r * 7) % 40;
+            const int endLine = qMin(39, startLine + (r % 4) * (r % 9));
+            ranges.append(new Kate::TextRange(buffer, KTextEditor::Range(startLine, 0, endLine, 1), KTextEditor::MovingRange::DoNotExpand));
+        }
+        QCOMPARE(wrongRangesForLine(buffer, ranges), -1);
+
+        buffer.startEditing();
+        buffer.wrapLine(KTextEditor::Cursor(5, 0));
+        buffer.unwrapLine(20);
+        buffer.finishEditing();
+        QCOMPARE(wrongRangesForLine(buffer, ranges), -1);
+
+        buffer.startEditing();
+        buffer.insertLines(10, QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c"));
+        buffer.finishEditing();
+        QCOMPARE(wrongRangesForLine(buffer, ranges), -1);
+
+        buffer.startEditing();
+        buffer.insertText(KTextEditor::Cursor(15, 1), QStringLiteral("text"));
+        buffer.removeLines(2, 12);
+        buffer.finishEditing();
+        QCOMPARE(wrongRangesForLine(buffer, ranges), -1);
+
+        // ranges moved by edits must not leave dangling entries behind
+        for (int r = 0; r < ranges.size(); r += 2) {
+            delete ranges.at(r);
+            ranges[r] = 0;
+        }
+        ranges.removeAll(0);
+        QCOMPARE(wrongRangesForLine(buffer, ranges), -1);
+
+        buffer.startEditing();
+        buffer.removeLines(0, buffer.lines() - 2);
+        buffer.finishEditing();
+        QCOMPARE(wrongRangesForLine(buffer, ranges), -1);
+        qDeleteAll(ranges);
+    }
+}
+
+void KateTextBufferTest::manyCursorsTest()
+{
+    // test with different block sizes, edits move cursors between blocks
+    for (int i = 1; i <= 4; ++i) {
+        Kate::TextBuffer buffer(0, i);
+        QStringList lines;
+        for (int l = 1; l < 20; ++l) {
+            lines << QStringLiteral("0123456789");
+        }
+        buffer.startEditing();
+        buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("0123456789"));
+        buffer.insertLines(0, lines);
+        buffer.finishEditing();
+
+        const qint64 revision = buffer.revision();
+        buffer.history().lockRevision(revision);
+
+        // cursors at each column of each line with both behaviors, some behind the end of the line
+        QList<Kate::TextCursor *> cursors;
+        QList<KTextEditor::Cursor> positions;
+        for (int l = 0; l < 20; ++l) {
+            for (int c = 0; c <= 12; ++c) {
+                cursors << new Kate::TextCursor(buffer, KTextEditor::Cursor(l, c), Kate::TextCursor::MoveOnInsert);
+                cursors << new Kate::TextCursor(buffer, KTextEditor::Cursor(l, c), Kate::TextCursor::StayOnInsert);
+                positions << KTextEditor::Cursor(l, c) << KTextEditor::Cursor(l, c);
+            }
+        }
+
+        buffer.startEditing();
+        buffer.insertText(KTextEditor::Cursor(3, 5), QStringLiteral("abc"));
+        buffer.wrapLine(KTextEditor::Cursor(4, 5));
+        buffer.unwrapLine(9);
+        buffer.unwrapLine(4);
+        buffer.removeText(KTextEditor::Range(2, 2, 2, 7));
+        buffer.insertText(KTextEditor::Cursor(2, 2), QStringLiteral("x"));
+        buffer.wrapLine(KTextEditor::Cursor(12, 0));
+        buffer.unwrapLine(1);
+        buffer.finishEditing();
+
+        // cursors inside of their lines move like the history says
+        for (int c = 0; c < cursors.size(); ++c) {
+            if (positions.at(c).column() > 10) {
+                continue;
+            }
+
+            int line = positions.at(c).line(), column = positions.at(c).column();
+            buffer.history().transformCursor(line, column, (c % 2) ? KTextEditor::MovingCursor::StayOnInsert : KTextEditor::MovingCursor::MoveOnInsert, revision);
+            QCOMPARE(cursors.at(c)->toCursor(), KTextEditor::Cursor(line, column));
+        }
+
+        // moving and deleting the cursors needs them at the right place in their block
+        for (int c = 0; c < cursors.size(); c += 3) {
+            cursors.at(c)->setPosition(KTextEditor::Cursor(c % buffer.lines(), c % 7));
+            QCOMPARE(cursors.at(c)->toCursor(), KTextEditor::Cursor(c % buffer.lines(), c % 7));
+        }
+        buffer.history().unlockRevision(revision);
+        qDeleteAll(cursors);
+    }
+}
+
+void KateTextBufferTest::historyCheckpointTest()
+{
+    Kate::TextBuffer buffer(0);
+    QStringList lines;
+    for (int l = 1; l < 10; ++l) {
+        lines << QStringLiteral("0123456789");
+    }
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("0123456789"));
+    buffer.insertLines(0, lines);
+    buffer.finishEditing();
+
+    const qint64 revision = buffer.revision();
+    buffer.history().lockRevision(revision);
+
+    // long runs of typing and deleting on a few lines, with line changes in between
+    for (int i = 0; i < 1500; ++i) {
+        const int line = (i / 300) % 2 ? 2 : 5;
+        const int length = buffer.line(line)->length();
+        buffer.startEditing();
+        if (i % 5 == 4 && length > 3) {
+            buffer.removeText(KTextEditor::Range(line, (i * 7) % (length - 2), line, (i * 7) % (length - 2) + 2));
+        } else {
+            buffer.insertText(KTextEditor::Cursor(line, (i * 3) % (length + 1)), QStringLiteral("ab"));
+        }
+        if (i == 700) {
+            buffer.wrapLine(KTextEditor::Cursor(2, 4));
+        } else if (i == 1000) {
+            buffer.unwrapLine(3);
+        }
+        buffer.finishEditing();
+    }
+
+    // transforming at once must match transforming revision by revision, which doesn't use the composite mappings
+    for (int line = 0; line < 10; ++line) {
+        for (int column = 0; column < 40; ++column) {
+            for (int behavior = 0; behavior < 2; ++behavior) {
+                const KTextEditor::MovingCursor::InsertBehavior insertBehavior = behavior ? KTextEditor::MovingCursor::StayOnInsert : KTextEditor::MovingCursor::MoveOnInsert;
+                int expectedLine = line, expectedColumn = column;
+                for (qint64 r = revision; r < buffer.revision(); ++r) {
+                    buffer.history().transformCursor(expectedLine, expectedColumn, insertBehavior, r, r + 1);
+                }
+
+                int transformedLine = line, transformedColumn = column;
+                buffer.history().transformCursor(transformedLine, transformedColumn, insertBehavior, revision);
+                QCOMPARE(KTextEditor::Cursor(transformedLine, transformedColumn), KTextEditor::Cursor(expectedLine, expectedColumn));
+
+                // a second time, now with cached mappings
+                transformedLine = line;
+                transformedColumn = column;
+                buffer.history().transformCursor(transformedLine, transformedColumn, insertBehavior, revision);
+                QCOMPARE(KTextEditor::Cursor(transformedLine, transformedColumn), KTextEditor::Cursor(expectedLine, expectedColumn));
+
+                // reverse
+                for (qint64 r = buffer.revision(); r > revision; --r) {
+                    buffer.history().transformCursor(expectedLine, expectedColumn, insertBehavior, r, r - 1);
+                }
+                buffer.history().transformCursor(transformedLine, transformedColumn, insertBehavior, buffer.revision(), revision);
+                QCOMPARE(KTextEditor::Cursor(transformedLine, transformedColumn), KTextEditor::Cursor(expectedLine, expectedColumn));
+            }
+        }
+    }
+
+    // ranges skip the runs on other lines
+    KTextEditor::Range range(0, 2, 9, 3);
+    buffer.history().transformRange(range, KTextEditor::MovingRange::ExpandLeft, KTextEditor::MovingRange::AllowEmpty, revision);
+    QCOMPARE(range, KTextEditor::Range(0, 2, 9, 3));
+
+    // a locked revision in the middle of a run keeps the entries behind it transformable
+    buffer.history().unlockRevision(revision);
+    const qint64 middleRevision = buffer.revision();
+    buffer.history().lockRevision(middleRevision);
+    for (int i = 0; i < 10; ++i) {
+        buffer.startEditing();
+        buffer.insertText(KTextEditor::Cursor(2, 0), QStringLiteral("x"));
+        buffer.finishEditing();
+    }
+    int line = 2, column = 0;
+    buffer.history().transformCursor(line, column, KTextEditor::MovingCursor::MoveOnInsert, middleRevision);
+    QCOMPARE(KTextEditor::Cursor(line, column), KTextEditor::Cursor(2, 10));
+    buffer.history().unlockRevision(middleRevision);
+}
+
+void KateTextBufferTest::visitLinesTest()
+{
+    // test with different block sizes, the visiting crosses blocks
+    for (int i = 1; i <= 4; ++i) {
+        Kate::TextBuffer buffer(0, i);
+        QStringList lines;
+        for (int l = 1; l < 10; ++l) {
+            lines << QString::number(l);
+        }
+        buffer.startEditing();
+        buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("0"));
+        buffer.insertLines(0, lines);
+        buffer.finishEditing();
+
+        QStringList visited;
+        buffer.visitLines(2, 8, [&visited](int line, const QStringRef & text) {
+            visited << QString::number(line) + text.toString();
+            return line < 6;
+        });
+        QCOMPARE(visited, QStringList() << QStringLiteral("22") << QStringLiteral("33") << QStringLiteral("44") << QStringLiteral("55") << QStringLiteral("66"));
+
+        visited.clear();
+        int blocks = 0;
+        buffer.visitBlocks(1, 9, [&visited, &blocks](int firstLine, const QVector<QStringRef> &texts) {
+            for (int l = 0; l < texts.size(); ++l) {
+                visited << QString::number(firstLine + l) + texts.at(l).toString();
+            }
+            ++blocks;
+            return true;
+        });
+        QCOMPARE(visited.size(), 9);
+        QCOMPARE(visited.first(), QStringLiteral("11"));
+        QCOMPARE(visited.last(), QStringLiteral("99"));
+        QVERIFY(blocks > 1);
+    }
+}
+
+void KateTextBufferTest::blockCharsTest()
+{
+    // small blocks of short lines
+    Kate::TextBuffer buffer(0, 4);
+    QStringList lines;
+    for (int l = 1; l < 8; ++l) {
+        lines << QString::number(l);
+    }
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("0"));
+    buffer.insertLines(0, lines);
+    buffer.finishEditing();
+
+    QList<Kate::TextCursor *> cursors;
+    for (int l = 0; l < 8; ++l) {
+        cursors << new Kate::TextCursor(buffer, KTextEditor::Cursor(l, 1), Kate::TextCursor::MoveOnInsert);
+    }
+
+    // a huge line gets a block of its own
+    const QString huge(100000, QLatin1Char('x'));
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(3, 0), huge);
+    buffer.finishEditing();
+    QCOMPARE(cursors.at(3)->block()->lines(), 1);
+    QCOMPARE(cursors.at(3)->block()->chars(), qint64(huge.size() + 1));
+    QVERIFY(cursors.at(2)->block() != cursors.at(3)->block());
+    QVERIFY(cursors.at(4)->block() != cursors.at(3)->block());
+    for (int l = 0; l < 8; ++l) {
+        QCOMPARE(cursors.at(l)->toCursor(), KTextEditor::Cursor(l, (l == 3) ? (huge.size() + 1) : 1));
+        QCOMPARE(buffer.line(l)->text(), (l == 3) ? (huge + QString::number(l)) : QString::number(l));
+    }
+
+    // after removing it, line edits merge the small blocks again
+    buffer.startEditing();
+    buffer.removeText(KTextEditor::Range(3, 0, 3, huge.size()));
+    for (int l = 0; l < 8; ++l) {
+        buffer.wrapLine(KTextEditor::Cursor(l, 1));
+        buffer.unwrapLine(l + 1);
+    }
+    buffer.finishEditing();
+    QCOMPARE(cursors.at(3)->block()->chars(), qint64(cursors.at(3)->block()->lines()));
+    QVERIFY(cursors.at(3)->block()->lines() > 1);
+    for (int l = 0; l < 8; ++l) {
+        QCOMPARE(cursors.at(l)->toCursor(), KTextEditor::Cursor(l, 1));
+        QCOMPARE(buffer.line(l)->text(), QString::number(l));
+    }
+    qDeleteAll(cursors);
+}
+
+void KateTextBufferTest::giantLineTest()
+{
+    Kate::TextBuffer buffer(0);
+    QString expected;
+    for (int i = 0; i < 20000; ++i) {
+        expected += QString::number(i % 10) + QStringLiteral("abcdefghi");
+    }
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), expected);
+    buffer.finishEditing();
+    Kate::TextCursor cursor(buffer, KTextEditor::Cursor(0, 100000), Kate::TextCursor::MoveOnInsert);
+
+    // edits all over the line, reading the text in between or not
+    for (int i = 0; i < 500; ++i) {
+        const int column = (i * 7919) % expected.size();
+        buffer.startEditing();
+        if (i % 3 == 0) {
+            const int length = qMin(expected.size() - column, (i * 31) % 20000);
+            buffer.removeText(KTextEditor::Range(0, column, 0, column + length));
+            expected.remove(column, length);
+        } else {
+            const QString text = QString(i, QLatin1Char('x'));
+            buffer.insertText(KTextEditor::Cursor(0, column), text);
+            expected.insert(column, text);
+        }
+        buffer.finishEditing();
+
+        QCOMPARE(buffer.line(0)->length(), expected.size());
+        if (i % 50 == 0) {
+            QCOMPARE(buffer.line(0)->text(), expected);
+            QCOMPARE(buffer.line(0)->string(column, 1000), expected.mid(column, 1000));
+            QCOMPARE(buffer.line(0)->at(column), expected.at(column));
+        }
+    }
+    QCOMPARE(buffer.line(0)->text(), expected);
+    QCOMPARE(cursor.toCursor().line(), 0);
+
+    // wrap and unwrap in the middle
+    const int middle = expected.size() / 2;
+    buffer.startEditing();
+    buffer.wrapLine(KTextEditor::Cursor(0, middle));
+    buffer.finishEditing();
+    QCOMPARE(buffer.line(0)->text(), expected.left(middle));
+    QCOMPARE(buffer.line(1)->text(), expected.mid(middle));
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(1, 0), QStringLiteral("y"));
+    buffer.unwrapLine(1);
+    buffer.finishEditing();
+    expected.insert(middle, QLatin1Char('y'));
+    QCOMPARE(buffer.line(0)->text(), expected);
+
+    // shrink it to a short line again
+    buffer.startEditing();
+    buffer.removeText(KTextEditor::Range(0, 10, 0, expected.size() - 10));
+    buffer.finishEditing();
+    expected.remove(10, expected.size() - 20);
+    QCOMPARE(buffer.line(0)->text(), expected);
+    QCOMPARE(buffer.line(0)->length(), 20);
+}
+
+void KateTextBufferTest::textRangeTest()
+{
+    // lines with chars needing two, three and four bytes in UTF-8, test with different block sizes
+    const QString pair = QString(QChar(0xd83d)) + QChar(0xde00);
+    const QStringList texts = QStringList() << QStringLiteral("first")
+                              << QString()
+                              << QStringLiteral("gr") + QChar(0xfc) + QStringLiteral("n ") + QChar(0x20ac) + pair
+                              << QStringLiteral("last");
+    for (int i = 1; i <= 3; ++i) {
+        Kate::TextBuffer buffer(0, i);
+        buffer.startEditing();
+        buffer.insertText(KTextEditor::Cursor(0, 0), texts.join(QLatin1Char('\n')));
+        buffer.finishEditing();
+        QCOMPARE(buffer.lines(), 4);
+
+        QCOMPARE(buffer.text(), texts.join(QLatin1Char('\n')));
+        QCOMPARE(buffer.utf8Text(), texts.join(QLatin1Char('\n')).toUtf8());
+
+        // compare all ranges with the text built line by line, columns behind the lines included
+        for (int startLine = 0; startLine < 5; ++startLine) {
+            for (int startColumn = 0; startColumn < 12; startColumn += 3) {
+                for (int endLine = startLine; endLine < 5; ++endLine) {
+                    for (int endColumn = 0; endColumn < 12; endColumn += 2) {
+                        const KTextEditor::Range range(startLine, startColumn, endLine, endColumn);
+                        QString expected;
+                        for (int line = startLine; line <= endLine && line < texts.size(); ++line) {
+                            const int start = (line == startLine) ? startColumn : 0;
+                            const int end = (line == endLine) ? endColumn : texts.at(line).size();
+                            expected += texts.at(line).mid(start, qMax(0, end - start));
+                            if (line < endLine) {
+                                expected += QLatin1Char('\n');
+                            }
+                        }
+
+                        QCOMPARE(buffer.text(range), expected);
+
+                        // ranges splitting the surrogate pair produce lone surrogates, encoded as U+FFFD
+                        for (int c = 0; c < expected.size(); ++c) {
+                            if (expected.at(c).isHighSurrogate() && c + 1 < expected.size() && expected.at(c + 1).isLowSurrogate()) {
+                                ++c;
+                            } else if (expected.at(c).isSurrogate()) {
+                                expected[c] = QChar(QChar::ReplacementCharacter);
+                            }
+                        }
+                        QCOMPARE(buffer.utf8Text(range), expected.toUtf8());
+                    }
+                }
+            }
+        }
+    }
+
+    // lone surrogates
+    Kate::TextBuffer buffer(0);
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("a") + QChar(0xde00) + QChar(0xd83d));
+    buffer.finishEditing();
+    QCOMPARE(buffer.utf8Text(), QByteArray("a\xef\xbf\xbd\xef\xbf\xbd"));
+}
+
+void KateTextBufferTest::cloneTest()
+{
+    // source with some blocks
+    Kate::TextBuffer *source = new Kate::TextBuffer(0, 4);
+    source->startEditing();
+    QStringList lines;
+    for (int i = 1; i < 16; ++i) {
+        lines << QStringLiteral("line %1").arg(i);
+    }
+    source->insertText(KTextEditor::Cursor(0, 0), QStringLiteral("line 0"));
+    source->insertLines(0, lines);
+    source->finishEditing();
+    const QString text = source->text();
+
+    Kate::TextBuffer clone(0, 4);
+    clone.cloneFrom(*source);
+    QCOMPARE(clone.lines(), 16);
+    QCOMPARE(clone.text(), text);
+
+    // all lines are shared
+    for (int i = 0; i < 16; ++i) {
+        QVERIFY(clone.line(i) == source->line(i));
+    }
+
+    // editing the clone copies the lines of the edited block only
+    clone.startEditing();
+    clone.insertText(KTextEditor::Cursor(1, 0), QStringLiteral("clone "));
+    clone.finishEditing();
+    QCOMPARE(clone.line(1)->string(), QStringLiteral("clone line 1"));
+    QCOMPARE(source->line(1)->string(), QStringLiteral("line 1"));
+    QVERIFY(clone.line(15) == source->line(15));
+
+    // editing the source copies its lines, the clone keeps its text
+    source->startEditing();
+    source->removeText(KTextEditor::Range(15, 0, 15, 5));
+    source->finishEditing();
+    QCOMPARE(source->line(15)->string(), QStringLiteral("15"));
+    QCOMPARE(clone.line(15)->string(), QStringLiteral("line 15"));
+    QVERIFY(clone.line(14) != source->line(14));
+
+    // copying the shared lines keeps their text
+    QVERIFY(clone.line(8) == source->line(8));
+    clone.detachLines(8, 8);
+    QVERIFY(clone.line(8) != source->line(8));
+    QCOMPARE(clone.line(8)->string(), source->line(8)->string());
+
+    // the clone survives its source
+    delete source;
+    QCOMPARE(clone.lines(), 16);
+    QCOMPARE(clone.line(5)->string(), QStringLiteral("line 5"));
+    clone.startEditing();
+    clone.wrapLine(KTextEditor::Cursor(5, 4));
+    clone.finishEditing();
+    QCOMPARE(clone.lines(), 17);
+    QCOMPARE(clone.line(6)->string(), QStringLiteral(" 5"));
+}
+
+void KateTextBufferTest::historyChangedLinesTest()
+{
+    Kate::TextBuffer buffer(0);
+    QStringList lines;
+    for (int l = 1; l < 20; ++l) {
+        lines << QStringLiteral("line");
+    }
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("line"));
+    buffer.insertLines(0, lines);
+    buffer.finishEditing();
+
+    const qint64 revision = buffer.revision();
+    buffer.history().lockRevision(revision);
+
+    auto changedLines = [&buffer, revision]() {
+        QStringList intervals;
+        foreach (const Kate::TextHistory::LineInterval &interval, buffer.history().changedLines(revision)) {
+            intervals << QStringLiteral("%1-%2").arg(interval.start).arg(interval.end);
+        }
+        return intervals.join(QLatin1Char(' '));
+    };
+    QCOMPARE(changedLines(), QString());
+
+    // typing on one line
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(3, 0), QStringLiteral("a"));
+    buffer.insertText(KTextEditor::Cursor(3, 1), QStringLiteral("b"));
+    buffer.finishEditing();
+    QCOMPARE(changedLines(), QStringLiteral("3-3"));
+
+    // wrap and insert lines, the lines behind move
+    buffer.startEditing();
+    buffer.wrapLine(KTextEditor::Cursor(10, 2));
+    buffer.insertLines(15, QStringList() << QStringLiteral("a") << QStringLiteral("b"));
+    buffer.finishEditing();
+    QCOMPARE(changedLines(), QStringLiteral("3-3 10-11 16-17"));
+
+    // removed changed lines are gone, unwrapped lines change the line in front
+    buffer.startEditing();
+    buffer.removeLines(11, 11);
+    buffer.unwrapLine(4);
+    buffer.finishEditing();
+    QCOMPARE(changedLines(), QStringLiteral("3-3 9-9 14-15"));
+
+    // intervals getting adjacent are coalesced
+    buffer.startEditing();
+    buffer.removeLines(5, 8);
+    buffer.removeLines(4, 4);
+    buffer.finishEditing();
+    QCOMPARE(changedLines(), QStringLiteral("3-4 9-10"));
+
+    // intermediate revisions
+    QCOMPARE(buffer.history().changedLines(revision, revision + 1).size(), 1);
+    QCOMPARE(buffer.history().changedLines(revision + 2, revision + 3).first().start, 10);
+    QCOMPARE(buffer.history().changedLines(revision + 2, revision + 3).first().end, 11);
+    QVERIFY(buffer.history().changedLines(buffer.revision()).isEmpty());
+
+    buffer.history().unlockRevision(revision);
+}
+
+void KateTextBufferTest::memoryUsageTest()
+{
+    Kate::TextBuffer buffer(0);
+    qint64 text = 0, highlighting = 0, history = 0, movingRanges = 0;
+    buffer.memoryUsage(text, highlighting, history, movingRanges);
+    QVERIFY(text > 0);
+    const qint64 emptyText = text;
+    const qint64 emptyHistory = history;
+    const qint64 emptyMovingRanges = movingRanges;
+
+    // text and history grow with the edits, while the old revision is locked
+    const qint64 revision = buffer.revision();
+    buffer.history().lockRevision(revision);
+    buffer.startEditing();
+    for (int i = 0; i < 1000; ++i) {
+        buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("some text"));
+        buffer.wrapLine(KTextEditor::Cursor(0, 4));
+    }
+    buffer.finishEditing();
+    buffer.memoryUsage(text, highlighting, history, movingRanges);
+    QVERIFY(text >= emptyText + 1000 * 9 * qint64(sizeof(QChar)));
+    QVERIFY(history > emptyHistory);
+    QCOMPARE(movingRanges, emptyMovingRanges);
+
+    // ranges and their cursors are counted
+    Kate::TextRange *range = new Kate::TextRange(buffer, KTextEditor::Range(2, 0, 7, 1), KTextEditor::MovingRange::DoNotExpand);
+    buffer.memoryUsage(text, highlighting, history, movingRanges);
+    QVERIFY(movingRanges > emptyMovingRanges);
+    delete range;
+
+    buffer.history().unlockRevision(revision);
+    buffer.memoryUsage(text, highlighting, history, movingRanges);
+    QCOMPARE(movingRanges, emptyMovingRanges);
+}
@@ -33,13 +33,33 @@ public:
     virtual ~KateTextBufferTest();
 
 private Q_SLOTS:
+    void initTestCase_data();
     void basicBufferTest();
     void wrapLineTest();
     void insertRemoveTextTest();
     void cursorTest();
+    void insertRemoveLinesTest();
     void foldingTest();
     void nestedFoldingTest();
     void saveFileInUnwritableFolder();
+    void largeFileLoadTest();
+    void truncatedLargeFileTest();
+    void backgroundLoadTest();
+    void backgroundSaveTest();
+    void loaderDecodingTest();
+    void blockIndexTest();
+    void lineAttributesTest();
+    void snapshotTest();
+    void rangesForLineTest();
+    void manyCursorsTest();
+    void historyCheckpointTest();
+    void visitLinesTest();
+    void blockCharsTest();
+    void giantLineTest();
+    void textRangeTest();
+    void cloneTest();
+    void historyChangedLinesTest();
+    void memoryUsageTest();
 };
 
 #endif // KATEBUFFERTEST_H
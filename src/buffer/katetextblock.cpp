@@ -20,13 +20,32 @@
 
 #include "katetextblock.h"
 #include "katetextbuffer.h"
+#include "katetextmappedfile.h"
+
+#include <algorithm>
+#include <limits>
 
 namespace Kate
 {
 
+/**
+ * Order of the cursors in a block, by line and column.
+ */
+static bool cursorLessThan(const TextCursor *a, const TextCursor *b)
+{
+    return (a->lineInBlock() < b->lineInBlock()) || (a->lineInBlock() == b->lineInBlock() && a->column() < b->column());
+}
+
 TextBlock::TextBlock(TextBuffer *buffer, int startLine)
     : m_buffer(buffer)
+    , m_mappedPosition(0)
+    , m_mappedEnd(0)
+    , m_mappedLines(0)
+    , m_sharedLines(0)
+    , m_chars(0)
     , m_startLine(startLine)
+    , m_startLineRevision(0)
+    , m_blockIndex(-1)
 {
     // reserve the block size
     m_lines.reserve(m_buffer->m_blockSize);
@@ -36,18 +55,32 @@ TextBlock::~TextBlock()
 {
     // blocks should be empty before they are deleted!
     Q_ASSERT(m_lines.empty());
+    Q_ASSERT(!m_mappedFile);
+    Q_ASSERT(m_compactLineStarts.isEmpty());
+    Q_ASSERT(m_compactLines.isEmpty());
+    Q_ASSERT(!m_sharedLines);
     Q_ASSERT(m_cursors.empty());
 
     // it only is a hint for ranges for this block, not the storage of them
 }
 
-void TextBlock::setStartLine(int startLine)
+int TextBlock::startLine() const
 {
-    // allow only valid lines
-    Q_ASSERT(startLine >= 0);
-    Q_ASSERT(startLine < m_buffer->lines());
+    // blocks not yet part of the buffer know their start line
+    if (m_blockIndex < 0) {
+        return m_startLine;
+    }
+
+    // blocks got split or merged, the buffer renumbers them first
+    m_buffer->ensureBlockIndex();
 
-    m_startLine = startLine;
+    // recompute start line, if it changed since last time
+    if (m_startLineRevision != m_buffer->m_startLinesRevision) {
+        m_startLine = m_buffer->blockStartLine(m_blockIndex);
+        m_startLineRevision = m_buffer->m_startLinesRevision;
+    }
+
+    return m_startLine;
 }
 
 TextLine TextBlock::line(int line) const
@@ -58,6 +91,14 @@ TextLine TextBlock::line(int line) const
     // calc internal line
     line = line - startLine();
 
+    // lines in compact storage get their TextLine one by one, highlighting and painting keep the block compact
+    if (!m_compactLineStarts.isEmpty()) {
+        return compactLine(line);
+    }
+
+    // decode lines of large files on first access
+    loadLines();
+
     // in range
     Q_ASSERT(line < m_lines.size());
 
@@ -65,26 +106,250 @@ TextLine TextBlock::line(int line) const
     return m_lines.at(line);
 }
 
+TextLine TextBlock::compactLine(int line) const
+{
+    // in range
+    Q_ASSERT(line < lines());
+
+    if (m_compactLines.isEmpty()) {
+        m_compactLines.resize(lines());
+    }
+
+    TextLine &textLine = m_compactLines[line];
+    if (!textLine) {
+        const int start = m_compactLineStarts.at(line);
+        textLine = TextLine::create(m_compactText.mid(start, m_compactLineStarts.at(line + 1) - start));
+    }
+    return textLine;
+}
+
 void TextBlock::appendLine(const QString &textOfLine)
 {
+    loadLines();
     m_lines.append(TextLine::create(textOfLine));
+    m_chars += textOfLine.size();
+}
+
+void TextBlock::appendCompactLine(const QChar *text, int length)
+{
+    Q_ASSERT(!m_mappedFile);
+
+    // first line, no TextLines allowed, we don't need their reserved memory
+    if (m_compactLineStarts.isEmpty()) {
+        Q_ASSERT(m_lines.empty());
+        m_lines.squeeze();
+        m_compactLineStarts.reserve(m_buffer->m_blockSize + 1);
+        m_compactLineStarts.append(0);
+    }
+
+    m_compactText.append(text, length);
+    m_compactLineStarts.append(m_compactText.size());
+    m_chars += length;
+}
+
+void TextBlock::squeeze()
+{
+    m_compactText.squeeze();
+    m_compactLineStarts.squeeze();
+}
+
+QStringRef TextBlock::lineView(int line) const
+{
+    // right input
+    Q_ASSERT(line >= startLine());
+
+    // calc internal line
+    line = line - startLine();
+
+    // in range
+    Q_ASSERT(line < lines());
+
+    // lines in compact storage are handed out directly
+    if (!m_compactLineStarts.isEmpty()) {
+        const int start = m_compactLineStarts.at(line);
+        return QStringRef(&m_compactText, start, m_compactLineStarts.at(line + 1) - start);
+    }
+
+    // decode lines of large files on first access
+    loadLines();
+    return QStringRef(&m_lines.at(line)->text());
 }
 
 void TextBlock::clearLines()
 {
+    // give up our share of shared lines, no need to copy them
+    if (m_sharedLines && !m_sharedLines->deref()) {
+        delete m_sharedLines;
+    }
+    m_sharedLines = 0;
+
+    m_mappedFile.clear();
+    m_compactText.clear();
+    m_compactLineStarts.clear();
+    m_compactLines.clear();
     m_lines.clear();
+    m_snapshotShare.clear();
+    m_chars = 0;
+}
+
+void TextBlock::setMappedLines(const QSharedPointer<TextMappedFile> &mappedFile, qint64 position, qint64 end, int lines)
+{
+    Q_ASSERT(m_lines.empty());
+    Q_ASSERT(!m_mappedFile);
+    Q_ASSERT(m_compactLineStarts.isEmpty());
+    Q_ASSERT(lines > 0);
+
+    // don't keep the reserved memory around, most blocks of large files are never decoded
+    m_lines.squeeze();
+
+    m_mappedFile = mappedFile;
+    m_mappedPosition = position;
+    m_mappedEnd = end;
+    m_mappedLines = lines;
 }
 
-void TextBlock::text(QString &text) const
+void TextBlock::memoryUsage(qint64 &text, qint64 &highlighting, qint64 &movingRanges) const
 {
-    // combine all lines
+    // lines of large files not decoded yet live in the mapped file, not on the heap
+    text += sizeof(TextBlock) + qint64(m_compactText.capacity()) * sizeof(QChar) + qint64(m_compactLineStarts.capacity()) * sizeof(int);
+
+    // text lines, shared ones are split among the blocks sharing them
+    qint64 linesText = 0;
+    qint64 linesHighlighting = 0;
+    foreach (const TextLine &line, m_lines) {
+        linesText += line->textMemoryUsage();
+        linesHighlighting += line->highlightingMemoryUsage();
+    }
+
+    // accessed lines in compact storage, they are not shared
+    text += qint64(m_compactLines.capacity()) * sizeof(TextLine);
+    foreach (const TextLine &line, m_compactLines) {
+        if (line) {
+            text += line->textMemoryUsage();
+            highlighting += line->highlightingMemoryUsage();
+        }
+    }
+    const int shares = m_sharedLines ? qMax(1, m_sharedLines->load()) : 1;
+    text += qint64(m_lines.capacity()) * sizeof(TextLine) + linesText / shares;
+    highlighting += linesHighlighting / shares;
+
+    // cursors of ranges are part of their range
+    movingRanges += qint64(m_cursors.capacity()) * sizeof(TextCursor *);
+    foreach (TextCursor *cursor, m_cursors) {
+        if (!cursor->kateRange()) {
+            movingRanges += sizeof(TextCursor);
+        }
+    }
+}
+
+void TextBlock::shareLines(TextBlock &block)
+{
+    Q_ASSERT(m_lines.empty());
+    Q_ASSERT(!m_mappedFile);
+    Q_ASSERT(m_compactLineStarts.isEmpty());
+    Q_ASSERT(!m_sharedLines);
+
+    // lines of large files not decoded yet and compact storage are shared by their storage
+    // accessed lines in compact storage are not, they get their TextLine again on access
+    m_mappedFile = block.m_mappedFile;
+    m_mappedPosition = block.m_mappedPosition;
+    m_mappedEnd = block.m_mappedEnd;
+    m_mappedLines = block.m_mappedLines;
+    m_compactText = block.m_compactText;
+    m_compactLineStarts = block.m_compactLineStarts;
+    m_chars = block.m_chars;
+
+    // the text lines might be shared with snapshots of the other buffer, too
+    m_snapshotShare = block.m_snapshotShare;
+
+    // text lines are shared until one of the blocks modifies them
+    if (!block.m_lines.isEmpty()) {
+        if (!block.m_sharedLines) {
+            block.m_sharedLines = new QAtomicInt(1);
+        }
+        block.m_sharedLines->ref();
+        m_sharedLines = block.m_sharedLines;
+        m_lines = block.m_lines;
+    }
+}
+
+void TextBlock::detachLines()
+{
+    if (!m_sharedLines) {
+        return;
+    }
+
+    // last block sharing the lines, they are ours alone now
+    if (!m_sharedLines->deref()) {
+        delete m_sharedLines;
+        m_sharedLines = 0;
+        return;
+    }
+    m_sharedLines = 0;
+
+    // copy the lines, with their highlighting, the copies are not shared with snapshots
     for (int i = 0; i < m_lines.size(); ++i) {
-        // not first line, insert \n
-        if (i > 0 || startLine() > 0) {
-            text.append(QLatin1Char('\n'));
+        m_lines[i] = TextLine(new TextLineData(*m_lines.at(i)));
+    }
+    m_snapshotShare.clear();
+}
+
+QSharedPointer<TextLinesShare> TextBlock::shareLinesWithSnapshot() const
+{
+    // all snapshots since the lines got shared first use the same share
+    QSharedPointer<TextLinesShare> share = m_snapshotShare.toStrongRef();
+    if (!share) {
+        share = QSharedPointer<TextLinesShare>(new TextLinesShare());
+        m_snapshotShare = share;
+    }
+    return share;
+}
+
+void TextBlock::detachLineFromSnapshots(int line)
+{
+    // snapshots read the text of their lines from other threads, edit a copy
+    if (!m_snapshotShare.isNull()) {
+        m_lines[line] = TextLine(new TextLineData(*m_lines.at(line)));
+    }
+}
+
+void TextBlock::createLines()
+{
+    // lines of large files: drop the reference first, lines() must count the real lines from now on
+    if (m_mappedFile) {
+        QSharedPointer<TextMappedFile> mappedFile;
+        mappedFile.swap(m_mappedFile);
+
+        m_lines.reserve(qMax(m_buffer->m_blockSize, m_mappedLines));
+        if (!mappedFile->readLines(m_mappedPosition, m_mappedEnd, m_mappedLines, m_lines)) {
+            // the file changed behind our back, our lines are empty now
+            m_buffer->mappedFileReadFailed();
         }
+        Q_ASSERT(m_lines.size() == m_mappedLines);
 
-        text.append(m_lines.at(i)->text());
+        // now we know our size
+        m_chars = 0;
+        foreach (const TextLine &line, m_lines) {
+            m_chars += line->length();
+        }
+        return;
+    }
+
+    // compact storage: each line gets its own copy of its text, accessed lines keep their TextLine
+    QString text;
+    text.swap(m_compactText);
+    QVector<int> lineStarts;
+    lineStarts.swap(m_compactLineStarts);
+    QVector<TextLine> compactLines;
+    compactLines.swap(m_compactLines);
+
+    m_lines.reserve(qMax(m_buffer->m_blockSize, lineStarts.size() - 1));
+    for (int i = 0; i + 1 < lineStarts.size(); ++i) {
+        if (!compactLines.isEmpty() && compactLines.at(i)) {
+            m_lines.append(compactLines.at(i));
+        } else {
+            m_lines.append(TextLine::create(text.mid(lineStarts.at(i), lineStarts.at(i + 1) - lineStarts.at(i))));
+        }
     }
 }
 
@@ -94,6 +359,12 @@ void TextBlock::wrapLine(const KTextEditor::Cursor &position, int fixStartLinesS
     int line = position.line() - startLine();
 
     // get text
+    loadLines();
+    detachLines();
+    if (position.column() < m_lines.at(line)->length()) {
+        // only wrapping inside the line changes its text
+        detachLineFromSnapshots(line);
+    }
     QString &text = m_lines.at(line)->textReadWrite();
 
     // check if valid column
@@ -148,39 +419,25 @@ void TextBlock::wrapLine(const KTextEditor::Cursor &position, int fixStartLinesS
         return;
     }
 
-    // move all cursors on the line which has the text inserted
+    // move all cursors behind the wrap position, the ones at it only if they want to
+    // order the cursors at it that stay in front of the moving ones, the order stays valid then
+    QVector<TextCursor *>::iterator it = std::partition(cursorsAt(line, position.column()), cursorsAt(line, position.column() + 1), [](const TextCursor *cursor) {
+        return !cursor->m_moveOnInsert;
+    });
+
     // remember all ranges modified
     QSet<TextRange *> changedRanges;
-    foreach (TextCursor *cursor, m_cursors) {
-        // skip cursors on lines in front of the wrapped one!
-        if (cursor->lineInBlock() < line) {
-            continue;
-        }
-
-        // either this is simple, line behind the wrapped one
-        if (cursor->lineInBlock() > line) {
-            // patch line of cursor
-            cursor->m_line++;
-        }
-
-        // this is the wrapped line
-        else {
-            // skip cursors with too small column
-            if (cursor->column() <= position.column()) {
-                if (cursor->column() < position.column() || !cursor->m_moveOnInsert) {
-                    continue;
-                }
-            }
-
-            // move cursor
-
-            // patch line of cursor
-            cursor->m_line++;
+    for (; it != m_cursors.end(); ++it) {
+        TextCursor *cursor = *it;
 
-            // patch column
+        // this is the wrapped line, patch column
+        if (cursor->lineInBlock() == line) {
             cursor->m_column -= position.column();
         }
 
+        // patch line of cursor
+        cursor->m_line++;
+
         // remember range, if any
         if (cursor->kateRange()) {
             changedRanges.insert(cursor->kateRange());
@@ -198,6 +455,14 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
     // calc internal line
     line = line - startLine();
 
+    // decode lines of large files, we might touch the previous block, too
+    loadLines();
+    detachLines();
+    if (previousBlock) {
+        previousBlock->loadLines();
+        previousBlock->detachLines();
+    }
+
     // two possiblities: either first line of this block or later line
     if (line == 0) {
         // we need previous block with at least one line
@@ -207,11 +472,14 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
         // move last line of previous block to this one, might result in empty block
         TextLine oldFirst = m_lines.at(0);
         int lastLineOfPreviousBlock = previousBlock->lines() - 1;
+        previousBlock->detachLineFromSnapshots(lastLineOfPreviousBlock);
         TextLine newFirst = previousBlock->m_lines.last();
         m_lines[0] = newFirst;
         previousBlock->m_lines.erase(previousBlock->m_lines.begin() + (previousBlock->lines() - 1));
 
         const int oldSizeOfPreviousLine = newFirst->text().size();
+        previousBlock->m_chars -= oldSizeOfPreviousLine;
+        m_chars += oldSizeOfPreviousLine;
         if (oldFirst->length() > 0) {
             // append text
             newFirst->textReadWrite().append(oldFirst->text());
@@ -220,9 +488,6 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
             newFirst->markAsModified(true);
         }
 
-        // patch startLine of this block
-        --m_startLine;
-
         /**
          * fix all start lines
          * we need to do this NOW, else the range update will FAIL!
@@ -247,36 +512,36 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
         // move all cursors because of the unwrapped line
         // remember all ranges modified
         QSet<TextRange *> changedRanges;
-        foreach (TextCursor *cursor, m_cursors) {
-            // this is the unwrapped line
-            if (cursor->lineInBlock() == 0) {
-                // patch column
-                cursor->m_column += oldSizeOfPreviousLine;
-
-                // remember range, if any
-                if (cursor->kateRange()) {
-                    changedRanges.insert(cursor->kateRange());
-                }
+        const QVector<TextCursor *>::iterator unwrappedEnd = cursorsAt(1, 0);
+        for (QVector<TextCursor *>::iterator it = m_cursors.begin(); it != unwrappedEnd; ++it) {
+            // patch column
+            (*it)->m_column += oldSizeOfPreviousLine;
+
+            // remember range, if any
+            if ((*it)->kateRange()) {
+                changedRanges.insert((*it)->kateRange());
             }
         }
 
         // move cursors of the moved line from previous block to this block now
-        QSet<TextCursor *> newPreviousCursors;
-        foreach (TextCursor *cursor, previousBlock->m_cursors) {
-            if (cursor->lineInBlock() == lastLineOfPreviousBlock) {
-                cursor->m_line = 0;
-                cursor->m_block = this;
-                m_cursors.insert(cursor);
-
-                // remember range, if any
-                if (cursor->kateRange()) {
-                    changedRanges.insert(cursor->kateRange());
-                }
-            } else {
-                newPreviousCursors.insert(cursor);
+        const QVector<TextCursor *>::iterator movedBegin = previousBlock->cursorsAt(lastLineOfPreviousBlock, 0);
+        const int movedCursors = previousBlock->m_cursors.end() - movedBegin;
+        const int unwrappedCursors = unwrappedEnd - m_cursors.begin();
+        for (QVector<TextCursor *>::iterator it = movedBegin; it != previousBlock->m_cursors.end(); ++it) {
+            (*it)->m_line = 0;
+            (*it)->m_block = this;
+
+            // remember range, if any
+            if ((*it)->kateRange()) {
+                changedRanges.insert((*it)->kateRange());
             }
         }
-        previousBlock->m_cursors = newPreviousCursors;
+
+        // the moved cursors go in front, cursors behind the end of the moved line must be merged with the ones of the unwrapped line
+        m_cursors.insert(0, movedCursors, 0);
+        std::copy(movedBegin, previousBlock->m_cursors.end(), m_cursors.begin());
+        std::inplace_merge(m_cursors.begin(), m_cursors.begin() + movedCursors, m_cursors.begin() + movedCursors + unwrappedCursors, cursorLessThan);
+        previousBlock->m_cursors.resize(previousBlock->m_cursors.size() - movedCursors);
 
         // fixup the ranges that might be effected, because they moved from last line to this block
         foreach (TextRange *range, changedRanges) {
@@ -295,6 +560,7 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
     }
 
     // easy: just move text to previous line and remove current one
+    detachLineFromSnapshots(line - 1);
     const int oldSizeOfPreviousLine = m_lines.at(line - 1)->length();
     const int sizeOfCurrentLine = m_lines.at(line)->length();
     if (sizeOfCurrentLine > 0) {
@@ -332,16 +598,18 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
     }
 
     // move all cursors because of the unwrapped line
+    // cursors behind the end of the previous line must be merged with the ones of the unwrapped line afterwards
+    const int behindPreviousLine = cursorsAt(line - 1, oldSizeOfPreviousLine + 1) - m_cursors.begin();
+    const int unwrappedBegin = cursorsAt(line, 0) - m_cursors.begin();
+    const int unwrappedEnd = cursorsAt(line + 1, 0) - m_cursors.begin();
+
     // remember all ranges modified
     QSet<TextRange *> changedRanges;
-    foreach (TextCursor *cursor, m_cursors) {
-        // skip cursors in lines in front of removed one
-        if (cursor->lineInBlock() < line) {
-            continue;
-        }
+    for (int i = unwrappedBegin; i < m_cursors.size(); ++i) {
+        TextCursor *cursor = m_cursors.at(i);
 
         // this is the unwrapped line
-        if (cursor->lineInBlock() == line) {
+        if (i < unwrappedEnd) {
             // patch column
             cursor->m_column += oldSizeOfPreviousLine;
         }
@@ -354,6 +622,7 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
             changedRanges.insert(cursor->kateRange());
         }
     }
+    std::inplace_merge(m_cursors.begin() + behindPreviousLine, m_cursors.begin() + unwrappedBegin, m_cursors.begin() + unwrappedEnd, cursorLessThan);
 
     // check validity of all ranges, might invalidate them...
     foreach (TextRange *range, changedRanges) {
@@ -367,6 +636,9 @@ void TextBlock::insertText(const KTextEditor::Cursor &position, const QString &t
     int line = position.line() - startLine();
 
     // get text
+    loadLines();
+    detachLines();
+    detachLineFromSnapshots(line);
     QString &textOfLine = m_lines.at(line)->textReadWrite();
     int oldLength = textOfLine.size();
     m_lines.at(line)->markAsModified(true);
@@ -377,6 +649,7 @@ void TextBlock::insertText(const KTextEditor::Cursor &position, const QString &t
 
     // insert text
     textOfLine.insert(position.column(), text);
+    m_chars += text.size();
 
     /**
      * notify the text history
@@ -392,21 +665,17 @@ void TextBlock::insertText(const KTextEditor::Cursor &position, const QString &t
         return;
     }
 
-    // move all cursors on the line which has the text inserted
+    // move all cursors on the line behind the insert position, the ones at it only if they want to
+    // order the cursors at it that stay in front of the moving ones, the order stays valid then
+    QVector<TextCursor *>::iterator it = std::partition(cursorsAt(line, position.column()), cursorsAt(line, position.column() + 1), [](const TextCursor *cursor) {
+        return !cursor->m_moveOnInsert;
+    });
+    const QVector<TextCursor *>::iterator end = cursorsAt(line + 1, 0);
+
     // remember all ranges modified
     QSet<TextRange *> changedRanges;
-    foreach (TextCursor *cursor, m_cursors) {
-        // skip cursors not on this line!
-        if (cursor->lineInBlock() != line) {
-            continue;
-        }
-
-        // skip cursors with too small column
-        if (cursor->column() <= position.column()) {
-            if (cursor->column() < position.column() || !cursor->m_moveOnInsert) {
-                continue;
-            }
-        }
+    for (; it != end; ++it) {
+        TextCursor *cursor = *it;
 
         // patch column of cursor
         if (cursor->m_column <= oldLength) {
@@ -436,6 +705,9 @@ void TextBlock::removeText(const KTextEditor::Range &range, QString &removedText
     int line = range.start().line() - startLine();
 
     // get text
+    loadLines();
+    detachLines();
+    detachLineFromSnapshots(line);
     QString &textOfLine = m_lines.at(line)->textReadWrite();
     int oldLength = textOfLine.size();
 
@@ -451,6 +723,7 @@ void TextBlock::removeText(const KTextEditor::Range &range, QString &removedText
     // remove text
     textOfLine.remove(range.start().column(), range.end().column() - range.start().column());
     m_lines.at(line)->markAsModified(true);
+    m_chars -= removedText.size();
 
     /**
      * notify the text history
@@ -466,19 +739,14 @@ void TextBlock::removeText(const KTextEditor::Range &range, QString &removedText
         return;
     }
 
-    // move all cursors on the line which has the text removed
+    // move all cursors on the line behind the start of the removed text
+    QVector<TextCursor *>::iterator it = cursorsAt(line, range.start().column() + 1);
+    const QVector<TextCursor *>::iterator end = cursorsAt(line + 1, 0);
+
     // remember all ranges modified
     QSet<TextRange *> changedRanges;
-    foreach (TextCursor *cursor, m_cursors) {
-        // skip cursors not on this line!
-        if (cursor->lineInBlock() != line) {
-            continue;
-        }
-
-        // skip cursors with too small column
-        if (cursor->column() <= range.start().column()) {
-            continue;
-        }
+    for (; it != end; ++it) {
+        TextCursor *cursor = *it;
 
         // patch column of cursor
         if (cursor->column() <= range.end().column()) {
@@ -502,6 +770,7 @@ void TextBlock::removeText(const KTextEditor::Range &range, QString &removedText
 void TextBlock::debugPrint(int blockIndex) const
 {
     // print all blocks
+    loadLines();
     for (int i = 0; i < m_lines.size(); ++i)
         printf("%4d - %4d : %4d : '%s'\n", blockIndex, startLine() + i
                , m_lines.at(i)->text().size(), qPrintable(m_lines.at(i)->text()));
@@ -509,34 +778,39 @@ void TextBlock::debugPrint(int blockIndex) const
 
 TextBlock *TextBlock::splitBlock(int fromLine)
 {
+    // decode lines of large files and copy shared lines before moving them
+    loadLines();
+    detachLines();
+
     // half the block
     int linesOfNewBlock = lines() - fromLine;
 
-    // create and insert new block
+    // create and insert new block, the moved lines stay shared with our snapshots
     TextBlock *newBlock = new TextBlock(m_buffer, startLine() + fromLine);
+    newBlock->m_snapshotShare = m_snapshotShare;
 
     // move lines
     newBlock->m_lines.reserve(linesOfNewBlock);
     for (int i = fromLine; i < m_lines.size(); ++i) {
         newBlock->m_lines.append(m_lines.at(i));
+        newBlock->m_chars += m_lines.at(i)->length();
     }
     m_lines.resize(fromLine);
-
-    // move cursors
-    QSet<TextCursor *> oldBlockSet;
-    foreach (TextCursor *cursor, m_cursors) {
-        if (cursor->lineInBlock() >= fromLine) {
-            cursor->m_line = cursor->lineInBlock() - fromLine;
-            cursor->m_block = newBlock;
-            newBlock->m_cursors.insert(cursor);
-        } else {
-            oldBlockSet.insert(cursor);
-        }
+    m_chars -= newBlock->m_chars;
+
+    // move cursors, the ones behind the split line are at the end, the order stays valid
+    const QVector<TextCursor *>::iterator firstMoved = cursorsAt(fromLine, 0);
+    newBlock->m_cursors.reserve(m_cursors.end() - firstMoved);
+    for (QVector<TextCursor *>::iterator it = firstMoved; it != m_cursors.end(); ++it) {
+        TextCursor *cursor = *it;
+        cursor->m_line = cursor->lineInBlock() - fromLine;
+        cursor->m_block = newBlock;
+        newBlock->m_cursors.append(cursor);
     }
-    m_cursors = oldBlockSet;
+    m_cursors.resize(firstMoved - m_cursors.begin());
 
     // fix ALL ranges!
-    QList<TextRange *> allRanges = m_uncachedRanges.toList() + m_cachedLineForRanges.keys();
+    QList<TextRange *> allRanges = m_uncachedRanges.ranges() + m_cachedLineForRanges.keys();
     foreach (TextRange *range, allRanges) {
         // update both blocks
         updateRange(range);
@@ -547,25 +821,66 @@ TextBlock *TextBlock::splitBlock(int fromLine)
     return newBlock;
 }
 
+int TextBlock::middleLineByChars() const
+{
+    Q_ASSERT(lines() > 1);
+
+    // decode lines of large files before looking at them
+    loadLines();
+
+    // first line that ends behind the half of the chars
+    int line = 0;
+    for (qint64 chars = 0; line < m_lines.size() - 1; ++line) {
+        chars += m_lines.at(line)->length();
+        if (2 * chars >= m_chars) {
+            break;
+        }
+    }
+
+    // the first half ends with that line, unless it is the last one
+    return qBound(1, line + 1, m_lines.size() - 1);
+}
+
 void TextBlock::mergeBlock(TextBlock *targetBlock)
 {
+    // decode lines of large files and copy shared lines before moving them
+    loadLines();
+    detachLines();
+    targetBlock->loadLines();
+    targetBlock->detachLines();
+
     // move cursors, do this first, now still lines() count is correct for target
+    // they are behind all cursors of the target, the order stays valid
+    targetBlock->m_cursors.reserve(targetBlock->m_cursors.size() + m_cursors.size());
     foreach (TextCursor *cursor, m_cursors) {
         cursor->m_line = cursor->lineInBlock() + targetBlock->lines();
         cursor->m_block = targetBlock;
-        targetBlock->m_cursors.insert(cursor);
+        targetBlock->m_cursors.append(cursor);
     }
     m_cursors.clear();
 
+    // the moved lines stay shared with our snapshots, the target can only track the snapshots of one block
+    if (!m_snapshotShare.isNull()) {
+        if (targetBlock->m_snapshotShare.isNull()) {
+            targetBlock->m_snapshotShare = m_snapshotShare;
+        } else if (targetBlock->m_snapshotShare != m_snapshotShare) {
+            for (int i = 0; i < m_lines.size(); ++i) {
+                detachLineFromSnapshots(i);
+            }
+        }
+    }
+
     // move lines
     targetBlock->m_lines.reserve(targetBlock->lines() + lines());
     for (int i = 0; i < m_lines.size(); ++i) {
         targetBlock->m_lines.append(m_lines.at(i));
     }
     m_lines.clear();
+    targetBlock->m_chars += m_chars;
+    m_chars = 0;
 
     // fix ALL ranges!
-    QList<TextRange *> allRanges = m_uncachedRanges.toList() + m_cachedLineForRanges.keys();
+    QList<TextRange *> allRanges = m_uncachedRanges.ranges() + m_cachedLineForRanges.keys();
     foreach (TextRange *range, allRanges) {
         // update both blocks
         updateRange(range);
@@ -576,41 +891,130 @@ void TextBlock::mergeBlock(TextBlock *targetBlock)
 void TextBlock::deleteBlockContent()
 {
     // kill cursors, if not belonging to a range
-    QSet<TextCursor *> copy = m_cursors;
+    const QVector<TextCursor *> copy = m_cursors;
     foreach (TextCursor *cursor, copy)
         if (!cursor->kateRange()) {
             delete cursor;
         }
 
     // kill lines
-    m_lines.clear();
+    clearLines();
 }
 
 void TextBlock::clearBlockContent(TextBlock *targetBlock)
 {
     // move cursors, if not belonging to a range
-    QSet<TextCursor *> copy = m_cursors;
-    foreach (TextCursor *cursor, copy) {
+    // they all go to the start of the target, in front of its cursors
+    QVector<TextCursor *> movedCursors;
+    QVector<TextCursor *> rangeCursors;
+    foreach (TextCursor *cursor, m_cursors) {
         if (!cursor->kateRange()) {
             cursor->m_column = 0;
             cursor->m_line = 0;
             cursor->m_block = targetBlock;
-            targetBlock->m_cursors.insert(cursor);
-            m_cursors.remove(cursor);
+            movedCursors.append(cursor);
+        } else {
+            rangeCursors.append(cursor);
         }
     }
+    targetBlock->m_cursors = movedCursors + targetBlock->m_cursors;
+    m_cursors = rangeCursors;
 
     // kill lines
-    m_lines.clear();
+    clearLines();
+}
+
+void TextBlock::moveCursorsBehindInsertedLines(int column, TextBlock *targetBlock, int lastLineLength, QSet<TextRange *> &changedRanges)
+{
+    // ranges leaving this block span the inserted lines now
+    foreach (TextRange *range, m_uncachedRanges.ranges()) {
+        if (range->endInternal().block() != this) {
+            changedRanges.insert(range);
+        }
+    }
+
+    // move the cursors at the end of the last line behind the inserted lines, like wrapLine() does
+    // the target is a new block without cursors, the moved cursors keep their order
+    Q_ASSERT(targetBlock->m_cursors.isEmpty());
+    const int line = lines() - 1;
+    const int targetLine = targetBlock->lines() - 1;
+    const QVector<TextCursor *>::iterator firstMoved = std::partition(cursorsAt(line, column), cursorsAt(line, column + 1), [](const TextCursor *cursor) {
+        return !cursor->m_moveOnInsert;
+    });
+    for (QVector<TextCursor *>::iterator it = firstMoved; it != m_cursors.end(); ++it) {
+        TextCursor *cursor = *it;
+        cursor->m_column = cursor->m_column - column + lastLineLength;
+        cursor->m_line = targetLine;
+        cursor->m_block = targetBlock;
+        targetBlock->m_cursors.append(cursor);
+
+        // remember range, if any
+        if (cursor->kateRange()) {
+            changedRanges.insert(cursor->kateRange());
+        }
+    }
+    m_cursors.resize(firstMoved - m_cursors.begin());
+}
+
+void TextBlock::moveCursorsToBlockStart(TextBlock *targetBlock, QSet<TextRange *> &changedRanges)
+{
+    // move all cursors, like removing the text and unwrapping the lines would do
+    // they all go to the start of the target, in front of its cursors
+    foreach (TextCursor *cursor, m_cursors) {
+        cursor->m_column = 0;
+        cursor->m_line = 0;
+        cursor->m_block = targetBlock;
+
+        // remember range, if any
+        if (cursor->kateRange()) {
+            changedRanges.insert(cursor->kateRange());
+        }
+    }
+    targetBlock->m_cursors = m_cursors + targetBlock->m_cursors;
+    m_cursors.clear();
+
+    // kill lines
+    clearLines();
+}
+
+void TextBlock::insertCursor(Kate::TextCursor *cursor)
+{
+    m_cursors.insert(cursorsAt(cursor->lineInBlock(), cursor->column()), cursor);
+}
+
+void TextBlock::removeCursor(Kate::TextCursor *cursor)
+{
+    // search in the cursors at the same position
+    for (QVector<TextCursor *>::iterator it = cursorsAt(cursor->lineInBlock(), cursor->column()); it != m_cursors.end() && !cursorLessThan(cursor, *it); ++it) {
+        if (*it == cursor) {
+            m_cursors.erase(it);
+            return;
+        }
+    }
+
+    // the cursor must be there, else the order got broken
+    Q_ASSERT(false);
+}
+
+QVector<TextCursor *>::iterator TextBlock::cursorsAt(int line, int column)
+{
+    return std::lower_bound(m_cursors.begin(), m_cursors.end(), KTextEditor::Cursor(line, column), [](const TextCursor *cursor, const KTextEditor::Cursor &position) {
+        return (cursor->lineInBlock() < position.line()) || (cursor->lineInBlock() == position.line() && cursor->column() < position.column());
+    });
 }
 
 void TextBlock::markModifiedLinesAsSaved()
 {
+    // lines of large files not decoded yet or in compact storage can't be modified
+    if (m_mappedFile || !m_compactLineStarts.isEmpty()) {
+        return;
+    }
+
     // mark all modified lines as saved
     for (int i = 0; i < m_lines.size(); ++i) {
-        TextLine textLine = m_lines[i];
-        if (textLine->markedAsModified()) {
-            textLine->markAsSavedOnDisk(true);
+        if (m_lines.at(i)->markedAsModified()) {
+            detachLines();
+            m_lines.at(i)->markAsSavedOnDisk(true);
         }
     }
 }
@@ -627,7 +1031,8 @@ void TextBlock::updateRange(TextRange *range)
     /**
      * perhaps remove range and be done
      */
-    if ((endLine < m_startLine) || (startLine >= (m_startLine + lines()))) {
+    const int blockStartLine = this->startLine();
+    if ((endLine < blockStartLine) || (startLine >= (blockStartLine + lines()))) {
         removeRange(range);
         return;
     }
@@ -635,14 +1040,23 @@ void TextBlock::updateRange(TextRange *range)
     /**
      * The range is still a single-line range, and is still cached to the correct line.
      */
-    if (isSingleLine && m_cachedLineForRanges.contains(range) && (m_cachedLineForRanges.value(range) == startLine - m_startLine)) {
+    if (isSingleLine && m_cachedLineForRanges.contains(range) && (m_cachedLineForRanges.value(range) == startLine - blockStartLine)) {
         return;
     }
 
     /**
-     * The range is still a multi-line range, and is already in the correct set.
+     * multi-line range: the range cannot be cached per line, as it spans multiple lines
+     * index it with its lines relative to this block, clipped to it, lines outside of this
+     * block then stay valid if other blocks change, the tree skips updates without change
      */
-    if (!isSingleLine && m_uncachedRanges.contains(range)) {
+    if (!isSingleLine) {
+        if (m_cachedLineForRanges.contains(range)) {
+            removeRange(range);
+        }
+
+        const int blockEndLine = blockStartLine + lines() - 1;
+        m_uncachedRanges.insert(range, qMax(startLine - blockStartLine, 0),
+                                (endLine > blockEndLine) ? std::numeric_limits<int>::max() : (endLine - blockStartLine));
         return;
     }
 
@@ -651,21 +1065,10 @@ void TextBlock::updateRange(TextRange *range)
      */
     removeRange(range);
 
-    /**
-     * simple case: multi-line range
-     */
-    if (!isSingleLine) {
-        /**
-         * The range cannot be cached per line, as it spans multiple lines
-         */
-        m_uncachedRanges.insert(range);
-        return;
-    }
-
     /**
      * The range is contained by a single line, put it into the line-cache
      */
-    const int lineOffset = startLine - m_startLine;
+    const int lineOffset = startLine - blockStartLine;
 
     /**
      * enlarge cache if needed
@@ -23,10 +23,13 @@
 
 #include <QVector>
 #include <QSet>
+#include <QSharedPointer>
+#include <QAtomicInt>
 
 #include <ktexteditor_export.h>
 #include <ktexteditor/cursor.h>
 #include "katetextline.h"
+#include "katetextrangetree.h"
 
 namespace Kate
 {
@@ -34,6 +37,13 @@ namespace Kate
 class TextBuffer;
 class TextCursor;
 class TextRange;
+class TextMappedFile;
+
+/**
+ * Held by the snapshots sharing the text lines of a block, see TextBlock::shareLinesWithSnapshot().
+ */
+struct TextLinesShare {
+};
 
 /**
  * Class representing a text block.
@@ -42,6 +52,8 @@ class TextRange;
  */
 class KTEXTEDITOR_EXPORT TextBlock
 {
+    friend class TextBufferSnapshot;
+
 public:
     /**
      * Construct an empty text block.
@@ -57,18 +69,20 @@ public:
 
     /**
      * Start line of this block.
+     * For blocks in the buffer this is computed with the block index of the buffer,
+     * at most once per change of the start lines.
      * @return start line of this block
      */
-    int startLine() const
-    {
-        return m_startLine;
-    }
+    int startLine() const;
 
     /**
-     * Set start line of this block.
-     * @param startLine new start line of this block
+     * Set index of this block in the buffer, the buffer computes our start line from now on.
+     * @param index index of this block in the buffer
      */
-    void setStartLine(int startLine);
+    void setBlockIndex(int index)
+    {
+        m_blockIndex = index;
+    }
 
     /**
      * Retrieve a text line.
@@ -83,25 +97,150 @@ public:
      */
     void appendLine(const QString &textOfLine);
 
+    /**
+     * Append a new line to the compact storage of this block.
+     * Lines in compact storage share one string, they only get a TextLine on first access.
+     * Only allowed for empty blocks or blocks with all lines in compact storage.
+     * @param text text of the line to append
+     * @param length length of the text
+     */
+    void appendCompactLine(const QChar *text, int length);
+
+    /**
+     * Release unused memory of the compact storage, call this after all lines got appended.
+     */
+    void squeeze();
+
+    /**
+     * Are the lines of this block still in compact storage?
+     * @return lines in compact storage?
+     */
+    bool isCompact() const
+    {
+        return !m_compactLineStarts.isEmpty();
+    }
+
+    /**
+     * Retrieve text of a line, lines in compact storage don't get a TextLine for this.
+     * @param line wanted line number
+     * @return view on text of the line, only valid until the block is modified
+     */
+    QStringRef lineView(int line) const;
+
+    /**
+     * Visit the text of some lines of this block, without creating a TextLine for lines in compact storage.
+     * The visitor is called as visitor(index, text) with the index of the line in this block and a view on
+     * its text, only valid until the block is modified, and returns false to stop the visiting.
+     * @param from index of the first line to visit
+     * @param to index behind the last line to visit
+     * @param visitor visitor to call for each line
+     * @return false if the visitor stopped the visiting
+     */
+    template<typename Visitor>
+    bool visitLines(int from, int to, Visitor &visitor) const
+    {
+        Q_ASSERT(from >= 0 && to <= lines());
+
+        // lines in compact storage are handed out directly
+        if (!m_compactLineStarts.isEmpty()) {
+            for (int i = from; i < to; ++i) {
+                const int start = m_compactLineStarts.at(i);
+                if (!visitor(i, QStringRef(&m_compactText, start, m_compactLineStarts.at(i + 1) - start))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // decode lines of large files on first access
+        loadLines();
+        for (int i = from; i < to; ++i) {
+            if (!visitor(i, QStringRef(&m_lines.at(i)->text()))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     /**
      * Clear the lines.
      */
     void clearLines();
 
+    /**
+     * Number of chars in the lines of this block, without line ends.
+     * Lines of memory mapped blocks are not counted before they are decoded.
+     * @return number of chars
+     */
+    qint64 chars() const
+    {
+        return m_chars;
+    }
+
     /**
      * Number of lines in this block.
      * @return number of lines
      */
     int lines() const
     {
-        return m_lines.size();
+        if (m_mappedFile) {
+            return m_mappedLines;
+        }
+        return m_compactLineStarts.isEmpty() ? m_lines.size() : (m_compactLineStarts.size() - 1);
+    }
+
+    /**
+     * Let this block reference lines of a memory mapped file.
+     * The lines are only decoded on first access.
+     * The block must be empty.
+     * @param mappedFile mapped file holding the lines
+     * @param position byte offset of the first line in the file
+     * @param end byte offset behind the last line in the file
+     * @param lines number of lines
+     */
+    void setMappedLines(const QSharedPointer<TextMappedFile> &mappedFile, qint64 position, qint64 end, int lines);
+
+    /**
+     * Are the lines of this block still not decoded from a memory mapped file?
+     * @return lines not yet loaded?
+     */
+    bool isMapped() const
+    {
+        return !m_mappedFile.isNull();
     }
 
     /**
-     * Retrieve text of block.
-     * @param text for this block, lines separated by '\n'
+     * Estimate the memory used by this block, see TextBuffer::memoryUsage().
+     * Lines shared with blocks of other buffers are split among them.
+     * @param text bytes used for the text and the lines get added to this
+     * @param highlighting bytes used for the highlighting attributes get added to this
+     * @param movingRanges bytes used for the cursors not belonging to ranges get added to this
      */
-    void text(QString &text) const;
+    void memoryUsage(qint64 &text, qint64 &highlighting, qint64 &movingRanges) const;
+
+    /**
+     * Let this block share the lines of a block of another buffer, copy-on-write.
+     * Text lines are shared together with their highlighting, lines in compact storage or
+     * of a memory mapped file just like their storage. The block must be empty.
+     * @param block block to share the lines with
+     */
+    void shareLines(TextBlock &block);
+
+    /**
+     * Copy the lines shared with blocks of other buffers, see shareLines().
+     * Must be called before the text lines of this block are modified, either by
+     * edits or by the highlighting. Does nothing if the lines are not shared.
+     */
+    void detachLines();
+
+    /**
+     * Let a snapshot share the text lines of this block, see TextBufferSnapshot.
+     * Unlike shareLines() only edits copy a shared line, just before they change its text,
+     * the highlighting leaves the text alone. The snapshot must hold the returned share
+     * as long as it uses the lines.
+     * @return share of the snapshots of this block
+     */
+    QSharedPointer<TextLinesShare> shareLinesWithSnapshot() const;
 
     /**
      * Wrap line at given cursor position.
@@ -146,6 +285,12 @@ public:
      */
     TextBlock *splitBlock(int fromLine);
 
+    /**
+     * Find the line to split this block at to get two halves with about the same number of chars.
+     * @return line in this block, at least 1 and less than lines(), the block needs at least two lines
+     */
+    int middleLineByChars() const;
+
     /**
      * Merge this block with given one, the given one must be a direct predecessor.
      * @param targetBlock block to merge with
@@ -166,14 +311,37 @@ public:
      */
     void clearBlockContent(TextBlock *targetBlock);
 
+    /**
+     * Move the cursors at the end of our last line to the last line of the given block.
+     * This is used by insertLines() of TextBuffer, the new lines got inserted behind our last line.
+     * @param column length of our last line, cursors behind it and the ones at it with move on insert behavior move
+     * @param targetBlock block holding the last inserted line
+     * @param lastLineLength length of the last inserted line
+     * @param changedRanges will get the ranges of the moved cursors and the ranges that now span the inserted lines
+     */
+    void moveCursorsBehindInsertedLines(int column, TextBlock *targetBlock, int lastLineLength, QSet<TextRange *> &changedRanges);
+
+    /**
+     * Move all cursors to the start of the given block and clear the lines.
+     * This is used by removeLines() of TextBuffer for the removed blocks.
+     * @param targetBlock block behind the removed lines
+     * @param changedRanges will get the ranges of the moved cursors
+     */
+    void moveCursorsToBlockStart(TextBlock *targetBlock, QSet<TextRange *> &changedRanges);
+
     /**
      * Return all ranges in this block which might intersect the given line.
      * @param line line to check intersection
-     * @return list of sets of possible candidate ranges
+     * @return possible candidate ranges
      */
-    QList<QSet<TextRange *> > rangesForLine(int line) const
+    QVector<TextRange *> rangesForLine(int line) const
     {
-        return QList<QSet<TextRange *> >() << m_uncachedRanges << cachedRangesForLine(line);
+        QVector<TextRange *> ranges;
+        m_uncachedRanges.rangesForLine(line - startLine(), ranges);
+        foreach (TextRange *range, cachedRangesForLine(line)) {
+            ranges.append(range);
+        }
+        return ranges;
     }
 
     /**
@@ -192,26 +360,20 @@ public:
     void markModifiedLinesAsSaved();
 
     /**
-     * Insert cursor into this block.
+     * Insert cursor into this block, at the place its position sorts to.
      * @param cursor cursor to insert
      */
-    void insertCursor(Kate::TextCursor *cursor)
-    {
-        m_cursors.insert(cursor);
-    }
+    void insertCursor(Kate::TextCursor *cursor);
 
     /**
-     * Remove cursor from this block.
+     * Remove cursor from this block, its position must be the one it was inserted with or moved to by the block.
      * @param cursor cursor to remove
      */
-    void removeCursor(Kate::TextCursor *cursor)
-    {
-        m_cursors.remove(cursor);
-    }
+    void removeCursor(Kate::TextCursor *cursor);
 
     /**
      * Update a range from this block.
-     * Will move the range to right set, either cached for one-line ranges or not.
+     * Will move the range to right place, either cached for one-line ranges or into the interval tree.
      * @param range range to update
      */
     void updateRange(TextRange *range);
@@ -230,7 +392,7 @@ public:
      */
     QSet<TextRange *> cachedRangesForLine(int line) const
     {
-        line -= m_startLine;
+        line -= startLine();
         if (line >= 0 && line < m_cachedRangesForLine.size()) {
             return m_cachedRangesForLine[line];
         } else {
@@ -238,6 +400,45 @@ public:
         }
     }
 
+private:
+    /**
+     * Find the first cursor at or behind the given position, cursors are sorted by line and column.
+     * @param line line in this block
+     * @param column column
+     * @return iterator to the first cursor not in front of the position
+     */
+    QVector<TextCursor *>::iterator cursorsAt(int line, int column);
+
+    /**
+     * Ensure lines of a memory mapped block are decoded and lines in compact storage have their TextLine.
+     * Must be called before m_lines is accessed, only line() gets along without it.
+     */
+    void loadLines() const
+    {
+        if (m_mappedFile || !m_compactLineStarts.isEmpty()) {
+            const_cast<TextBlock *>(this)->createLines();
+        }
+    }
+
+    /**
+     * Create the lines from the memory mapped file or the compact storage and drop that.
+     */
+    void createLines();
+
+    /**
+     * Retrieve a line in compact storage, only this line gets a TextLine, the block stays compact.
+     * @param line line index in this block
+     * @return text line
+     */
+    TextLine compactLine(int line) const;
+
+    /**
+     * Copy a line shared with snapshots before its text gets modified.
+     * Does nothing if no snapshot shares the lines.
+     * @param line line index in this block
+     */
+    void detachLineFromSnapshots(int line);
+
 private:
     /**
      * parent text buffer
@@ -250,14 +451,80 @@ private:
     QVector<Kate::TextLine> m_lines;
 
     /**
-     * Startline of this block
+     * Memory mapped file holding our lines, as long as they are not decoded.
+     * Set for blocks of large files, see TextBuffer::setLargeFileLimit().
+     */
+    QSharedPointer<TextMappedFile> m_mappedFile;
+
+    /**
+     * Byte offset of our first line in the mapped file.
+     */
+    qint64 m_mappedPosition;
+
+    /**
+     * Byte offset behind our last line in the mapped file.
+     */
+    qint64 m_mappedEnd;
+
+    /**
+     * Number of lines in the mapped file, valid as long as m_mappedFile is set.
+     */
+    int m_mappedLines;
+
+    /**
+     * Compact storage: text of all lines without end of line chars.
+     */
+    QString m_compactText;
+
+    /**
+     * Compact storage: start offsets of the lines in m_compactText, followed by the end of the last line.
+     * Empty if no lines are in compact storage.
+     */
+    QVector<int> m_compactLineStarts;
+
+    /**
+     * Compact storage: TextLines of the lines accessed by line(), null for the others.
+     * Empty until the first access. They keep their highlighting once the block leaves compact storage.
+     */
+    mutable QVector<Kate::TextLine> m_compactLines;
+
+    /**
+     * Number of blocks sharing m_lines, see shareLines(), 0 if the lines are not shared.
+     */
+    QAtomicInt *m_sharedLines;
+
+    /**
+     * Share held by the snapshots sharing m_lines, see shareLinesWithSnapshot().
+     * Null once all of them are gone.
+     */
+    mutable QWeakPointer<TextLinesShare> m_snapshotShare;
+
+    /**
+     * Number of chars in our lines, see chars()
+     */
+    qint64 m_chars;
+
+    /**
+     * Startline of this block, as given on construction or cached from the block index of the buffer
+     */
+    mutable int m_startLine;
+
+    /**
+     * Revision of the start lines of the buffer m_startLine was computed for
+     */
+    mutable uint m_startLineRevision;
+
+    /**
+     * Index of this block in the buffer, -1 as long as the block is not part of the buffer
      */
-    int m_startLine;
+    int m_blockIndex;
 
     /**
-     * Set of cursors for this block.
+     * Cursors of this block, sorted by line and column.
+     * Edits only touch the cursors behind the edit position, they move all by the same offset,
+     * cursors at the position that stay in place are kept in front of the moved ones.
      */
-    QSet<TextCursor *> m_cursors;
+    QVector<TextCursor *> m_cursors;
 
     /**
      * Contains for each line-offset the ranges that were cached into it.
@@ -271,9 +538,9 @@ private:
     QHash<TextRange *, int> m_cachedLineForRanges;
 
     /**
-     * This contains all the ranges that are not cached.
+     * This contains all the ranges that are not cached, indexed by their lines relative to this block.
      */
-    QSet<TextRange *> m_uncachedRanges;
+    TextRangeTree m_uncachedRanges;
 };
 
 }
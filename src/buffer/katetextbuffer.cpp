@@ -22,21 +22,19 @@
 
 #include "katetextbuffer.h"
 #include "katetextloader.h"
+#include "katetextmappedfile.h"
+#include "katetextloadthread.h"
+#include "katetextsavethread.h"
 
 // this is unfortunate, but needed for performance
 #include "katedocument.h"
 #include "kateview.h"
 #include "katepartdebug.h"
 
-#ifndef Q_OS_WIN
-#include <unistd.h>
+#include <QFileInfo>
 
-// needed for umask application
-#include <sys/types.h>
-#include <sys/stat.h>
-#endif
-
-#include <QSaveFile>
+#include <limits>
+#include <string.h>
 
 #if 0
 #define BUFFER_DEBUG qCDebug(LOG_KTE)
@@ -47,11 +45,86 @@
 namespace Kate
 {
 
+/**
+ * bounds for the average line length the targeted chars per block are computed from
+ */
+static const qint64 minimalBlockLineLength = 64;
+static const qint64 maximalBlockLineLength = 1024;
+
+/**
+ * Count the bytes the UTF-8 encoding of the given text needs, see encodeUtf8().
+ * @param text text to encode
+ * @return number of bytes
+ */
+static int utf8Length(const QStringRef &text)
+{
+    const ushort *data = reinterpret_cast<const ushort *>(text.unicode());
+    const int size = text.size();
+    int length = size;
+    for (int i = 0; i < size; ++i) {
+        const ushort c = data[i];
+        if (c < 0x80) {
+            continue;
+        }
+
+        if (c < 0x800) {
+            length += 1;
+        } else if (QChar::isHighSurrogate(c) && i + 1 < size && QChar::isLowSurrogate(data[i + 1])) {
+            // four bytes for two chars
+            length += 2;
+            ++i;
+        } else {
+            length += 2;
+        }
+    }
+    return length;
+}
+
+/**
+ * Encode the given text as UTF-8, unpaired surrogates are encoded as U+FFFD.
+ * @param text text to encode
+ * @param out buffer to write to, must have room for utf8Length(text) bytes
+ * @return position behind the written bytes
+ */
+static char *encodeUtf8(const QStringRef &text, char *out)
+{
+    const ushort *data = reinterpret_cast<const ushort *>(text.unicode());
+    const int size = text.size();
+    for (int i = 0; i < size; ++i) {
+        uint c = data[i];
+        if (c < 0x80) {
+            *out++ = char(c);
+            continue;
+        }
+
+        if (c < 0x800) {
+            *out++ = char(0xc0 | (c >> 6));
+        } else {
+            if (QChar::isHighSurrogate(c) && i + 1 < size && QChar::isLowSurrogate(data[i + 1])) {
+                c = QChar::surrogateToUcs4(ushort(c), data[++i]);
+                *out++ = char(0xf0 | (c >> 18));
+                *out++ = char(0x80 | ((c >> 12) & 0x3f));
+            } else {
+                if (QChar::isSurrogate(c)) {
+                    c = QChar::ReplacementCharacter;
+                }
+                *out++ = char(0xe0 | (c >> 12));
+            }
+            *out++ = char(0x80 | ((c >> 6) & 0x3f));
+        }
+        *out++ = char(0x80 | (c & 0x3f));
+    }
+    return out;
+}
+
 TextBuffer::TextBuffer(KTextEditor::DocumentPrivate *parent, int blockSize)
     : QObject(parent)
     , m_document(parent)
     , m_history(*this)
     , m_blockSize(blockSize)
+    , m_blockChars(blockCharsForAverage(0, 0, blockSize))
+    , m_firstStaleBlock(-1)
+    , m_startLinesRevision(1)
     , m_lines(0)
     , m_lastUsedBlock(0)
     , m_revision(0)
@@ -67,6 +140,13 @@ TextBuffer::TextBuffer(KTextEditor::DocumentPrivate *parent, int blockSize)
     , m_endOfLineMode(eolUnix)
     , m_newLineAtEof(false)
     , m_lineLengthLimit(4096)
+    , m_largeFileLimit(0)
+    , m_compactStorage(false)
+    , m_loadThread(0)
+    , m_loadedLines(0)
+    , m_saveThread(0)
+    , m_fileReadFailed(false)
+    , m_editingRefused(false)
 {
     // minimal block size must be > 0
     Q_ASSERT(m_blockSize > 0);
@@ -80,6 +160,19 @@ TextBuffer::~TextBuffer()
     // remove document pointer, this will avoid any notifyAboutRangeChange to have a effect
     m_document = 0;
 
+    // stop background loading, without notification
+    if (m_loadThread) {
+        m_loadThread->cancel();
+        finishLoading(false);
+    }
+
+    // let background saving finish, the file must be complete, without notification
+    if (m_saveThread) {
+        m_saveThread->wait();
+        delete m_saveThread;
+        m_saveThread = 0;
+    }
+
     // not allowed during editing
     Q_ASSERT(m_editingTransactions == 0);
 
@@ -115,8 +208,14 @@ void TextBuffer::invalidateRanges()
 
 void TextBuffer::clear()
 {
-    // not allowed during editing
-    Q_ASSERT(m_editingTransactions == 0);
+    // not allowed during editing, refused transactions while loading changed nothing
+    Q_ASSERT(m_editingTransactions == 0 || m_editingRefused);
+
+    // stop background loading, without notification, we are cleared anyway
+    if (m_loadThread) {
+        m_loadThread->cancel();
+        finishLoading(false);
+    }
 
     invalidateRanges();
 
@@ -135,17 +234,24 @@ void TextBuffer::clear()
 
     // insert one block with one empty line
     m_blocks.append(newBlock);
+    rebuildBlockIndex();
 
     // reset lines and last used block
     m_lines = 1;
     m_lastUsedBlock = 0;
 
+    // reset targeted block chars
+    m_blockChars = blockCharsForAverage(0, 0, m_blockSize);
+
     // reset revision
     m_revision = 0;
 
     // reset bom detection
     m_generateByteOrderMark = false;
 
+    // the lines of a broken mapped file are gone
+    m_fileReadFailed = false;
+
     // reset the filter device
     m_mimeTypeForFilterDev = QLatin1String("text/plain");
 
@@ -156,6 +262,56 @@ void TextBuffer::clear()
     emit cleared();
 }
 
+void TextBuffer::cloneFrom(const TextBuffer &source)
+{
+    Q_ASSERT(&source != this);
+    Q_ASSERT(!source.isLoading());
+
+    clear();
+
+    /**
+     * replace the empty line of the first block and share the lines of all blocks of the source
+     */
+    m_blocks.last()->clearLines();
+    m_blocks.reserve(source.m_blocks.size());
+    m_lines = 0;
+    for (int b = 0; b < source.m_blocks.size(); ++b) {
+        if (b > 0) {
+            m_blocks.append(new TextBlock(this, m_lines));
+        }
+
+        m_blocks.last()->shareLines(*source.m_blocks.at(b));
+        m_lines += m_blocks.last()->lines();
+    }
+    Q_ASSERT(m_lines == source.m_lines);
+    rebuildBlockIndex();
+    m_blockChars = source.m_blockChars;
+
+    // take over the properties of the loaded file
+    m_textCodec = source.m_textCodec;
+    m_generateByteOrderMark = source.m_generateByteOrderMark;
+    m_endOfLineMode = source.m_endOfLineMode;
+    m_mimeTypeForFilterDev = source.m_mimeTypeForFilterDev;
+    setDigest(source.digest());
+}
+
+void TextBuffer::detachLines(int startLine, int endLine)
+{
+    if (startLine > endLine) {
+        return;
+    }
+
+    // get block, this will assert on invalid line, walk the blocks from there
+    for (int blockIndex = blockForLine(startLine); blockIndex < m_blocks.size(); ++blockIndex) {
+        TextBlock *block = m_blocks.at(blockIndex);
+        if (block->startLine() > endLine) {
+            break;
+        }
+
+        block->detachLines();
+    }
+}
+
 TextLine TextBuffer::line(int line) const
 {
     // get block, this will assert on invalid line
@@ -165,17 +321,94 @@ TextLine TextBuffer::line(int line) const
     return m_blocks.at(blockIndex)->line(line);
 }
 
+QStringRef TextBuffer::lineView(int line) const
+{
+    // get block, this will assert on invalid line
+    int blockIndex = blockForLine(line);
+
+    // get view on line text
+    return m_blocks.at(blockIndex)->lineView(line);
+}
+
+bool TextBuffer::isLineCompact(int line) const
+{
+    // get block, this will assert on invalid line
+    return m_blocks.at(blockForLine(line))->isCompact();
+}
+
 QString TextBuffer::text() const
 {
-    QString text;
+    return text(KTextEditor::Range(0, 0, lines() - 1, std::numeric_limits<int>::max()));
+}
+
+QString TextBuffer::text(const KTextEditor::Range &range) const
+{
+    // compute size first, no reallocations while copying
+    int size = 0;
+    visitRange(range, [&size](const QStringRef & text, bool newline) {
+        size += text.size() + (newline ? 1 : 0);
+    });
+
+    if (size == 0) {
+        return QString();
+    }
+
+    // copy the lines directly
+    QString result(size, Qt::Uninitialized);
+    QChar *out = result.data();
+    visitRange(range, [&out](const QStringRef & text, bool newline) {
+        memcpy(out, text.unicode(), text.size() * sizeof(QChar));
+        out += text.size();
+        if (newline) {
+            *out++ = QLatin1Char('\n');
+        }
+    });
+
+    Q_ASSERT(out == result.constData() + size);
+    return result;
+}
+
+QByteArray TextBuffer::utf8Text() const
+{
+    return utf8Text(KTextEditor::Range(0, 0, lines() - 1, std::numeric_limits<int>::max()));
+}
 
-    // combine all blocks
+QByteArray TextBuffer::utf8Text(const KTextEditor::Range &range) const
+{
+    // compute size of the encoded text first, no reallocations while encoding
+    int size = 0;
+    visitRange(range, [&size](const QStringRef & text, bool newline) {
+        size += utf8Length(text) + (newline ? 1 : 0);
+    });
+
+    if (size == 0) {
+        return QByteArray();
+    }
+
+    // encode the lines directly
+    QByteArray result(size, Qt::Uninitialized);
+    char *out = result.data();
+    visitRange(range, [&out](const QStringRef & text, bool newline) {
+        out = encodeUtf8(text, out);
+        if (newline) {
+            *out++ = '\n';
+        }
+    });
+
+    Q_ASSERT(out == result.constData() + size);
+    return result;
+}
+
+void TextBuffer::memoryUsage(qint64 &text, qint64 &highlighting, qint64 &history, qint64 &movingRanges) const
+{
+    text = qint64(m_blocks.capacity()) * sizeof(TextBlock *) + qint64(m_blockLinesTree.capacity()) * sizeof(int);
+    highlighting = 0;
+    movingRanges = qint64(m_ranges.size()) * sizeof(TextRange) + qint64(m_invalidCursors.size()) * sizeof(TextCursor);
     foreach (TextBlock *block, m_blocks) {
-        block->text(text);
+        block->memoryUsage(text, highlighting, movingRanges);
     }
 
-    // return generated string
-    return text;
+    history = m_history.memoryUsage();
 }
 
 bool TextBuffer::startEditing()
@@ -188,6 +421,16 @@ bool TextBuffer::startEditing()
         return false;
     }
 
+    /**
+     * no editing while loading in the background, the loaded blocks are appended behind our back
+     * the transaction must still be finished, but all edits inside it are refused
+     */
+    m_editingRefused = (m_loadThread != 0);
+    if (m_editingRefused) {
+        BUFFER_DEBUG << "Editing refused, file still loading";
+        return false;
+    }
+
     // reset information about edit...
     m_editingLastRevision = m_revision;
     m_editingLastLines = m_lines;
@@ -216,6 +459,12 @@ bool TextBuffer::finishEditing()
         return false;
     }
 
+    // refused transaction, nothing changed
+    if (m_editingRefused) {
+        m_editingRefused = false;
+        return false;
+    }
+
     // assert that if buffer changed, the line ranges are set and valid!
     Q_ASSERT(!editingChangedBuffer() || (m_editingMinimalLineChanged != -1 && m_editingMaximalLineChanged != -1));
     Q_ASSERT(!editingChangedBuffer() || (m_editingMinimalLineChanged <= m_editingMaximalLineChanged));
@@ -239,6 +488,11 @@ void TextBuffer::wrapLine(const KTextEditor::Cursor &position)
     // only allowed if editing transaction running
     Q_ASSERT(m_editingTransactions > 0);
 
+    // refused while loading, see startEditing()
+    if (m_editingRefused) {
+        return;
+    }
+
     // get block, this will assert on invalid line
     int blockIndex = blockForLine(position.line());
 
@@ -282,6 +536,11 @@ void TextBuffer::unwrapLine(int line)
     // only allowed if editing transaction running
     Q_ASSERT(m_editingTransactions > 0);
 
+    // refused while loading, see startEditing()
+    if (m_editingRefused) {
+        return;
+    }
+
     // line 0 can't be unwrapped
     Q_ASSERT(line > 0);
 
@@ -336,6 +595,11 @@ void TextBuffer::insertText(const KTextEditor::Cursor &position, const QString &
     // only allowed if editing transaction running
     Q_ASSERT(m_editingTransactions > 0);
 
+    // refused while loading, see startEditing()
+    if (m_editingRefused) {
+        return;
+    }
+
     // skip work, if no text to insert
     if (text.isEmpty()) {
         return;
@@ -350,6 +614,9 @@ void TextBuffer::insertText(const KTextEditor::Cursor &position, const QString &
     // remember changes
     ++m_revision;
 
+    // the block might have too many chars now
+    balanceBlock(blockIndex);
+
     // update changed line interval
     if (position.line() < m_editingMinimalLineChanged || m_editingMinimalLineChanged == -1) {
         m_editingMinimalLineChanged = position.line();
@@ -373,6 +640,11 @@ void TextBuffer::removeText(const KTextEditor::Range &range)
     // only allowed if editing transaction running
     Q_ASSERT(m_editingTransactions > 0);
 
+    // refused while loading, see startEditing()
+    if (m_editingRefused) {
+        return;
+    }
+
     // only ranges on one line are supported
     Q_ASSERT(range.start().line() == range.end().line());
 
@@ -410,6 +682,228 @@ void TextBuffer::removeText(const KTextEditor::Range &range)
         emit m_document->KTextEditor::Document::textRemoved(m_document, range, text);
 }
 
+void TextBuffer::insertLines(int line, const QStringList &lines)
+{
+    // debug output for REAL low-level debugging
+    BUFFER_DEBUG << "insertLines" << line << lines.size();
+
+    // only allowed if editing transaction running
+    Q_ASSERT(m_editingTransactions > 0);
+
+    // refused while loading, see startEditing()
+    if (m_editingRefused) {
+        return;
+    }
+
+    // skip work, if no lines to insert
+    if (lines.isEmpty()) {
+        return;
+    }
+
+    // get block, this will assert on invalid line
+    int blockIndex = blockForLine(line);
+    TextBlock *block = m_blocks.at(blockIndex);
+    const int lineLength = block->lineView(line).size();
+
+    // split off the lines behind the given one, the new blocks go in between
+    const int fromLine = line - block->startLine() + 1;
+    if (fromLine < block->lines()) {
+        m_blocks.insert(m_blocks.begin() + blockIndex + 1, block->splitBlock(fromLine));
+    }
+
+    /**
+     * create the new blocks, at most block size lines each
+     * the new lines are modified, like wrapLine + insertText would mark them
+     */
+    QVector<TextBlock *> newBlocks;
+    for (int i = 0; i < lines.size(); ++i) {
+        if (newBlocks.isEmpty() || newBlocks.last()->lines() >= m_blockSize || newBlocks.last()->chars() >= m_blockChars) {
+            newBlocks.append(new TextBlock(this, line + 1 + i));
+        }
+
+        newBlocks.last()->appendLine(lines.at(i));
+        newBlocks.last()->line(line + 1 + i)->markAsModified(true);
+    }
+
+    // splice in the new blocks
+    m_blocks.insert(blockIndex + 1, newBlocks.size(), 0);
+    for (int i = 0; i < newBlocks.size(); ++i) {
+        m_blocks[blockIndex + 1 + i] = newBlocks.at(i);
+    }
+
+    /**
+     * alter the line counter, the blocks behind the split one get renumbered on next access
+     * the new blocks know their start lines, the range update works
+     */
+    m_lines += lines.size();
+    invalidateBlockIndex(blockIndex);
+
+    /**
+     * notify the text history
+     */
+    m_history.insertLines(line, lineLength, lines.size(), lines.last().size());
+
+    // move cursors at the end of the line behind the inserted ones, check validity of all ranges, might invalidate them...
+    QSet<TextRange *> changedRanges;
+    block->moveCursorsBehindInsertedLines(lineLength, newBlocks.last(), lines.last().size(), changedRanges);
+    foreach (TextRange *range, changedRanges) {
+        // ranges might have left the block completely, checkValidity only visits the blocks they span now
+        block->updateRange(range);
+        range->checkValidity();
+    }
+
+    // remember changes
+    ++m_revision;
+
+    // update changed line interval
+    if (line < m_editingMinimalLineChanged || m_editingMinimalLineChanged == -1) {
+        m_editingMinimalLineChanged = line;
+    }
+
+    if (line <= m_editingMaximalLineChanged) {
+        m_editingMaximalLineChanged += lines.size();
+    } else {
+        m_editingMaximalLineChanged = line + lines.size();
+    }
+
+    /**
+     * balance the changed blocks if needed, back to front, the indices in front stay valid
+     * only the block behind the new ones, the last new one and the one we inserted behind can be too small
+     */
+    const int lastNewBlockIndex = blockIndex + newBlocks.size();
+    if (lastNewBlockIndex + 1 < m_blocks.size()) {
+        balanceBlock(lastNewBlockIndex + 1);
+    }
+    balanceBlock(lastNewBlockIndex);
+    balanceBlock(blockIndex);
+
+    // emit signal about done change
+    emit linesInserted(line, lines);
+
+    /**
+     * the document signals know no whole lines, emit what wrapLine + insertText would do
+     */
+    if (m_document) {
+        int previousLineLength = lineLength;
+        for (int i = 0; i < lines.size(); ++i) {
+            emit m_document->KTextEditor::Document::lineWrapped(m_document, KTextEditor::Cursor(line + i, previousLineLength));
+            if (!lines.at(i).isEmpty()) {
+                emit m_document->KTextEditor::Document::textInserted(m_document, KTextEditor::Cursor(line + i + 1, 0), lines.at(i));
+            }
+            previousLineLength = lines.at(i).size();
+        }
+    }
+}
+
+void TextBuffer::removeLines(int from, int to)
+{
+    // debug output for REAL low-level debugging
+    BUFFER_DEBUG << "removeLines" << from << to;
+
+    // only allowed if editing transaction running
+    Q_ASSERT(m_editingTransactions > 0);
+
+    // refused while loading, see startEditing()
+    if (m_editingRefused) {
+        return;
+    }
+
+    // the line behind the removed ones must exist, it takes the cursors
+    Q_ASSERT(from >= 0);
+    Q_ASSERT(from <= to);
+    Q_ASSERT(to + 1 < lines());
+
+    // remember removed text, for the signals
+    QStringList removedLines;
+    removedLines.reserve(to - from + 1);
+    for (int line = from; line <= to; ++line) {
+        removedLines.append(lineView(line).toString());
+    }
+
+    /**
+     * split the blocks at the start and behind the end of the removed lines
+     * afterwards the removed lines are exactly the blocks firstBlock to lastBlock
+     */
+    int firstBlock = blockForLine(from);
+    int fromLine = from - m_blocks.at(firstBlock)->startLine();
+    if (fromLine > 0) {
+        m_blocks.insert(m_blocks.begin() + firstBlock + 1, m_blocks.at(firstBlock)->splitBlock(fromLine));
+        invalidateBlockIndex(firstBlock);
+        ++firstBlock;
+    }
+
+    int lastBlock = blockForLine(to + 1);
+    fromLine = to + 1 - m_blocks.at(lastBlock)->startLine();
+    if (fromLine > 0) {
+        m_blocks.insert(m_blocks.begin() + lastBlock + 1, m_blocks.at(lastBlock)->splitBlock(fromLine));
+        invalidateBlockIndex(lastBlock);
+    } else {
+        --lastBlock;
+    }
+
+    // move cursors of the removed blocks to the start of the line behind, kill the blocks
+    TextBlock *targetBlock = m_blocks.at(lastBlock + 1);
+    QSet<TextRange *> changedRanges;
+    for (int i = firstBlock; i <= lastBlock; ++i) {
+        m_blocks.at(i)->moveCursorsToBlockStart(targetBlock, changedRanges);
+        delete m_blocks.at(i);
+    }
+    m_blocks.erase(m_blocks.begin() + firstBlock, m_blocks.begin() + lastBlock + 1);
+
+    /**
+     * alter the line counter, the blocks behind the removed ones get renumbered on next access
+     */
+    m_lines -= removedLines.size();
+    invalidateBlockIndex(firstBlock);
+
+    /**
+     * notify the text history
+     */
+    m_history.removeLines(from, removedLines.size());
+
+    // check validity of all ranges, might invalidate them...
+    foreach (TextRange *range, changedRanges) {
+        range->checkValidity();
+    }
+
+    // remember changes
+    ++m_revision;
+
+    // update changed line interval
+    if (from < m_editingMinimalLineChanged || m_editingMinimalLineChanged == -1) {
+        m_editingMinimalLineChanged = from;
+    }
+
+    if (to < m_editingMaximalLineChanged) {
+        m_editingMaximalLineChanged -= removedLines.size();
+    } else {
+        m_editingMaximalLineChanged = from;
+    }
+
+    /**
+     * balance the blocks around the removed ones if needed, back to front
+     */
+    balanceBlock(firstBlock);
+    if (firstBlock > 0) {
+        balanceBlock(firstBlock - 1);
+    }
+
+    // emit signal about done change
+    emit linesRemoved(from, removedLines);
+
+    /**
+     * the document signals know no whole lines, emit what removeText + unwrapLine would do
+     */
+    if (m_document) {
+        foreach (const QString &text, removedLines) {
+            if (!text.isEmpty()) {
+                emit m_document->KTextEditor::Document::textRemoved(m_document, KTextEditor::Range(from, 0, from, text.size()), text);
+            }
+            emit m_document->KTextEditor::Document::lineUnwrapped(m_document, from + 1);
+        }
+    }
+}
+
 int TextBuffer::blockForLine(int line) const
 {
     // only allow valid lines
@@ -421,6 +915,9 @@ int TextBuffer::blockForLine(int line) const
     Q_ASSERT(!m_blocks.isEmpty());
     Q_ASSERT(m_lastUsedBlock >= 0);
 
+    // blocks got split or merged, renumber them first
+    ensureBlockIndex();
+
     /**
      * shortcut: try last block first
      */
@@ -438,35 +935,30 @@ int TextBuffer::blockForLine(int line) const
     }
 
     /**
-     * search for right block
-     * use binary search
-     * if we leave this loop not by returning the found element we have an error
+     * search for right block with the block index
+     * descend the tree to find the number of blocks completely in front of the line
      */
-    int blockStart = 0;
-    int blockEnd = m_blocks.size() - 1;
-    while (blockEnd >= blockStart) {
-        // get middle and ensure it is OK
-        int middle = blockStart + ((blockEnd - blockStart) / 2);
-        Q_ASSERT(middle >= 0);
-        Q_ASSERT(middle < m_blocks.size());
-
-        // facts bout this block
-        TextBlock *block = m_blocks[middle];
-        const int start = block->startLine();
-        const int lines = block->lines();
+    const int blocks = m_blocks.size();
+    Q_ASSERT(m_blockLinesTree.size() == blocks + 1);
+    int step = 1;
+    while (2 * step <= blocks) {
+        step *= 2;
+    }
 
-        // right block found, remember it and return it
-        if (start <= line && line < (start + lines)) {
-            m_lastUsedBlock = middle;
-            return middle;
+    int index = 0;
+    int remainingLines = line;
+    for (; step > 0; step /= 2) {
+        if ((index + step <= blocks) && (m_blockLinesTree[index + step] <= remainingLines)) {
+            index += step;
+            remainingLines -= m_blockLinesTree[index];
         }
+    }
 
-        // half our stuff ;)
-        if (line < start) {
-            blockEnd = middle - 1;
-        } else {
-            blockStart = middle + 1;
-        }
+    // right block found, remember it and return it
+    if (index < blocks) {
+        Q_ASSERT(remainingLines < m_blocks[index]->lines());
+        m_lastUsedBlock = index;
+        return index;
     }
 
     // we should always find a block
@@ -479,19 +971,77 @@ void TextBuffer::fixStartLines(int startBlock)
     // only allow valid start block
     Q_ASSERT(startBlock >= 0);
     Q_ASSERT(startBlock < m_blocks.size());
+    ensureBlockIndex();
+    Q_ASSERT(m_blockLinesTree.size() == m_blocks.size() + 1);
+
+    // difference of the line count of the block to the one in the index
+    const int delta = m_blocks.at(startBlock)->lines() - (blockStartLine(startBlock + 1) - blockStartLine(startBlock));
+
+    // update index, all following blocks will recompute their start line
+    for (int i = startBlock + 1; i < m_blockLinesTree.size(); i += i & -i) {
+        m_blockLinesTree[i] += delta;
+    }
+    ++m_startLinesRevision;
+}
+
+int TextBuffer::blockStartLine(int index) const
+{
+    // only allow valid index
+    Q_ASSERT(index >= 0);
+    ensureBlockIndex();
+    Q_ASSERT(index < m_blockLinesTree.size());
+
+    // sum up the line counts of all blocks in front
+    int startLine = 0;
+    for (int i = index; i > 0; i -= i & -i) {
+        startLine += m_blockLinesTree[i];
+    }
+    return startLine;
+}
+
+void TextBuffer::rebuildBlockIndex()
+{
+    invalidateBlockIndex(0);
+    updateBlockIndex();
+}
+
+void TextBuffer::invalidateBlockIndex(int firstStaleBlock)
+{
+    Q_ASSERT(firstStaleBlock >= 0);
+    if (m_firstStaleBlock < 0 || firstStaleBlock < m_firstStaleBlock) {
+        m_firstStaleBlock = firstStaleBlock;
+    }
 
-    // new start line for next block
-    TextBlock *block = m_blocks.at(startBlock);
-    int newStartLine = block->startLine() + block->lines();
+    // start lines might have changed, too
+    ++m_startLinesRevision;
+}
 
-    // fixup block
-    for (int index = startBlock + 1; index < m_blocks.size(); ++index) {
-        // set new start line
-        block = m_blocks.at(index);
-        block->setStartLine(newStartLine);
+void TextBuffer::updateBlockIndex()
+{
+    const int blocks = m_blocks.size();
+    const int first = qMin(m_firstStaleBlock, blocks);
+    m_firstStaleBlock = -1;
 
-        // calculate next start line
-        newStartLine += block->lines();
+    /**
+     * the nodes up to the first stale block only sum up blocks in front of it, they stay valid
+     * renumber the blocks behind and collect their start lines
+     */
+    m_blockLinesTree.resize(blocks + 1);
+    QVector<int> startLines(blocks - first + 1);
+    startLines[0] = blockStartLine(first);
+    for (int i = first; i < blocks; ++i) {
+        TextBlock *block = m_blocks.at(i);
+        block->setBlockIndex(i);
+        startLines[i - first + 1] = startLines[i - first] + block->lines();
+    }
+
+    /**
+     * each stale node sums up the blocks in (j - lowbit(j), j], the difference of two start lines
+     * only O(log n) nodes reach in front of the first stale block
+     */
+    for (int j = first + 1; j <= blocks; ++j) {
+        const int from = j - (j & -j);
+        m_blockLinesTree[j] = startLines[j - first] - ((from >= first) ? startLines[from - first] : blockStartLine(from));
     }
 }
 
@@ -511,11 +1061,24 @@ void TextBuffer::balanceBlock(int index)
         TextBlock *newBlock = blockToBalance->splitBlock(halfSize);
         Q_ASSERT(newBlock);
         m_blocks.insert(m_blocks.begin() + index + 1, newBlock);
+        invalidateBlockIndex(index);
 
         // split is done
         return;
     }
 
+    // too many chars, split it in halves of about the same chars, they might need another split
+    if (blockToBalance->chars() >= 2 * m_blockChars && blockToBalance->lines() > 1) {
+        TextBlock *newBlock = blockToBalance->splitBlock(blockToBalance->middleLineByChars());
+        m_blocks.insert(m_blocks.begin() + index + 1, newBlock);
+        invalidateBlockIndex(index);
+
+        // back to front, the index of the first half stays valid
+        balanceBlock(index + 1);
+        balanceBlock(index);
+        return;
+    }
+
     // second case: possibly too small block
 
     // if only one block, no chance to unite
@@ -525,12 +1088,15 @@ void TextBuffer::balanceBlock(int index)
     }
 
     // block still large enough, do nothing
-    if (2 * blockToBalance->lines() > m_blockSize) {
+    if (2 * blockToBalance->lines() > m_blockSize || 2 * blockToBalance->chars() > m_blockChars) {
         return;
     }
 
-    // unite small block with predecessor
+    // unite small block with predecessor, if that doesn't result in too many chars
     TextBlock *targetBlock = m_blocks.at(index - 1);
+    if (targetBlock->chars() + blockToBalance->chars() >= 2 * m_blockChars) {
+        return;
+    }
 
     // merge block
     blockToBalance->mergeBlock(targetBlock);
@@ -538,6 +1104,22 @@ void TextBuffer::balanceBlock(int index)
     // delete old block
     delete blockToBalance;
     m_blocks.erase(m_blocks.begin() + index);
+    invalidateBlockIndex(index - 1);
+}
+
+void TextBuffer::adaptBlockChars()
+{
+    qint64 chars = 0;
+    foreach (TextBlock *block, m_blocks) {
+        chars += block->chars();
+    }
+    m_blockChars = blockCharsForAverage(chars, m_lines, m_blockSize);
+}
+
+int TextBuffer::blockCharsForAverage(qint64 chars, qint64 lines, int blockSize)
+{
+    const qint64 averageLineLength = (lines > 0) ? (chars / lines) : 0;
+    return blockSize * int(qBound(minimalBlockLineLength, averageLineLength, maximalBlockLineLength));
 }
 
 void TextBuffer::debugPrint(const QString &title) const
@@ -564,6 +1146,15 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
      */
     clear();
 
+    /**
+     * large files are memory mapped, lines are decoded on first access
+     * falls back to normal loading if the file or encoding doesn't allow that
+     */
+    if ((m_largeFileLimit > 0) && (QFileInfo(filename).size() >= m_largeFileLimit) && loadMapped(filename, tooLongLinesWrapped, longestLineLoaded)) {
+        encodingErrors = false;
+        return true;
+    }
+
     /**
      * construct the file loader for the given file, with correct prober type
      */
@@ -592,6 +1183,7 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
          */
         m_blocks.last()->clearLines();
         m_lines = 0;
+        qint64 loadedChars = 0;
 
         /**
          * try to open file, with given encoding
@@ -610,6 +1202,7 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
             // create one dummy textline, in any case
             m_blocks.last()->appendLine(QString());
             m_lines++;
+            rebuildBlockIndex();
             return false;
         }
 
@@ -640,53 +1233,31 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
                 /**
                  * calculate line length
                  */
-                int lineLength = length;
-                if ((m_lineLengthLimit > 0) && (lineLength > m_lineLengthLimit)) {
-                    /**
-                     * search for place to wrap
-                     */
-                    int spacePosition = m_lineLengthLimit - 1;
-                    for (int testPosition = m_lineLengthLimit - 1; (testPosition >= 0) && (testPosition >= (m_lineLengthLimit - (m_lineLengthLimit / 10))); --testPosition) {
-                        /**
-                         * wrap place found?
-                         */
-                        if (unicodeData[testPosition].isSpace() || unicodeData[testPosition].isPunct()) {
-                            spacePosition = testPosition;
-                            break;
-                        }
-                    }
-
-                    /**
-                     * wrap the line
-                     */
-                    lineLength = spacePosition + 1;
-                    length -= lineLength;
+                const int lineLength = wrappedLineLength(unicodeData, length, m_lineLengthLimit);
+                if (lineLength < length) {
                     tooLongLinesWrapped = true;
-                } else {
-                    /**
-                     * be done after this round
-                     */
-                    length = 0;
                 }
+                length -= lineLength;
 
                 /**
-                 * construct new text line with content from file
-                 * move data pointer
-                 */
-                QString textLine(unicodeData, lineLength);
-                unicodeData += lineLength;
-
-                /**
-                 * ensure blocks aren't too large
+                 * ensure blocks aren't too large, by lines or chars, relative to the lines loaded so far
                  */
-                if (m_blocks.last()->lines() >= m_blockSize) {
+                if (m_blocks.last()->lines() >= m_blockSize || m_blocks.last()->chars() >= blockCharsForAverage(loadedChars, m_lines, m_blockSize)) {
+                    m_blocks.last()->squeeze();
                     m_blocks.append(new TextBlock(this, m_blocks.last()->startLine() + m_blocks.last()->lines()));
                 }
 
                 /**
-                 * append line to last block
+                 * append line with content from file to last block
+                 * move data pointer
                  */
-                m_blocks.last()->appendLine(textLine);
+                if (m_compactStorage) {
+                    m_blocks.last()->appendCompactLine(unicodeData, lineLength);
+                } else {
+                    m_blocks.last()->appendLine(QString(unicodeData, lineLength));
+                }
+                unicodeData += lineLength;
+                loadedChars += lineLength;
                 ++m_lines;
             } while (length > 0);
         }
@@ -699,6 +1270,11 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
         }
     }
 
+    // index the new blocks
+    m_blocks.last()->squeeze();
+    rebuildBlockIndex();
+    adaptBlockChars();
+
     // save checksum of file on disk
     setDigest(file.digest());
 
@@ -734,154 +1310,397 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
     return true;
 }
 
-const QByteArray &TextBuffer::digest() const
+int TextBuffer::wrappedLineLength(const QChar *unicodeData, int length, int lineLengthLimit)
 {
-    return m_digest;
+    /**
+     * short enough, take the whole line
+     */
+    if ((lineLengthLimit <= 0) || (length <= lineLengthLimit)) {
+        return length;
+    }
+
+    /**
+     * search for place to wrap
+     */
+    int spacePosition = lineLengthLimit - 1;
+    for (int testPosition = lineLengthLimit - 1; (testPosition >= 0) && (testPosition >= (lineLengthLimit - (lineLengthLimit / 10))); --testPosition) {
+        /**
+         * wrap place found?
+         */
+        if (unicodeData[testPosition].isSpace() || unicodeData[testPosition].isPunct()) {
+            spacePosition = testPosition;
+            break;
+        }
+    }
+
+    return spacePosition + 1;
 }
 
-void TextBuffer::setDigest(const QByteArray &checksum)
+void TextBuffer::startLoading(const QString &filename, bool enforceTextCodec)
 {
-    m_digest = checksum;
+    // fallback codec must exist
+    Q_ASSERT(m_fallbackTextCodec);
+
+    // codec must be set!
+    Q_ASSERT(m_textCodec);
+
+    /**
+     * first: clear buffer in any case, will stop running loading, too
+     */
+    clear();
+
+    /**
+     * start thread, it will hand out blocks as they are ready
+     */
+    m_loadThread = new TextLoadThread(this, filename, enforceTextCodec);
+    m_loadedLines = 0;
+    connect(m_loadThread, SIGNAL(blocksAvailable()), this, SLOT(slotBlocksLoaded()), Qt::QueuedConnection);
+    connect(m_loadThread, SIGNAL(finished()), this, SLOT(slotLoadingThreadFinished()), Qt::QueuedConnection);
+    m_loadThread->start();
+
+    /**
+     * wait for the first lines, we want to show something at once
+     */
+    m_loadThread->waitForBlocks();
+    spliceLoadedBlocks();
 }
 
-void TextBuffer::setTextCodec(QTextCodec *codec)
+void TextBuffer::cancelLoading()
 {
-    m_textCodec = codec;
+    if (!m_loadThread) {
+        return;
+    }
 
-    // enforce bom for some encodings
-    int mib = m_textCodec->mibEnum();
-    if (mib == 1013 || mib == 1014 || mib == 1015) { // utf16
-        setGenerateByteOrderMark(true);
+    m_loadThread->cancel();
+    finishLoading(true);
+}
+
+void TextBuffer::slotBlocksLoaded()
+{
+    // ignore notifications of threads already finished
+    if (!m_loadThread || sender() != m_loadThread) {
+        return;
     }
-    if (mib == 1017 || mib == 1018 || mib == 1019) { // utf32
-        setGenerateByteOrderMark(true);
+
+    spliceLoadedBlocks();
+}
+
+void TextBuffer::slotLoadingThreadFinished()
+{
+    // ignore notifications of threads already finished
+    if (!m_loadThread || sender() != m_loadThread) {
+        return;
     }
+
+    finishLoading(true);
 }
 
-bool TextBuffer::save(const QString &filename)
+void TextBuffer::spliceLoadedBlocks()
 {
-    // codec must be set!
-    Q_ASSERT(m_textCodec);
+    Q_ASSERT(m_loadThread);
 
-#ifndef Q_OS_WIN
-    const bool newFile = !QFile::exists(filename);
-#endif
+    // no editing while loading, see startEditing()
+    Q_ASSERT(m_editingTransactions == 0 || m_editingRefused);
+
+    bool reset = false;
+    QVector<TextBlock *> blocks = m_loadThread->takeBlocks(reset);
 
     /**
-     * use QSaveFile for save write + rename
+     * thread restarted with another codec, throw away the lines we have
+     * clear() must not stop the thread here
      */
-    QSaveFile saveFile(filename);
-    saveFile.setDirectWriteFallback(true);
+    const bool replaced = reset && m_loadedLines > 0;
+    if (replaced) {
+        TextLoadThread *loadThread = m_loadThread;
+        m_loadThread = 0;
+        clear();
+        m_loadThread = loadThread;
+        m_loadedLines = 0;
+    }
 
-    if (!saveFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        return false;
+    if (blocks.isEmpty()) {
+        if (replaced) {
+            emit linesLoaded(0);
+        }
+        return;
     }
 
+    // the first blocks replace the empty line of the cleared buffer
+    const int firstChangedLine = (m_loadedLines == 0) ? 0 : m_lines;
+
+    foreach (TextBlock *block, blocks) {
+        if (m_loadedLines == 0) {
+            /**
+             * first block replaces the empty line of our first block
+             * cursors there stay valid, they are all at 0,0
+             */
+            Q_ASSERT(m_blocks.size() == 1 && m_lines == 1);
+            m_blocks.first()->clearLines();
+            block->mergeBlock(m_blocks.first());
+            delete block;
+            m_lines = m_blocks.first()->lines();
+        } else {
+            m_lines += block->lines();
+            m_blocks.append(block);
+        }
+
+        m_loadedLines = m_lines;
+    }
+
+    // index the new blocks
+    rebuildBlockIndex();
+
+    emit linesLoaded(firstChangedLine);
+    emit loadingProgress(m_loadThread->progress());
+}
+
+void TextBuffer::finishLoading(bool emitFinished)
+{
+    Q_ASSERT(m_loadThread);
+
     /**
-     * construct correct filter device and try to open
+     * wait for the thread, then take the remaining blocks and results
      */
-    KCompressionDevice::CompressionType type = KFilterDev::compressionTypeForMimeType(m_mimeTypeForFilterDev);
-    KCompressionDevice file(&saveFile, false, type);
+    m_loadThread->wait();
+    const bool canceled = m_loadThread->isCanceled();
+    if (emitFinished) {
+        spliceLoadedBlocks();
+    }
+    const TextLoadThread::Result result = m_loadThread->result();
+    const QString filename = m_loadThread->fileName();
+    delete m_loadThread;
+    m_loadThread = 0;
 
-    if (!file.open(QIODevice::WriteOnly)) {
+    if (!emitFinished) {
+        return;
+    }
+
+    if (result.success) {
+        // remember used codec, might change bom setting
+        if (!result.encodingErrors) {
+            setTextCodec(result.textCodec);
+        }
+
+        // save checksum of file on disk
+        setDigest(result.digest);
+
+        // remember if BOM was found
+        if (result.byteOrderMarkFound) {
+            setGenerateByteOrderMark(true);
+        }
+
+        // remember eol mode, if any found in file
+        if (result.eol != eolUnknown) {
+            setEndOfLineMode(result.eol);
+        }
+
+        // remember mime type for filter device
+        m_mimeTypeForFilterDev = result.mimeTypeForFilterDev;
+    }
+
+    // keep blocks balanced relative to the lines we got
+    adaptBlockChars();
+
+    BUFFER_DEBUG << "Loading in background finished, lines" << m_lines << "success" << result.success << "canceled" << canceled;
+
+    /**
+     * canceled loading keeps the lines we got so far
+     */
+    const bool success = result.success || (canceled && m_loadedLines > 0);
+    if (result.success) {
+        emit loaded(filename, result.encodingErrors);
+    }
+    emit loadingFinished(success, result.encodingErrors, result.tooLongLinesWrapped, result.longestLineLoaded, canceled);
+}
+
+bool TextBuffer::loadMapped(const QString &filename, bool &tooLongLinesWrapped, int &longestLineLoaded)
+{
+    // buffer must be cleared
+    Q_ASSERT(m_blocks.size() == 1);
+    Q_ASSERT(m_lines == 1);
+
+    /**
+     * compressed files must be decompressed completely, no lazy loading possible
+     */
+    const QString mimeType = QMimeDatabase().mimeTypeForFile(filename).name();
+    if (KFilterDev::compressionTypeForMimeType(mimeType) != KCompressionDevice::None) {
         return false;
     }
 
     /**
-     * construct stream + disable Unicode headers
+     * map the file and build the index of block starts
      */
-    QTextStream stream(&file);
-    stream.setCodec(QTextCodec::codecForName("UTF-16"));
+    if (!TextMappedFile::codecSupported(m_textCodec)) {
+        return false;
+    }
 
-    // set the correct codec
-    stream.setCodec(m_textCodec);
+    QSharedPointer<TextMappedFile> file(new TextMappedFile(filename));
+    QVector<qint64> blockStarts;
+    int lines = 0;
+    if (!file->open(m_textCodec, m_lineLengthLimit) || !file->index(m_blockSize, blockStarts, lines)) {
+        BUFFER_DEBUG << "Failed to map file" << filename << "fall back to normal loading";
+        return false;
+    }
 
-    // generate byte order mark?
-    stream.setGenerateByteOrderMark(generateByteOrderMark());
+    /**
+     * replace the empty line of the first block and create the other blocks
+     */
+    m_blocks.last()->clearLines();
+    m_blocks.reserve(blockStarts.size());
+    m_lines = 0;
+    for (int b = 0; b < blockStarts.size(); ++b) {
+        if (b > 0) {
+            m_blocks.append(new TextBlock(this, m_lines));
+        }
 
-    // our loved eol string ;)
-    QString eol = QLatin1String("\n"); //m_doc->config()->eolString ();
-    if (endOfLineMode() == eolDos) {
-        eol = QLatin1String("\r\n");
-    } else if (endOfLineMode() == eolMac) {
-        eol = QLatin1String("\r");
+        const int linesOfBlock = qMin(m_blockSize, lines - m_lines);
+        const qint64 blockEnd = (b + 1 < blockStarts.size()) ? blockStarts.at(b + 1) : file->size();
+        m_blocks.last()->setMappedLines(file, blockStarts.at(b), blockEnd, linesOfBlock);
+        m_lines += linesOfBlock;
     }
+    Q_ASSERT(m_lines == lines);
+    rebuildBlockIndex();
 
-    // just dump the lines out ;)
-    for (int i = 0; i < m_lines; ++i) {
-        // get line to save
-        Kate::TextLine textline = line(i);
+    // the blocks are not decoded, the bytes of the file are a good guess for the chars
+    m_blockChars = blockCharsForAverage(file->size(), m_lines, m_blockSize);
 
-        stream << textline->text();
+    // the digest was computed while indexing, no need to read the file again
+    setDigest(file->digest());
 
-        // append correct end of line string
-        if ((i + 1) < m_lines) {
-            stream << eol;
-        }
+    tooLongLinesWrapped = file->tooLongLinesWrapped();
+    longestLineLoaded = qMax(longestLineLoaded, file->longestLine());
+
+    // remember if BOM was found
+    if (file->byteOrderMarkFound()) {
+        setGenerateByteOrderMark(true);
     }
 
-    if (m_newLineAtEof) {
-        Q_ASSERT(m_lines > 0); // see .h file
-        const Kate::TextLine lastLine = line(m_lines - 1);
-        const int firstChar = lastLine->firstChar();
-        if (firstChar > -1 || lastLine->length() > 0) {
-            stream << eol;
-        }
+    // remember eol mode, if any found in file
+    if (file->eol() != eolUnknown) {
+        setEndOfLineMode(file->eol());
     }
 
-    // flush stream
-    stream.flush();
+    // no filter device used
+    m_mimeTypeForFilterDev = mimeType;
 
-    // close and delete file
-    file.close();
+    BUFFER_DEBUG << "Mapped file" << filename << "with codec" << m_textCodec->name() << "lines" << m_lines << "blocks" << m_blocks.size();
 
-    // flush file
-    if (!saveFile.flush()) {
-        return false;
+    // emit success
+    emit loaded(filename, false);
+    return true;
+}
+
+void TextBuffer::mappedFileReadFailed()
+{
+    if (m_fileReadFailed) {
+        return;
     }
 
-#ifndef Q_OS_WIN
-    // ensure that the file is written to disk
-#ifdef HAVE_FDATASYNC
-    fdatasync(saveFile.handle());
-#else
-    fsync(saveFile.handle());
-#endif
-#endif
+    BUFFER_DEBUG << "Failed to read lines of mapped file, it changed on disk";
+    m_fileReadFailed = true;
+    emit fileReadError();
+}
+
+const QByteArray &TextBuffer::digest() const
+{
+    return m_digest;
+}
+
+void TextBuffer::setDigest(const QByteArray &checksum)
+{
+    m_digest = checksum;
+}
+
+void TextBuffer::setTextCodec(QTextCodec *codec)
+{
+    m_textCodec = codec;
+
+    // enforce bom for some encodings
+    int mib = m_textCodec->mibEnum();
+    if (mib == 1013 || mib == 1014 || mib == 1015) { // utf16
+        setGenerateByteOrderMark(true);
+    }
+    if (mib == 1017 || mib == 1018 || mib == 1019) { // utf32
+        setGenerateByteOrderMark(true);
+    }
+}
+
+bool TextBuffer::save(const QString &filename, QByteArray *digest)
+{
+    // codec must be set!
+    Q_ASSERT(m_textCodec);
+
+    /**
+     * same pipeline as for saving in the background, just on this thread
+     */
+    TextSaveThread saveThread(*this, filename);
+    saveThread.write();
+    if (digest) {
+        *digest = saveThread.result().digest;
+    }
+    return finishSaving(saveThread);
+}
 
-    // did save work?
-    // only finalize if stream status == OK
-    bool ok = (stream.status() == QTextStream::Ok) && saveFile.commit();
+bool TextBuffer::startSaving(const QString &filename)
+{
+    // codec must be set!
+    Q_ASSERT(m_textCodec);
 
-    // remember this revision as last saved if we had success!
-    if (ok) {
-        m_history.setLastSavedRevision();
+    // only one save at once
+    if (m_saveThread) {
+        return false;
     }
 
-#ifndef Q_OS_WIN
-    if (ok && newFile) { // QTemporaryFile sets permissions to 0600, so fixing this
-        const mode_t mask = umask(0);
-        umask(mask);
+    /**
+     * the thread saves a snapshot, editing can go on meanwhile
+     */
+    m_saveThread = new TextSaveThread(*this, filename);
+    connect(m_saveThread, SIGNAL(finished()), this, SLOT(slotSavingThreadFinished()), Qt::QueuedConnection);
+    m_saveThread->start();
+    return true;
+}
 
-        const mode_t fileMode = 0666 & ~mask;
-        chmod(QFile::encodeName(filename).constData(), fileMode);
+void TextBuffer::slotSavingThreadFinished()
+{
+    // ignore notifications of threads already finished
+    if (!m_saveThread || sender() != m_saveThread) {
+        return;
     }
-#endif
+
+    TextSaveThread *saveThread = m_saveThread;
+    m_saveThread = 0;
+    saveThread->wait();
+    const bool ok = finishSaving(*saveThread);
+    const QString filename = saveThread->fileName();
+    const QByteArray digest = saveThread->result().digest;
+    delete saveThread;
+
+    emit savingFinished(filename, ok, digest);
+}
+
+bool TextBuffer::finishSaving(const TextSaveThread &saveThread)
+{
+    const bool ok = saveThread.result().success;
 
     // report CODEC + ERRORS
-    BUFFER_DEBUG << "Saved file " << filename << "with codec" << m_textCodec->name() << (ok ? "without" : "with") << "errors";
+    BUFFER_DEBUG << "Saved file " << saveThread.fileName() << "with codec" << m_textCodec->name() << (ok ? "without" : "with") << "errors";
 
-    if (ok) {
-        markModifiedLinesAsSaved();
+    if (!ok) {
+        return false;
     }
 
-    // emit signal on success
-    if (ok) {
-        emit saved(filename);
+    /**
+     * remember the saved revision
+     * lines are only flagged as saved if nothing was edited while saving, else we can't tell which are
+     */
+    m_history.setLastSavedRevision(saveThread.revision());
+    if (saveThread.revision() == m_revision) {
+        markModifiedLinesAsSaved();
     }
 
-    // return success or not
-    return ok;
+    // emit signal on success
+    emit saved(saveThread.fileName());
+    return true;
 }
 
 void TextBuffer::notifyAboutRangeChange(KTextEditor::View *view, int startLine, int endLine, bool rangeWithAttribute)
@@ -923,35 +1742,33 @@ QList<TextRange *> TextBuffer::rangesForLine(int line, KTextEditor::View *view,
 
     // get the ranges of the right block
     QList<TextRange *> rightRanges;
-    foreach (const QSet<TextRange *> &ranges, m_blocks.at(blockIndex)->rangesForLine(line)) {
-        foreach (TextRange *const range, ranges) {
-            /**
-            * we want only ranges with attributes, but this one has none
-            */
-            if (rangesWithAttributeOnly && !range->hasAttribute()) {
-                continue;
-            }
+    foreach (TextRange *const range, m_blocks.at(blockIndex)->rangesForLine(line)) {
+        /**
+        * we want only ranges with attributes, but this one has none
+        */
+        if (rangesWithAttributeOnly && !range->hasAttribute()) {
+            continue;
+        }
 
-            /**
-            * we want ranges for no view, but this one's attribute is only valid for views
-            */
-            if (!view && range->attributeOnlyForViews()) {
-                continue;
-            }
+        /**
+        * we want ranges for no view, but this one's attribute is only valid for views
+        */
+        if (!view && range->attributeOnlyForViews()) {
+            continue;
+        }
 
-            /**
-            * the range's attribute is not valid for this view
-            */
-            if (range->view() && range->view() != view) {
-                continue;
-            }
+        /**
+        * the range's attribute is not valid for this view
+        */
+        if (range->view() && range->view() != view) {
+            continue;
+        }
 
-            /**
-            * if line is in the range, ok
-            */
-            if (range->startInternal().lineInternal() <= line && line <= range->endInternal().lineInternal()) {
-                rightRanges.append(range);
-            }
+        /**
+        * if line is in the range, ok
+        */
+        if (range->startInternal().lineInternal() <= line && line <= range->endInternal().lineInternal()) {
+            rightRanges.append(range);
         }
     }
 
@@ -23,6 +23,7 @@
 
 #include <QObject>
 #include <QString>
+#include <QStringList>
 #include <QVector>
 #include <QSet>
 #include <QTextCodec>
@@ -35,6 +36,7 @@
 #include "katetextcursor.h"
 #include "katetextrange.h"
 #include "katetexthistory.h"
+#include "katetextbuffersnapshot.h"
 
 // encoding prober
 #include <KEncodingProber>
@@ -42,6 +44,9 @@
 namespace Kate
 {
 
+class TextLoadThread;
+class TextSaveThread;
+
 /**
  * Class representing a text buffer.
  * The interface is line based, internally the text will be stored in blocks of text lines.
@@ -51,6 +56,9 @@ class KTEXTEDITOR_EXPORT TextBuffer : public QObject
     friend class TextCursor;
     friend class TextRange;
     friend class TextBlock;
+    friend class TextLoadThread;
+    friend class TextSaveThread;
+    friend class TextBufferSnapshot;
 
     Q_OBJECT
 
@@ -86,6 +94,23 @@ public:
      */
     virtual void clear();
 
+    /**
+     * Replace the content of this buffer by the content of another buffer.
+     * The lines are shared copy-on-write, together with their highlighting: a block only copies
+     * its lines when either buffer modifies them, see detachLines(). The buffer is cleared before,
+     * like load() does, the properties of the loaded file, like codec and eol mode, are taken over.
+     * @param source buffer to clone, must not load in the background
+     */
+    void cloneFrom(const TextBuffer &source);
+
+    /**
+     * Copy the lines shared with another buffer, see cloneFrom(), before they get modified
+     * by others than the editing functions of the buffer, like the highlighting.
+     * @param startLine first line that will be modified
+     * @param endLine last line that will be modified
+     */
+    void detachLines(int startLine, int endLine);
+
     /**
      * Set encoding prober type for this buffer to use for load.
      * @param proberType prober type to use for encoding
@@ -189,6 +214,9 @@ public:
 
     /**
      * Set line length limit
+     * Longer lines are wrapped on load, see tooLongLinesWrapped(). Each line keeps its text in
+     * one QString, TextLineData::text() hands out a reference to it, so edits of a giant line
+     * copy the whole line.
      * @param lineLengthLimit new line length limit
      */
     void setLineLengthLimit(int lineLengthLimit)
@@ -196,6 +224,38 @@ public:
         m_lineLengthLimit = lineLengthLimit;
     }
 
+    /**
+     * Set size limit for large files.
+     * Files at least that large are memory mapped on load and their lines are only
+     * decoded on first access, if their encoding allows that.
+     * @param largeFileLimit new limit in bytes, <= 0 disables the lazy loading
+     */
+    void setLargeFileLimit(qint64 largeFileLimit)
+    {
+        m_largeFileLimit = largeFileLimit;
+    }
+
+    /**
+     * Select the storage for loaded lines.
+     * With compact storage the lines of a block are kept in one string with an index of the
+     * line starts, a line only gets its own TextLine on first access, see lineView().
+     * Without it, each line is stored as TextLine at once.
+     * @param compactStorage use compact storage for lines loaded from now on?
+     */
+    void setCompactStorage(bool compactStorage)
+    {
+        m_compactStorage = compactStorage;
+    }
+
+    /**
+     * Is compact storage used for loaded lines?
+     * @return compact storage used?
+     */
+    bool compactStorage() const
+    {
+        return m_compactStorage;
+    }
+
     /**
      * Load the given file. This will first clear the buffer and then load the file.
      * Even on error during loading the buffer will still be cleared.
@@ -210,14 +270,71 @@ public:
      */
     virtual bool load(const QString &filename, bool &encodingErrors, bool &tooLongLinesWrapped, int &longestLineLoaded, bool enforceTextCodec);
 
+    /**
+     * Load the given file in a background thread. This will first clear the buffer.
+     * Returns after the first lines are available, the remaining ones are added while the
+     * event loop runs, loadingFinished() is emitted at the end.
+     * The buffer must not be edited while loading, use cancelLoading() to stop it.
+     * Before calling this, setTextCodec must have been used to set codec!
+     * @param filename file to open
+     * @param enforceTextCodec enforce to use only the set text codec
+     */
+    void startLoading(const QString &filename, bool enforceTextCodec);
+
+    /**
+     * Is a file loaded in the background at the moment?
+     * @return loading running?
+     */
+    bool isLoading() const
+    {
+        return m_loadThread;
+    }
+
+    /**
+     * Cancel loading in the background, keeps the lines loaded so far.
+     * Will emit loadingFinished().
+     */
+    void cancelLoading();
+
     /**
      * Save the current buffer content to the given file.
      * Before calling this, setTextCodec and setFallbackTextCodec must have been used to set codec!
      * @param filename file to save
+     * @param digest if not 0, will get the git compatible sha1 digest of the written file,
+     *               computed while writing, empty for compressed files
      * @return success
      * Virtual, can be overwritten.
      */
-    virtual bool save(const QString &filename);
+    virtual bool save(const QString &filename, QByteArray *digest = 0);
+
+    /**
+     * Save the current buffer content to the given file in a background thread.
+     * The thread saves a snapshot of the buffer, the buffer may be edited meanwhile,
+     * savingFinished() is emitted at the end. Same settings as for save() are used.
+     * @param filename file to save
+     * @return saving started? false if another saving is still running
+     */
+    bool startSaving(const QString &filename);
+
+    /**
+     * Is the buffer saved in the background at the moment?
+     * @return saving running?
+     */
+    bool isSaving() const
+    {
+        return m_saveThread;
+    }
+
+    /**
+     * Did decoding lines of a memory mapped file fail, e.g. as another program truncated it?
+     * The lines of the affected blocks are empty then, saving is refused as it would destroy
+     * the content of the file. Reset by clear().
+     * @return reading the file failed?
+     */
+    bool fileReadFailed() const
+    {
+        return m_fileReadFailed;
+    }
 
     /**
      * Lines currently stored in this buffer.
@@ -246,28 +363,176 @@ public:
      */
     TextLine line(int line) const;
 
+    /**
+     * Retrieve the text of a line as view.
+     * Unlike line() this doesn't create a TextLine for lines in compact storage.
+     * The view is only valid until the buffer is modified.
+     * @param line wanted line number
+     * @return view on text of the line
+     */
+    QStringRef lineView(int line) const;
+
+    /**
+     * Is the given line still in compact storage, see setCompactStorage()?
+     * Accessing lines keeps them there, they only leave it once their block gets modified.
+     * @param line wanted line number
+     * @return line in compact storage?
+     */
+    bool isLineCompact(int line) const;
+
+    /**
+     * Visit the text of the lines from startLine to endLine, both inclusive.
+     * Unlike line() this neither creates a TextLine for lines in compact storage nor touches
+     * the reference counts of the lines, it is meant for loops over many lines.
+     * The visitor is called as visitor(line, text) with a view on the text of the line,
+     * only valid until the buffer is modified, and returns false to stop the visiting.
+     * @param startLine first line to visit
+     * @param endLine last line to visit
+     * @param visitor visitor to call for each line, in line order
+     */
+    template<typename Visitor>
+    void visitLines(int startLine, int endLine, Visitor visitor) const
+    {
+        if (startLine > endLine) {
+            return;
+        }
+
+        // get block, this will assert on invalid line, walk the blocks from there
+        int blockIndex = blockForLine(startLine);
+        int from = startLine - m_blocks.at(blockIndex)->startLine();
+        for (int line = startLine; line <= endLine; ++blockIndex) {
+            const TextBlock *block = m_blocks.at(blockIndex);
+            const int to = qMin(block->lines(), from + endLine - line + 1);
+            const int blockStartLine = line - from;
+            auto lineVisitor = [&visitor, blockStartLine](int index, const QStringRef & text) {
+                return visitor(blockStartLine + index, text);
+            };
+            if (!block->visitLines(from, to, lineVisitor)) {
+                return;
+            }
+
+            line += to - from;
+            from = 0;
+        }
+    }
+
+    /**
+     * Visit the text of the lines from startLine to endLine, both inclusive, a block at a time.
+     * The visitor is called as visitor(firstLine, lines) with the views on the text of the lines
+     * starting at line firstLine, see visitLines(), and returns false to stop the visiting.
+     * @param startLine first line to visit
+     * @param endLine last line to visit
+     * @param visitor visitor to call for each block, in line order
+     */
+    template<typename Visitor>
+    void visitBlocks(int startLine, int endLine, Visitor visitor) const
+    {
+        if (startLine > endLine) {
+            return;
+        }
+
+        // one vector for the views of all blocks, resize(0) keeps its memory
+        QVector<QStringRef> views;
+        auto collect = [&views](int, const QStringRef & text) {
+            views.append(text);
+            return true;
+        };
+
+        // get block, this will assert on invalid line, walk the blocks from there
+        int blockIndex = blockForLine(startLine);
+        int from = startLine - m_blocks.at(blockIndex)->startLine();
+        for (int line = startLine; line <= endLine; ++blockIndex) {
+            const TextBlock *block = m_blocks.at(blockIndex);
+            const int to = qMin(block->lines(), from + endLine - line + 1);
+            views.resize(0);
+            block->visitLines(from, to, collect);
+            if (!visitor(line, views)) {
+                return;
+            }
+
+            line += to - from;
+            from = 0;
+        }
+    }
+
     /**
      * Retrieve text of complete buffer.
      * @return text for this buffer, lines separated by '\n'
      */
     QString text() const;
 
+    /**
+     * Retrieve text of a range, like text() without concatenating line by line:
+     * the size of the text is computed first, the lines are copied directly into it.
+     * Columns behind the end of their line and lines behind the last one are ignored.
+     * @param range wanted range
+     * @return text of the range, lines separated by '\n'
+     */
+    QString text(const KTextEditor::Range &range) const;
+
+    /**
+     * Retrieve text of complete buffer, UTF-8 encoded.
+     * @return UTF-8 encoded text for this buffer, lines separated by '\n'
+     */
+    QByteArray utf8Text() const;
+
+    /**
+     * Retrieve text of a range, UTF-8 encoded, see text(range).
+     * The bytes are written directly, no QString is created in between.
+     * Unpaired surrogates are encoded as U+FFFD.
+     * @param range wanted range
+     * @return UTF-8 encoded text of the range, lines separated by '\n'
+     */
+    QByteArray utf8Text(const KTextEditor::Range &range) const;
+
+    /**
+     * Estimate the memory used by this buffer, for the memory accounting of the documents.
+     * Cheap: walks the blocks and lines once, no lines of large files get decoded for it.
+     * @param text bytes used for the text and the lines
+     * @param highlighting bytes used for the highlighting attributes of the lines
+     * @param history bytes used for the editing history
+     * @param movingRanges bytes used for the moving cursors and ranges
+     */
+    void memoryUsage(qint64 &text, qint64 &highlighting, qint64 &history, qint64 &movingRanges) const;
+
+    /**
+     * Take an immutable snapshot of the text of the buffer at the current revision.
+     * It may be read from any thread while the buffer is edited, see TextBufferSnapshot.
+     * @return snapshot of the buffer
+     */
+    TextBufferSnapshot snapshot() const
+    {
+        return TextBufferSnapshot(*this);
+    }
+
     /**
      * Start an editing transaction, the wrapLine/unwrapLine/insertText and removeText functions
      * are only allowed to be called inside a editing transaction.
      * Editing transactions can stack. The number of startEdit and endEdit calls must match.
-     * @return returns true, if no transaction was already running
+     * While a file is loaded in the background, all edits of the transaction are refused,
+     * see editingRefused().
+     * @return returns true, if no transaction was already running and editing is allowed
      * Virtual, can be overwritten.
      */
     virtual bool startEditing();
 
     /**
      * Finish an editing transaction. Only allowed to be called if editing transaction is started.
-     * @return returns true, if this finished last running transaction
+     * @return returns true, if this finished last running transaction and it was not refused
      * Virtual, can be overwritten.
      */
     virtual bool finishEditing();
 
+    /**
+     * Are the edits of the running transaction refused? Editing is not allowed while a file
+     * is loaded in the background, transactions started then change nothing, see isLoading().
+     * @return edits refused?
+     */
+    bool editingRefused() const
+    {
+        return m_editingRefused;
+    }
+
     /**
      * Query the number of editing transactions running atm.
      * @return number of running transactions
@@ -362,6 +627,28 @@ public:
      */
     virtual void removeText(const KTextEditor::Range &range);
 
+    /**
+     * Insert whole lines behind the given line.
+     * Same as wrapping the line at its end and inserting the text for each of the new lines,
+     * but the lines are spliced in as new blocks, with one history entry.
+     * The document signals of these single steps are emitted after all lines got inserted.
+     * @param line line to insert the new lines behind
+     * @param lines text of the new lines, without end of line chars
+     * Virtual, can be overwritten.
+     */
+    virtual void insertLines(int line, const QStringList &lines);
+
+    /**
+     * Remove whole lines, the lines behind move up. The last line can't be removed.
+     * Same as removing the text of each line and unwrapping the line behind,
+     * but complete blocks are removed at once, with one history entry.
+     * The document signals of these single steps are emitted after all lines got removed.
+     * @param from first line to remove
+     * @param to last line to remove, must not be the last line of the buffer
+     * Virtual, can be overwritten.
+     */
+    virtual void removeLines(int from, int to);
+
     /**
      * TextHistory of this buffer
      * @return text history for this buffer
@@ -385,12 +672,53 @@ Q_SIGNALS:
      */
     void loaded(const QString &filename, bool encodingErrors);
 
+    /**
+     * Loading in the background made progress, new lines were added at the end of the buffer.
+     * @param percent percentage of file loaded
+     */
+    void loadingProgress(int percent);
+
+    /**
+     * Loading in the background changed the lines from the given one on, see startLoading().
+     * The first loaded lines replace the empty line of the cleared buffer, later ones are
+     * appended. If the file is loaded again with another codec, all lines get replaced.
+     * Existing cursors and ranges stay valid, they are all in front of the changed lines
+     * or at the start of the buffer.
+     * @param line first changed line
+     */
+    void linesLoaded(int line);
+
+    /**
+     * Loading in the background is done, see startLoading().
+     * @param success the file got loaded, perhaps with encoding errors or only partially if canceled
+     * @param encodingErrors were there problems occurred while decoding the file?
+     * @param tooLongLinesWrapped were too long lines found and wrapped?
+     * @param longestLineLoaded the longest line in the file (before wrapping)
+     * @param canceled was loading canceled, the buffer then only holds the start of the file
+     */
+    void loadingFinished(bool success, bool encodingErrors, bool tooLongLinesWrapped, int longestLineLoaded, bool canceled);
+
     /**
      * Buffer saved successfully a file
      * @param filename file which was saved
      */
     void saved(const QString &filename);
 
+    /**
+     * Saving in the background is done, see startSaving().
+     * On success saved() was emitted before.
+     * @param filename file which was saved
+     * @param success the file got saved
+     * @param digest git compatible sha1 digest of the written file, empty for compressed files or on failure
+     */
+    void savingFinished(const QString &filename, bool success, const QByteArray &digest);
+
+    /**
+     * Decoding lines of a memory mapped file failed for the first time, see fileReadFailed().
+     * May be emitted while lines are accessed, connect queued to react with more than a flag.
+     */
+    void fileReadError();
+
     /**
      * Editing transaction has started.
      */
@@ -427,6 +755,113 @@ Q_SIGNALS:
      */
     void textRemoved(const KTextEditor::Range &range, const QString &text);
 
+    /**
+     * Lines got inserted, see insertLines().
+     * @param line line the lines got inserted behind
+     * @param lines text of the inserted lines
+     */
+    void linesInserted(int line, const QStringList &lines);
+
+    /**
+     * Lines got removed, see removeLines().
+     * @param line first removed line
+     * @param lines text of the removed lines
+     */
+    void linesRemoved(int line, const QStringList &lines);
+
+private:
+    /**
+     * Visit the text of the given range, see text(range).
+     * The visitor is called as visitor(text, newline) for each line of the range, with a view
+     * on the part of the line inside the range, newline tells if a '\n' follows.
+     * @param range range to visit
+     * @param visitor visitor to call for each line, in line order
+     */
+    template<typename Visitor>
+    void visitRange(const KTextEditor::Range &range, Visitor visitor) const
+    {
+        const int startLine = range.start().line();
+        const int endLine = qMin(range.end().line(), lines() - 1);
+        if (startLine < 0 || startLine > endLine) {
+            return;
+        }
+
+        visitLines(startLine, endLine, [&range, &visitor](int line, const QStringRef & text) {
+            int start = 0;
+            int end = text.size();
+            if (line == range.start().line()) {
+                start = qMin(range.start().column(), end);
+            }
+            if (line == range.end().line()) {
+                end = qBound(start, range.end().column(), end);
+            }
+
+            visitor(QStringRef(text.string(), text.position() + start, end - start), line < range.end().line());
+            return true;
+        });
+    }
+
+    /**
+     * Load the given file lazily, using a memory mapping. The buffer must be cleared before.
+     * Will only build the block index, lines are decoded by the blocks on first access.
+     * No encoding detection is done, the current text codec is used.
+     * @param filename file to open
+     * @param tooLongLinesWrapped were too long lines found and wrapped?
+     * @param longestLineLoaded the longest line in the file (in bytes)
+     * @return success, false if the file can't be loaded lazily, then normal loading must be used
+     */
+    bool loadMapped(const QString &filename, bool &tooLongLinesWrapped, int &longestLineLoaded);
+
+    /**
+     * Remember that a block failed to decode its lines from the memory mapped file.
+     */
+    void mappedFileReadFailed();
+
+    /**
+     * Compute length of the next part of a loaded line, too long lines are wrapped
+     * at a space or punctuation near the limit, if possible.
+     * @param unicodeData text of the line
+     * @param length length of the line
+     * @param lineLengthLimit line length limit, <= 0 means no limit
+     * @return length of the part to put into one text line
+     */
+    static int wrappedLineLength(const QChar *unicodeData, int length, int lineLengthLimit);
+
+    /**
+     * Add the blocks the loading thread produced until now.
+     */
+    void spliceLoadedBlocks();
+
+    /**
+     * Loading thread is done or canceled, add remaining blocks and take over the results.
+     * Deletes the thread.
+     * @param emitFinished emit loadingFinished()?
+     */
+    void finishLoading(bool emitFinished);
+
+    /**
+     * Saving is done, take over the results of the saving thread.
+     * @param saveThread thread that saved, must be finished
+     * @return success
+     */
+    bool finishSaving(const TextSaveThread &saveThread);
+
+private Q_SLOTS:
+    /**
+     * Loading thread has new blocks for us.
+     */
+    void slotBlocksLoaded();
+
+    /**
+     * Loading thread finished.
+     */
+    void slotLoadingThreadFinished();
+
+    /**
+     * Saving thread finished.
+     */
+    void slotSavingThreadFinished();
+
 private:
     /**
      * Find block containing given line.
@@ -436,17 +871,72 @@ private:
     int blockForLine(int line) const;
 
     /**
-     * Fix start lines of all blocks after the given one
-     * @param startBlock index of block from which we start to fix
+     * Fix start lines of all blocks after the given one.
+     * Only the block index is updated, in O(log n), the blocks compute their start line on access.
+     * @param startBlock index of block which line count changed
      */
     void fixStartLines(int startBlock);
 
     /**
-     * Balance the given block. Look if it is too small or too large.
+     * Compute start line of block with the given index with the block index.
+     * @param index block index, m_blocks.size() is allowed, too
+     * @return start line of the block
+     */
+    int blockStartLine(int index) const;
+
+    /**
+     * Renumber all blocks and rebuild the block index now.
+     * Used after all blocks got replaced, e.g. on load or clear.
+     */
+    void rebuildBlockIndex();
+
+    /**
+     * Mark the block index as stale from the given block on.
+     * Must be called after blocks got inserted or removed, e.g. by a split or merge.
+     * The index is updated on the next lookup, only for the stale blocks.
+     * @param firstStaleBlock first block which moved or changed its line count
+     */
+    void invalidateBlockIndex(int firstStaleBlock);
+
+    /**
+     * Update the block index, if blocks got inserted or removed since the last lookup.
+     */
+    void ensureBlockIndex() const
+    {
+        if (m_firstStaleBlock >= 0) {
+            const_cast<TextBuffer *>(this)->updateBlockIndex();
+        }
+    }
+
+    /**
+     * Renumber the stale blocks and recompute the index nodes covering them.
+     */
+    void updateBlockIndex();
+
+    /**
+     * Balance the given block. Look if it is too small or too large, by lines or chars.
      * @param index block to balance
      */
     void balanceBlock(int index);
 
+    /**
+     * Adapt the targeted number of chars per block to the average line length of the buffer.
+     * Used after loading, see blockCharsForAverage().
+     */
+    void adaptBlockChars();
+
+    /**
+     * Targeted number of chars per block for a file with the given number of chars and lines.
+     * Blocks of lines of about the average length are limited by their line count, only longer
+     * lines make blocks split by their chars. Minified files with huge lines still get blocks of
+     * bounded size, the average line length is clamped.
+     * @param chars chars of the file
+     * @param lines lines of the file
+     * @param blockSize line count of the blocks
+     * @return targeted chars per block
+     */
+    static int blockCharsForAverage(qint64 chars, qint64 lines, int blockSize);
+
     /**
      * Block for given index in block list.
      * @param index block index
@@ -547,11 +1037,33 @@ private:
      */
     const int m_blockSize;
 
+    /**
+     * targeted number of chars per block, blocks with twice the chars get split, see balanceBlock()
+     */
+    int m_blockChars;
+
     /**
      * List of blocks which contain the lines of this buffer
      */
     QVector<TextBlock *> m_blocks;
 
+    /**
+     * Block index: Fenwick tree over the line counts of the blocks, 1-based.
+     * Allows to compute the start line of a block and to find the block for a line in O(log n),
+     * a changed line count of a block needs only O(log n) updates.
+     */
+    QVector<int> m_blockLinesTree;
+
+    /**
+     * First block not yet renumbered in the block index, -1 if the index is up to date.
+     */
+    int m_firstStaleBlock;
+
+    /**
+     * Bumped each time start lines of blocks change, blocks cache their start line per revision.
+     */
+    uint m_startLinesRevision;
+
     /**
      * Number of lines in buffer
      */
@@ -644,6 +1156,41 @@ private:
      * Limit for line length, longer lines will be wrapped on load
      */
     int m_lineLengthLimit;
+
+    /**
+     * Files at least this large are loaded lazily, <= 0 disables this
+     */
+    qint64 m_largeFileLimit;
+
+    /**
+     * Store loaded lines compact?
+     */
+    bool m_compactStorage;
+
+    /**
+     * Thread loading a file in the background, if any
+     */
+    TextLoadThread *m_loadThread;
+
+    /**
+     * Lines added by the background loading so far
+     */
+    int m_loadedLines;
+
+    /**
+     * Thread saving a file in the background, if any
+     */
+    TextSaveThread *m_saveThread;
+
+    /**
+     * Did decoding lines of a memory mapped file fail?
+     */
+    bool m_fileReadFailed;
+
+    /**
+     * Are the edits of the running transaction refused, as it started while loading?
+     */
+    bool m_editingRefused;
 };
 
 }
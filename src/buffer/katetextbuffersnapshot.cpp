@@ -0,0 +1,185 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2016 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "katetextbuffersnapshot.h"
+#include "katetextbuffer.h"
+#include "katetextmappedfile.h"
+
+#include <QMutexLocker>
+
+namespace Kate
+{
+
+TextBufferSnapshot::TextBufferSnapshot()
+    : m_lines(0)
+    , m_revision(-1)
+    , m_readFailed(false)
+{
+}
+
+TextBufferSnapshot::TextBufferSnapshot(const TextBuffer &buffer)
+    : m_lines(0)
+    , m_revision(buffer.revision())
+    , m_readFailed(buffer.fileReadFailed())
+{
+    /**
+     * share the lines of all blocks, no line is decoded or copied here
+     */
+    m_blocks.reserve(buffer.m_blocks.size());
+    foreach (TextBlock *textBlock, buffer.m_blocks) {
+        Block block;
+        block.startLine = m_lines;
+        block.lines = textBlock->lines();
+
+        if (textBlock->m_mappedFile) {
+            block.mappedFile = textBlock->m_mappedFile;
+            block.mappedPosition = textBlock->m_mappedPosition;
+            block.mappedEnd = textBlock->m_mappedEnd;
+            if (!m_mappedLines) {
+                m_mappedLines = QSharedPointer<MappedLines>(new MappedLines());
+            }
+        } else if (textBlock->isCompact()) {
+            block.compactText = textBlock->m_compactText;
+            block.compactLineStarts = textBlock->m_compactLineStarts;
+        } else {
+            block.textLines = textBlock->m_lines;
+            block.linesShare = textBlock->shareLinesWithSnapshot();
+        }
+
+        m_lines += block.lines;
+        m_blocks.append(block);
+    }
+}
+
+int TextBufferSnapshot::blockForLine(int line) const
+{
+    Q_ASSERT(line >= 0 && line < m_lines);
+
+    int first = 0;
+    int last = m_blocks.size() - 1;
+    while (first < last) {
+        const int middle = (first + last + 1) / 2;
+        if (m_blocks.at(middle).startLine <= line) {
+            first = middle;
+        } else {
+            last = middle - 1;
+        }
+    }
+
+    return first;
+}
+
+QString TextBufferSnapshot::mappedLine(int block, int line) const
+{
+    QMutexLocker locker(&m_mappedLines->mutex);
+
+    // decode all lines of the block at once, the next lines are wanted, too
+    if (m_mappedLines->block != block) {
+        const Block &mappedBlock = m_blocks.at(block);
+        m_mappedLines->lines.clear();
+        mappedBlock.mappedFile->readLines(mappedBlock.mappedPosition, mappedBlock.mappedEnd, mappedBlock.lines, m_mappedLines->lines);
+        m_mappedLines->block = block;
+    }
+
+    return m_mappedLines->lines.at(line)->text();
+}
+
+QString TextBufferSnapshot::line(int line) const
+{
+    const int blockIndex = blockForLine(line);
+    const Block &block = m_blocks.at(blockIndex);
+    line -= block.startLine;
+
+    if (block.mappedFile) {
+        return mappedLine(blockIndex, line);
+    }
+
+    if (!block.compactLineStarts.isEmpty()) {
+        const int start = block.compactLineStarts.at(line);
+        return block.compactText.mid(start, block.compactLineStarts.at(line + 1) - start);
+    }
+
+    return block.textLines.at(line)->text();
+}
+
+int TextBufferSnapshot::lineLength(int line) const
+{
+    const int blockIndex = blockForLine(line);
+    const Block &block = m_blocks.at(blockIndex);
+    line -= block.startLine;
+
+    if (block.mappedFile) {
+        return mappedLine(blockIndex, line).size();
+    }
+
+    if (!block.compactLineStarts.isEmpty()) {
+        return block.compactLineStarts.at(line + 1) - block.compactLineStarts.at(line);
+    }
+
+    return block.textLines.at(line)->length();
+}
+
+QString TextBufferSnapshot::text() const
+{
+    if (m_lines == 0) {
+        return QString();
+    }
+
+    return text(KTextEditor::Range(0, 0, m_lines - 1, lineLength(m_lines - 1)));
+}
+
+QString TextBufferSnapshot::text(const KTextEditor::Range &range) const
+{
+    if (!range.isValid() || range.end().line() >= m_lines) {
+        return QString();
+    }
+
+    QString text;
+    for (int line = range.start().line(); line <= range.end().line(); ++line) {
+        // not first line, insert \n
+        if (line > range.start().line()) {
+            text.append(QLatin1Char('\n'));
+        }
+
+        const QString lineText = this->line(line);
+        const int start = (line == range.start().line()) ? qMin(range.start().column(), lineText.size()) : 0;
+        const int end = (line == range.end().line()) ? qMin(range.end().column(), lineText.size()) : lineText.size();
+        text.append(lineText.constData() + start, end - start);
+    }
+
+    return text;
+}
+
+bool TextBufferSnapshot::readFailed() const
+{
+    if (m_readFailed) {
+        return true;
+    }
+
+    foreach (const Block &block, m_blocks) {
+        if (block.mappedFile && block.mappedFile->readFailed()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}
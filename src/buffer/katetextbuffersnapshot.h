@@ -0,0 +1,212 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2016 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_TEXTBUFFERSNAPSHOT_H
+#define KATE_TEXTBUFFERSNAPSHOT_H
+
+#include <QString>
+#include <QVector>
+#include <QSharedPointer>
+#include <QMutex>
+
+#include <ktexteditor/range.h>
+#include <ktexteditor_export.h>
+#include "katetextline.h"
+
+namespace Kate
+{
+
+class TextBuffer;
+class TextMappedFile;
+struct TextLinesShare;
+
+/**
+ * Immutable snapshot of the text of a TextBuffer at one revision.
+ *
+ * Taking a snapshot is cheap, the snapshot shares the lines of each block with the buffer,
+ * no line is copied. Editing the buffer afterwards copies the changed lines only.
+ * The snapshot must be taken on the thread owning the buffer, after that it may be
+ * copied to and read from any thread while editing goes on, it never changes.
+ *
+ * To map positions computed on the snapshot back to the buffer, use
+ * TextHistory::transformRange() with revision() as from revision. Lock the revision
+ * on the thread owning the buffer as long as such results may come.
+ */
+class KTEXTEDITOR_EXPORT TextBufferSnapshot
+{
+public:
+    /**
+     * Construct an empty snapshot without any lines.
+     */
+    TextBufferSnapshot();
+
+    /**
+     * Take a snapshot of the given buffer, only on the thread owning the buffer.
+     * @param buffer buffer to take the snapshot of
+     */
+    explicit TextBufferSnapshot(const TextBuffer &buffer);
+
+    /**
+     * Revision of the buffer the snapshot was taken at.
+     * @return revision, -1 for an empty snapshot
+     */
+    qint64 revision() const
+    {
+        return m_revision;
+    }
+
+    /**
+     * Lines of the snapshot.
+     * @return number of lines
+     */
+    int lines() const
+    {
+        return m_lines;
+    }
+
+    /**
+     * Retrieve the text of a line.
+     * @param line wanted line number
+     * @return text of the line
+     */
+    QString line(int line) const;
+
+    /**
+     * Retrieve the length of a line.
+     * @param line wanted line number
+     * @return length of the line
+     */
+    int lineLength(int line) const;
+
+    /**
+     * Retrieve the complete text.
+     * @return text of the snapshot, lines separated by '\n'
+     */
+    QString text() const;
+
+    /**
+     * Retrieve the text of the given range, columns behind the end of their line are ignored.
+     * @param range wanted range
+     * @return text of the range, lines separated by '\n', empty for invalid ranges
+     */
+    QString text(const KTextEditor::Range &range) const;
+
+    /**
+     * Did decoding lines of a memory mapped file fail for this snapshot or the buffer?
+     * Then some lines of the snapshot are empty instead of holding their text.
+     * @return reading lines failed?
+     */
+    bool readFailed() const;
+
+private:
+    /**
+     * Find the block containing the given line.
+     * @param line line to search for
+     * @return index of the block
+     */
+    int blockForLine(int line) const;
+
+    /**
+     * Retrieve the text of a line of a block of a memory mapped file.
+     * @param block index of the block
+     * @param line line index in the block
+     * @return text of the line
+     */
+    QString mappedLine(int block, int line) const;
+
+    /**
+     * Lines of one block of the buffer, stored like the block did.
+     */
+    struct Block {
+        Block()
+            : startLine(0)
+            , lines(0)
+            , mappedPosition(0)
+            , mappedEnd(0)
+        {
+        }
+
+        int startLine;
+        int lines;
+
+        /**
+         * lines, for blocks with created lines, shared with the block as long as the share is held
+         */
+        QVector<TextLine> textLines;
+        QSharedPointer<TextLinesShare> linesShare;
+
+        /**
+         * text + line starts for blocks in compact storage
+         */
+        QString compactText;
+        QVector<int> compactLineStarts;
+
+        /**
+         * mapped file + byte range of the lines for lazy loaded blocks
+         */
+        QSharedPointer<TextMappedFile> mappedFile;
+        qint64 mappedPosition;
+        qint64 mappedEnd;
+    };
+
+    /**
+     * blocks, in line order
+     */
+    QVector<Block> m_blocks;
+
+    /**
+     * Decoded lines of the last used block of a memory mapped file.
+     * Lines are mostly read in order, like this each block gets decoded once.
+     */
+    struct MappedLines {
+        MappedLines()
+            : block(-1)
+        {
+        }
+
+        QMutex mutex;
+        int block;
+        QVector<TextLine> lines;
+    };
+
+    /**
+     * decoded lines, shared by all copies of the snapshot, 0 if no block is memory mapped
+     */
+    QSharedPointer<MappedLines> m_mappedLines;
+
+    /**
+     * number of lines
+     */
+    int m_lines;
+
+    /**
+     * revision of the buffer
+     */
+    qint64 m_revision;
+
+    /**
+     * did the buffer fail to read lines before the snapshot was taken?
+     */
+    bool m_readFailed;
+};
+
+}
+
+#endif
@@ -66,7 +66,8 @@ TextCursor::~TextCursor()
 
 void TextCursor::setPosition(const TextCursor &position)
 {
-    if (m_block && m_block != position.m_block) {
+    // remove in any case, the block keeps its cursors sorted by position
+    if (m_block) {
         m_block->removeCursor(this);
     }
 
@@ -21,9 +21,17 @@
 #include "katetexthistory.h"
 #include "katetextbuffer.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace Kate
 {
 
+/**
+ * checkpoints cover at most this many entries, this bounds the costs to compute their mappings
+ */
+static const int maximalCheckpointEntries = 512;
+
 TextHistory::TextHistory(TextBuffer &buffer)
     : m_buffer(buffer)
     , m_lastSavedRevision(-1)
@@ -51,15 +59,25 @@ void TextHistory::clear()
     // remove all history entries and add no-change dummy for first revision
     m_historyEntries.clear();
     m_historyEntries.push_back(Entry());
+    m_checkpoints.clear();
 
     // first entry will again belong to first revision
     m_firstHistoryEntryRevision = 0;
 }
 
-void TextHistory::setLastSavedRevision()
+qint64 TextHistory::memoryUsage() const
+{
+    qint64 usage = qint64(m_historyEntries.capacity()) * sizeof(Entry) + qint64(m_checkpoints.capacity()) * sizeof(Checkpoint);
+    foreach (const Checkpoint &checkpoint, m_checkpoints) {
+        usage += qint64(checkpoint.moveOnInsertMapping.capacity() + checkpoint.stayOnInsertMapping.capacity()) * sizeof(MappingPiece);
+    }
+    return usage;
+}
+
+void TextHistory::setLastSavedRevision(qint64 revision)
 {
-    // current revision was successful saved
-    m_lastSavedRevision = revision();
+    // given revision was successful saved
+    m_lastSavedRevision = revision;
 }
 
 void TextHistory::wrapLine(const KTextEditor::Cursor &position)
@@ -107,6 +125,29 @@ void TextHistory::removeText(const KTextEditor::Range &range, int oldLineLength)
     addEntry(entry);
 }
 
+void TextHistory::insertLines(int line, int lineLength, int lines, int lastLineLength)
+{
+    // create and add new entry
+    Entry entry;
+    entry.type = Entry::InsertLines;
+    entry.line = line;
+    entry.column = lineLength;
+    entry.length = lines;
+    entry.oldLineLength = lastLineLength;
+    addEntry(entry);
+}
+
+void TextHistory::removeLines(int line, int lines)
+{
+    // create and add new entry
+    Entry entry;
+    entry.type = Entry::RemoveLines;
+    entry.line = line;
+    entry.column = 0;
+    entry.length = lines;
+    addEntry(entry);
+}
+
 void TextHistory::addEntry(const Entry &entry)
 {
     /**
@@ -125,9 +166,10 @@ void TextHistory::addEntry(const Entry &entry)
         m_firstHistoryEntryRevision = revision() + 1;
 
         /**
-         * remember edit
+         * remember edit, the transformation of the first entry is never used, no checkpoints needed
          */
         m_historyEntries.first() = entry;
+        m_checkpoints.clear();
 
         /**
          * be done...
@@ -139,6 +181,148 @@ void TextHistory::addEntry(const Entry &entry)
      * ok, we have more than one entry or the entry is referenced, just add up new entries
      */
     m_historyEntries.push_back(entry);
+    addToCheckpoints(m_firstHistoryEntryRevision + m_historyEntries.size() - 1);
+}
+
+void TextHistory::addToCheckpoints(qint64 revision)
+{
+    const Entry &entry = m_historyEntries.last();
+    if (entry.type != Entry::InsertText && entry.type != Entry::RemoveText) {
+        return;
+    }
+
+    /**
+     * extend the checkpoint of the previous entry, if it is for the same line and not too large
+     */
+    if (!m_checkpoints.isEmpty()) {
+        Checkpoint &checkpoint = m_checkpoints.last();
+        if (checkpoint.lastRevision + 1 == revision && checkpoint.line == entry.line
+                && checkpoint.lastRevision - checkpoint.firstRevision + 1 < maximalCheckpointEntries) {
+            checkpoint.lastRevision = revision;
+            checkpoint.moveOnInsertMapping.clear();
+            checkpoint.stayOnInsertMapping.clear();
+            return;
+        }
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.firstRevision = revision;
+    checkpoint.lastRevision = revision;
+    checkpoint.line = entry.line;
+    m_checkpoints.append(checkpoint);
+}
+
+int TextHistory::checkpointBehind(qint64 revision) const
+{
+    return std::lower_bound(m_checkpoints.begin(), m_checkpoints.end(), revision, [](const Checkpoint &checkpoint, qint64 revision) {
+        return checkpoint.lastRevision < revision;
+    }) - m_checkpoints.begin();
+}
+
+int TextHistory::checkpointInFront(qint64 revision) const
+{
+    return std::upper_bound(m_checkpoints.begin(), m_checkpoints.end(), revision, [](qint64 revision, const Checkpoint &checkpoint) {
+        return revision < checkpoint.firstRevision;
+    }) - m_checkpoints.begin() - 1;
+}
+
+void TextHistory::appendPiece(QVector<MappingPiece> &mapping, qint64 start, qint64 offset, bool constant)
+{
+    if (!mapping.isEmpty() && mapping.last().start == start) {
+        mapping.removeLast();
+    }
+
+    if (!mapping.isEmpty() && mapping.last().constant == constant && mapping.last().offset == offset) {
+        return;
+    }
+
+    const MappingPiece piece = { int(start), int(offset), constant };
+    mapping.append(piece);
+}
+
+QVector<TextHistory::MappingPiece> TextHistory::entryMapping(const Entry &entry, bool moveOnInsert)
+{
+    QVector<MappingPiece> mapping;
+    appendPiece(mapping, std::numeric_limits<int>::min(), 0, false);
+
+    // same cases as Entry::transformCursor
+    if (entry.length <= 0) {
+        return mapping;
+    }
+
+    if (entry.type == Entry::InsertText) {
+        appendPiece(mapping, moveOnInsert ? entry.column : (entry.column + 1), entry.length, false);
+        appendPiece(mapping, entry.oldLineLength + 1, entry.oldLineLength + entry.length, true);
+        appendPiece(mapping, entry.oldLineLength + entry.length, 0, false);
+    } else {
+        Q_ASSERT(entry.type == Entry::RemoveText);
+        appendPiece(mapping, entry.column + 1, entry.column, true);
+        appendPiece(mapping, entry.column + entry.length + 1, -entry.length, false);
+    }
+
+    return mapping;
+}
+
+QVector<TextHistory::MappingPiece> TextHistory::composeMappings(const QVector<MappingPiece> &first, const QVector<MappingPiece> &second)
+{
+    QVector<MappingPiece> mapping;
+    for (int i = 0; i < first.size(); ++i) {
+        const MappingPiece &piece = first.at(i);
+
+        // all columns of a constant piece map to the same column
+        if (piece.constant) {
+            appendPiece(mapping, piece.start, mapColumn(second, piece.offset), true);
+            continue;
+        }
+
+        // split the columns of the piece at the starts of the second mapping's pieces their mapped columns hit
+        const qint64 start = piece.start;
+        const qint64 end = (i + 1 < first.size()) ? qint64(first.at(i + 1).start) : (qint64(std::numeric_limits<int>::max()) + 1);
+        for (int j = 0; j < second.size(); ++j) {
+            const qint64 secondStart = qint64(second.at(j).start) - piece.offset;
+            const qint64 secondEnd = (j + 1 < second.size()) ? (qint64(second.at(j + 1).start) - piece.offset) : end;
+            const qint64 pieceStart = qMax(start, secondStart);
+            if (pieceStart >= qMin(end, secondEnd)) {
+                continue;
+            }
+
+            if (second.at(j).constant) {
+                appendPiece(mapping, pieceStart, second.at(j).offset, true);
+            } else {
+                appendPiece(mapping, pieceStart, qint64(piece.offset) + second.at(j).offset, false);
+            }
+        }
+    }
+
+    return mapping;
+}
+
+int TextHistory::mapColumn(const QVector<MappingPiece> &mapping, int column)
+{
+    // the first piece starts at the minimal column, there is always one in front
+    const MappingPiece &piece = *(std::upper_bound(mapping.begin(), mapping.end(), column, [](int column, const MappingPiece &piece) {
+        return column < piece.start;
+    }) - 1);
+
+    return piece.constant ? piece.offset : (column + piece.offset);
+}
+
+void TextHistory::computeMappings(Checkpoint &checkpoint) const
+{
+    if (!checkpoint.moveOnInsertMapping.isEmpty()) {
+        return;
+    }
+
+    for (qint64 revision = checkpoint.firstRevision; revision <= checkpoint.lastRevision; ++revision) {
+        const Entry &entry = m_historyEntries.at(revision - m_firstHistoryEntryRevision);
+        if (revision == checkpoint.firstRevision) {
+            checkpoint.moveOnInsertMapping = entryMapping(entry, true);
+            checkpoint.stayOnInsertMapping = entryMapping(entry, false);
+        } else {
+            checkpoint.moveOnInsertMapping = composeMappings(checkpoint.moveOnInsertMapping, entryMapping(entry, true));
+            checkpoint.stayOnInsertMapping = composeMappings(checkpoint.stayOnInsertMapping, entryMapping(entry, false));
+        }
+    }
 }
 
 void TextHistory::lockRevision(qint64 revision)
@@ -194,11 +378,17 @@ void TextHistory::unlockRevision(qint64 revision)
          * remove unrefed from the list now
          */
         if (unreferencedEdits > 0) {
-            // remove stuff from history
+            // remove stuff from history, give back the memory if most of it is unused now
             m_historyEntries.erase(m_historyEntries.begin(), m_historyEntries.begin() + unreferencedEdits);
+            if (m_historyEntries.capacity() > 4 * m_historyEntries.size()) {
+                m_historyEntries.squeeze();
+            }
 
             // patch first entry revision
             m_firstHistoryEntryRevision += unreferencedEdits;
+
+            // remove the checkpoints of removed entries, the transformation of the first entry is never used
+            m_checkpoints.erase(m_checkpoints.begin(), m_checkpoints.begin() + checkpointBehind(m_firstHistoryEntryRevision + 1));
         }
     }
 }
@@ -320,6 +510,42 @@ void TextHistory::Entry::transformCursor(int &cursorLine, int &cursorColumn, boo
 
         return;
 
+    /**
+     * Insert lines behind a line
+     */
+    case InsertLines:
+        /**
+         * cursors at the end of this line move behind the inserted lines, like for a wrap
+         */
+        if (cursorLine == line) {
+            if (cursorColumn <= column) {
+                if (cursorColumn < column || !moveOnInsert) {
+                    return;
+                }
+            }
+
+            cursorColumn = cursorColumn - column + oldLineLength;
+        }
+
+        cursorLine += length;
+        return;
+
+    /**
+     * Remove lines
+     */
+    case RemoveLines:
+        /**
+         * cursors in the removed lines move to the start of the line behind them
+         */
+        if (cursorLine < line + length) {
+            cursorColumn = 0;
+            cursorLine = line;
+            return;
+        }
+
+        cursorLine -= length;
+        return;
+
     /**
      * nothing
      */
@@ -447,6 +673,50 @@ void TextHistory::Entry::reverseTransformCursor(int &cursorLine, int &cursorColu
         }
         return;
 
+    /**
+     * Insert lines behind a line
+     */
+    case InsertLines:
+        /**
+         * ignore this line and the ones in front
+         */
+        if (cursorLine <= line) {
+            return;
+        }
+
+        /**
+         * cursors in the inserted lines move to the insert position, the ones behind the end stay behind it
+         */
+        if (cursorLine <= line + length) {
+            cursorColumn = column + ((cursorLine == line + length) ? qMax(0, cursorColumn - oldLineLength) : 0);
+            cursorLine = line;
+            return;
+        }
+
+        cursorLine -= length;
+        return;
+
+    /**
+     * Remove lines
+     */
+    case RemoveLines:
+        /**
+         * ignore lines in front of the removed ones
+         */
+        if (cursorLine < line) {
+            return;
+        }
+
+        /**
+         * skip cursors at the start of the first line behind, they stay in front of the inserted lines
+         */
+        if (cursorLine == line && cursorColumn == 0 && !moveOnInsert) {
+            return;
+        }
+
+        cursorLine += length;
+        return;
+
     /**
      * nothing
      */
@@ -494,14 +764,52 @@ void TextHistory::transformCursor(int &line, int &column, KTextEditor::MovingCur
      * forward or reverse transform?
      */
     if (toRevision > fromRevision) {
-        for (int rev = fromRevision - m_firstHistoryEntryRevision + 1; rev <= (toRevision - m_firstHistoryEntryRevision); ++rev) {
-            const Entry &entry = m_historyEntries.at(rev);
-            entry.transformCursor(line, column, moveOnInsert);
+        int checkpoint = checkpointBehind(fromRevision + 1);
+        for (qint64 revision = fromRevision + 1; revision <= toRevision;) {
+            /**
+             * run of text edits on one line, skip it for other lines, use the composite mapping if we need the whole run
+             */
+            if (checkpoint < m_checkpoints.size() && m_checkpoints.at(checkpoint).firstRevision <= revision) {
+                Checkpoint &current = m_checkpoints[checkpoint++];
+                const qint64 lastRevision = qMin(current.lastRevision, toRevision);
+                if (current.line != line) {
+                    revision = lastRevision + 1;
+                } else if (revision == current.firstRevision && lastRevision == current.lastRevision) {
+                    computeMappings(current);
+                    column = mapColumn(moveOnInsert ? current.moveOnInsertMapping : current.stayOnInsertMapping, column);
+                    revision = lastRevision + 1;
+                } else {
+                    for (; revision <= lastRevision; ++revision) {
+                        m_historyEntries.at(revision - m_firstHistoryEntryRevision).transformCursor(line, column, moveOnInsert);
+                    }
+                }
+                continue;
+            }
+
+            m_historyEntries.at(revision - m_firstHistoryEntryRevision).transformCursor(line, column, moveOnInsert);
+            ++revision;
         }
     } else {
-        for (int rev = fromRevision - m_firstHistoryEntryRevision; rev >= (toRevision - m_firstHistoryEntryRevision + 1); --rev) {
-            const Entry &entry = m_historyEntries.at(rev);
-            entry.reverseTransformCursor(line, column, moveOnInsert);
+        int checkpoint = checkpointInFront(fromRevision);
+        for (qint64 revision = fromRevision; revision >= toRevision + 1;) {
+            /**
+             * run of text edits on one line, skip it for other lines
+             */
+            if (checkpoint >= 0 && m_checkpoints.at(checkpoint).lastRevision >= revision) {
+                const Checkpoint &current = m_checkpoints.at(checkpoint--);
+                const qint64 firstRevision = qMax(current.firstRevision, toRevision + 1);
+                if (current.line != line) {
+                    revision = firstRevision - 1;
+                } else {
+                    for (; revision >= firstRevision; --revision) {
+                        m_historyEntries.at(revision - m_firstHistoryEntryRevision).reverseTransformCursor(line, column, moveOnInsert);
+                    }
+                }
+                continue;
+            }
+
+            m_historyEntries.at(revision - m_firstHistoryEntryRevision).reverseTransformCursor(line, column, moveOnInsert);
+            --revision;
         }
     }
 }
@@ -559,8 +867,20 @@ void TextHistory::transformRange(KTextEditor::Range &range, KTextEditor::MovingR
      * forward or reverse transform?
      */
     if (toRevision > fromRevision) {
-        for (int rev = fromRevision - m_firstHistoryEntryRevision + 1; rev <= (toRevision - m_firstHistoryEntryRevision); ++rev) {
-            const Entry &entry = m_historyEntries.at(rev);
+        int checkpoint = checkpointBehind(fromRevision + 1);
+        for (qint64 rev = fromRevision + 1; rev <= toRevision; ++rev) {
+            /**
+             * skip runs of text edits on lines the range doesn't start or end at
+             */
+            if (checkpoint < m_checkpoints.size() && m_checkpoints.at(checkpoint).firstRevision <= rev) {
+                const Checkpoint &current = m_checkpoints.at(checkpoint++);
+                if (current.line != startLine && current.line != endLine) {
+                    rev = qMin(current.lastRevision, toRevision);
+                    continue;
+                }
+            }
+
+            const Entry &entry = m_historyEntries.at(rev - m_firstHistoryEntryRevision);
 
             entry.transformCursor(startLine, startColumn, moveOnInsertStart);
 
@@ -579,8 +899,20 @@ void TextHistory::transformRange(KTextEditor::Range &range, KTextEditor::MovingR
             }
         }
     } else {
-        for (int rev = fromRevision - m_firstHistoryEntryRevision; rev >= (toRevision - m_firstHistoryEntryRevision + 1); --rev) {
-            const Entry &entry = m_historyEntries.at(rev);
+        int checkpoint = checkpointInFront(fromRevision);
+        for (qint64 rev = fromRevision; rev >= toRevision + 1; --rev) {
+            /**
+             * skip runs of text edits on lines the range doesn't start or end at
+             */
+            if (checkpoint >= 0 && m_checkpoints.at(checkpoint).lastRevision >= rev) {
+                const Checkpoint &current = m_checkpoints.at(checkpoint--);
+                if (current.line != startLine && current.line != endLine) {
+                    rev = qMax(current.firstRevision, toRevision + 1);
+                    continue;
+                }
+            }
+
+            const Entry &entry = m_historyEntries.at(rev - m_firstHistoryEntryRevision);
 
             entry.reverseTransformCursor(startLine, startColumn, moveOnInsertStart);
 
@@ -604,4 +936,143 @@ void TextHistory::transformRange(KTextEditor::Range &range, KTextEditor::MovingR
     range.setRange(KTextEditor::Cursor(startLine, startColumn), KTextEditor::Cursor(endLine, endColumn));
 }
 
+QVector<TextHistory::LineInterval> TextHistory::changedLines(qint64 fromRevision, qint64 toRevision) const
+{
+    /**
+     * -1 special meaning for toRevision
+     */
+    if (toRevision == -1) {
+        toRevision = revision();
+    }
+
+    QVector<LineInterval> intervals;
+    if (fromRevision == toRevision) {
+        return intervals;
+    }
+
+    /**
+     * some invariants must hold
+     */
+    Q_ASSERT(fromRevision < toRevision);
+    Q_ASSERT(fromRevision >= m_firstHistoryEntryRevision);
+    Q_ASSERT(toRevision < (m_firstHistoryEntryRevision + m_historyEntries.size()));
+
+    int checkpoint = checkpointBehind(fromRevision + 1);
+    for (qint64 revision = fromRevision + 1; revision <= toRevision;) {
+        /**
+         * run of text edits on one line, it changes just that line
+         */
+        if (checkpoint < m_checkpoints.size() && m_checkpoints.at(checkpoint).firstRevision <= revision) {
+            const Checkpoint &current = m_checkpoints.at(checkpoint++);
+            markLines(intervals, current.line, current.line);
+            revision = qMin(current.lastRevision, toRevision) + 1;
+            continue;
+        }
+
+        const Entry &entry = m_historyEntries.at(revision - m_firstHistoryEntryRevision);
+        switch (entry.type) {
+        case Entry::WrapLine:
+            shiftForInsertedLines(intervals, entry.line + 1, 1);
+            markLines(intervals, entry.line, entry.line + 1);
+            break;
+
+        case Entry::UnwrapLine:
+            shiftForRemovedLines(intervals, entry.line, 1);
+            markLines(intervals, entry.line - 1, entry.line - 1);
+            break;
+
+        case Entry::InsertText:
+        case Entry::RemoveText:
+            markLines(intervals, entry.line, entry.line);
+            break;
+
+        case Entry::InsertLines:
+            shiftForInsertedLines(intervals, entry.line + 1, entry.length);
+            markLines(intervals, entry.line + 1, entry.line + entry.length);
+            break;
+
+        case Entry::RemoveLines:
+            shiftForRemovedLines(intervals, entry.line, entry.length);
+            break;
+
+        case Entry::NoChange:
+            break;
+        }
+        ++revision;
+    }
+
+    return intervals;
+}
+
+void TextHistory::markLines(QVector<LineInterval> &intervals, int start, int end)
+{
+    /**
+     * first interval ending at or behind the line in front of start, the ones in front stay untouched
+     */
+    const int first = std::lower_bound(intervals.constBegin(), intervals.constEnd(), start - 1, [](const LineInterval &interval, int line) {
+        return interval.end < line;
+    }) - intervals.constBegin();
+
+    /**
+     * swallow all intervals overlapping or adjacent
+     */
+    int last = first;
+    for (; last < intervals.size() && intervals.at(last).start <= end + 1; ++last) {
+        start = qMin(start, intervals.at(last).start);
+        end = qMax(end, intervals.at(last).end);
+    }
+
+    const LineInterval interval = {start, end};
+    if (first == last) {
+        intervals.insert(first, interval);
+    } else {
+        intervals[first] = interval;
+        intervals.remove(first + 1, last - first - 1);
+    }
+}
+
+void TextHistory::shiftForInsertedLines(QVector<LineInterval> &intervals, int line, int lines)
+{
+    /**
+     * only intervals reaching the inserted lines move, an interval containing them grows
+     */
+    for (int i = intervals.size() - 1; i >= 0 && intervals.at(i).end >= line; --i) {
+        LineInterval &interval = intervals[i];
+        interval.end += lines;
+        if (interval.start >= line) {
+            interval.start += lines;
+        }
+    }
+}
+
+void TextHistory::shiftForRemovedLines(QVector<LineInterval> &intervals, int line, int lines)
+{
+    /**
+     * first interval reaching the removed lines, start at the one in front, it might become adjacent
+     */
+    const int first = std::lower_bound(intervals.constBegin(), intervals.constEnd(), line, [](const LineInterval &interval, int line) {
+        return interval.end < line;
+    }) - intervals.constBegin();
+
+    int target = qMax(0, first - 1);
+    for (int i = target; i < intervals.size(); ++i) {
+        LineInterval interval = intervals.at(i);
+        if (i >= first) {
+            // lines behind the removed ones move up, the removed ones vanish
+            interval.start = (interval.start < line) ? interval.start : qMax(line, interval.start - lines);
+            interval.end = (interval.end >= line + lines) ? (interval.end - lines) : qMin(interval.end, line - 1);
+            if (interval.start > interval.end) {
+                continue;
+            }
+        }
+
+        if (target > 0 && intervals.at(target - 1).end + 1 >= interval.start) {
+            intervals[target - 1].end = qMax(intervals.at(target - 1).end, interval.end);
+        } else {
+            intervals[target++] = interval;
+        }
+    }
+    intervals.resize(target);
+}
+
 }
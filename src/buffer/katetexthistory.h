@@ -21,7 +21,7 @@
 #ifndef KATE_TEXTHISTORY_H
 #define KATE_TEXTHISTORY_H
 
-#include <QList>
+#include <QVector>
 
 #include <ktexteditor/range.h>
 
@@ -72,6 +72,9 @@ public:
 
     /**
      * Transform a cursor from one revision to an other.
+     * Runs of text edits on one line cost one step each, see Checkpoint, all other entries
+     * one step per revision: the cost stays linear in the number of checkpoints and line
+     * wraps, unwraps, inserts and removals between the revisions, not logarithmic.
      * @param line line number of the cursor to transform
      * @param column column number of the cursor to transform
      * @param insertBehavior behavior of this cursor on insert of text at its position
@@ -82,6 +85,7 @@ public:
 
     /**
      * Transform a range from one revision to an other.
+     * Same cost as transformCursor(), linear in the checkpoints and other entries passed.
      * @param range range to transform
      * @param insertBehaviors behavior of this range on insert of text at its position
      * @param emptyBehavior behavior on becoming empty
@@ -90,6 +94,32 @@ public:
      */
     void transformRange(KTextEditor::Range &range, KTextEditor::MovingRange::InsertBehaviors insertBehaviors, KTextEditor::MovingRange::EmptyBehavior emptyBehavior, qint64 fromRevision, qint64 toRevision = -1);
 
+    /**
+     * Interval of lines, both inclusive, see changedLines().
+     */
+    struct LineInterval {
+        int start;
+        int end;
+    };
+
+    /**
+     * Lines changed between two revisions, to let incremental consumers like the spell checking
+     * only process what changed since the revision they saw last, after a whole batch of edits.
+     * The intervals use the line numbers of toRevision: lines with modified text and inserted lines
+     * are contained, removed lines are gone and not reported themselves, use transformCursor()
+     * to move line numbers remembered for fromRevision.
+     * @param fromRevision revision the changes start from, must be locked or the current revision
+     * @param toRevision revision the changes lead to, default of -1 is current revision, must not be in front of fromRevision
+     * @return intervals of changed lines, sorted and coalesced, neither overlapping nor adjacent
+     */
+    QVector<LineInterval> changedLines(qint64 fromRevision, qint64 toRevision = -1) const;
+
+    /**
+     * Estimate the memory used by the history entries and checkpoints.
+     * @return bytes used
+     */
+    qint64 memoryUsage() const;
+
 private:
     /**
      * Class representing one entry in the editing history.
@@ -122,6 +152,8 @@ private:
             , UnwrapLine
             , InsertText
             , RemoveText
+            , InsertLines
+            , RemoveLines
         };
 
         /**
@@ -153,16 +185,60 @@ private:
         int column;
 
         /**
-         * length of change (length of insert or removed text)
+         * length of change (length of insert or removed text, number of inserted or removed lines)
          */
         int length;
 
         /**
          * old line length (needed for unwrap and insert)
+         * for inserted lines the length of the last inserted line
          */
         int oldLineLength;
     };
 
+    /**
+     * Piece of a composite column mapping, pieces are sorted by start column.
+     * Columns from the start up to the start of the next piece map to column + offset,
+     * for constant pieces all of them map to offset.
+     */
+    struct MappingPiece {
+        int start;
+        int offset;
+        bool constant;
+    };
+
+    /**
+     * Checkpoint for a run of text inserts and removals on one line, like typing produces.
+     * Transforming skips the whole run for cursors on other lines, cursors on the line use
+     * the composite column mapping of all entries of the run, computed on first use.
+     * Each checkpoint is still visited, there is no index to jump over many of them at once.
+     */
+    class Checkpoint
+    {
+    public:
+        Checkpoint()
+            : firstRevision(-1), lastRevision(-1), line(-1)
+        {
+        }
+
+        /**
+         * revisions the entries of the run lead to, inclusive
+         */
+        qint64 firstRevision;
+        qint64 lastRevision;
+
+        /**
+         * line all entries of the run change
+         */
+        int line;
+
+        /**
+         * composite column mappings for cursors moving on insert or not, empty if not computed yet
+         */
+        QVector<MappingPiece> moveOnInsertMapping;
+        QVector<MappingPiece> stayOnInsertMapping;
+    };
+
     /**
      * Construct an empty text history.
      * @param buffer buffer this text history belongs to
@@ -180,9 +256,10 @@ private:
     void clear();
 
     /**
-     * Set current revision as last saved revision
+     * Set given revision as last saved revision
+     * @param revision saved revision, the buffer might have been edited while saving
      */
-    void setLastSavedRevision();
+    void setLastSavedRevision(qint64 revision);
 
     /**
      * Notify about wrap line at given cursor position.
@@ -212,12 +289,113 @@ private:
      */
     void removeText(const KTextEditor::Range &range, int oldLineLength);
 
+    /**
+     * Notify about insert of whole lines behind the given line.
+     * @param line line the lines are inserted behind
+     * @param lineLength text length of this line
+     * @param lines number of inserted lines
+     * @param lastLineLength text length of the last inserted line
+     */
+    void insertLines(int line, int lineLength, int lines, int lastLineLength);
+
+    /**
+     * Notify about removal of whole lines.
+     * @param line first removed line
+     * @param lines number of removed lines
+     */
+    void removeLines(int line, int lines);
+
     /**
      * Generic function to add a entry to the history. Is used by the above functions for the different editing primitives.
      * @param entry new entry to add
      */
     void addEntry(const Entry &entry);
 
+    /**
+     * Add the entry with the given revision to the checkpoints, if it is a text insert or removal.
+     * @param revision revision the entry leads to
+     */
+    void addToCheckpoints(qint64 revision);
+
+    /**
+     * Find the first checkpoint ending at or behind the given revision.
+     * @param revision revision to search for
+     * @return index of the checkpoint, m_checkpoints.size() if none
+     */
+    int checkpointBehind(qint64 revision) const;
+
+    /**
+     * Find the last checkpoint starting at or in front of the given revision.
+     * @param revision revision to search for
+     * @return index of the checkpoint, -1 if none
+     */
+    int checkpointInFront(qint64 revision) const;
+
+    /**
+     * Compute the composite mappings of the given checkpoint, if not already done.
+     * @param checkpoint checkpoint to compute the mappings for
+     */
+    void computeMappings(Checkpoint &checkpoint) const;
+
+    /**
+     * Column mapping of a single text insert or removal.
+     * @param entry entry to get the mapping for
+     * @param moveOnInsert behavior of the cursors on insert of text at their position
+     * @return column mapping
+     */
+    static QVector<MappingPiece> entryMapping(const Entry &entry, bool moveOnInsert);
+
+    /**
+     * Compose two column mappings.
+     * @param first mapping applied first
+     * @param second mapping applied to the result of the first one
+     * @return composite mapping
+     */
+    static QVector<MappingPiece> composeMappings(const QVector<MappingPiece> &first, const QVector<MappingPiece> &second);
+
+    /**
+     * Append a piece to a column mapping, pieces must come in order of their start.
+     * Empty pieces get replaced, pieces mapping like the one in front extend it.
+     * @param mapping mapping to append to
+     * @param start start column of the piece
+     * @param offset offset or constant column of the piece
+     * @param constant do all columns of the piece map to the same column?
+     */
+    static void appendPiece(QVector<MappingPiece> &mapping, qint64 start, qint64 offset, bool constant);
+
+    /**
+     * Map a column with the given mapping, O(log n).
+     * @param mapping mapping to use
+     * @param column column to map
+     * @return mapped column
+     */
+    static int mapColumn(const QVector<MappingPiece> &mapping, int column);
+
+    /**
+     * Add lines to the changed lines, see changedLines(), coalesce them with overlapping or adjacent ones.
+     * @param intervals sorted intervals to add to
+     * @param start first changed line
+     * @param end last changed line
+     */
+    static void markLines(QVector<LineInterval> &intervals, int start, int end);
+
+    /**
+     * Move the changed lines for inserted lines, see changedLines().
+     * @param intervals sorted intervals to move
+     * @param line first inserted line, lines at or behind it move
+     * @param lines number of inserted lines
+     */
+    static void shiftForInsertedLines(QVector<LineInterval> &intervals, int line, int lines);
+
+    /**
+     * Move the changed lines for removed lines, see changedLines().
+     * Removed changed lines are dropped, intervals becoming adjacent are coalesced.
+     * @param intervals sorted intervals to move
+     * @param line first removed line
+     * @param lines number of removed lines
+     */
+    static void shiftForRemovedLines(QVector<LineInterval> &intervals, int line, int lines);
+
 private:
     /**
      * TextBuffer this history belongs to
@@ -232,7 +410,12 @@ private:
     /**
      * history of edits
      */
-    QList<Entry> m_historyEntries;
+    QVector<Entry> m_historyEntries;
+
+    /**
+     * checkpoints for runs of text edits on one line, sorted by revision
+     */
+    QVector<Checkpoint> m_checkpoints;
 
     /**
      * offset for the first entry in m_history, to which revision it really belongs?
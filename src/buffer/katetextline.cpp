@@ -20,22 +20,122 @@
 
 #include "katetextline.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 namespace Kate
 {
 
+/**
+ * Attributes are stored as four varints each: the distance of the offset to the end of the
+ * previous attribute, the length, the attribute value and the zigzag encoded folding value.
+ * Most of them need one byte, instead of twelve for the plain Attribute.
+ */
+static inline int writeVarint(uchar *data, uint value)
+{
+    int bytes = 0;
+    while (value >= 0x80) {
+        data[bytes++] = uchar(value) | 0x80;
+        value >>= 7;
+    }
+    data[bytes++] = uchar(value);
+    return bytes;
+}
+
+static inline uint readVarint(const uchar *&data)
+{
+    uint value = 0;
+    for (int shift = 0; ; shift += 7) {
+        const uchar byte = *data++;
+        value |= uint(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+}
+
+/**
+ * zigzag encoding, folding ends are negative, keep them small, too
+ */
+static inline uint zigZag(int value)
+{
+    return (uint(value) << 1) ^ uint(value >> 31);
+}
+
+static inline int unZigZag(uint value)
+{
+    return int(value >> 1) ^ -int(value & 1);
+}
+
+static inline int writeAttribute(uchar *data, uint offsetDelta, const TextLineData::Attribute &attribute)
+{
+    int bytes = writeVarint(data, offsetDelta);
+    bytes += writeVarint(data + bytes, uint(attribute.length));
+    bytes += writeVarint(data + bytes, uint(attribute.attributeValue));
+    bytes += writeVarint(data + bytes, zigZag(attribute.foldingValue));
+    return bytes;
+}
+
+static inline void readAttribute(const uchar *&data, int &previousEnd, TextLineData::Attribute &attribute)
+{
+    attribute.offset = previousEnd + int(readVarint(data));
+    attribute.length = int(readVarint(data));
+    attribute.attributeValue = short(readVarint(data));
+    attribute.foldingValue = short(unZigZag(readVarint(data)));
+    previousEnd = attribute.offset + attribute.length;
+}
+
+/**
+ * maximal size of one encoded attribute
+ */
+static const int maximalAttributeSize = 4 * 5;
+
+/**
+ * Capacity of heap storage for encoded attributes of given size.
+ * Only depends on the size, that way we don't need to store it.
+ */
+static inline int attributesCapacity(int size)
+{
+    int capacity = 64;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
 TextLineData::TextLineData()
-    : m_flags(0)
+    : m_attributesHeap(0)
+    , m_attributesSize(0)
+    , m_attributesEnd(0)
+    , m_flags(0)
 {
 }
 
 TextLineData::TextLineData(const QString &text)
     : m_text(text)
+    , m_attributesHeap(0)
+    , m_attributesSize(0)
+    , m_attributesEnd(0)
     , m_flags(0)
 {
 }
 
+TextLineData::TextLineData(const TextLineData &other)
+    : m_text(other.m_text)
+    , m_contextStack(other.m_contextStack)
+    , m_attributesHeap(0)
+    , m_attributesSize(0)
+    , m_attributesEnd(other.m_attributesEnd)
+    , m_flags(other.m_flags)
+{
+    memcpy(resizeAttributes(other.m_attributesSize), other.attributesData(), other.m_attributesSize);
+}
+
 TextLineData::~TextLineData()
 {
+    if (m_attributesSize > int(sizeof(m_attributesInline))) {
+        free(m_attributesHeap);
+    }
 }
 
 int TextLineData::firstChar() const
@@ -74,6 +174,17 @@ int TextLineData::previousNonSpaceChar(int pos) const
     return -1;
 }
 
+qint64 TextLineData::textMemoryUsage() const
+{
+    return sizeof(TextLineData) + qint64(m_text.capacity()) * sizeof(QChar);
+}
+
+qint64 TextLineData::highlightingMemoryUsage() const
+{
+    // only attributes not fitting into the inline storage need own memory
+    return (m_attributesSize > int(sizeof(m_attributesInline))) ? attributesCapacity(m_attributesSize) : 0;
+}
+
 QString TextLineData::leadingWhitespace() const
 {
     if (firstChar() < 0) {
@@ -195,14 +306,130 @@ int TextLineData::virtualLength(int tabWidth) const
 void TextLineData::addAttribute(const Attribute &attribute)
 {
     // try to append to previous range, if no folding info + same attribute value
-    if ((attribute.foldingValue == 0) && !m_attributesList.isEmpty() && (m_attributesList.back().foldingValue == 0)
-            && (m_attributesList.back().attributeValue == attribute.attributeValue)
-            && ((m_attributesList.back().offset + m_attributesList.back().length) == attribute.offset)) {
-        m_attributesList.back().length += attribute.length;
+    if ((attribute.foldingValue == 0) && (m_attributesSize > 0) && (m_attributesEnd == attribute.offset)) {
+        const int lastStart = lastAttributeStart();
+        const uchar *data = attributesData() + lastStart;
+        int previousEnd = 0;
+        Attribute last;
+        readAttribute(data, previousEnd, last);
+
+        // read relative to 0, the offset is the encoded distance to the attribute before
+        const uint offsetDelta = uint(last.offset);
+        if ((last.foldingValue == 0) && (last.attributeValue == attribute.attributeValue)) {
+            // re-encode the last attribute with the new length
+            last.length += attribute.length;
+            uchar encoded[maximalAttributeSize];
+            const int encodedSize = writeAttribute(encoded, offsetDelta, last);
+            memcpy(resizeAttributes(lastStart + encodedSize) + lastStart, encoded, encodedSize);
+            m_attributesEnd += attribute.length;
+            return;
+        }
+    }
+
+    uchar encoded[maximalAttributeSize];
+    const int encodedSize = writeAttribute(encoded, uint(attribute.offset - m_attributesEnd), attribute);
+    const int oldSize = m_attributesSize;
+    memcpy(resizeAttributes(oldSize + encodedSize) + oldSize, encoded, encodedSize);
+    m_attributesEnd = attribute.offset + attribute.length;
+}
+
+TextLineData::AttributeIterator::AttributeIterator(const TextLineData &line)
+    : m_data(line.attributesData())
+    , m_end(line.attributesData() + line.m_attributesSize)
+    , m_atEnd(false)
+{
+    next();
+}
+
+void TextLineData::AttributeIterator::next()
+{
+    if (m_data >= m_end) {
+        m_atEnd = true;
         return;
     }
 
-    m_attributesList.append(attribute);
+    int previousEnd = m_attribute.offset + m_attribute.length;
+    readAttribute(m_data, previousEnd, m_attribute);
+}
+
+QVector<TextLineData::Attribute> TextLineData::attributesList() const
+{
+    QVector<Attribute> attributes;
+    const uchar *data = attributesData();
+    const uchar *end = data + m_attributesSize;
+    int previousEnd = 0;
+    while (data < end) {
+        Attribute attribute;
+        readAttribute(data, previousEnd, attribute);
+        attributes.append(attribute);
+    }
+    return attributes;
+}
+
+short TextLineData::attribute(int pos) const
+{
+    const uchar *data = attributesData();
+    const uchar *end = data + m_attributesSize;
+    int previousEnd = 0;
+    while (data < end) {
+        Attribute attribute;
+        readAttribute(data, previousEnd, attribute);
+        if (pos >= attribute.offset && pos < (attribute.offset + attribute.length)) {
+            return attribute.attributeValue;
+        }
+
+        if (pos < attribute.offset) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+uchar *TextLineData::resizeAttributes(int size)
+{
+    const int inlineSize = int(sizeof(m_attributesInline));
+    const bool wasOnHeap = m_attributesSize > inlineSize;
+    const bool onHeap = size > inlineSize;
+
+    if (!wasOnHeap && onHeap) {
+        uchar *heap = static_cast<uchar *>(malloc(attributesCapacity(size)));
+        Q_CHECK_PTR(heap);
+        memcpy(heap, m_attributesInline, m_attributesSize);
+        m_attributesHeap = heap;
+    } else if (wasOnHeap && !onHeap) {
+        // copy pointer first, it shares the memory with the inline storage
+        uchar *heap = m_attributesHeap;
+        memcpy(m_attributesInline, heap, size);
+        free(heap);
+    } else if (onHeap && attributesCapacity(size) != attributesCapacity(m_attributesSize)) {
+        uchar *heap = static_cast<uchar *>(realloc(m_attributesHeap, attributesCapacity(size)));
+        Q_CHECK_PTR(heap);
+        m_attributesHeap = heap;
+    }
+
+    m_attributesSize = size;
+    return onHeap ? m_attributesHeap : m_attributesInline;
+}
+
+int TextLineData::lastAttributeStart() const
+{
+    Q_ASSERT(m_attributesSize > 0);
+
+    /**
+     * walk back over the four varints of the last attribute
+     * only the last byte of each varint has the high bit not set
+     */
+    const uchar *data = attributesData();
+    int position = m_attributesSize - 1;
+    for (int i = 0; i < 4; ++i) {
+        --position;
+        while (position >= 0 && (data[position] & 0x80)) {
+            --position;
+        }
+    }
+
+    return position + 1;
 }
 
 }
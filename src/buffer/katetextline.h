@@ -90,6 +90,59 @@ public:
         short foldingValue;
     };
 
+    /**
+     * Decodes the attributes of a line one by one, without allocating, see attributesList().
+     * The line must stay alive and unchanged while iterating.
+     */
+    class KTEXTEDITOR_EXPORT AttributeIterator
+    {
+    public:
+        /**
+         * Construct an iterator without any attributes.
+         */
+        AttributeIterator()
+            : m_data(0)
+            , m_end(0)
+            , m_atEnd(true)
+        {
+        }
+
+        /**
+         * Construct an iterator at the first attribute of the given line.
+         * @param line line to iterate over
+         */
+        explicit AttributeIterator(const TextLineData &line);
+
+        /**
+         * Are all attributes visited?
+         * @return no current attribute
+         */
+        bool atEnd() const
+        {
+            return m_atEnd;
+        }
+
+        /**
+         * Current attribute, only valid if not atEnd().
+         * @return current attribute
+         */
+        const Attribute &attribute() const
+        {
+            return m_attribute;
+        }
+
+        /**
+         * Move to the next attribute.
+         */
+        void next();
+
+    private:
+        const uchar *m_data;
+        const uchar *m_end;
+        Attribute m_attribute;
+        bool m_atEnd;
+    };
+
     /**
      * Flags of TextLineData
      */
@@ -113,6 +166,13 @@ public:
      */
     TextLineData(const QString &text);
 
+    /**
+     * Construct a copy of a text line, with its highlighting and flags.
+     * Used to detach lines shared by the blocks of different buffers, see TextBlock::detachLines().
+     * @param other text line to copy
+     */
+    TextLineData(const TextLineData &other);
+
     /**
      * Destruct the text line
      */
@@ -275,6 +335,19 @@ public:
         return m_text.length();
     }
 
+    /**
+     * Estimate the memory used by this line for its text, including the line itself.
+     * @return bytes used for the text
+     */
+    qint64 textMemoryUsage() const;
+
+    /**
+     * Estimate the memory used by this line for its highlighting attributes.
+     * The context stacks are interned by the highlighting and not counted.
+     * @return bytes used for the highlighting
+     */
+    qint64 highlightingMemoryUsage() const;
+
     /**
      * Returns \e true, if the line's hl-continue flag is set, otherwise returns
      * \e false. The hl-continue flag is set in the hl-definition files.
@@ -374,7 +447,8 @@ public:
     }
 
     /**
-     * Sets the syntax highlight context number
+     * Sets the syntax highlight context number.
+     * The highlighting interns the stacks, equal stacks of all lines share their data.
      * @param val new context array
      */
     void setContextStack(const ContextStack &val)
@@ -393,18 +467,26 @@ public:
      */
     void clearAttributes()
     {
-        m_attributesList.clear();
+        resizeAttributes(0);
+        m_attributesEnd = 0;
     }
 
     /**
-     * Accessor to attributes
-     * @return attributes of this line
+     * Has this line any attributes?
+     * @return attributes there?
      */
-    const QVector<Attribute> &attributesList() const
+    bool hasAttributes() const
     {
-        return m_attributesList;
+        return m_attributesSize > 0;
     }
 
+    /**
+     * Accessor to attributes, they are decoded for this, see addAttribute().
+     * Allocates the list, code running for each painted line should use AttributeIterator.
+     * @return attributes of this line
+     */
+    QVector<Attribute> attributesList() const;
+
     /**
      * Gets the attribute at the given position
      * use KRenderer::attributes  to get the KTextAttribute for this.
@@ -412,20 +494,7 @@ public:
      * @param pos position of attribute requested
      * @return value of attribute
      */
-    short attribute(int pos) const
-    {
-        for (int i = 0; i < m_attributesList.size(); ++i) {
-            if (pos >= m_attributesList[i].offset && pos < (m_attributesList[i].offset + m_attributesList[i].length)) {
-                return m_attributesList[i].attributeValue;
-            }
-
-            if (pos < m_attributesList[i].offset) {
-                break;
-            }
-        }
-
-        return 0;
-    }
+    short attribute(int pos) const;
 
     /**
      * set hl continue flag
@@ -464,21 +533,59 @@ private:
         return m_text;
     }
 
+    /**
+     * Encoded attributes, inline or on the heap, depending on their size.
+     * @return encoded attributes
+     */
+    const uchar *attributesData() const
+    {
+        return (m_attributesSize > int(sizeof(m_attributesInline))) ? m_attributesHeap : m_attributesInline;
+    }
+
+    /**
+     * Resize the storage of the encoded attributes, keeps the existing data up to the new size.
+     * @param size new size in bytes
+     * @return encoded attributes
+     */
+    uchar *resizeAttributes(int size);
+
+    /**
+     * Offset of the encoded last attribute.
+     * @return offset of last attribute in the encoded data
+     */
+    int lastAttributeStart() const;
+
 private:
+    TextLineData &operator=(const TextLineData &) Q_DECL_EQ_DELETE;
+
     /**
      * text of this line
      */
     QString m_text;
 
     /**
-     * attributes of this line
+     * context stack of this line
      */
-    QVector<Attribute> m_attributesList;
+    ContextStack m_contextStack;
 
     /**
-     * context stack of this line
+     * attributes of this line, encoded, see addAttribute()
+     * a few attributes are stored inline, for more the data is on the heap
      */
-    ContextStack m_contextStack;
+    union {
+        uchar m_attributesInline[2 * sizeof(void *)];
+        uchar *m_attributesHeap;
+    };
+
+    /**
+     * size of the encoded attributes in bytes
+     */
+    int m_attributesSize;
+
+    /**
+     * end of the last attribute, offset + length
+     */
+    int m_attributesEnd;
 
     /**
      * flags of this line
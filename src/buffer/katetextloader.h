@@ -25,10 +25,19 @@
 #include <QFile>
 #include <QCryptographicHash>
 #include <QMimeDatabase>
+#include <QTextCodec>
+
+#include <string.h>
 
 // on the fly compression
 #include <KFilterDev>
 
+// SSE2 is part of all x86-64 cpus, use it to scan the data
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KATE_TEXTLOADER_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace Kate
 {
 
@@ -146,6 +155,24 @@ public:
         return m_bomFound;
     }
 
+    /**
+     * Size of the file on disk, for compressed files this is the compressed size.
+     * @return file size
+     */
+    qint64 fileSize() const
+    {
+        return m_fileSize;
+    }
+
+    /**
+     * Current read position in the (uncompressed) file content, for progress reporting.
+     * @return read position
+     */
+    qint64 position() const
+    {
+        return m_file->pos();
+    }
+
     /**
      * mime type used to create filter dev
      * @return mime-type of filter device
@@ -258,6 +285,15 @@ public:
                                         m_codec = codecForHtml;
                                     }
                                     
+                                    /**
+                                     * pure ascii data is valid utf-8, no need to run the prober
+                                     * if non-ascii data later is no valid utf-8, we get an encoding error
+                                     * and the fallback codec is used, null bytes hint at utf-16/32 data
+                                     */
+                                    else if (asciiLength(m_buffer.constData(), c) == c && !memchr(m_buffer.constData(), 0, c)) {
+                                        m_codec = QTextCodec::codecForMib(106);
+                                    }
+
                                     /**
                                      * else: use KEncodingProber
                                      */
@@ -281,18 +317,11 @@ public:
                             m_firstRead = false;
                         }
 
+                        // decode + detect broken encoding
                         Q_ASSERT(m_codec);
-                        QString unicode = m_codec->toUnicode(m_buffer.constData() + bomBytes, c - bomBytes, m_converterState);
-
-                        // detect broken encoding
-                        for (int i = 0; i < unicode.size(); ++i) {
-                            if (unicode[i] == 0) {
-                                encodingError = true;
-                                break;
-                            }
+                        if (!appendDecoded(m_buffer.constData() + bomBytes, c - bomBytes)) {
+                            encodingError = true;
                         }
-
-                        m_text.append(unicode);
                     }
 
                     // is file completely read ?
@@ -323,6 +352,17 @@ public:
                 }
             }
 
+            /**
+             * jump to the next end of line char, all chars before belong to the current line
+             */
+            const int lineBreak = findLineBreak(m_text.unicode(), m_position, m_text.length());
+            if (lineBreak > m_position) {
+                m_lastWasEndOfLine = false;
+                m_lastWasR = false;
+                m_position = lineBreak;
+                continue;
+            }
+
             if (m_text.at(m_position) == lf) {
                 m_lastWasEndOfLine = true;
 
@@ -373,9 +413,6 @@ public:
                 m_position++;
 
                 return !encodingError;
-            } else {
-                m_lastWasEndOfLine = false;
-                m_lastWasR = false;
             }
 
             m_position++;
@@ -389,6 +426,209 @@ public:
         return m_digest.result();
     }
 
+private:
+    /**
+     * Decode the given data with the current codec and append it to the text.
+     * For utf-8 and latin-1 ascii runs are widened directly into the text,
+     * only the other bytes need to go through the codec.
+     * @param data data to decode
+     * @param length length of data
+     * @return true if no encoding errors occurred
+     */
+    bool appendDecoded(const char *data, int length)
+    {
+        const int oldLength = m_text.length();
+        const int mib = m_codec->mibEnum();
+
+        if (mib == 4) {
+            /**
+             * latin-1 maps all bytes 1:1 to unicode
+             */
+            appendLatin1(data, length);
+        } else if (mib != 106) {
+            m_text.append(m_codec->toUnicode(data, length, m_converterState));
+        } else {
+            /**
+             * we may skip the codec, a byte order mark was already removed by readLine
+             */
+            m_converterState->flags |= QTextCodec::IgnoreHeader;
+
+            /**
+             * incomplete char at the end of the previous data? must be completed by the codec
+             */
+            bool needsCodec = (m_converterState->remainingChars > 0);
+
+            const char *end = data + length;
+            while (data < end) {
+                if (!needsCodec) {
+                    const int ascii = asciiLength(data, end - data);
+                    appendLatin1(data, ascii);
+                    data += ascii;
+                    if (data == end) {
+                        break;
+                    }
+                }
+
+                /**
+                 * pass all up to the next longer ascii run to the codec,
+                 * for single ascii chars between other chars switching is too expensive
+                 */
+                const char *codecEnd = data;
+                while (codecEnd < end) {
+                    while (codecEnd < end && uchar(*codecEnd) >= 0x80) {
+                        ++codecEnd;
+                    }
+
+                    const int ascii = asciiLength(codecEnd, end - codecEnd);
+                    if (ascii >= 64) {
+                        break;
+                    }
+                    codecEnd += ascii;
+                }
+
+                // ensure progress for an incomplete char directly followed by an ascii run
+                if (codecEnd == data) {
+                    ++codecEnd;
+                }
+
+                m_text.append(m_codec->toUnicode(data, codecEnd - data, m_converterState));
+                data = codecEnd;
+                needsCodec = false;
+            }
+        }
+
+        // the codec converts invalid chars to null
+        return !containsNull(m_text.unicode() + oldLength, m_text.length() - oldLength);
+    }
+
+    /**
+     * Widen latin-1 data directly into the text.
+     * @param data data to append
+     * @param length length of data
+     */
+    void appendLatin1(const char *data, int length)
+    {
+        const int oldLength = m_text.length();
+        m_text.resize(oldLength + length);
+        ushort *dst = reinterpret_cast<ushort *>(m_text.data()) + oldLength;
+
+        int i = 0;
+#ifdef KATE_TEXTLOADER_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= length; i += 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_unpacklo_epi8(chunk, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 8), _mm_unpackhi_epi8(chunk, zero));
+        }
+#endif
+        for (; i < length; ++i) {
+            dst[i] = uchar(data[i]);
+        }
+    }
+
+    /**
+     * Index of lowest set bit.
+     * @param mask mask, must not be 0
+     * @return index of lowest set bit
+     */
+    static int lowestBit(uint mask)
+    {
+        Q_ASSERT(mask);
+#if defined(Q_CC_GNU)
+        return __builtin_ctz(mask);
+#else
+        int bit = 0;
+        while (!(mask & 1)) {
+            mask >>= 1;
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    /**
+     * Count the ascii chars at the start of the data.
+     * @param data data to check
+     * @param length length of data
+     * @return number of ascii chars before the first non-ascii char
+     */
+    static int asciiLength(const char *data, int length)
+    {
+        int i = 0;
+#ifdef KATE_TEXTLOADER_SSE2
+        for (; i + 16 <= length; i += 16) {
+            const uint mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+            if (mask) {
+                return i + lowestBit(mask);
+            }
+        }
+#endif
+        for (; i < length; ++i) {
+            if (uchar(data[i]) >= 0x80) {
+                return i;
+            }
+        }
+        return length;
+    }
+
+    /**
+     * Search the next char that might end a line: \n, \r or the unicode line separator.
+     * @param text text to search in
+     * @param from start of search
+     * @param to end of search
+     * @return position of found char, to if none found
+     */
+    static int findLineBreak(const QChar *text, int from, int to)
+    {
+        const ushort *data = reinterpret_cast<const ushort *>(text);
+        int i = from;
+#ifdef KATE_TEXTLOADER_SSE2
+        const __m128i lf = _mm_set1_epi16(short('\n'));
+        const __m128i cr = _mm_set1_epi16(short('\r'));
+        const __m128i ls = _mm_set1_epi16(short(QChar::LineSeparator));
+        for (; i + 8 <= to; i += 8) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            const __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(chunk, lf), _mm_cmpeq_epi16(chunk, cr)), _mm_cmpeq_epi16(chunk, ls));
+            const uint mask = _mm_movemask_epi8(found);
+            if (mask) {
+                return i + lowestBit(mask) / 2;
+            }
+        }
+#endif
+        for (; i < to; ++i) {
+            if (data[i] == '\n' || data[i] == '\r' || data[i] == QChar::LineSeparator) {
+                return i;
+            }
+        }
+        return to;
+    }
+
+    /**
+     * Check for null chars.
+     * @param text text to check
+     * @param length length of text
+     * @return null char found?
+     */
+    static bool containsNull(const QChar *text, int length)
+    {
+        const ushort *data = reinterpret_cast<const ushort *>(text);
+        int i = 0;
+#ifdef KATE_TEXTLOADER_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= length; i += 8) {
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), zero))) {
+                return true;
+            }
+        }
+#endif
+        for (; i < length; ++i) {
+            if (!data[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
 private:
     QTextCodec *m_codec;
     bool m_eof;
@@ -0,0 +1,225 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2016 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "katetextloadthread.h"
+#include "katetextloader.h"
+#include "katetextblock.h"
+
+namespace Kate
+{
+
+TextLoadThread::TextLoadThread(TextBuffer *buffer, const QString &filename, bool enforceTextCodec)
+    : QThread()
+    , m_buffer(buffer)
+    , m_filename(filename)
+    , m_enforceTextCodec(enforceTextCodec)
+    , m_proberType(buffer->encodingProberType())
+    , m_fallbackTextCodec(buffer->fallbackTextCodec())
+    , m_blockSize(buffer->m_blockSize)
+    , m_lineLengthLimit(buffer->m_lineLengthLimit)
+    , m_compactStorage(buffer->m_compactStorage)
+    , m_textCodec(buffer->textCodec())
+    , m_canceled(0)
+    , m_progress(0)
+    , m_reset(false)
+    , m_notified(false)
+    , m_done(false)
+{
+}
+
+TextLoadThread::~TextLoadThread()
+{
+    // thread must be done
+    Q_ASSERT(!isRunning());
+
+    // kill the blocks nobody took
+    foreach (TextBlock *block, m_blocks) {
+        block->clearLines();
+        delete block;
+    }
+}
+
+void TextLoadThread::waitForBlocks()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_blocks.isEmpty() && !m_done) {
+        m_blocksQueued.wait(&m_mutex);
+    }
+}
+
+QVector<TextBlock *> TextLoadThread::takeBlocks(bool &reset)
+{
+    QMutexLocker locker(&m_mutex);
+
+    reset = m_reset;
+    m_reset = false;
+    m_notified = false;
+
+    QVector<TextBlock *> blocks;
+    blocks.swap(m_blocks);
+    return blocks;
+}
+
+void TextLoadThread::queueBlock(TextBlock *block)
+{
+    QMutexLocker locker(&m_mutex);
+    m_blocks.append(block);
+    m_blocksQueued.wakeAll();
+
+    /**
+     * notify the GUI thread, first batch at once to show the start of the file fast,
+     * later ones at most every 100ms, else the GUI thread is busy with tiny batches
+     */
+    if (!m_notified && (!m_lastNotification.isValid() || m_lastNotification.elapsed() >= 100)) {
+        m_notified = true;
+        m_lastNotification.start();
+        locker.unlock();
+        emit blocksAvailable();
+    }
+}
+
+void TextLoadThread::resetBlocks()
+{
+    QMutexLocker locker(&m_mutex);
+    foreach (TextBlock *block, m_blocks) {
+        block->clearLines();
+        delete block;
+    }
+    m_blocks.clear();
+    m_reset = true;
+    m_lastNotification.invalidate();
+}
+
+void TextLoadThread::run()
+{
+    /**
+     * construct the file loader for the given file, with correct prober type
+     */
+    Kate::TextLoader file(m_filename, m_proberType);
+
+    /**
+     * triple play, see TextBuffer::load
+     */
+    for (int i = 0; i < (m_enforceTextCodec ? 1 : 4); ++i) {
+        /**
+         * blocks of the previous round are useless
+         */
+        if (i > 0) {
+            resetBlocks();
+            m_result.tooLongLinesWrapped = false;
+            m_result.longestLineLoaded = 0;
+        }
+
+        QTextCodec *codec = m_textCodec;
+        if (i == 1) {
+            codec = 0;
+        } else if (i == 2) {
+            codec = m_fallbackTextCodec;
+        }
+
+        if (!file.open(codec)) {
+            break;
+        }
+
+        // read in all lines...
+        TextBlock *block = new TextBlock(m_buffer, 0);
+        m_result.encodingErrors = false;
+        qint64 loadedChars = 0;
+        qint64 loadedLines = 0;
+        while (!file.eof() && !isCanceled()) {
+            // read line
+            int offset = 0, length = 0;
+            bool currentError = !file.readLine(offset, length);
+            m_result.encodingErrors = m_result.encodingErrors || currentError;
+
+            // bail out on encoding error, if not last round!
+            if (m_result.encodingErrors && i < (m_enforceTextCodec ? 0 : 3)) {
+                break;
+            }
+
+            // get unicode data for this line
+            const QChar *unicodeData = file.unicode() + offset;
+
+            if (m_result.longestLineLoaded < length) {
+                m_result.longestLineLoaded = length;
+            }
+
+            /**
+             * split lines, if too large
+             */
+            do {
+                const int lineLength = TextBuffer::wrappedLineLength(unicodeData, length, m_lineLengthLimit);
+                if (lineLength < length) {
+                    m_result.tooLongLinesWrapped = true;
+                }
+
+                /**
+                 * hand out full blocks, by lines or chars, relative to the lines loaded so far
+                 */
+                if (block->lines() >= m_blockSize || block->chars() >= TextBuffer::blockCharsForAverage(loadedChars, loadedLines, m_blockSize)) {
+                    m_progress.storeRelease(qBound(0, int(file.position() * 100 / qMax(qint64(1), file.fileSize())), 99));
+                    block->squeeze();
+                    queueBlock(block);
+                    block = new TextBlock(m_buffer, 0);
+                }
+
+                if (m_compactStorage) {
+                    block->appendCompactLine(unicodeData, lineLength);
+                } else {
+                    block->appendLine(QString(unicodeData, lineLength));
+                }
+                unicodeData += lineLength;
+                length -= lineLength;
+                loadedChars += lineLength;
+                ++loadedLines;
+            } while (length > 0);
+        }
+
+        // canceled or retry with other codec, throw away the last block
+        if (isCanceled() || (m_result.encodingErrors && i < (m_enforceTextCodec ? 0 : 3))) {
+            block->clearLines();
+            delete block;
+
+            if (isCanceled()) {
+                break;
+            }
+            continue;
+        }
+
+        // be done
+        block->squeeze();
+        queueBlock(block);
+        m_result.success = true;
+        m_result.textCodec = file.textCodec();
+        m_result.digest = file.digest();
+        m_result.byteOrderMarkFound = file.byteOrderMarkFound();
+        m_result.eol = file.eol();
+        m_result.mimeTypeForFilterDev = file.mimeTypeForFilterDev();
+        m_progress.storeRelease(100);
+        break;
+    }
+
+    // no more blocks will come
+    QMutexLocker locker(&m_mutex);
+    m_done = true;
+    m_blocksQueued.wakeAll();
+}
+
+}
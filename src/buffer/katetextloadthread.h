@@ -0,0 +1,250 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2016 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_TEXTLOADTHREAD_H
+#define KATE_TEXTLOADTHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QTextCodec>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include <KEncodingProber>
+
+#include "katetextbuffer.h"
+
+namespace Kate
+{
+
+class TextBlock;
+
+/**
+ * Thread to load a file for a TextBuffer in the background.
+ * The thread reads and decodes the file into detached blocks, TextBuffer takes them
+ * in batches and splices them in on the GUI thread, see TextBuffer::startLoading().
+ *
+ * The result is only written by the thread, it may only be read after the thread finished.
+ */
+class TextLoadThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Construct the loading thread, copies all settings needed from the buffer.
+     * @param buffer buffer to load into, blocks are created for it, it is not touched otherwise
+     * @param filename file to load
+     * @param enforceTextCodec enforce to use only the text codec of the buffer
+     */
+    TextLoadThread(TextBuffer *buffer, const QString &filename, bool enforceTextCodec);
+
+    /**
+     * Destruct the thread, must be finished. Deletes all blocks not taken.
+     */
+    ~TextLoadThread();
+
+    /**
+     * Request cancellation, the thread will stop as fast as possible.
+     * Use wait() afterwards.
+     */
+    void cancel()
+    {
+        m_canceled.storeRelease(1);
+    }
+
+    /**
+     * Was the cancellation requested?
+     * @return canceled?
+     */
+    bool isCanceled() const
+    {
+        return m_canceled.loadAcquire();
+    }
+
+    /**
+     * File we load.
+     * @return file name
+     */
+    const QString &fileName() const
+    {
+        return m_filename;
+    }
+
+    /**
+     * Block until the first blocks are there or the thread is finished.
+     */
+    void waitForBlocks();
+
+    /**
+     * Take the loaded blocks, ownership goes to the caller.
+     * @param reset will be set to true if blocks taken before are invalid, as the thread
+     *              restarted loading with another codec
+     * @return loaded blocks, in line order
+     */
+    QVector<TextBlock *> takeBlocks(bool &reset);
+
+    /**
+     * Progress of the loading, in bytes of the file read so far, only a hint.
+     * @return loading progress in percent
+     */
+    int progress() const
+    {
+        return m_progress.loadAcquire();
+    }
+
+    /**
+     * Result of the loading, meanings match the arguments of TextBuffer::load.
+     */
+    struct Result {
+        Result()
+            : success(false)
+            , encodingErrors(false)
+            , tooLongLinesWrapped(false)
+            , longestLineLoaded(0)
+            , textCodec(0)
+            , byteOrderMarkFound(false)
+            , eol(TextBuffer::eolUnknown)
+        {
+        }
+
+        bool success;
+        bool encodingErrors;
+        bool tooLongLinesWrapped;
+        int longestLineLoaded;
+        QTextCodec *textCodec;
+        bool byteOrderMarkFound;
+        TextBuffer::EndOfLineMode eol;
+        QString mimeTypeForFilterDev;
+        QByteArray digest;
+    };
+
+    /**
+     * Result of the loading, only valid after the thread finished.
+     * @return loading result
+     */
+    const Result &result() const
+    {
+        return m_result;
+    }
+
+Q_SIGNALS:
+    /**
+     * New blocks can be taken by takeBlocks().
+     * Not emitted again before the blocks got taken.
+     */
+    void blocksAvailable();
+
+protected:
+    /**
+     * Load the file, same triple play as TextBuffer::load does.
+     */
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    /**
+     * Queue the given block for takeBlocks() and notify, if needed.
+     * @param block block to queue
+     */
+    void queueBlock(TextBlock *block);
+
+    /**
+     * Loading will restart with other codec, throw away queued blocks.
+     */
+    void resetBlocks();
+
+private:
+    /**
+     * buffer we load for
+     */
+    TextBuffer *const m_buffer;
+
+    /**
+     * file to load
+     */
+    const QString m_filename;
+
+    /**
+     * settings copied from buffer
+     */
+    const bool m_enforceTextCodec;
+    const KEncodingProber::ProberType m_proberType;
+    QTextCodec *const m_fallbackTextCodec;
+    const int m_blockSize;
+    const int m_lineLengthLimit;
+    const bool m_compactStorage;
+    QTextCodec *const m_textCodec;
+
+    /**
+     * loading result
+     */
+    Result m_result;
+
+    /**
+     * cancellation requested?
+     */
+    QAtomicInt m_canceled;
+
+    /**
+     * progress in percent
+     */
+    QAtomicInt m_progress;
+
+    /**
+     * protects the block queue and the flags below
+     */
+    QMutex m_mutex;
+
+    /**
+     * signaled when blocks got queued or the thread is done
+     */
+    QWaitCondition m_blocksQueued;
+
+    /**
+     * loaded blocks not yet taken
+     */
+    QVector<TextBlock *> m_blocks;
+
+    /**
+     * blocks taken before are invalid
+     */
+    bool m_reset;
+
+    /**
+     * blocksAvailable() emitted but blocks not yet taken
+     */
+    bool m_notified;
+
+    /**
+     * time of last notification, to not flood the GUI thread with tiny batches
+     */
+    QElapsedTimer m_lastNotification;
+
+    /**
+     * thread is done, no more blocks will come
+     */
+    bool m_done;
+};
+
+}
+
+#endif
@@ -0,0 +1,399 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2016 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "katetextmappedfile.h"
+
+#include <QCryptographicHash>
+
+#include <limits>
+#include <string.h>
+
+namespace Kate
+{
+
+/**
+ * Feed the hash with data of any size, QCryptographicHash::addData only takes int lengths.
+ */
+static void addToHash(QCryptographicHash &hash, const uchar *data, qint64 length)
+{
+    while (length > 0) {
+        const int part = int(qMin(length, qint64(64 * 1024 * 1024)));
+        hash.addData(reinterpret_cast<const char *>(data), part);
+        data += part;
+        length -= part;
+    }
+}
+
+TextMappedFile::TextMappedFile(const QString &filename)
+    : m_file(filename)
+    , m_data(0)
+    , m_size(0)
+    , m_dataStart(0)
+    , m_codec(0)
+    , m_utf8(false)
+    , m_lineLengthLimit(0)
+    , m_bomFound(false)
+    , m_eol(TextBuffer::eolUnknown)
+    , m_tooLongLinesWrapped(false)
+    , m_longestLine(0)
+{
+}
+
+TextMappedFile::~TextMappedFile()
+{
+    if (m_data) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+    }
+}
+
+bool TextMappedFile::codecSupported(QTextCodec *codec)
+{
+    if (!codec) {
+        return false;
+    }
+
+    /**
+     * utf-8 + the usual single byte encodings, for all of them \n and \r are only
+     * used as end of line chars and each byte starts a new char
+     * US-ASCII, ISO-8859-1 to -10, ISO-8859-13 to -16, KOI8-R, KOI8-U, windows-1250 to -1258
+     */
+    const int mib = codec->mibEnum();
+    return mib == 106
+           || (mib >= 3 && mib <= 13)
+           || (mib >= 109 && mib <= 112)
+           || mib == 2084 || mib == 2088
+           || (mib >= 2250 && mib <= 2258);
+}
+
+bool TextMappedFile::open(QTextCodec *codec, int lineLengthLimit)
+{
+    Q_ASSERT(codecSupported(codec));
+
+    m_codec = codec;
+    m_utf8 = (codec->mibEnum() == 106);
+    m_lineLengthLimit = lineLengthLimit;
+
+    /**
+     * empty files can't be mapped, normal loading is fast enough for them anyway
+     */
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() == 0) {
+        return false;
+    }
+
+    m_size = m_file.size();
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        return false;
+    }
+
+    /**
+     * skip utf-8 byte order mark, other byte order marks indicate an encoding we can't handle
+     */
+    if (m_size >= 2 && ((m_data[0] == 0xff && m_data[1] == 0xfe) || (m_data[0] == 0xfe && m_data[1] == 0xff))) {
+        return false;
+    }
+
+    if (m_size >= 3 && m_data[0] == 0xef && m_data[1] == 0xbb && m_data[2] == 0xbf) {
+        if (!m_utf8) {
+            return false;
+        }
+
+        m_dataStart = 3;
+        m_bomFound = true;
+    }
+
+    return true;
+}
+
+bool TextMappedFile::index(int linesPerBlock, QVector<qint64> &blockStarts, int &lines)
+{
+    Q_ASSERT(m_data);
+    Q_ASSERT(linesPerBlock > 0);
+
+    bool crLfFound = false;
+    bool lfFound = false;
+    bool crFound = false;
+    qint64 physicalLineLength = 0;
+
+    /**
+     * the digest is computed block by block while the bytes are hot in the cache anyway
+     * init the hash with the git header, like DocumentPrivate::createDigest() does
+     */
+    QCryptographicHash crypto(QCryptographicHash::Sha1);
+    crypto.addData(QString(QLatin1String("blob %1")).arg(m_size).toLatin1() + '\0');
+    qint64 hashed = 0;
+
+    lines = 0;
+    blockStarts.clear();
+    qint64 position = m_dataStart;
+    while (true) {
+        /**
+         * buffer can't hold more lines
+         */
+        if (lines == std::numeric_limits<int>::max()) {
+            return false;
+        }
+
+        if ((lines % linesPerBlock) == 0) {
+            blockStarts.append(position);
+            addToHash(crypto, m_data + hashed, position - hashed);
+            hashed = position;
+        }
+        ++lines;
+
+        qint64 lineEnd = 0;
+        const qint64 next = nextLine(m_data, m_size, position, lineEnd);
+
+        /**
+         * remember kind of line end, same rules as the TextLoader uses
+         */
+        physicalLineLength += lineEnd - position;
+        if (next == lineEnd) {
+            m_tooLongLinesWrapped = true;
+        } else {
+            if (next > lineEnd) {
+                if (m_data[lineEnd] == '\n') {
+                    lfFound = true;
+                } else if (next == lineEnd + 2) {
+                    crLfFound = true;
+                } else {
+                    crFound = true;
+                }
+            }
+
+            /**
+             * without line length limit we refuse to handle lines larger than QString can hold
+             */
+            if (physicalLineLength > std::numeric_limits<int>::max() / 4) {
+                return false;
+            }
+
+            m_longestLine = qMax(m_longestLine, int(physicalLineLength));
+            physicalLineLength = 0;
+        }
+
+        if (next < 0) {
+            break;
+        }
+
+        position = next;
+    }
+
+    if (crLfFound) {
+        m_eol = TextBuffer::eolDos;
+    } else if (lfFound) {
+        m_eol = TextBuffer::eolUnix;
+    } else if (crFound) {
+        m_eol = TextBuffer::eolMac;
+    }
+
+    addToHash(crypto, m_data + hashed, m_size - hashed);
+    m_digest = crypto.result();
+
+    /**
+     * lines are read from the file from now on, the mapping is not needed any more
+     */
+    m_file.unmap(const_cast<uchar *>(m_data));
+    m_data = 0;
+    return true;
+}
+
+bool TextMappedFile::readLines(qint64 position, qint64 end, int count, QVector<Kate::TextLine> &lines) const
+{
+    QByteArray bytes;
+    bool ok = readBytes(position, end, bytes);
+
+    /**
+     * decode the lines, the bytes must hold exactly the lines index() found
+     */
+    const uchar *data = reinterpret_cast<const uchar *>(bytes.constData());
+    qint64 linePosition = 0;
+    int decoded = 0;
+    for (; ok && decoded < count; ++decoded) {
+        if (linePosition < 0) {
+            ok = false;
+            break;
+        }
+
+        qint64 lineEnd = 0;
+        const qint64 next = nextLine(data, bytes.size(), linePosition, lineEnd);
+        lines.append(TextLine::create(decode(bytes.constData() + linePosition, int(lineEnd - linePosition))));
+        linePosition = next;
+    }
+
+    if (ok && linePosition >= 0 && linePosition != bytes.size()) {
+        ok = false;
+    }
+
+    /**
+     * the file changed behind our back, the best we can do is to hand out empty lines
+     */
+    if (!ok) {
+        m_readFailed.store(1);
+        for (; decoded < count; ++decoded) {
+            lines.append(TextLine::create(QString()));
+        }
+    }
+
+    return ok;
+}
+
+bool TextMappedFile::readBytes(qint64 position, qint64 end, QByteArray &data) const
+{
+    Q_ASSERT(position >= 0 && position <= end && end <= m_size);
+
+    /**
+     * read, don't access a mapping: if the file got truncated, we just get less bytes
+     */
+    QMutexLocker locker(&m_fileMutex);
+    if (m_file.seek(position)) {
+        data = m_file.read(end - position);
+    }
+
+    if (data.size() != end - position) {
+        m_readFailed.store(1);
+        return false;
+    }
+
+    return true;
+}
+
+QString TextMappedFile::decode(const char *data, int length) const
+{
+    return m_utf8 ? QString::fromUtf8(data, length) : m_codec->toUnicode(data, length);
+}
+
+qint64 TextMappedFile::nextLine(const uchar *data, qint64 size, qint64 position, qint64 &lineEnd) const
+{
+    /**
+     * limit search for line end, if the line is too long we wrap it anyway
+     * utf-8 needs at most three bytes per utf-16 char
+     */
+    qint64 searchEnd = size;
+    if (m_lineLengthLimit > 0) {
+        searchEnd = qMin(size, position + (m_utf8 ? 3 : 1) * qint64(m_lineLengthLimit) + 1);
+    }
+
+    const char *chars = reinterpret_cast<const char *>(data);
+    const char *lf = static_cast<const char *>(memchr(chars + position, '\n', searchEnd - position));
+    const char *cr = static_cast<const char *>(memchr(chars + position, '\r', (lf ? (lf - chars) : searchEnd) - position));
+
+    qint64 next = -1;
+    if (cr) {
+        /**
+         * \r\n is one line end, \r alone, too
+         */
+        lineEnd = cr - chars;
+        next = (lineEnd + 1 < size && data[lineEnd + 1] == '\n') ? (lineEnd + 2) : (lineEnd + 1);
+    } else if (lf) {
+        lineEnd = lf - chars;
+        next = lineEnd + 1;
+    } else {
+        /**
+         * either end of data or line longer than search range
+         */
+        lineEnd = searchEnd;
+        if (searchEnd < size) {
+            next = searchEnd;
+        }
+    }
+
+    /**
+     * wrap too long lines, next line starts directly behind the wrap position
+     */
+    const qint64 wrap = wrapPosition(data, position, lineEnd);
+    if (wrap < lineEnd) {
+        lineEnd = wrap;
+        return wrap;
+    }
+
+    return next;
+}
+
+qint64 TextMappedFile::wrapPosition(const uchar *data, qint64 position, qint64 lineEnd) const
+{
+    /**
+     * each char needs at least one byte, no need to count chars for short lines
+     */
+    if ((m_lineLengthLimit <= 0) || (lineEnd - position <= m_lineLengthLimit)) {
+        return lineEnd;
+    }
+
+    /**
+     * search the byte offset of the first char behind the limit
+     * for utf-8 count utf-16 chars like QString does, chars outside the BMP need two of them
+     */
+    qint64 limitPosition = position + m_lineLengthLimit;
+    if (m_utf8) {
+        int length = 0;
+        limitPosition = position;
+        while (limitPosition < lineEnd) {
+            const int charLength = (data[limitPosition] >= 0xf0) ? 2 : 1;
+            if (length + charLength > m_lineLengthLimit) {
+                break;
+            }
+
+            length += charLength;
+            ++limitPosition;
+            while (limitPosition < lineEnd && (data[limitPosition] & 0xc0) == 0x80) {
+                ++limitPosition;
+            }
+        }
+
+        if (limitPosition == lineEnd) {
+            return lineEnd;
+        }
+
+        /**
+         * tiny limit and a char outside the BMP, take at least that char
+         */
+        if (limitPosition == position) {
+            ++limitPosition;
+            while (limitPosition < lineEnd && (data[limitPosition] & 0xc0) == 0x80) {
+                ++limitPosition;
+            }
+            return limitPosition;
+        }
+    }
+
+    /**
+     * search for place to wrap in the last 10% of the chars, like TextBuffer::load does
+     * only ascii spaces and punctuation are considered
+     */
+    qint64 testPosition = limitPosition;
+    for (int tested = 0; (tested < m_lineLengthLimit / 10) && (testPosition > position);) {
+        // step back one char
+        --testPosition;
+        while (m_utf8 && (testPosition > position) && ((data[testPosition] & 0xc0) == 0x80)) {
+            --testPosition;
+        }
+
+        const uchar c = data[testPosition];
+        if (c < 0x80 && (QChar::fromLatin1(c).isSpace() || QChar::fromLatin1(c).isPunct())) {
+            return testPosition + 1;
+        }
+
+        tested += (m_utf8 && c >= 0xf0) ? 2 : 1;
+    }
+
+    return limitPosition;
+}
+
+}
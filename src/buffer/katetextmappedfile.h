@@ -0,0 +1,281 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2016 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_TEXTMAPPEDFILE_H
+#define KATE_TEXTMAPPEDFILE_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QTextCodec>
+#include <QVector>
+
+#include "katetextline.h"
+#include "katetextbuffer.h"
+
+namespace Kate
+{
+
+/**
+ * Memory mapped file, used by TextBuffer to load large files lazily.
+ * Loading only builds an index of the byte offsets at which the blocks start,
+ * the text of the lines of a block is decoded on first access.
+ *
+ * Only uncompressed files in UTF-8 or a single byte encoding are supported,
+ * for these the end of line chars can be found without decoding the data.
+ *
+ * The file is only mapped while index() scans it. Later the bytes of a block are
+ * read from the still opened file, a file truncated by another program then just
+ * gives less bytes instead of a SIGBUS on access to the mapping. Such failures are
+ * remembered, see readFailed().
+ *
+ * The file stays opened as long as this object lives, the blocks referencing it
+ * hold a shared pointer to it.
+ */
+class TextMappedFile
+{
+public:
+    /**
+     * Construct mapped file, does not open or map it.
+     * @param filename file to map
+     */
+    explicit TextMappedFile(const QString &filename);
+
+    /**
+     * Destruct mapped file, will unmap and close it.
+     */
+    ~TextMappedFile();
+
+    /**
+     * Check if given codec can be used for lazy loading.
+     * @param codec codec to check
+     * @return codec can be used?
+     */
+    static bool codecSupported(QTextCodec *codec);
+
+    /**
+     * Open and map the file.
+     * @param codec codec to decode the lines, must be supported, see codecSupported()
+     * @param lineLengthLimit lines longer than this are wrapped, <= 0 means no limit
+     * @return success, false if file can't be mapped or has a byte order mark we can't handle
+     */
+    bool open(QTextCodec *codec, int lineLengthLimit);
+
+    /**
+     * Scan the whole file, build the block index and compute the digest.
+     * The file is unmapped afterwards.
+     * @param linesPerBlock number of lines for each block, last block might have less
+     * @param blockStarts will be filled with the byte offset of the first line of each block
+     * @param lines will be filled with number of lines, this is always at least one
+     * @return success, false if the file has too many lines or too long lines to be handled lazily
+     */
+    bool index(int linesPerBlock, QVector<qint64> &blockStarts, int &lines);
+
+    /**
+     * Decode lines, this may be used from any thread.
+     * If the bytes can't be read any more or don't hold the expected lines, e.g. as the file
+     * was truncated or rewritten in place, empty lines are appended and readFailed() is set.
+     * @param position byte offset of first line to decode, as returned by index()
+     * @param end byte offset behind the last line, the start of the next block or size()
+     * @param count number of lines to decode
+     * @param lines vector the decoded lines are appended to
+     * @return success
+     */
+    bool readLines(qint64 position, qint64 end, int count, QVector<Kate::TextLine> &lines) const;
+
+    /**
+     * Did reading lines fail once? Then some lines were handed out empty.
+     * @return read failed?
+     */
+    bool readFailed() const
+    {
+        return m_readFailed.load() != 0;
+    }
+
+    /**
+     * Git compatible sha1 digest of the file content, computed by index().
+     * @return digest
+     */
+    const QByteArray &digest() const
+    {
+        return m_digest;
+    }
+
+    /**
+     * Was a byte order mark found at file start?
+     * @return byte order mark found?
+     */
+    bool byteOrderMarkFound() const
+    {
+        return m_bomFound;
+    }
+
+    /**
+     * Detected end of line mode, filled by index().
+     * @return eol mode of file
+     */
+    TextBuffer::EndOfLineMode eol() const
+    {
+        return m_eol;
+    }
+
+    /**
+     * Were too long lines wrapped by index()?
+     * @return too long lines found?
+     */
+    bool tooLongLinesWrapped() const
+    {
+        return m_tooLongLinesWrapped;
+    }
+
+    /**
+     * Length of longest line found by index(), in bytes.
+     * @return length of longest line
+     */
+    int longestLine() const
+    {
+        return m_longestLine;
+    }
+
+    /**
+     * Size of the mapped file, in bytes.
+     * @return file size
+     */
+    qint64 size() const
+    {
+        return m_size;
+    }
+
+private:
+    /**
+     * Find end of line starting at the given position.
+     * Too long lines are wrapped here, in that case the next line
+     * starts directly at the returned end.
+     * @param data bytes to search, either the mapping or the bytes of a block
+     * @param size number of bytes
+     * @param position offset of line start in data
+     * @param lineEnd will be set to the offset of the line end, without end of line chars
+     * @return offset of next line start, -1 if this is the last line
+     */
+    qint64 nextLine(const uchar *data, qint64 size, qint64 position, qint64 &lineEnd) const;
+
+    /**
+     * Compute place to wrap the given line at, if it is longer than the line length limit.
+     * @param data bytes holding the line
+     * @param position offset of line start in data
+     * @param lineEnd offset of line end in data
+     * @return offset to wrap at, lineEnd if no wrapping is needed
+     */
+    qint64 wrapPosition(const uchar *data, qint64 position, qint64 lineEnd) const;
+
+    /**
+     * Read the bytes of a block from the file.
+     * @param position byte offset of the block start
+     * @param end byte offset of the block end
+     * @param data will be filled with the bytes
+     * @return success, false if the file got truncated
+     */
+    bool readBytes(qint64 position, qint64 end, QByteArray &data) const;
+
+    /**
+     * Decode the text of a line.
+     * @param data bytes of the line
+     * @param length number of bytes
+     * @return text of the line
+     */
+    QString decode(const char *data, int length) const;
+
+private:
+    /**
+     * the file, must stay open for the mapping
+     */
+    QFile m_file;
+
+    /**
+     * protects m_file, lines of snapshots are read from other threads
+     */
+    mutable QMutex m_fileMutex;
+
+    /**
+     * mapped data, only while index() runs
+     */
+    const uchar *m_data;
+
+    /**
+     * size of the file when it was mapped
+     */
+    qint64 m_size;
+
+    /**
+     * offset of first line, behind a byte order mark
+     */
+    qint64 m_dataStart;
+
+    /**
+     * codec to decode the lines
+     */
+    QTextCodec *m_codec;
+
+    /**
+     * is the codec utf-8? we use the faster QString::fromUtf8 then
+     */
+    bool m_utf8;
+
+    /**
+     * limit for line length, longer lines are wrapped
+     */
+    int m_lineLengthLimit;
+
+    /**
+     * byte order mark found?
+     */
+    bool m_bomFound;
+
+    /**
+     * end of line mode found during index()
+     */
+    TextBuffer::EndOfLineMode m_eol;
+
+    /**
+     * did index() wrap lines?
+     */
+    bool m_tooLongLinesWrapped;
+
+    /**
+     * longest line found during index()
+     */
+    int m_longestLine;
+
+    /**
+     * digest computed by index()
+     */
+    QByteArray m_digest;
+
+    /**
+     * set once reading lines failed
+     */
+    mutable QAtomicInt m_readFailed;
+};
+
+}
+
+#endif
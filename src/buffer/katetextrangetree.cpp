@@ -0,0 +1,120 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2016 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "katetextrangetree.h"
+
+#include <QtAlgorithms>
+
+#include <limits>
+
+namespace Kate
+{
+
+void TextRangeTree::insert(TextRange *range, int startLine, int endLine)
+{
+    Q_ASSERT(startLine <= endLine);
+
+    // nothing to do if the lines are still the same, this is the usual case for updates
+    QHash<TextRange *, QPair<int, int> >::iterator it = m_lines.find(range);
+    if (it != m_lines.end()) {
+        if (it->first == startLine && it->second == endLine) {
+            return;
+        }
+
+        *it = qMakePair(startLine, endLine);
+    } else {
+        m_lines.insert(range, qMakePair(startLine, endLine));
+    }
+
+    m_dirty = true;
+}
+
+bool TextRangeTree::remove(TextRange *range)
+{
+    if (!m_lines.remove(range)) {
+        return false;
+    }
+
+    m_dirty = true;
+    return true;
+}
+
+void TextRangeTree::rangesForLine(int line, QVector<TextRange *> &ranges) const
+{
+    if (m_dirty) {
+        rebuild();
+    }
+
+    collect(0, m_nodes.size(), line, ranges);
+}
+
+void TextRangeTree::rebuild() const
+{
+    m_nodes.clear();
+    m_nodes.reserve(m_lines.size());
+    for (QHash<TextRange *, QPair<int, int> >::const_iterator it = m_lines.constBegin(); it != m_lines.constEnd(); ++it) {
+        const Node node = { it->first, it->second, it->second, it.key() };
+        m_nodes.append(node);
+    }
+
+    qSort(m_nodes.begin(), m_nodes.end(), nodeLessThan);
+    computeMaxEndLine(0, m_nodes.size());
+    m_dirty = false;
+}
+
+int TextRangeTree::computeMaxEndLine(int begin, int end) const
+{
+    if (begin >= end) {
+        return std::numeric_limits<int>::min();
+    }
+
+    const int middle = begin + (end - begin) / 2;
+    Node &node = m_nodes[middle];
+    node.maxEndLine = qMax(node.endLine, qMax(computeMaxEndLine(begin, middle), computeMaxEndLine(middle + 1, end)));
+    return node.maxEndLine;
+}
+
+void TextRangeTree::collect(int begin, int end, int line, QVector<TextRange *> &ranges) const
+{
+    while (begin < end) {
+        const int middle = begin + (end - begin) / 2;
+        const Node &node = m_nodes.at(middle);
+
+        // no range of this sub tree reaches the line
+        if (node.maxEndLine < line) {
+            return;
+        }
+
+        collect(begin, middle, line, ranges);
+
+        // this range and all behind it start after the line
+        if (node.startLine > line) {
+            return;
+        }
+
+        if (node.endLine >= line) {
+            ranges.append(node.range);
+        }
+
+        begin = middle + 1;
+    }
+}
+
+}
@@ -0,0 +1,159 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2016 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_TEXTRANGETREE_H
+#define KATE_TEXTRANGETREE_H
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QVector>
+
+namespace Kate
+{
+
+class TextRange;
+
+/**
+ * Interval tree for the ranges a TextBlock can't cache per line.
+ * Each range is stored with its start and end line, the TextBlock stores them relative
+ * to its start and clipped to the block, ends outside of the block don't change then.
+ *
+ * The tree is an array sorted by start line, the middle element of each sub array is the
+ * root of its sub tree and knows the largest end line of it. Lookups of the ranges
+ * intersecting a line are O(log n + k). Changes only mark the tree as dirty, the array
+ * is rebuilt by the next lookup, ranges change far less often than lines are painted.
+ */
+class TextRangeTree
+{
+public:
+    /**
+     * Construct an empty tree.
+     */
+    TextRangeTree()
+        : m_dirty(false)
+    {
+    }
+
+    /**
+     * Insert a range or update its lines.
+     * @param range range to insert
+     * @param startLine start line of the range
+     * @param endLine end line of the range
+     */
+    void insert(TextRange *range, int startLine, int endLine);
+
+    /**
+     * Remove a range.
+     * @param range range to remove
+     * @return was the range in the tree?
+     */
+    bool remove(TextRange *range);
+
+    /**
+     * Is the given range in the tree?
+     * @param range range to check for
+     * @return range in the tree?
+     */
+    bool contains(TextRange *range) const
+    {
+        return m_lines.contains(range);
+    }
+
+    /**
+     * Is the tree empty?
+     * @return tree empty?
+     */
+    bool isEmpty() const
+    {
+        return m_lines.isEmpty();
+    }
+
+    /**
+     * All ranges in the tree, in no special order.
+     * @return ranges in the tree
+     */
+    QList<TextRange *> ranges() const
+    {
+        return m_lines.keys();
+    }
+
+    /**
+     * Append all ranges intersecting the given line.
+     * @param line line to check intersection
+     * @param ranges will get the ranges intersecting the line
+     */
+    void rangesForLine(int line, QVector<TextRange *> &ranges) const;
+
+private:
+    /**
+     * Node of the tree, the range with its lines.
+     */
+    struct Node {
+        int startLine;
+        int endLine;
+        int maxEndLine;
+        TextRange *range;
+    };
+
+    /**
+     * Sort the nodes by start line.
+     */
+    static bool nodeLessThan(const Node &a, const Node &b)
+    {
+        return a.startLine < b.startLine;
+    }
+
+    /**
+     * Rebuild the node array from the lines of the ranges.
+     */
+    void rebuild() const;
+
+    /**
+     * Compute the largest end lines of the sub tree in [begin, end).
+     * @return largest end line of the sub tree
+     */
+    int computeMaxEndLine(int begin, int end) const;
+
+    /**
+     * Collect the ranges of the sub tree in [begin, end) intersecting the line.
+     */
+    void collect(int begin, int end, int line, QVector<TextRange *> &ranges) const;
+
+private:
+    /**
+     * start and end line for each range, this is the content of the tree
+     */
+    QHash<TextRange *, QPair<int, int> > m_lines;
+
+    /**
+     * nodes sorted by start line, only valid if not dirty
+     */
+    mutable QVector<Node> m_nodes;
+
+    /**
+     * nodes need a rebuild?
+     */
+    mutable bool m_dirty;
+};
+
+}
+
+#endif
@@ -0,0 +1,285 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2016 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "katetextsavethread.h"
+#include "katetextbuffer.h"
+
+#ifndef Q_OS_WIN
+#include <unistd.h>
+
+// needed for the mode of new files
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#include <QSaveFile>
+#include <QFile>
+#include <QCryptographicHash>
+#include <QTextEncoder>
+
+#include <KFilterDev>
+
+namespace Kate
+{
+
+/**
+ * encode the text in chunks of about this many chars
+ */
+static const int saveChunkSize = 256 * 1024;
+
+/**
+ * MIB enum of UTF-8, its size can be counted without encoding
+ */
+static const int utf8Mib = 106;
+
+/**
+ * Number of bytes UTF-8 needs for the given text.
+ * @param text text to count
+ * @return number of bytes, -1 for unpaired surrogates, the encoder replaces them
+ */
+static qint64 utf8Size(const QString &text)
+{
+    qint64 size = 0;
+    const ushort *data = text.utf16();
+    const int length = text.size();
+    for (int i = 0; i < length; ++i) {
+        const ushort c = data[i];
+        if (c < 0x80) {
+            size += 1;
+        } else if (c < 0x800) {
+            size += 2;
+        } else if (!QChar::isSurrogate(c)) {
+            size += 3;
+        } else if (QChar::isHighSurrogate(c) && (i + 1 < length) && QChar::isLowSurrogate(data[i + 1])) {
+            size += 4;
+            ++i;
+        } else {
+            return -1;
+        }
+    }
+    return size;
+}
+
+static QString eolString(TextBuffer::EndOfLineMode mode)
+{
+    if (mode == TextBuffer::eolDos) {
+        return QStringLiteral("\r\n");
+    } else if (mode == TextBuffer::eolMac) {
+        return QStringLiteral("\r");
+    }
+    return QStringLiteral("\n");
+}
+
+TextSaveThread::TextSaveThread(const TextBuffer &buffer, const QString &filename)
+    : QThread()
+    , m_filename(filename)
+    , m_snapshot(buffer)
+    , m_textCodec(buffer.textCodec())
+    , m_generateByteOrderMark(buffer.generateByteOrderMark())
+    , m_newLineAtEof(buffer.m_newLineAtEof)
+    , m_eol(eolString(buffer.endOfLineMode()))
+    , m_mimeTypeForFilterDev(buffer.m_mimeTypeForFilterDev)
+    , m_newFileMode(0)
+{
+    // codec must be set!
+    Q_ASSERT(m_textCodec);
+
+#ifndef Q_OS_WIN
+    /**
+     * mode for new files, the umask is process wide and can only be read by setting it
+     * therefore read it here, on the thread owning the buffer, never in the saving thread
+     */
+    const mode_t mask = umask(0);
+    umask(mask);
+    m_newFileMode = 0666 & ~mask;
+#endif
+}
+
+TextSaveThread::~TextSaveThread()
+{
+    // thread must be done
+    Q_ASSERT(!isRunning());
+}
+
+void TextSaveThread::run()
+{
+    write();
+}
+
+bool TextSaveThread::encode(QIODevice *device, QCryptographicHash *hash, qint64 &size) const
+{
+    /**
+     * same encoding as a QTextStream would do, byte order mark only if wanted
+     */
+    QTextEncoder encoder(m_textCodec, m_generateByteOrderMark ? QTextCodec::DefaultConversion : QTextCodec::IgnoreHeader);
+
+    size = 0;
+    QString chunk;
+    chunk.reserve(saveChunkSize + m_eol.size());
+    const int lines = m_snapshot.lines();
+    for (int i = 0; i < lines; ++i) {
+        chunk += m_snapshot.line(i);
+
+        // append correct end of line string
+        if (hasEndOfLine(i)) {
+            chunk += m_eol;
+        }
+
+        // hand out full chunks and the last one
+        if (chunk.size() < saveChunkSize && (i + 1) < lines) {
+            continue;
+        }
+
+        const QByteArray data = encoder.fromUnicode(chunk);
+        chunk.clear();
+        size += data.size();
+
+        if (hash) {
+            hash->addData(data);
+        }
+
+        if (device && device->write(data) != data.size()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+qint64 TextSaveThread::encodedSize() const
+{
+    if (m_textCodec->mibEnum() != utf8Mib) {
+        qint64 size = 0;
+        encode(0, 0, size);
+        return size;
+    }
+
+    /**
+     * UTF-8 is counted without encoding, the end of line strings are ASCII
+     * the byte order mark is the size of the encoding of a single ASCII char minus one
+     */
+    QTextEncoder encoder(m_textCodec, m_generateByteOrderMark ? QTextCodec::DefaultConversion : QTextCodec::IgnoreHeader);
+    qint64 size = encoder.fromUnicode(QStringLiteral("a")).size() - 1;
+    const int lines = m_snapshot.lines();
+    for (int i = 0; i < lines; ++i) {
+        const qint64 lineSize = utf8Size(m_snapshot.line(i));
+        if (lineSize < 0) {
+            // unpaired surrogates, let the encoder count
+            encode(0, 0, size);
+            return size;
+        }
+
+        size += lineSize;
+        if (hasEndOfLine(i)) {
+            size += m_eol.size();
+        }
+    }
+    return size;
+}
+
+bool TextSaveThread::hasEndOfLine(int line) const
+{
+    return ((line + 1) < m_snapshot.lines()) || (m_newLineAtEof && m_snapshot.lineLength(line) > 0);
+}
+
+bool TextSaveThread::write()
+{
+    m_result = Result();
+
+#ifndef Q_OS_WIN
+    const bool newFile = !QFile::exists(m_filename);
+#endif
+
+    /**
+     * use QSaveFile for save write + rename
+     */
+    QSaveFile saveFile(m_filename);
+    saveFile.setDirectWriteFallback(true);
+
+    if (!saveFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    /**
+     * construct correct filter device and try to open
+     */
+    KCompressionDevice::CompressionType type = KFilterDev::compressionTypeForMimeType(m_mimeTypeForFilterDev);
+    KCompressionDevice file(&saveFile, false, type);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    /**
+     * the digest of uncompressed files is computed from the written bytes
+     * the git header needs the size first, it is counted before, without writing
+     * for compressed files we don't know the size before compressing, no digest for them
+     */
+    QCryptographicHash crypto(QCryptographicHash::Sha1);
+    const bool computeDigest = (type == KCompressionDevice::None);
+    qint64 digestSize = 0;
+    if (computeDigest) {
+        digestSize = encodedSize();
+        crypto.addData(QString(QLatin1String("blob %1")).arg(digestSize).toLatin1() + '\0');
+    }
+
+    // write all lines
+    qint64 size = 0;
+    bool ok = encode(&file, computeDigest ? &crypto : 0, size);
+
+    // lines of a lazy loaded file that changed on disk are empty, don't write them over the real content
+    ok = ok && !m_snapshot.readFailed();
+    Q_ASSERT(!ok || !computeDigest || size == digestSize);
+
+    // close file
+    file.close();
+
+    // flush file
+    if (!ok || !saveFile.flush()) {
+        return false;
+    }
+
+#ifndef Q_OS_WIN
+    // QTemporaryFile sets permissions to 0600, new files get the usual ones
+    if (newFile) {
+        fchmod(saveFile.handle(), m_newFileMode);
+    }
+
+    // ensure that the file is written to disk
+#ifdef HAVE_FDATASYNC
+    fdatasync(saveFile.handle());
+#else
+    fsync(saveFile.handle());
+#endif
+#endif
+
+    // did save work?
+    ok = saveFile.commit();
+
+    m_result.success = ok;
+    if (ok && computeDigest && (size == digestSize)) {
+        m_result.digest = crypto.result();
+    }
+    return ok;
+}
+
+}
@@ -0,0 +1,180 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2016 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_TEXTSAVETHREAD_H
+#define KATE_TEXTSAVETHREAD_H
+
+#include <QThread>
+#include <QTextCodec>
+#include <QByteArray>
+#include <QString>
+
+#include "katetextbuffersnapshot.h"
+
+class QIODevice;
+class QCryptographicHash;
+
+namespace Kate
+{
+
+class TextBuffer;
+
+/**
+ * Thread to save a TextBuffer in the background.
+ * The thread encodes the lines of a snapshot of the buffer, the buffer can be edited meanwhile.
+ * The file is written through QSaveFile, the git compatible sha1 digest is computed from the
+ * written bytes while writing. The size needed for the digest header is counted before,
+ * for UTF-8 without encoding, nothing is read back or kept in memory.
+ *
+ * write() can be used directly, too, to save on the calling thread, TextBuffer::save does that.
+ * The result is only written by the thread, it may only be read after the thread finished.
+ */
+class TextSaveThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Construct the saving thread, takes a snapshot and copies all settings needed from the buffer.
+     * Only on the thread owning the buffer.
+     * @param buffer buffer to save
+     * @param filename file to save to
+     */
+    TextSaveThread(const TextBuffer &buffer, const QString &filename);
+
+    /**
+     * Destruct the thread, must be finished.
+     */
+    ~TextSaveThread();
+
+    /**
+     * File we save to.
+     * @return file name
+     */
+    const QString &fileName() const
+    {
+        return m_filename;
+    }
+
+    /**
+     * Revision of the buffer we save.
+     * @return saved revision
+     */
+    qint64 revision() const
+    {
+        return m_snapshot.revision();
+    }
+
+    /**
+     * Write the file, run() does this in the background.
+     * @return success
+     */
+    bool write();
+
+    /**
+     * Result of the saving.
+     */
+    struct Result {
+        Result()
+            : success(false)
+        {
+        }
+
+        bool success;
+
+        /**
+         * git compatible sha1 digest of the written file, empty if not computed, like for compressed files
+         */
+        QByteArray digest;
+    };
+
+    /**
+     * Result of the saving, only valid after the thread finished or write() returned.
+     * @return saving result
+     */
+    const Result &result() const
+    {
+        return m_result;
+    }
+
+protected:
+    /**
+     * Write the file.
+     */
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    /**
+     * Encode all lines and write the bytes to the device.
+     * The text is encoded in chunks, the lines are never all in memory at once.
+     * @param device device to write to, 0 to only count the bytes
+     * @param hash if not 0, gets all encoded bytes added
+     * @param size will get the number of bytes
+     * @return success, false if writing failed
+     */
+    bool encode(QIODevice *device, QCryptographicHash *hash, qint64 &size) const;
+
+    /**
+     * Number of bytes encode() will produce, without writing anything.
+     * @return encoded size
+     */
+    qint64 encodedSize() const;
+
+    /**
+     * Is the given line followed by an end of line string in the file?
+     * @param line line to check
+     * @return end of line string needed
+     */
+    bool hasEndOfLine(int line) const;
+
+private:
+    /**
+     * file to save to
+     */
+    const QString m_filename;
+
+    /**
+     * text to save
+     */
+    const TextBufferSnapshot m_snapshot;
+
+    /**
+     * settings copied from buffer
+     */
+    QTextCodec *const m_textCodec;
+    const bool m_generateByteOrderMark;
+    const bool m_newLineAtEof;
+    const QString m_eol;
+    const QString m_mimeTypeForFilterDev;
+
+    /**
+     * mode for newly created files, computed from the umask on construction
+     */
+    uint m_newFileMode;
+
+    /**
+     * saving result
+     */
+    Result m_result;
+};
+
+}
+
+#endif
@@ -163,6 +163,8 @@ KateCompletionWidget::KateCompletionWidget(KTextEditor::ViewPrivate *parent)
     connect(&view()->doc()->buffer(), SIGNAL(lineUnwrapped(int)), this, SLOT(unwrapLine(int)));
     connect(&view()->doc()->buffer(), SIGNAL(textInserted(KTextEditor::Cursor,QString)), this, SLOT(insertText(KTextEditor::Cursor,QString)));
     connect(&view()->doc()->buffer(), SIGNAL(textRemoved(KTextEditor::Range,QString)), this, SLOT(removeText(KTextEditor::Range)));
+    connect(&view()->doc()->buffer(), SIGNAL(linesInserted(int,QStringList)), this, SLOT(insertLines(int,QStringList)));
+    connect(&view()->doc()->buffer(), SIGNAL(linesRemoved(int,QStringList)), this, SLOT(removeLines(int,QStringList)));
 
     // This is a non-focus widget, it is passed keyboard input from the view
 
@@ -1348,6 +1350,24 @@ void KateCompletionWidget::unwrapLine(int)
     m_automaticInvocationTimer->stop();
 }
 
+void KateCompletionWidget::insertLines(int, const QStringList &)
+{
+    m_lastInsertionByUser = !m_completionEditRunning;
+
+    // whole lines, like wrap line, be done
+    m_automaticInvocationLine.clear();
+    m_automaticInvocationTimer->stop();
+}
+
+void KateCompletionWidget::removeLines(int, const QStringList &)
+{
+    m_lastInsertionByUser = !m_completionEditRunning;
+
+    // just removal
+    m_automaticInvocationLine.clear();
+    m_automaticInvocationTimer->stop();
+}
+
 void KateCompletionWidget::insertText(const KTextEditor::Cursor &position, const QString &text)
 {
     m_lastInsertionByUser = !m_completionEditRunning;
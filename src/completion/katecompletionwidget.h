@@ -24,6 +24,7 @@
 
 #include <QFrame>
 #include <QObject>
+#include <QStringList>
 
 #include <ktexteditor_export.h>
 
@@ -181,6 +182,8 @@ private Q_SLOTS:
     void unwrapLine(int line);
     void insertText(const KTextEditor::Cursor &position, const QString &text);
     void removeText(const KTextEditor::Range &range);
+    void insertLines(int line, const QStringList &lines);
+    void removeLines(int line, const QStringList &lines);
 
 private:
     void updateAndShow();
@@ -210,14 +210,16 @@ void KateWordCompletionModel::completionInvoked(KTextEditor::View *view, const K
 QStringList KateWordCompletionModel::allMatches(KTextEditor::View *view, const KTextEditor::Range &range) const
 {
     QSet<QString> result;
-    const int minWordSize = qMax(2, qobject_cast<KTextEditor::ViewPrivate *>(view)->config()->wordCompletionMinimalWordLength());
-    const int lines = view->document()->lines();
-    for (int line = 0; line < lines; line++) {
-        const QString &text = view->document()->line(line);
+    KTextEditor::ViewPrivate *viewPrivate = qobject_cast<KTextEditor::ViewPrivate *>(view);
+    const int minWordSize = qMax(2, viewPrivate->config()->wordCompletionMinimalWordLength());
+    const KTextEditor::Cursor cursorPosition = view->cursorPosition();
+
+    // visit the text of the lines directly, no copies of all lines of the document
+    viewPrivate->doc()->buffer().visitLines(0, view->document()->lines() - 1, [&](int line, const QStringRef & text) {
         int wordBegin = 0;
         int offset = 0;
         const int end = text.size();
-        const bool cursorLine = view->cursorPosition().line() == line;
+        const bool cursorLine = cursorPosition.line() == line;
         while (offset < end) {
             const QChar c = text.at(offset);
             // increment offset when at line end, so we take the last character too
@@ -226,8 +228,8 @@ QStringList KateWordCompletionModel::allMatches(KTextEditor::View *view, const K
                     /**
                      * don't add the word we are inside with cursor!
                      */
-                    if (!cursorLine || (view->cursorPosition().column() < wordBegin || view->cursorPosition().column() > offset)) {
-                        result.insert(text.mid(wordBegin, offset - wordBegin));
+                    if (!cursorLine || (cursorPosition.column() < wordBegin || cursorPosition.column() > offset)) {
+                        result.insert(QString(text.unicode() + wordBegin, offset - wordBegin));
                     }
                 }
                 wordBegin = offset + 1;
@@ -237,7 +239,8 @@ QStringList KateWordCompletionModel::allMatches(KTextEditor::View *view, const K
             }
             offset += 1;
         }
-    }
+        return true;
+    });
     return result.values();
 }
 
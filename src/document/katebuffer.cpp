@@ -32,6 +32,7 @@
 #include <KFilterDev>
 
 #include <QDate>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
 #include <QTextCodec>
@@ -43,6 +44,33 @@
  */
 static const int KATE_MAX_DYNAMIC_CONTEXTS = 512;
 
+/**
+ * Lines behind the highlighted area that are highlighted at once for painting,
+ * for lines farther away the highlighting is done in the background
+ */
+static const int KATE_HL_SYNCHRONOUS_LINES = 512;
+
+/**
+ * Time in ms the highlighting in the background may block the event loop at once
+ */
+static const int KATE_HL_BACKGROUND_TIME_SLICE = 20;
+
+/**
+ * Lines highlighted by the background highlighting between two checks of the time
+ */
+static const int KATE_HL_BACKGROUND_LINES = 64;
+
+/**
+ * Lines behind the wanted ones doHighlight() highlights at most to find the end of a
+ * change of the context, the remaining lines get highlighted on demand
+ */
+static const int KATE_HL_CONVERGENCE_LINES = 512;
+
+/**
+ * Maximal number of stale ranges remembered, the farthest ones are dropped
+ */
+static const int KATE_HL_MAX_STALE_RANGES = 16;
+
 /**
  * Create an empty buffer. (with one block with one empty line)
  */
@@ -52,11 +80,21 @@ KateBuffer::KateBuffer(KTextEditor::DocumentPrivate *doc)
       m_brokenEncoding(false),
       m_tooLongLinesWrapped(false),
       m_longestLineLoaded(0),
+      m_loadingCanceled(false),
       m_highlight(0),
       m_tabWidth(8),
       m_lineHighlighted(0),
-      m_maxDynamicContexts(KATE_MAX_DYNAMIC_CONTEXTS)
+      m_maxDynamicContexts(KATE_MAX_DYNAMIC_CONTEXTS),
+      m_backgroundHighlightingTarget(-1),
+      m_paintedUnhighlightedStart(-1),
+      m_paintedUnhighlightedEnd(-1)
 {
+    connect(this, SIGNAL(loadingFinished(bool,bool,bool,int,bool)), this, SLOT(slotLoadingFinished(bool,bool,bool,int,bool)));
+    connect(this, SIGNAL(linesLoaded(int)), this, SLOT(slotLinesLoaded(int)));
+
+    m_backgroundHighlightingTimer.setSingleShot(true);
+    m_backgroundHighlightingTimer.setInterval(0);
+    connect(&m_backgroundHighlightingTimer, SIGNAL(timeout()), this, SLOT(backgroundHighlighting()));
 }
 
 /**
@@ -96,6 +134,11 @@ void KateBuffer::editEnd()
     Q_ASSERT(editingMaximalLineChanged() != -1);
     Q_ASSERT(editingMinimalLineChanged() <= editingMaximalLineChanged());
 
+    /**
+     * highlighting of changed lines can't converge to the one before
+     */
+    splitStaleHighlightedRanges(editingMinimalLineChanged(), editingMaximalLineChanged(), 0);
+
     /**
      * no highlighting, nothing to do
      */
@@ -134,9 +177,12 @@ void KateBuffer::clear()
     m_brokenEncoding = false;
     m_tooLongLinesWrapped = false;
     m_longestLineLoaded = 0;
+    m_loadingCanceled = false;
 
     // back to line 0 with hl
     m_lineHighlighted = 0;
+    m_staleHighlightedRanges.clear();
+    stopBackgroundHighlighting();
 }
 
 bool KateBuffer::openFile(const QString &m_file, bool enforceTextCodec)
@@ -155,10 +201,17 @@ bool KateBuffer::openFile(const QString &m_file, bool enforceTextCodec)
     // line length limit
     setLineLengthLimit(m_doc->lineLengthLimit());
 
+    // large files are loaded lazily, limit is configured in MiB
+    setLargeFileLimit(qint64(m_doc->config()->largeFileLimit()) * 1024 * 1024);
+
+    // store lines compact until they are accessed?
+    setCompactStorage(m_doc->config()->compactLineStorage());
+
     // then, try to load the file
     m_brokenEncoding = false;
     m_tooLongLinesWrapped = false;
     m_longestLineLoaded = 0;
+    m_loadingCanceled = false;
 
     /**
      * allow non-existent files without error, if local file!
@@ -189,6 +242,18 @@ bool KateBuffer::openFile(const QString &m_file, bool enforceTextCodec)
         return false;
     }
 
+    /**
+     * large files are loaded in the background, the rest is done when that is finished
+     * memory mapped lazy loading is preferred, if it applies, it is faster
+     */
+    const qint64 fileSize = QFileInfo(m_file).size();
+    const qint64 backgroundLoadLimit = qint64(m_doc->config()->backgroundLoadLimit()) * 1024 * 1024;
+    const qint64 largeFileLimit = qint64(m_doc->config()->largeFileLimit()) * 1024 * 1024;
+    if ((backgroundLoadLimit > 0) && (fileSize >= backgroundLoadLimit) && !((largeFileLimit > 0) && (fileSize >= largeFileLimit))) {
+        startLoading(m_file, enforceTextCodec);
+        return true;
+    }
+
     /**
      * try to load
      */
@@ -196,6 +261,55 @@ bool KateBuffer::openFile(const QString &m_file, bool enforceTextCodec)
         return false;
     }
 
+    takeOverLoadedFileSettings();
+
+    // okay, loading did work
+    return true;
+}
+
+void KateBuffer::cloneFrom(const KateBuffer &source)
+{
+    // share the lines, this clears us before
+    Kate::TextBuffer::cloneFrom(source);
+
+    // take over the state of the loaded file
+    m_brokenEncoding = source.m_brokenEncoding;
+    m_tooLongLinesWrapped = source.m_tooLongLinesWrapped;
+    m_longestLineLoaded = source.m_longestLineLoaded;
+    m_loadingCanceled = source.m_loadingCanceled;
+
+    // the shared lines carry the highlighting of the source, it is valid for us, too
+    if (m_highlight && (m_highlight == source.m_highlight) && (m_tabWidth == source.m_tabWidth)) {
+        m_lineHighlighted = source.m_lineHighlighted;
+    }
+}
+
+void KateBuffer::slotLoadingFinished(bool success, bool encodingErrors, bool tooLongLinesWrapped, int longestLineLoaded, bool canceled)
+{
+    m_brokenEncoding = encodingErrors;
+    m_tooLongLinesWrapped = tooLongLinesWrapped;
+    m_longestLineLoaded = longestLineLoaded;
+    m_loadingCanceled = canceled;
+
+    if (success && !canceled) {
+        takeOverLoadedFileSettings();
+    }
+
+    emit backgroundLoadFinished(success);
+}
+
+void KateBuffer::slotLinesLoaded(int line)
+{
+    // the loaded lines are not highlighted, the first ones replace a highlighted empty line
+    if (m_lineHighlighted > line) {
+        m_lineHighlighted = line;
+    }
+
+    emit tagLines(line, lines() - 1);
+}
+
+void KateBuffer::takeOverLoadedFileSettings()
+{
     // save back encoding
     m_doc->config()->setEncoding(QString::fromLatin1(textCodec()->name()));
 
@@ -208,9 +322,6 @@ bool KateBuffer::openFile(const QString &m_file, bool enforceTextCodec)
     if (generateByteOrderMark()) {
         m_doc->config()->setBom(true);
     }
-
-    // okay, loading did work
-    return true;
 }
 
 bool KateBuffer::canEncode()
@@ -235,7 +346,7 @@ bool KateBuffer::canEncode()
     return true;
 }
 
-bool KateBuffer::saveFile(const QString &m_file)
+bool KateBuffer::saveFile(const QString &m_file, QByteArray *digest)
 {
     // first: setup fallback and normal encoding
     setEncodingProberType(KateGlobalConfig::global()->proberType());
@@ -251,8 +362,8 @@ bool KateBuffer::saveFile(const QString &m_file)
     // append a newline character at the end of the file (eof) ?
     setNewLineAtEof(m_doc->config()->newLineAtEof());
 
-    // try to save
-    if (!save(m_file)) {
+    // try to save, the digest is computed from the written bytes
+    if (!save(m_file, digest)) {
         return false;
     }
 
@@ -284,24 +395,181 @@ void KateBuffer::ensureHighlighted(int line, int lookAhead)
     doHighlight(m_lineHighlighted, end, false);
 }
 
+bool KateBuffer::isLineHighlighted(int line) const
+{
+    return line < m_lineHighlighted || !m_highlight || m_highlight->noHighlighting();
+}
+
+bool KateBuffer::ensureHighlightedForPainting(int line)
+{
+    // valid line at all?
+    if (line < 0 || line >= lines()) {
+        return true;
+    }
+
+    // already hl up-to-date for this line or nothing to highlight?
+    if (line < m_lineHighlighted || !m_highlight || m_highlight->noHighlighting()) {
+        return true;
+    }
+
+    // near enough, do it at once
+    if (line - m_lineHighlighted < KATE_HL_SYNCHRONOUS_LINES) {
+        ensureHighlighted(line);
+        return true;
+    }
+
+    // remember the line to tag it later, let the background do the work
+    if (m_paintedUnhighlightedStart == -1) {
+        m_paintedUnhighlightedStart = m_paintedUnhighlightedEnd = line;
+    } else {
+        m_paintedUnhighlightedStart = qMin(m_paintedUnhighlightedStart, line);
+        m_paintedUnhighlightedEnd = qMax(m_paintedUnhighlightedEnd, line);
+    }
+
+    m_backgroundHighlightingTarget = qMax(m_backgroundHighlightingTarget, qMin(line + 64, lines() - 1));
+    if (!m_backgroundHighlightingTimer.isActive()) {
+        m_backgroundHighlightingTimer.start();
+    }
+    return false;
+}
+
+void KateBuffer::backgroundHighlighting()
+{
+    // highlighting gone or lines removed meanwhile?
+    const int target = qMin(m_backgroundHighlightingTarget, lines() - 1);
+    if (!m_highlight || m_highlight->noHighlighting() || target < 0) {
+        stopBackgroundHighlighting();
+        return;
+    }
+
+    // highlight some lines, until our time is up
+    QElapsedTimer timer;
+    timer.start();
+    while (m_lineHighlighted <= target && timer.elapsed() < KATE_HL_BACKGROUND_TIME_SLICE) {
+        const int start = m_lineHighlighted;
+        doHighlight(start, qMin(start + KATE_HL_BACKGROUND_LINES - 1, target), false);
+
+        // no progress possible, e.g. dynamic contexts got reset
+        if (m_lineHighlighted <= start) {
+            break;
+        }
+    }
+
+    // tag the lines painted without highlighting that are done now, the views repaint them
+    const int highlightedEnd = qMin(m_lineHighlighted - 1, lines() - 1);
+    if (m_paintedUnhighlightedStart != -1 && m_paintedUnhighlightedStart <= highlightedEnd) {
+        const int tagStart = m_paintedUnhighlightedStart;
+        const int tagEnd = qMin(m_paintedUnhighlightedEnd, highlightedEnd);
+        if (tagEnd < m_paintedUnhighlightedEnd) {
+            m_paintedUnhighlightedStart = tagEnd + 1;
+        } else {
+            m_paintedUnhighlightedStart = m_paintedUnhighlightedEnd = -1;
+        }
+
+        emit tagLines(tagStart, tagEnd);
+        m_doc->repaintViews(true);
+    }
+
+    // more to do? continue after the pending events
+    if (m_lineHighlighted <= target) {
+        m_backgroundHighlightingTimer.start();
+    } else {
+        m_backgroundHighlightingTarget = -1;
+    }
+}
+
+void KateBuffer::stopBackgroundHighlighting()
+{
+    m_backgroundHighlightingTimer.stop();
+    m_backgroundHighlightingTarget = -1;
+    m_paintedUnhighlightedStart = m_paintedUnhighlightedEnd = -1;
+}
+
 void KateBuffer::wrapLine(const KTextEditor::Cursor &position)
 {
+    // refused while loading, nothing changes
+    if (editingRefused()) {
+        return;
+    }
+
     // call original
     Kate::TextBuffer::wrapLine(position);
 
     if (m_lineHighlighted > position.line() + 1) {
         m_lineHighlighted++;
     }
+    splitStaleHighlightedRanges(position.line() + 1, position.line(), 1);
+
+    // lines painted without highlighting may move down, tagging some more is fine
+    if (m_paintedUnhighlightedEnd > position.line()) {
+        ++m_paintedUnhighlightedEnd;
+    }
 }
 
 void KateBuffer::unwrapLine(int line)
 {
+    // refused while loading, nothing changes
+    if (editingRefused()) {
+        return;
+    }
+
     // reimplemented, so first call original
     Kate::TextBuffer::unwrapLine(line);
 
     if (m_lineHighlighted > line) {
         --m_lineHighlighted;
     }
+    splitStaleHighlightedRanges(line, line, -1);
+
+    // lines painted without highlighting move up, the joined line gets tagged, too
+    if (m_paintedUnhighlightedEnd >= line) {
+        --m_paintedUnhighlightedEnd;
+        m_paintedUnhighlightedStart = qMin(m_paintedUnhighlightedStart, m_paintedUnhighlightedEnd);
+    }
+}
+
+void KateBuffer::insertLines(int line, const QStringList &lines)
+{
+    // refused while loading, nothing changes
+    if (editingRefused()) {
+        return;
+    }
+
+    // call original
+    Kate::TextBuffer::insertLines(line, lines);
+
+    if (m_lineHighlighted > line + 1) {
+        m_lineHighlighted += lines.size();
+    }
+    splitStaleHighlightedRanges(line + 1, line, lines.size());
+
+    if (m_paintedUnhighlightedEnd > line) {
+        m_paintedUnhighlightedEnd += lines.size();
+    }
+}
+
+void KateBuffer::removeLines(int from, int to)
+{
+    // refused while loading, nothing changes
+    if (editingRefused()) {
+        return;
+    }
+
+    // reimplemented, so first call original
+    Kate::TextBuffer::removeLines(from, to);
+
+    if (m_lineHighlighted > to) {
+        m_lineHighlighted -= to - from + 1;
+    } else if (m_lineHighlighted > from) {
+        m_lineHighlighted = from;
+    }
+    splitStaleHighlightedRanges(from, to, from - to - 1);
+
+    // lines painted without highlighting move up, removed ones are forgotten
+    if (m_paintedUnhighlightedEnd >= from) {
+        m_paintedUnhighlightedEnd = (m_paintedUnhighlightedEnd > to) ? (m_paintedUnhighlightedEnd - (to - from + 1)) : (from - 1);
+        m_paintedUnhighlightedStart = qMin(m_paintedUnhighlightedStart, m_paintedUnhighlightedEnd);
+    }
 }
 
 void KateBuffer::setTabWidth(int w)
@@ -349,6 +617,46 @@ void KateBuffer::setHighlight(int hlMode)
 void KateBuffer::invalidateHighlighting()
 {
     m_lineHighlighted = 0;
+    m_staleHighlightedRanges.clear();
+}
+
+void KateBuffer::splitStaleHighlightedRanges(int from, int to, int shift)
+{
+    if (m_staleHighlightedRanges.isEmpty()) {
+        return;
+    }
+
+    // ranges need two lines at least to be of use
+    QVector<QPair<int, int> > ranges;
+    for (int i = 0; i < m_staleHighlightedRanges.size(); ++i) {
+        const QPair<int, int> &range = m_staleHighlightedRanges[i];
+
+        const int frontEnd = qMin(range.second, from);
+        if (frontEnd - range.first >= 2) {
+            ranges.append(qMakePair(range.first, frontEnd));
+        }
+
+        const int backStart = qMax(range.first, to + 1);
+        if (range.second - backStart >= 2) {
+            ranges.append(qMakePair(backStart + shift, range.second + shift));
+        }
+    }
+    m_staleHighlightedRanges = ranges;
+}
+
+int KateBuffer::staleHighlightedRangeEnd(int line) const
+{
+    for (int i = 0; i < m_staleHighlightedRanges.size(); ++i) {
+        const QPair<int, int> &range = m_staleHighlightedRanges[i];
+        if (range.first > line) {
+            break;
+        }
+
+        if (line + 1 < range.second) {
+            return range.second;
+        }
+    }
+    return -1;
 }
 
 void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
@@ -401,6 +709,13 @@ void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
     // if possible get previous line, otherwise create 0 line.
     Kate::TextLine prevLine = (startLine >= 1) ? plainLine(startLine - 1) : Kate::TextLine();
 
+    // lines behind endLine are only highlighted to find the end of a change of the context
+    const int lastLine = qMin(endLine + KATE_HL_CONVERGENCE_LINES, lines() - 1);
+    int validEnd = -1;
+
+    // lines shared with a cloned buffer must be copied before we change their highlighting
+    detachLines(startLine, lastLine);
+
     // here we are atm, start at start line in the block
     int current_line = startLine;
     int start_spellchecking = -1;
@@ -408,9 +723,10 @@ void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
     bool ctxChanged = false;
     Kate::TextLine textLine = plainLine(current_line);
     Kate::TextLine nextLine;
+
     // loop over the lines of the block, from startline to endline or end of block
     // if stillcontinue forces us to do so
-    for (; current_line < qMin(endLine + 1, lines()); ++current_line) {
+    for (; current_line <= lastLine; ++current_line) {
         // get next line, if any
         if ((current_line + 1) < lines()) {
             nextLine = plainLine(current_line + 1);
@@ -444,27 +760,76 @@ void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
         // move around the lines
         prevLine = textLine;
         textLine = nextLine;
+
+        /**
+         * lines behind that got highlighted before consistent with the end state of this line?
+         * the valid ones after the wanted lines, the ones of a stale range anywhere
+         */
+        int consistentEnd = staleHighlightedRangeEnd(current_line);
+        if (consistentEnd == -1 && current_line >= endLine && current_line + 1 < m_lineHighlighted) {
+            consistentEnd = m_lineHighlighted;
+        }
+
+        /**
+         * end state as before: the lines behind are still valid, skip them, if wanted at all
+         */
+        if (!ctxChanged && consistentEnd != -1) {
+            if (consistentEnd > endLine) {
+                validEnd = consistentEnd;
+                ++current_line;
+                break;
+            }
+
+            current_line = consistentEnd - 1;
+            prevLine = plainLine(consistentEnd - 1);
+            textLine = plainLine(consistentEnd);
+            continue;
+        }
+
+        /**
+         * behind the wanted lines, only go on if the change may still converge
+         */
+        if (current_line >= endLine && consistentEnd == -1) {
+            ++current_line;
+            break;
+        }
     }
 
     /**
      * perhaps we need to adjust the maximal highlighed line
      */
     int oldHighlighted = m_lineHighlighted;
-    if (ctxChanged || current_line > m_lineHighlighted) {
+    if (validEnd != -1) {
+        // the context converged, the lines behind are valid
+        m_lineHighlighted = qMax(m_lineHighlighted, validEnd);
+    } else if (ctxChanged || current_line > m_lineHighlighted) {
+        // the valid lines behind turn stale, later highlighting might converge to them
+        if (ctxChanged && oldHighlighted - current_line >= 2) {
+            m_staleHighlightedRanges.prepend(qMakePair(current_line, oldHighlighted));
+            if (m_staleHighlightedRanges.size() > KATE_HL_MAX_STALE_RANGES) {
+                m_staleHighlightedRanges.removeLast();
+            }
+        }
+
         m_lineHighlighted = current_line;
     }
 
-    // tag the changed lines !
+    // the stale ranges start behind the valid lines
+    splitStaleHighlightedRanges(0, m_lineHighlighted - 1, 0);
+
+    // tag the changed lines, all behind them, too, if the context did not converge
     if (invalidate) {
+        const int tagEnd = (validEnd != -1) ? current_line : qMax(current_line, oldHighlighted);
+
 #ifdef BUFFER_DEBUGGING
-        qCDebug(LOG_KTE) << "HIGHLIGHTED TAG LINES: " << startLine <<  current_line;
+        qCDebug(LOG_KTE) << "HIGHLIGHTED TAG LINES: " << startLine << tagEnd;
 #endif
 
-        emit tagLines(startLine, qMax(current_line, oldHighlighted));
+        emit tagLines(startLine, tagEnd);
 
         if (start_spellchecking >= 0 && lines() > 0) {
             emit respellCheckBlock(start_spellchecking,
-                                   qMin(lines() - 1, (last_line_spellchecking == -1) ? qMax(current_line, oldHighlighted) : last_line_spellchecking));
+                                   qMin(lines() - 1, (last_line_spellchecking == -1) ? tagEnd : last_line_spellchecking));
         }
     }
 
@@ -590,16 +955,17 @@ KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
         /**
          * walk over all attributes of the line and compute the matchings
          */
-        const QVector<Kate::TextLineData::Attribute> &startLineAttributes = startTextLine->attributesList();
-        for (int i = 0; i < startLineAttributes.size(); ++i) {
+        for (Kate::TextLineData::AttributeIterator it(*startTextLine); !it.atEnd(); it.next()) {
+            const Kate::TextLineData::Attribute &attribute = it.attribute();
+
             /**
              * folding close?
              */
-            if (startLineAttributes[i].foldingValue < 0) {
+            if (attribute.foldingValue < 0) {
                 /**
                  * search for this type, try to decrement counter, perhaps erase element!
                  */
-                QHash<short, QPair<int, int> >::iterator end = foldingStartToOffsetAndCount.find(-startLineAttributes[i].foldingValue);
+                QHash<short, QPair<int, int> >::iterator end = foldingStartToOffsetAndCount.find(-attribute.foldingValue);
                 if (end != foldingStartToOffsetAndCount.end()) {
                     if (end.value().second > 1) {
                         --(end.value().second);
@@ -612,15 +978,15 @@ KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
             /**
              * folding open?
              */
-            if (startLineAttributes[i].foldingValue > 0) {
+            if (attribute.foldingValue > 0) {
                 /**
                  * search for this type, either insert it, with current offset or increment counter!
                  */
-                QHash<short, QPair<int, int> >::iterator start = foldingStartToOffsetAndCount.find(startLineAttributes[i].foldingValue);
+                QHash<short, QPair<int, int> >::iterator start = foldingStartToOffsetAndCount.find(attribute.foldingValue);
                 if (start != foldingStartToOffsetAndCount.end()) {
                     ++(start.value().second);
                 } else {
-                    foldingStartToOffsetAndCount.insert(startLineAttributes[i].foldingValue, qMakePair(startLineAttributes[i].offset, 1));
+                    foldingStartToOffsetAndCount.insert(attribute.foldingValue, qMakePair(attribute.offset, 1));
                 }
             }
         }
@@ -659,12 +1025,13 @@ KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
         /**
          * search for matching end marker
          */
-        const QVector<Kate::TextLineData::Attribute> &lineAttributes = textLine->attributesList();
-        for (int i = 0; i < lineAttributes.size(); ++i) {
+        for (Kate::TextLineData::AttributeIterator it(*textLine); !it.atEnd(); it.next()) {
+            const Kate::TextLineData::Attribute &attribute = it.attribute();
+
             /**
              * matching folding close?
              */
-            if (lineAttributes[i].foldingValue == -openedRegionType) {
+            if (attribute.foldingValue == -openedRegionType) {
                 --countOfOpenRegions;
 
                 /**
@@ -677,7 +1044,7 @@ KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
                      * fixes folding for stuff like
                      * #pragma mark END_OLD_AND_START_NEW_REGION
                      */
-                    KTextEditor::Cursor endCursor(line, lineAttributes[i].offset);
+                    KTextEditor::Cursor endCursor(line, attribute.offset);
                     if (endCursor.column() == 0 && endCursor.line() > 0) {
                         endCursor = KTextEditor::Cursor(endCursor.line() - 1, plainLine(lines() - 1)->length());
                     }
@@ -692,7 +1059,7 @@ KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
             /**
              * matching folding open?
              */
-            if (lineAttributes[i].foldingValue == openedRegionType) {
+            if (attribute.foldingValue == openedRegionType) {
                 ++countOfOpenRegions;
             }
         }
@@ -26,6 +26,7 @@
 #include <ktexteditor_export.h>
 
 #include <QObject>
+#include <QTimer>
 
 class KateLineInfo;
 namespace KTextEditor { class DocumentPrivate; }
@@ -109,12 +110,31 @@ public:
 
     /**
      * Open a file, use the given filename
+     * Large files are loaded in the background, then this returns with the first lines loaded
+     * and backgroundLoadFinished() is emitted later, check isLoading().
      * @param m_file filename to open
      * @param enforceTextCodec enforce to use only the set text codec
      * @return success
      */
     bool openFile(const QString &m_file, bool enforceTextCodec);
 
+    /**
+     * Replace the content by the content of another buffer, see Kate::TextBuffer::cloneFrom().
+     * The lines are shared copy-on-write, the highlighting of the source is kept, if
+     * this buffer uses the same highlighting and tab width.
+     * @param source buffer to clone, must not load in the background
+     */
+    void cloneFrom(const KateBuffer &source);
+
+    /**
+     * Was loading in the background canceled? Then only the start of the file is there.
+     * @return loading canceled?
+     */
+    bool loadingCanceled() const
+    {
+        return m_loadingCanceled;
+    }
+
     /**
      * Did encoding errors occur on load?
      * @return encoding errors occurred on load?
@@ -147,9 +167,10 @@ public:
     /**
      * Save the buffer to a file, use the given filename + codec + end of line chars (internal use of qtextstream)
      * @param m_file filename to save to
+     * @param digest if not 0, will get the digest of the written file, see Kate::TextBuffer::save
      * @return success
      */
-    bool saveFile(const QString &m_file);
+    bool saveFile(const QString &m_file, QByteArray *digest = 0);
 
 public:
     /**
@@ -177,6 +198,25 @@ public:
      */
     void ensureHighlighted(int line, int lookAhead = 64);
 
+    /**
+     * Update highlighting of given line @p line for painting, without blocking.
+     * Lines near the highlighted area are highlighted at once, like ensureHighlighted() does.
+     * For lines farther away, the highlighting is done in the background in small steps
+     * between the events, tagLines() is emitted once they are done. Until then the line
+     * should be painted with its old highlighting or without any, use plainLine() to get it.
+     * @param line line to paint
+     * @return highlighting of the line is up to date
+     */
+    bool ensureHighlightedForPainting(int line);
+
+    /**
+     * Is the highlighting of the given line up to date?
+     * Unlike ensureHighlightedForPainting() this never highlights anything.
+     * @param line line to check
+     * @return highlighting of the line is up to date
+     */
+    bool isLineHighlighted(int line) const;
+
     /**
      * Return the total number of lines in the buffer.
      */
@@ -197,6 +237,20 @@ public:
      */
     void wrapLine(const KTextEditor::Cursor &position) Q_DECL_OVERRIDE;
 
+    /**
+     * Insert whole lines behind the given line.
+     * @param line line to insert the new lines behind
+     * @param lines text of the new lines
+     */
+    void insertLines(int line, const QStringList &lines) Q_DECL_OVERRIDE;
+
+    /**
+     * Remove whole lines, the last line can't be removed.
+     * @param from first line to remove
+     * @param to last line to remove
+     */
+    void removeLines(int from, int to) Q_DECL_OVERRIDE;
+
 public:
     inline int tabWidth() const
     {
@@ -242,7 +296,59 @@ private:
      */
     void doHighlight(int from, int to, bool invalidate);
 
+    /**
+     * Take over encoding, eol and bom settings of the loaded file into the document config.
+     */
+    void takeOverLoadedFileSettings();
+
+    /**
+     * Stop the highlighting in the background, forget the lines painted without highlighting.
+     */
+    void stopBackgroundHighlighting();
+
+    /**
+     * Lines of the stale ranges lose their highlighting as they changed or got removed,
+     * the ranges are split there, lines behind move, see m_staleHighlightedRanges.
+     * @param from first line changed or removed, lines get inserted there if to < from
+     * @param to last line changed or removed
+     * @param shift lines behind move by this
+     */
+    void splitStaleHighlightedRanges(int from, int to, int shift);
+
+    /**
+     * Find the stale range the given line and the following one are part of.
+     * @param line line to search
+     * @return end of the range, -1 if none
+     */
+    int staleHighlightedRangeEnd(int line) const;
+
+private Q_SLOTS:
+    /**
+     * Highlight the next lines requested by ensureHighlightedForPainting(), for some
+     * milliseconds, then give the event loop a chance, until all lines are done.
+     * It always continues at the first line without valid highlighting, edits before
+     * the lines requested therefore restart it from the first changed line.
+     */
+    void backgroundHighlighting();
+
+    /**
+     * Loading in the background finished, remember the results.
+     */
+    void slotLoadingFinished(bool success, bool encodingErrors, bool tooLongLinesWrapped, int longestLineLoaded, bool canceled);
+
+    /**
+     * Loading in the background changed lines, they need highlighting and repainting.
+     * @param line first changed line
+     */
+    void slotLinesLoaded(int line);
+
 Q_SIGNALS:
+    /**
+     * Loading started by openFile() in the background is done.
+     * @param success the file got loaded, perhaps only partially, see loadingCanceled()
+     */
+    void backgroundLoadFinished(bool success);
+
     /**
      * Emitted when the highlighting of a certain range has
      * changed.
@@ -271,6 +377,11 @@ private:
      */
     int m_longestLineLoaded;
 
+    /**
+     * loading in background canceled?
+     */
+    bool m_loadingCanceled;
+
     /**
      * current highlighting mode or 0
      */
@@ -284,10 +395,35 @@ private:
      */
     int m_lineHighlighted;
 
+    /**
+     * Ranges of lines behind m_lineHighlighted, as start + end line (exclusive), sorted.
+     * The highlighting of each range was consistent in itself, when the context in front of
+     * it changed. If a line of a range gets highlighted again with the same end state as
+     * before, the lines behind it are valid again, up to the end of the range.
+     */
+    QVector<QPair<int, int> > m_staleHighlightedRanges;
+
     /**
      * number of dynamic contexts causing a full invalidation
      */
     int m_maxDynamicContexts;
+
+    /**
+     * timer for the highlighting in the background, see backgroundHighlighting()
+     */
+    QTimer m_backgroundHighlightingTimer;
+
+    /**
+     * last line the highlighting in the background shall reach, -1 if none
+     */
+    int m_backgroundHighlightingTarget;
+
+    /**
+     * lines handed out for painting without up to date highlighting, to tag them once done,
+     * -1 if none
+     */
+    int m_paintedUnhighlightedStart;
+    int m_paintedUnhighlightedEnd;
 };
 
 #endif
@@ -238,6 +238,11 @@ KTextEditor::DocumentPrivate::DocumentPrivate(bool bSingleViewMode,
 
     // some nice signals from the buffer
     connect(m_buffer, SIGNAL(tagLines(int,int)), this, SLOT(tagLines(int,int)));
+    connect(m_buffer, SIGNAL(loadingProgress(int)), this, SLOT(slotLoadingProgress()));
+    connect(m_buffer, SIGNAL(backgroundLoadFinished(bool)), this, SLOT(slotBackgroundLoadFinished(bool)));
+
+    // emitted while lines are accessed, e.g. during painting, react later
+    connect(m_buffer, SIGNAL(fileReadError()), this, SLOT(slotFileReadError()), Qt::QueuedConnection);
 
     // if the user changes the highlight with the dialog, notify the doc
     connect(KateHlManager::self(), SIGNAL(changed()), SLOT(internalHlChanged()));
@@ -451,41 +456,20 @@ QString KTextEditor::DocumentPrivate::text(const KTextEditor::Range &range, bool
         return QString();
     }
 
-    QString s;
-
-    if (range.start().line() == range.end().line()) {
-        if (range.start().column() > range.end().column()) {
-            return QString();
-        }
-
-        Kate::TextLine textLine = m_buffer->plainLine(range.start().line());
-
-        if (!textLine) {
-            return QString();
-        }
-
-        return textLine->string(range.start().column(), range.end().column() - range.start().column());
-    } else {
+    // the buffer copies the lines directly, single lines are the same blockwise
+    if (!blockwise || range.onSingleLine()) {
+        return m_buffer->text(range);
+    }
 
-        for (int i = range.start().line(); (i <= range.end().line()) && (i < m_buffer->count()); ++i) {
-            Kate::TextLine textLine = m_buffer->plainLine(i);
+    QString s;
+    for (int i = range.start().line(); (i <= range.end().line()) && (i < m_buffer->count()); ++i) {
+        Kate::TextLine textLine = m_buffer->plainLine(i);
 
-            if (!blockwise) {
-                if (i == range.start().line()) {
-                    s.append(textLine->string(range.start().column(), textLine->length() - range.start().column()));
-                } else if (i == range.end().line()) {
-                    s.append(textLine->string(0, range.end().column()));
-                } else {
-                    s.append(textLine->string());
-                }
-            } else {
-                KTextEditor::Range subRange = rangeOnLine(range, i);
-                s.append(textLine->string(subRange.start().column(), subRange.columnWidth()));
-            }
+        KTextEditor::Range subRange = rangeOnLine(range, i);
+        s.append(textLine->string(subRange.start().column(), subRange.columnWidth()));
 
-            if (i < range.end().line()) {
-                s.append(QLatin1Char('\n'));
-            }
+        if (i < range.end().line()) {
+            s.append(QLatin1Char('\n'));
         }
     }
 
@@ -673,6 +657,63 @@ bool KTextEditor::DocumentPrivate::setText(const QStringList &text)
     return true;
 }
 
+bool KTextEditor::DocumentPrivate::cloneFrom(KTextEditor::DocumentPrivate *source)
+{
+    if (!source || source == this || source->m_buffer->isLoading()) {
+        return false;
+    }
+
+    /**
+     * we are about to invalidate all cursors/ranges/.. => m_buffer->cloneFrom will do so
+     */
+    emit aboutToInvalidateMovingInterfaceContent(this);
+
+    // same highlighting first, then the shared lines keep theirs
+    updateFileType(source->mode());
+    setHighlightingMode(source->highlightingMode());
+
+    // remove all marks, they belong to the old text
+    clearMarks();
+
+    // the clone below stops loading in the background, we are no longer loading then
+    if (m_buffer->isLoading()) {
+        setReadWrite(m_readWriteStateBeforeLoading);
+        delete m_loadingMessage;
+        m_documentState = DocumentIdle;
+    }
+
+    // share the lines
+    m_buffer->cloneFrom(*source->m_buffer);
+
+    // clear undo/redo history
+    m_undoManager->clearUndo();
+    m_undoManager->clearRedo();
+
+    // no, we are not modified
+    setModified(false);
+
+    // update all our views
+    foreach (KTextEditor::ViewPrivate *view, m_views) {
+        view->setCursorPosition(KTextEditor::Cursor());
+        view->updateView(true);
+    }
+
+    // Inform that the text has changed (required as we're not inside the usual editStart/End stuff)
+    emit textChanged(this);
+    return true;
+}
+
+KTextEditor::DocumentPrivate::MemoryUsage KTextEditor::DocumentPrivate::memoryUsage() const
+{
+    MemoryUsage usage;
+    m_buffer->memoryUsage(usage.text, usage.highlighting, usage.history, usage.movingRanges);
+    usage.undo = m_undoManager->memoryUsage();
+    foreach (KTextEditor::ViewPrivate *view, m_views) {
+        usage.layouts += view->layoutMemoryUsage();
+    }
+    return usage;
+}
+
 bool KTextEditor::DocumentPrivate::clear()
 {
     if (!isReadWrite()) {
@@ -731,6 +772,27 @@ bool KTextEditor::DocumentPrivate::insertText(const KTextEditor::Cursor &positio
     }
     int positionColumnExpanded = insertColumnExpanded;
 
+    /**
+     * many lines: insert the first part, wrap once and insert the lines in between as whole lines
+     * this is a lot faster than wrapping for each line, e.g. for large pastes
+     */
+    if (!block && text.count(newLineChar) > 1) {
+        const QStringList textLines = text.split(newLineChar);
+        if (!textLines.first().isEmpty()) {
+            editInsertText(currentLine, insertColumn, textLines.first());
+        }
+
+        editWrapLine(currentLine, insertColumn + textLines.first().size());
+        editInsertLines(currentLine + 1, textLines.mid(1, textLines.size() - 2));
+
+        if (!textLines.last().isEmpty()) {
+            editInsertText(currentLine + textLines.size() - 1, 0, textLines.last());
+        }
+
+        editEnd();
+        return true;
+    }
+
     int pos = 0;
     for (; pos < totalLength; pos++) {
         const QChar &ch = text.at(pos);
@@ -875,12 +937,7 @@ bool KTextEditor::DocumentPrivate::insertLines(int line, const QStringList &text
         return false;
     }
 
-    bool success = true;
-    foreach (const QString &string, text) {
-        success &= editInsertLine(line++, string);
-    }
-
-    return success;
+    return editInsertLines(line, text);
 }
 
 bool KTextEditor::DocumentPrivate::removeLine(int line)
@@ -1301,6 +1358,9 @@ bool KTextEditor::DocumentPrivate::editMarkLineAutoWrapped(int line, bool autowr
 
     m_undoManager->slotMarkLineAutoWrapped(line, autowrapped);
 
+    // the line might be shared with a cloned document
+    m_buffer->detachLines(line, line);
+    l = kateTextLine(line);
     l->setAutoWrapped(autowrapped);
 
     editEnd();
@@ -1449,9 +1509,14 @@ bool KTextEditor::DocumentPrivate::editUnWrapLine(int line, bool removeLine, int
 }
 
 bool KTextEditor::DocumentPrivate::editInsertLine(int line, const QString &s)
+{
+    return editInsertLines(line, QStringList() << s);
+}
+
+bool KTextEditor::DocumentPrivate::editInsertLines(int line, const QStringList &text)
 {
     // verbose debug
-    EDIT_DEBUG << "editInsertLine" << line << s;
+    EDIT_DEBUG << "editInsertLines" << line << text.size();
 
     if (line < 0) {
         return false;
@@ -1465,23 +1530,26 @@ bool KTextEditor::DocumentPrivate::editInsertLine(int line, const QString &s)
         return false;
     }
 
+    if (text.isEmpty()) {
+        return true;
+    }
+
     editStart();
 
-    m_undoManager->slotLineInserted(line, s);
+    m_undoManager->slotLinesInserted(line, text);
 
-    // wrap line
+    // insert the lines behind the previous line, in front of the first line wrap it and fill the new line
+    const int previousLineLength = (line > 0) ? m_buffer->line(line - 1)->length() : 0;
     if (line > 0) {
-        Kate::TextLine previousLine = m_buffer->line(line - 1);
-        m_buffer->wrapLine(KTextEditor::Cursor(line - 1, previousLine->text().size()));
+        m_buffer->insertLines(line - 1, text);
     } else {
         m_buffer->wrapLine(KTextEditor::Cursor(0, 0));
+        m_buffer->insertText(KTextEditor::Cursor(0, 0), text.first());
+        if (text.size() > 1) {
+            m_buffer->insertLines(0, text.mid(1));
+        }
     }
 
-    // insert text
-    m_buffer->insertText(KTextEditor::Cursor(line, 0), s);
-
-    Kate::TextLine tl = m_buffer->line(line);
-
     QList<KTextEditor::Mark *> list;
     for (QHash<int, KTextEditor::Mark *>::const_iterator i = m_marks.constBegin(); i != m_marks.constEnd(); ++i) {
         if (i.value()->line >= line) {
@@ -1494,7 +1562,7 @@ bool KTextEditor::DocumentPrivate::editInsertLine(int line, const QString &s)
     }
 
     for (int i = 0; i < list.size(); ++i) {
-        list.at(i)->line++;
+        list.at(i)->line += text.size();
         m_marks.insert(list.at(i)->line, list.at(i));
     }
 
@@ -1502,13 +1570,12 @@ bool KTextEditor::DocumentPrivate::editInsertLine(int line, const QString &s)
         emit marksChanged(this);
     }
 
-    KTextEditor::Range rangeInserted(line, 0, line, tl->length());
+    KTextEditor::Range rangeInserted(line, 0, line + text.size() - 1, text.last().size());
 
     if (line) {
-        Kate::TextLine prevLine = plainKateTextLine(line - 1);
-        rangeInserted.setStart(KTextEditor::Cursor(line - 1, prevLine->length()));
+        rangeInserted.setStart(KTextEditor::Cursor(line - 1, previousLineLength));
     } else {
-        rangeInserted.setEnd(KTextEditor::Cursor(line + 1, 0));
+        rangeInserted.setEnd(KTextEditor::Cursor(line + text.size(), 0));
     }
 
     emit textInserted(this, rangeInserted);
@@ -1542,29 +1609,27 @@ bool KTextEditor::DocumentPrivate::editRemoveLines(int from, int to)
 
     editStart();
     QStringList oldText;
-
-    /**
-     * first remove text
-     */
-    for (int line = to; line >= from; --line) {
-        Kate::TextLine tl = m_buffer->line(line);
-        oldText.prepend(this->line(line));
-        m_undoManager->slotLineRemoved(line, this->line(line));
-
-        m_buffer->removeText(KTextEditor::Range(KTextEditor::Cursor(line, 0), KTextEditor::Cursor(line, tl->text().size())));
+    oldText.reserve(to - from + 1);
+    for (int line = from; line <= to; ++line) {
+        oldText.append(this->line(line));
     }
 
+    m_undoManager->slotLinesRemoved(from, oldText);
+
     /**
-     * then collapse lines
+     * remove the lines at once, the line behind them moves up
+     * the last line can't be removed, remove the lines in front of it, clear it and unwrap it, skip to unwrap line 0
      */
-    for (int line = to; line >= from; --line) {
-        /**
-         * unwrap all lines, prefer to unwrap line behind, skip to wrap line 0
-         */
-        if (line + 1 < m_buffer->lines()) {
-            m_buffer->unwrapLine(line + 1);
-        } else if (line) {
-            m_buffer->unwrapLine(line);
+    if (to < lastLine()) {
+        m_buffer->removeLines(from, to);
+    } else {
+        if (from < to) {
+            m_buffer->removeLines(from, to - 1);
+        }
+
+        m_buffer->removeText(KTextEditor::Range(from, 0, from, m_buffer->line(from)->length()));
+        if (from > 0) {
+            m_buffer->unwrapLine(from);
         }
     }
 
@@ -2251,6 +2316,32 @@ bool KTextEditor::DocumentPrivate::openFile()
 
     bool success = m_buffer->openFile(localFilePath(), (m_reloading && m_userSetEncodingForNextReload));
 
+    //
+    // large file loaded in the background, show the first lines now
+    // no editing until the rest is there, see slotBackgroundLoadFinished
+    //
+    if (success && m_buffer->isLoading()) {
+        if (m_documentState != DocumentLoading) {
+            m_documentState = DocumentLoading;
+            m_readWriteStateBeforeLoading = isReadWrite();
+        }
+        setReadWrite(false);
+
+        foreach (KTextEditor::ViewPrivate *view, m_views) {
+            view->setCursorPosition(KTextEditor::Cursor());
+            view->updateView(true);
+        }
+
+        QTimer::singleShot(1000, this, SLOT(slotTriggerLoadingMessage()));
+        return true;
+    }
+
+    finishOpenFile(success, true);
+    return success;
+}
+
+void KTextEditor::DocumentPrivate::finishOpenFile(bool success, bool resetViews)
+{
     // disable view updates
     foreach (KTextEditor::ViewPrivate *view, m_views) {
         view->setUpdatesEnabled(false);
@@ -2269,7 +2360,10 @@ bool KTextEditor::DocumentPrivate::openFile()
     //
     foreach (KTextEditor::ViewPrivate *view, m_views) {
         // This is needed here because inserting the text moves the view's start position (it is a MovingCursor)
-        view->setCursorPosition(KTextEditor::Cursor());
+        // Not after background loading, the user might have moved around already
+        if (resetViews) {
+            view->setCursorPosition(KTextEditor::Cursor());
+        }
         view->setUpdatesEnabled(true);
         view->updateView(true);
     }
@@ -2340,16 +2434,79 @@ bool KTextEditor::DocumentPrivate::openFile()
                                      "Those lines were wrapped and the document is set to read-only mode, as saving will modify its content.", this->url().toString(), config()->lineLengthLimit(),m_buffer->longestLineLoaded());
     }
 
-    //
-    // return the success
-    //
-    return success;
+    // warn: loading aborted
+    if (m_buffer->loadingCanceled()) {
+        // this file can't be saved again without losing its end
+        setReadWrite(false);
+        m_readWriteStateBeforeLoading=false;
+        QPointer<KTextEditor::Message> message
+            = new KTextEditor::Message(i18n("Loading of the file %1 was aborted, only its first %2 lines are shown.<br />"
+                                            "The document is set to read-only mode, as saving would destroy the rest of the file.", this->url().toString(), lines()),
+                                       KTextEditor::Message::Warning);
+        message->setWordWrap(true);
+        postMessage(message);
+
+        // remember error
+        m_openingError = true;
+        m_openingErrorMessage = i18n("Loading of the file %1 was aborted, only its first %2 lines are shown."
+                                     " The document is set to read-only mode, as saving would destroy the rest of the file.", this->url().toString(), lines());
+    }
+}
+
+void KTextEditor::DocumentPrivate::slotLoadingProgress()
+{
+    // more lines arrived, update line count and scrollbars
+    foreach (KTextEditor::ViewPrivate *view, m_views) {
+        view->updateView(true);
+    }
+}
+
+void KTextEditor::DocumentPrivate::slotBackgroundLoadFinished(bool success)
+{
+    // document closed meanwhile
+    if (m_documentState != DocumentLoading) {
+        return;
+    }
+
+    finishOpenFile(success, false);
+
+    // this finishes the loading, restores the read-write state, too
+    slotCompleted();
+}
+
+void KTextEditor::DocumentPrivate::slotFileReadError()
+{
+    // document reloaded or closed meanwhile
+    if (!m_buffer->fileReadFailed()) {
+        return;
+    }
+
+    // the empty lines would overwrite the content of the file on saving
+    setReadWrite(false);
+    m_readWriteStateBeforeLoading = false;
+    QPointer<KTextEditor::Message> message
+        = new KTextEditor::Message(i18n("The file %1 was changed by another program while it was loaded, some lines could not be read and are shown empty.<br />"
+                                        "The document is set to read-only mode and can't be saved, as saving would destroy the content of the file. Please reload the file.", this->url().toString()),
+                                   KTextEditor::Message::Error);
+    message->setWordWrap(true);
+    postMessage(message);
+
+    // remember error
+    m_openingError = true;
+    m_openingErrorMessage = i18n("The file %1 was changed by another program while it was loaded, some lines could not be read and are shown empty."
+                                 " The document is set to read-only mode and can't be saved, as saving would destroy the content of the file. Please reload the file.", this->url().toString());
 }
 
 bool KTextEditor::DocumentPrivate::saveFile()
 {
     QWidget *parentWidget(dialogParent());
 
+    // lines of the file could not be read, they are empty, saving them would destroy the file
+    if (m_buffer->fileReadFailed()) {
+        KMessageBox::error(parentWidget, i18n("The document could not be saved, as some lines of the file %1 could not be read, it was changed by another program while it was loaded.\n\nPlease reload the file.", this->url().toString()));
+        return false;
+    }
+
     // some warnings, if file was changed by the outside!
     if (!url().isEmpty()) {
         if (m_fileChangedDialogsActivated && m_modOnHd) {
@@ -2480,7 +2637,8 @@ bool KTextEditor::DocumentPrivate::saveFile()
     //
     // try to save
     //
-    if (!m_buffer->saveFile(localFilePath())) {
+    QByteArray digest;
+    if (!m_buffer->saveFile(localFilePath(), &digest)) {
         // add m_file again to dirwatch
         activateDirWatch(oldPath);
 
@@ -2489,8 +2647,12 @@ bool KTextEditor::DocumentPrivate::saveFile()
         return false;
     }
 
-    // update the checksum
-    createDigest();
+    // update the checksum, computed while writing, only compressed files must be read again
+    if (!digest.isEmpty() && url().isLocalFile()) {
+        m_buffer->setDigest(digest);
+    } else {
+        createDigest();
+    }
 
     // add m_file again to dirwatch
     activateDirWatch();
@@ -2677,6 +2839,13 @@ bool KTextEditor::DocumentPrivate::closeUrl()
     // remove all marks
     clearMarks();
 
+    // the clear below stops loading in the background, we are no longer loading then
+    if (m_buffer->isLoading()) {
+        setReadWrite(m_readWriteStateBeforeLoading);
+        delete m_loadingMessage;
+        m_documentState = DocumentIdle;
+    }
+
     // clear the buffer
     m_buffer->clear();
 
@@ -5281,6 +5450,13 @@ void KTextEditor::DocumentPrivate::slotStarted(KIO::Job *job)
 
 void KTextEditor::DocumentPrivate::slotCompleted()
 {
+    /**
+     * still loading in the background, we are completed only after that
+     */
+    if (m_documentState == DocumentLoading && m_buffer->isLoading()) {
+        return;
+    }
+
     /**
      * if were loading, reset back to old read-write mode before loading
      * and kill the possible loading message
@@ -5345,9 +5521,9 @@ void KTextEditor::DocumentPrivate::slotTriggerLoadingMessage()
     m_loadingMessage->setPosition(KTextEditor::Message::TopInView);
 
     /**
-     * if around job: add cancel action
+     * if around job or loading in background: add cancel action
      */
-    if (m_loadingJob) {
+    if (m_loadingJob || m_buffer->isLoading()) {
         QAction *cancel = new QAction(i18n("&Abort Loading"), 0);
         connect(cancel, SIGNAL(triggered()), this, SLOT(slotAbortLoading()));
         m_loadingMessage->addAction(cancel);
@@ -5361,6 +5537,14 @@ void KTextEditor::DocumentPrivate::slotTriggerLoadingMessage()
 
 void KTextEditor::DocumentPrivate::slotAbortLoading()
 {
+    /**
+     * loading in background? stop it, we keep what we got so far
+     */
+    if (m_buffer->isLoading()) {
+        m_buffer->cancelLoading();
+        return;
+    }
+
     /**
      * no job, no work
      */
@@ -177,6 +177,56 @@ public Q_SLOTS:
         return KTextEditor::Document::replaceText(r, l, b);
     }
 
+public:
+    /**
+     * Replace the text by the text of another document, like setText(source->text()), but
+     * without copying: the lines are shared copy-on-write with the source, together with their
+     * highlighting, see KateBuffer::cloneFrom(). Mode and highlighting are taken over,
+     * marks and undo history are cleared, the document is not modified afterwards.
+     * @param source document to clone, must not load in the background
+     * @return success, fails for this document itself and for a source still loading
+     */
+    bool cloneFrom(KTextEditor::DocumentPrivate *source);
+
+    /**
+     * Estimated memory usage of a document, in bytes, split by subsystem.
+     */
+    struct MemoryUsage {
+        MemoryUsage()
+            : text(0)
+            , highlighting(0)
+            , layouts(0)
+            , undo(0)
+            , history(0)
+            , movingRanges(0)
+        {
+        }
+
+        qint64 total() const
+        {
+            return text + highlighting + layouts + undo + history + movingRanges;
+        }
+
+        qint64 text;
+        qint64 highlighting;
+        qint64 layouts;
+        qint64 undo;
+        qint64 history;
+        qint64 movingRanges;
+    };
+
+    /**
+     * Estimate the memory used by this document: text and highlighting of the buffer,
+     * the layouts cached by all views, undo groups, editing history and moving ranges.
+     * The estimates are rough, they are meant to find the documents and subsystems that
+     * use the most memory, not to count bytes exactly. Highlighting covers the attributes
+     * of the lines only: the context stacks are interned and shared by all documents, the
+     * folding ranges of the views are not counted. Lines shared with a clone are split
+     * among the documents sharing them.
+     * @return memory usage
+     */
+    MemoryUsage memoryUsage() const;
+
 public:
     bool isEditingTransactionRunning() const Q_DECL_OVERRIDE;
     QString text(const KTextEditor::Range &range, bool blockwise = false) const Q_DECL_OVERRIDE;
@@ -312,6 +362,15 @@ public:
      * @return true on success
      */
     bool editInsertLine(int line, const QString &s);
+
+    /**
+     * Insert whole lines in front of the given line, all at once.
+     * @param line line number, the new lines get this line number and the ones behind
+     * @param text text of the lines to insert
+     * @return true on success
+     */
+    bool editInsertLines(int line, const QStringList &text);
+
     /**
      * Remove a line
      * @param line line number
@@ -741,6 +800,17 @@ public:
      */
     bool openFile() Q_DECL_OVERRIDE;
 
+private:
+    /**
+     * Second part of openFile(), after the buffer is filled.
+     * Updates the views and reports loading problems.
+     * @param success did loading work?
+     * @param resetViews move the views to the document start
+     */
+    void finishOpenFile(bool success, bool resetViews);
+
+public:
+
     /**
      * save the file obtained by the kparts framework
      * the framework abstracts the uploading of remote files
@@ -1049,6 +1119,15 @@ public:
         return *m_buffer;
     }
 
+    /**
+     * Get read access to buffer of this document.
+     * @return document buffer
+     */
+    const KateBuffer &buffer() const
+    {
+        return *m_buffer;
+    }
+
     /**
      * set indentation mode by user
      * this will remember that a user did set it and will avoid reset on save
@@ -1293,6 +1372,22 @@ private Q_SLOTS:
      */
     void slotAbortLoading();
 
+    /**
+     * Loading in background made progress, update the views.
+     */
+    void slotLoadingProgress();
+
+    /**
+     * Loading in background finished.
+     * @param success did loading work?
+     */
+    void slotBackgroundLoadFinished(bool success);
+
+    /**
+     * Lines of a lazily loaded file could not be read, the file changed on disk.
+     */
+    void slotFileReadError();
+
     void slotUrlChanged(const QUrl &url);
 
 private:
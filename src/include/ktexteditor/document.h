@@ -130,6 +130,9 @@ Q_DECLARE_OPERATORS_FOR_FLAGS(SearchOptions)
  *
  * Every text editing transaction is also available through the signals
  * lineWrapped(), lineUnwrapped(), textInserted() and textRemoved().
+ * Edits of many whole lines, like pasting or removing a large block of text,
+ * are applied in one step: the signals for each of their lines are emitted
+ * after the complete edit, the document already holds its result then.
  * However, these signals should be used with care. Please be aware of the
  * following warning:
  *
@@ -878,6 +881,7 @@ Q_SIGNALS:
 
     /**
      * A line got wrapped.
+     * For edits of many whole lines this is emitted after the complete edit.
      * \param document document which emitted this signal
      * @param position position where the wrap occurred
      */
@@ -885,6 +889,7 @@ Q_SIGNALS:
 
     /**
      * A line got unwrapped.
+     * For edits of many whole lines this is emitted after the complete edit.
      * \param document document which emitted this signal
      * @param line line where the unwrap occurred
      */
@@ -892,6 +897,7 @@ Q_SIGNALS:
 
     /**
      * Text got inserted.
+     * For edits of many whole lines this is emitted after the complete edit.
      * \param document document which emitted this signal
      * @param position position where the insertion occurred
      * @param text inserted text
@@ -900,6 +906,7 @@ Q_SIGNALS:
 
     /**
      * Text got removed.
+     * For edits of many whole lines this is emitted after the complete edit.
      * \param document document which emitted this signal
      * @param range range where the removal occurred
      * @param text removed text
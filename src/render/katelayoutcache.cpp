@@ -23,6 +23,8 @@
 
 #include <QtAlgorithms>
 
+#include <limits>
+
 #include "katerenderer.h"
 #include "kateview.h"
 #include "katedocument.h"
@@ -134,6 +136,15 @@ void KateLineLayoutMap::slotEditDone(int fromLine, int toLine, int shiftAmount)
     }
 }
 
+qint64 KateLineLayoutMap::memoryUsage() const
+{
+    qint64 usage = qint64(m_lineLayouts.capacity()) * sizeof(LineLayoutPair);
+    foreach (const LineLayoutPair &pair, m_lineLayouts) {
+        usage += pair.second->memoryUsage();
+    }
+    return usage;
+}
+
 KateLineLayoutPtr &KateLineLayoutMap::operator[](int i)
 {
     LineLayoutMap::iterator it =
@@ -159,6 +170,9 @@ KateLayoutCache::KateLayoutCache(KateRenderer *renderer, QObject *parent)
     connect(&m_renderer->doc()->buffer(), SIGNAL(lineUnwrapped(int)), this, SLOT(unwrapLine(int)));
     connect(&m_renderer->doc()->buffer(), SIGNAL(textInserted(KTextEditor::Cursor,QString)), this, SLOT(insertText(KTextEditor::Cursor,QString)));
     connect(&m_renderer->doc()->buffer(), SIGNAL(textRemoved(KTextEditor::Range,QString)), this, SLOT(removeText(KTextEditor::Range)));
+    connect(&m_renderer->doc()->buffer(), SIGNAL(linesInserted(int,QStringList)), this, SLOT(insertLines(int,QStringList)));
+    connect(&m_renderer->doc()->buffer(), SIGNAL(linesRemoved(int,QStringList)), this, SLOT(removeLines(int,QStringList)));
+    connect(&m_renderer->doc()->buffer(), SIGNAL(linesLoaded(int)), this, SLOT(loadLines(int)));
 }
 
 void KateLayoutCache::updateViewCache(const KTextEditor::Cursor &startPos, int newViewLineCount, int viewLinesScrolled)
@@ -303,12 +317,12 @@ KateLineLayoutPtr KateLayoutCache::line(int realLine, int virtualLine)
         }
 
         if (!l->isValid()) {
-            l->setUsePlainTextLine(acceptDirtyLayouts());
+            l->setUsePlainTextLine(usePlainTextLine(realLine));
             l->textLine(!acceptDirtyLayouts());
             m_renderer->layoutLine(l, wrap() ? m_viewWidth : -1, enableLayoutCache);
         } else if (l->isLayoutDirty() && !acceptDirtyLayouts()) {
             // reset textline
-            l->setUsePlainTextLine(false);
+            l->setUsePlainTextLine(usePlainTextLine(realLine));
             l->textLine(true);
             m_renderer->layoutLine(l, wrap() ? m_viewWidth : -1, enableLayoutCache);
         }
@@ -327,9 +341,7 @@ KateLineLayoutPtr KateLayoutCache::line(int realLine, int virtualLine)
 
     // Mark it dirty, because it may not have the syntax highlighting applied
     // mark this here, to allow layoutLine to use plainLines...
-    if (acceptDirtyLayouts()) {
-        l->setUsePlainTextLine(true);
-    }
+    l->setUsePlainTextLine(usePlainTextLine(realLine));
 
     m_renderer->layoutLine(l, wrap() ? m_viewWidth : -1, enableLayoutCache);
     Q_ASSERT(l->isValid());
@@ -505,6 +517,11 @@ int KateLayoutCache::viewLineCount(int realLine)
     return lastViewLine(realLine) + 1;
 }
 
+qint64 KateLayoutCache::memoryUsage() const
+{
+    return m_lineLayouts.memoryUsage() + qint64(m_textLayouts.capacity()) * sizeof(KateTextLayout);
+}
+
 void KateLayoutCache::viewCacheDebugOutput() const
 {
     qCDebug(LOG_KTE) << "Printing values for " << m_textLayouts.count() << " lines:";
@@ -538,6 +555,22 @@ void KateLayoutCache::removeText(const KTextEditor::Range &range)
     m_lineLayouts.slotEditDone(range.start().line(), range.start().line(), 0);
 }
 
+void KateLayoutCache::insertLines(int line, const QStringList &lines)
+{
+    m_lineLayouts.slotEditDone(line, line + 1, lines.size());
+}
+
+void KateLayoutCache::removeLines(int line, const QStringList &lines)
+{
+    m_lineLayouts.slotEditDone(line, line + lines.size() - 1, -lines.size());
+}
+
+void KateLayoutCache::loadLines(int line)
+{
+    // lines from there on got replaced or appended by loading in the background
+    m_lineLayouts.slotEditDone(line, std::numeric_limits<int>::max(), 0);
+}
+
 void KateLayoutCache::clear()
 {
     m_textLayouts.clear();
@@ -582,6 +615,11 @@ void KateLayoutCache::relayoutLines(int startRealLine, int endRealLine)
     m_lineLayouts.relayoutLines(startRealLine, endRealLine);
 }
 
+bool KateLayoutCache::usePlainTextLine(int realLine) const
+{
+    return m_acceptDirtyLayouts || !m_renderer->doc()->buffer().ensureHighlightedForPainting(realLine);
+}
+
 bool KateLayoutCache::acceptDirtyLayouts()
 {
     return m_acceptDirtyLayouts;
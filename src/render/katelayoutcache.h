@@ -23,6 +23,7 @@
 #define KATELAYOUTCACHE_H
 
 #include <QPair>
+#include <QStringList>
 
 #include <ktexteditor/range.h>
 
@@ -51,6 +52,8 @@ public:
 
     KateLineLayoutPtr &operator[](int i);
 
+    qint64 memoryUsage() const;
+
     typedef QPair<int, KateLineLayoutPtr> LineLayoutPair;
 private:
     typedef QVector<LineLayoutPair> LineLayoutMap;
@@ -139,11 +142,31 @@ public:
     void viewCacheDebugOutput() const;
     // END
 
+    /**
+     * Estimate the memory used by the cached layouts, for the memory accounting of the documents.
+     * The internals of QTextLayout are not accessible, they are guessed from text length and line count.
+     * @return bytes used
+     */
+    qint64 memoryUsage() const;
+
 private Q_SLOTS:
     void wrapLine(const KTextEditor::Cursor &position);
     void unwrapLine(int line);
     void insertText(const KTextEditor::Cursor &position, const QString &text);
     void removeText(const KTextEditor::Range &range);
+    void insertLines(int line, const QStringList &lines);
+    void removeLines(int line, const QStringList &lines);
+    void loadLines(int line);
+
+private:
+    /**
+     * Shall the layout of the given line be done without up to date highlighting?
+     * True for dirty layouts accepted and for lines still highlighted in the background,
+     * see KateBuffer::ensureHighlightedForPainting(), they get tagged once done.
+     * @param realLine line to layout
+     * @return use plain text line
+     */
+    bool usePlainTextLine(int realLine) const;
 
 private:
     KateRenderer *m_renderer;
@@ -248,6 +248,24 @@ void KateLineLayout::setUsePlainTextLine(bool plain)
     m_usePlainTextLine = plain;
 }
 
+qint64 KateLineLayout::memoryUsage() const
+{
+    qint64 usage = sizeof(KateLineLayout) + qint64(m_dirtyList.size()) * sizeof(void *);
+
+    /**
+     * the engine of the QTextLayout is not accessible, guess it:
+     * glyphs, advances, offsets and attributes per char, item and line data per view line
+     */
+    if (m_layout) {
+        usage += sizeof(QTextLayout) + 400
+                 + qint64(m_layout->text().size()) * 32
+                 + qint64(m_layout->lineCount()) * 64
+                 + qint64(m_layout->additionalFormats().size()) * sizeof(QTextLayout::FormatRange);
+    }
+
+    return usage;
+}
+
 bool KateLineLayout::isRightToLeft() const
 {
     if (!m_layout) {
@@ -100,6 +100,12 @@ public:
     bool usePlainTextLine() const;
     void setUsePlainTextLine(bool plain = true);
 
+    /**
+     * Estimate the memory used by this layout, see KateLayoutCache::memoryUsage().
+     * @return bytes used
+     */
+    qint64 memoryUsage() const;
+
 private:
     // Disable copy
     KateLineLayout(const KateLineLayout &copy);
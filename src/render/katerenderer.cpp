@@ -376,16 +376,17 @@ QList<QTextLayout::FormatRange> KateRenderer::decorationsForLine(const Kate::Tex
 
     // Don't compute the highlighting if there isn't going to be any highlighting
     QList<Kate::TextRange *> rangesWithAttributes = m_doc->buffer().rangesForLine(line, m_printerFriendly ? 0 : m_view, true);
-    if (selectionsOnly || textLine->attributesList().count() || rangesWithAttributes.count()) {
+    if (selectionsOnly || textLine->hasAttributes() || rangesWithAttributes.count()) {
         RenderRangeList renderRanges;
 
         // Add the inbuilt highlighting to the list
         NormalRenderRange *inbuiltHighlight = new NormalRenderRange();
-        const QVector<Kate::TextLineData::Attribute> &al = textLine->attributesList();
-        for (int i = 0; i < al.count(); ++i)
-            if (al[i].length > 0 && al[i].attributeValue > 0) {
-                inbuiltHighlight->addRange(new KTextEditor::Range(KTextEditor::Cursor(line, al[i].offset), al[i].length), specificAttribute(al[i].attributeValue));
+        for (Kate::TextLineData::AttributeIterator it(*textLine); !it.atEnd(); it.next()) {
+            const Kate::TextLineData::Attribute &attribute = it.attribute();
+            if (attribute.length > 0 && attribute.attributeValue > 0) {
+                inbuiltHighlight->addRange(new KTextEditor::Range(KTextEditor::Cursor(line, attribute.offset), attribute.length), specificAttribute(attribute.attributeValue));
             }
+        }
         renderRanges.append(inbuiltHighlight);
 
         if (!completionHighlight) {
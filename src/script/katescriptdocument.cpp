@@ -20,6 +20,7 @@
 #include "katescriptdocument.h"
 
 #include "katedocument.h"
+#include "katebuffer.h"
 #include "kateview.h"
 #include "katerenderer.h"
 #include "kateconfig.h"
@@ -646,17 +647,22 @@ int KateScriptDocument::prevNonEmptyLine(int line)
 
 int KateScriptDocument::nextNonEmptyLine(int line)
 {
-    const int startLine = line;
-    for (int currentLine = startLine; currentLine < m_document->lines(); ++currentLine) {
-        Kate::TextLine textLine = m_document->plainKateTextLine(currentLine);
-        if (!textLine) {
-            return -1;
-        }
-        if (textLine->firstChar() != -1) {
-            return currentLine;
-        }
+    if (line < 0 || line >= m_document->lines()) {
+        return -1;
     }
-    return -1;
+
+    // visit the text of the lines directly, indenters scan large parts of the document with this
+    int nonEmptyLine = -1;
+    m_document->buffer().visitLines(line, m_document->lines() - 1, [&nonEmptyLine](int currentLine, const QStringRef & text) {
+        for (int i = 0; i < text.size(); ++i) {
+            if (!text.at(i).isSpace()) {
+                nonEmptyLine = currentLine;
+                return false;
+            }
+        }
+        return true;
+    });
+    return nonEmptyLine;
 }
 
 bool KateScriptDocument::isInWord(const QString &character, int attribute)
@@ -23,6 +23,8 @@
 #include "kateplaintextsearch.h"
 
 #include "kateregexpsearch.h"
+#include "katedocument.h"
+#include "katebuffer.h"
 
 #include <ktexteditor/document.h>
 
@@ -115,6 +117,24 @@ KTextEditor::Range KatePlainTextSearch::search(const QString &text, const KTextE
         const int endLine   = inputRange.end().line();
         const int forInc    = backwards ? -1 : +1;
 
+        // forward search visits the text of the lines directly, no copies of them
+        const KTextEditor::DocumentPrivate *document = qobject_cast<const KTextEditor::DocumentPrivate *>(m_document);
+        if (!backwards && document && (0 <= startLine) && (endLine < document->lines())) {
+            KTextEditor::Range found = KTextEditor::Range::invalid();
+            document->buffer().visitLines(startLine, endLine, [&](int line, const QStringRef & textLine) {
+                const int offset   = (line == startLine) ? startCol : 0;
+                const int line_end = (line ==   endLine) ?   endCol : textLine.length();
+                const int foundAt = textLine.indexOf(text, offset, m_caseSensitivity);
+
+                if ((offset <= foundAt) && (foundAt + text.length() <= line_end)) {
+                    found = KTextEditor::Range(line, foundAt, line, foundAt + text.length());
+                    return false;
+                }
+                return true;
+            });
+            return found;
+        }
+
         for (int line = backwards ? endLine : startLine; (startLine <= line) && (line <= endLine); line += forInc) {
             if ((line < 0) || (m_document->lines() <= line)) {
                 qCWarning(LOG_KTE) << "line " << line << " is not within interval [0.." << m_document->lines() << ") ... returning invalid range";
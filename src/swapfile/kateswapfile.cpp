@@ -41,8 +41,9 @@
 #include <unistd.h>
 #endif
 
-// swap file version header
-const static char swapFileVersionString[] = "Kate Swap File 2.0";
+// swap file version header, 2.1 added the whole line tokens, 2.0 files can still be recovered
+const static char swapFileVersionString[] = "Kate Swap File 2.1";
+const static char swapFileVersionString20[] = "Kate Swap File 2.0";
 
 // tokens for swap files
 const static qint8 EA_StartEditing  = 'S';
@@ -51,6 +52,8 @@ const static qint8 EA_WrapLine      = 'W';
 const static qint8 EA_UnwrapLine    = 'U';
 const static qint8 EA_InsertText    = 'I';
 const static qint8 EA_RemoveText    = 'R';
+const static qint8 EA_InsertLines   = 'L';
+const static qint8 EA_RemoveLines   = 'D';
 
 namespace Kate
 {
@@ -110,6 +113,8 @@ void SwapFile::setTrackingEnabled(bool enable)
         connect(&buffer, SIGNAL(lineUnwrapped(int)), this, SLOT(unwrapLine(int)));
         connect(&buffer, SIGNAL(textInserted(KTextEditor::Cursor,QString)), this, SLOT(insertText(KTextEditor::Cursor,QString)));
         connect(&buffer, SIGNAL(textRemoved(KTextEditor::Range,QString)), this, SLOT(removeText(KTextEditor::Range)));
+        connect(&buffer, SIGNAL(linesInserted(int,QStringList)), this, SLOT(insertLines(int,QStringList)));
+        connect(&buffer, SIGNAL(linesRemoved(int,QStringList)), this, SLOT(removeLines(int,QStringList)));
     } else {
         disconnect(&buffer, SIGNAL(editingStarted()), this, SLOT(startEditing()));
         disconnect(&buffer, SIGNAL(editingFinished()), this, SLOT(finishEditing()));
@@ -119,6 +124,8 @@ void SwapFile::setTrackingEnabled(bool enable)
         disconnect(&buffer, SIGNAL(lineUnwrapped(int)), this, SLOT(unwrapLine(int)));
         disconnect(&buffer, SIGNAL(textInserted(KTextEditor::Cursor,QString)), this, SLOT(insertText(KTextEditor::Cursor,QString)));
         disconnect(&buffer, SIGNAL(textRemoved(KTextEditor::Range,QString)), this, SLOT(removeText(KTextEditor::Range)));
+        disconnect(&buffer, SIGNAL(linesInserted(int,QStringList)), this, SLOT(insertLines(int,QStringList)));
+        disconnect(&buffer, SIGNAL(linesRemoved(int,QStringList)), this, SLOT(removeLines(int,QStringList)));
     }
 }
 
@@ -146,7 +153,7 @@ bool SwapFile::isValidSwapFile(QDataStream &stream, bool checkDigest) const
     QByteArray header;
     stream >> header;
 
-    if (header != swapFileVersionString) {
+    if (header != swapFileVersionString && header != swapFileVersionString20) {
         qCWarning(LOG_KTE) << "Can't open swap file, wrong version";
         return false;
     }
@@ -384,6 +391,51 @@ bool SwapFile::recover(QDataStream &stream, bool checkDigest)
 
             break;
         }
+        case EA_InsertLines: {
+            if (!editRunning) {
+                brokenSwapFile = true;
+                break;
+            }
+
+            int line;
+            QByteArray text;
+            stream >> line >> text;
+            const QStringList lines = QString::fromUtf8(text.data(), text.size()).split(QLatin1Char('\n'));
+            const int undoColumn = m_document->lineLength(line);
+
+            // emulate buffer insertLines with document
+            m_document->editInsertLines(line + 1, lines);
+
+            // track undo/redo cursor
+            if (firstEditInGroup) {
+                firstEditInGroup = false;
+                undoCursor = KTextEditor::Cursor(line, undoColumn);
+            }
+            redoCursor = KTextEditor::Cursor(line + lines.size(), lines.last().size());
+
+            break;
+        }
+        case EA_RemoveLines: {
+            if (!editRunning) {
+                brokenSwapFile = true;
+                break;
+            }
+
+            int line, count;
+            stream >> line >> count;
+
+            // emulate buffer removeLines with document
+            m_document->editRemoveLines(line, line + count - 1);
+
+            // track undo/redo cursor
+            if (firstEditInGroup) {
+                firstEditInGroup = false;
+                undoCursor = KTextEditor::Cursor(line + count, 0);
+            }
+            redoCursor = KTextEditor::Cursor(line, 0);
+
+            break;
+        }
         default: {
             qCWarning(LOG_KTE) << "Unknown type:" << type;
         }
@@ -528,6 +580,32 @@ void SwapFile::removeText(const KTextEditor::Range &range)
     m_needSync = true;
 }
 
+void SwapFile::insertLines(int line, const QStringList &lines)
+{
+    // skip if not open
+    if (!m_swapfile.isOpen()) {
+        return;
+    }
+
+    // format: qint8, int, bytearray
+    m_stream << EA_InsertLines << line << lines.join(QLatin1Char('\n')).toUtf8();
+
+    m_needSync = true;
+}
+
+void SwapFile::removeLines(int line, const QStringList &lines)
+{
+    // skip if not open
+    if (!m_swapfile.isOpen()) {
+        return;
+    }
+
+    // format: qint8, int, int
+    m_stream << EA_RemoveLines << line << lines.size();
+
+    m_needSync = true;
+}
+
 bool SwapFile::shouldRecover() const
 {
     // should not recover if the file has already recovered in another view
@@ -80,6 +80,8 @@ protected Q_SLOTS:
     void unwrapLine(int line);
     void insertText(const KTextEditor::Cursor &position, const QString &text);
     void removeText(const KTextEditor::Range &range);
+    void insertLines(int line, const QStringList &lines);
+    void removeLines(int line, const QStringList &lines);
 
 public Q_SLOTS:
     void discard();
@@ -65,7 +65,7 @@ bool isTrue(const QString& x)
 //END
 
 //BEGIN KateHighlighting
-KateHighlighting::KateHighlighting(const KateSyntaxModeListItem *def) : refCount(0)
+KateHighlighting::KateHighlighting(const KateSyntaxModeListItem *def) : refCount(0), m_contextStacksCompactSize(1024)
 {
     errorsAndWarnings = QString();
     building = false;
@@ -114,6 +114,52 @@ void KateHighlighting::cleanup()
     internalIDList.clear();
 }
 
+uint qHash(const KateHlInternedContextStack &entry)
+{
+    uint hash = entry.stack.size();
+    for (int i = 0; i < entry.stack.size(); ++i) {
+        hash = hash * 31 + uint(entry.stack.at(i));
+    }
+    return hash;
+}
+
+Kate::TextLineData::ContextStack KateHighlighting::internContextStack(const Kate::TextLineData::ContextStack &contextStack)
+{
+    /**
+     * all empty stacks share the shared null data
+     */
+    if (contextStack.isEmpty()) {
+        return Kate::TextLineData::ContextStack();
+    }
+
+    /**
+     * share data with equal stack of the table or add the stack
+     */
+    KateHlInternedContextStack entry;
+    entry.stack = contextStack;
+    QSet<KateHlInternedContextStack>::const_iterator it = m_contextStacks.constFind(entry);
+    if (it != m_contextStacks.constEnd()) {
+        return it->stack;
+    }
+
+    /**
+     * table too large? remove the stacks only the table still references, e.g. of closed documents
+     */
+    if (m_contextStacks.size() >= m_contextStacksCompactSize) {
+        for (QSet<KateHlInternedContextStack>::iterator i = m_contextStacks.begin(); i != m_contextStacks.end();) {
+            if (i->stack.isDetached()) {
+                i = m_contextStacks.erase(i);
+            } else {
+                ++i;
+            }
+        }
+        m_contextStacksCompactSize = qMax(1024, 2 * m_contextStacks.size());
+    }
+
+    m_contextStacks.insert(entry);
+    return entry.stack;
+}
+
 KateHlContext *KateHighlighting::generateContextStack(Kate::TextLineData::ContextStack &contextStack,
         KateHlContextModification modification,
         int &indexLastContextPreviousLine)
@@ -374,7 +420,8 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *_prevLine,
             bool anItemMatched = false;
             bool customStartEnableDetermined = false;
 
-            foreach (item, context->items) {
+            // only the items that may start with the current char are worth a try
+            foreach (item, context->itemsForChar(text[offset])) {
                 // does we only match if we are firstNonSpace?
                 if (item->firstNonSpace && (offset > startNonSpace)) {
                     continue;
@@ -556,33 +603,23 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *_prevLine,
 
     /**
      * has the context stack changed?
+     * stacks of lines are interned, an unchanged copy of the previous line's stack still is, too
+     * then comparing the data is enough
      */
-    if ((ctxChanged = (ctx != textLine->contextStack()))) {
-        /**
-         * try to share the simple stack that contains only 0
-         */
-        static const Kate::TextLineData::ContextStack onlyDefaulContext(1, 0);
-        if (ctx == onlyDefaulContext) {
-            textLine->setContextStack(onlyDefaulContext);
-        }
-
-        /**
-         * next try: try to share data with last line
-         */
-        else if (ctx == prevLine->contextStack()) {
-            textLine->setContextStack(prevLine->contextStack());
-        }
+    if (ctx.constData() != prevLine->contextStack().constData()) {
+        ctx = internContextStack(ctx);
+    }
 
-        /**
-         * ok, really use newly constructed stack!
-         */
-        else {
-            textLine->setContextStack(ctx);
-        }
+    if ((ctxChanged = (ctx.constData() != textLine->contextStack().constData()))) {
+        textLine->setContextStack(ctx);
     }
 
-    // write hl continue flag
-    textLine->setHlLineContinue(item && item->lineContinue());
+    // write hl continue flag, it is part of the end state of the line, too
+    const bool lineContinue = item && item->lineContinue();
+    if (lineContinue != textLine->hlLineContinue()) {
+        ctxChanged = true;
+        textLine->setHlLineContinue(lineContinue);
+    }
 
     // check for indentation based folding
     if (m_foldingIndentationSensitive && (tabWidth > 0) && !textLine->markedAsFoldingStartAttribute()) {
@@ -1734,6 +1771,11 @@ void KateHighlighting::makeContextList()
     // belongs to
     handleKateHlIncludeRules();
 
+    // all items are known now, build the first char dispatch of the contexts
+    foreach (KateHlContext *context, m_contexts) {
+        context->buildDispatch();
+    }
+
     embeddedHighlightingModes = embeddedHls.keys();
     embeddedHighlightingModes.removeOne(iName);
 
@@ -27,9 +27,12 @@
 #include "katesyntaxmanager.h"
 #include "spellcheck/prefixstore.h"
 
+#include <ktexteditor_export.h>
+
 #include <QVector>
 #include <QList>
 #include <QHash>
+#include <QSet>
 #include <QMap>
 
 #include <QRegularExpression>
@@ -127,6 +130,20 @@ typedef QList<KateHlIncludeRule *> KateHlIncludeRules;
 typedef QMap<QString, KateEmbeddedHlInfo> KateEmbeddedHlInfos;
 typedef QMap<KateHlContextModification *, QString> KateHlUnresolvedCtxRefs;
 
+/**
+ * Entry of the table of interned context stacks, see KateHighlighting::internContextStack().
+ */
+struct KateHlInternedContextStack {
+    Kate::TextLineData::ContextStack stack;
+
+    bool operator==(const KateHlInternedContextStack &other) const
+    {
+        return stack == other.stack;
+    }
+};
+
+uint qHash(const KateHlInternedContextStack &entry);
+
 class KateHighlighting
 {
 public:
@@ -163,6 +180,7 @@ public:
                      bool &ctxChanged,
                      int tabWidth = 0,
                      QVector<ContextChange>* contextChanges = 0);
+
     /**
      * Saves the attribute definitions to the config file.
      *
@@ -318,7 +336,16 @@ public:
      */
     QStringList getEmbeddedHighlightingModes() const;
 
-    KateHlContext *contextNum(int n) const;
+    KTEXTEDITOR_EXPORT KateHlContext *contextNum(int n) const;
+
+    /**
+     * Number of contexts, see contextNum().
+     * @return context count
+     */
+    int contextCount() const
+    {
+        return m_contexts.size();
+    }
 
 private:
     /**
@@ -352,6 +379,14 @@ private:
      */
     KateHlContext *generateContextStack(Kate::TextLineData::ContextStack &contextStack, KateHlContextModification modification, int &indexLastContextPreviousLine);
 
+    /**
+     * Intern the given context stack, the result shares its data with all equal interned stacks.
+     * Two interned stacks are equal exactly if their data is the same, that is an O(1) compare.
+     * @param contextStack context stack to intern
+     * @return interned context stack
+     */
+    Kate::TextLineData::ContextStack internContextStack(const Kate::TextLineData::ContextStack &contextStack);
+
     KateHlItem *createKateHlItem(KateSyntaxContextData *data, QList<KTextEditor::Attribute::Ptr> &iDl, QStringList *RegionList, QStringList *ContextList);
     int lookupAttrName(const QString &name, QList<KTextEditor::Attribute::Ptr> &iDl);
 
@@ -364,6 +399,17 @@ private:
 
     QMap< QPair<KateHlContext *, QString>, short> dynamicCtxs;
 
+    /**
+     * interned context stacks of all lines highlighted with this highlighting
+     * the lines reference the stack data, the implicit sharing counts the references
+     */
+    QSet<KateHlInternedContextStack> m_contextStacks;
+
+    /**
+     * table size at which stacks no line uses any more are removed
+     */
+    int m_contextStacksCompactSize;
+
     // make them pointers perhaps
     // NOTE: gets cleaned once makeContextList() finishes
     KateEmbeddedHlInfos embeddedHls;
@@ -35,6 +35,8 @@
 #include "katepartdebug.h"
 
 #include <QSet>
+
+#include <algorithm>
 //END
 
 //BEGIN KateHlItem
@@ -60,6 +62,29 @@ KateHlItem::~KateHlItem()
 {
 }
 
+bool KateHlItem::startChars(QBitArray &latin1) const
+{
+    latin1.fill(true);
+    return true;
+}
+
+/**
+ * Set the bits of the Latin-1 ones of the given chars, helper for KateHlItem::startChars().
+ * @return true if some of the chars are outside of Latin-1
+ */
+static bool setStartChars(QBitArray &latin1, const QString &chars)
+{
+    bool other = false;
+    foreach (const QChar &c, chars) {
+        if (c.unicode() < 256) {
+            latin1.setBit(c.unicode());
+        } else {
+            other = true;
+        }
+    }
+    return other;
+}
+
 void KateHlItem::dynamicSubstitute(QString &str, const QStringList *args)
 {
     for (int i = 0; i < str.length() - 1; ++i) {
@@ -97,6 +122,11 @@ int KateHlCharDetect::checkHgl(const QString &text, int offset, int /*len*/)
     return 0;
 }
 
+bool KateHlCharDetect::startChars(QBitArray &latin1) const
+{
+    return setStartChars(latin1, QString(sChar));
+}
+
 KateHlItem *KateHlCharDetect::clone(const QStringList *args)
 {
     char c = sChar.toLatin1();
@@ -128,6 +158,11 @@ int KateHl2CharDetect::checkHgl(const QString &text, int offset, int len)
     return 0;
 }
 
+bool KateHl2CharDetect::startChars(QBitArray &latin1) const
+{
+    return setStartChars(latin1, QString(sChar1));
+}
+
 KateHlItem *KateHl2CharDetect::clone(const QStringList *args)
 {
     char c1 = sChar1.toLatin1();
@@ -181,6 +216,25 @@ int KateHlStringDetect::checkHgl(const QString &text, int offset, int len)
     return 0;
 }
 
+bool KateHlStringDetect::startChars(QBitArray &latin1) const
+{
+    if (str.isEmpty()) {
+        return KateHlItem::startChars(latin1);
+    }
+
+    if (!_inSensitive) {
+        return setStartChars(latin1, QString(str[0]));
+    }
+
+    // str is upper case, chars outside of Latin-1 might be upper cased to its first char, too
+    for (int c = 0; c < 256; ++c) {
+        if (QChar(c).toUpper() == str[0]) {
+            latin1.setBit(c);
+        }
+    }
+    return true;
+}
+
 KateHlItem *KateHlStringDetect::clone(const QStringList *args)
 {
     QString newstr = str;
@@ -267,102 +321,145 @@ int KateHlRangeDetect::checkHgl(const QString &text, int offset, int len)
     }
     return 0;
 }
+
+bool KateHlRangeDetect::startChars(QBitArray &latin1) const
+{
+    return setStartChars(latin1, QString(sChar1));
+}
 //END
 
 //BEGIN KateHlKeyword
 KateHlKeyword::KateHlKeyword(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2, bool insensitive, const QString &delims)
     : KateHlItem(attribute, context, regionId, regionId2)
     , _insensitive(insensitive)
-    , minLen(0xFFFFFF)
-    , maxLen(0)
+    , m_latin1Deliminators(256)
 {
     alwaysStartEnable = false;
     customStartEnable = true;
     foreach (const QChar &c, delims) {
-        deliminators << c;
+        if (c.unicode() < 256) {
+            m_latin1Deliminators.setBit(c.unicode());
+        } else {
+            deliminators << c;
+        }
     }
-}
 
-KateHlKeyword::~KateHlKeyword()
-{
-    qDeleteAll(dict);
+    // empty trie, just the root
+    buildTrie(QStringList(), 0, 0, 0);
 }
 
 QSet<QString> KateHlKeyword::allKeywords() const
 {
-    QSet<QString> result;
-    foreach (const QSet<QString>* v, dict) {
-        if (!v) {
-            continue;
-        }
-        result.unite(*v);
-    }
-    return result;
+    return m_keywords;
 }
 
 void KateHlKeyword::addList(const QStringList &list)
 {
-    for (int i = 0; i < list.count(); ++i) {
-        int len = list[i].length();
-
-        if (minLen > len) {
-            minLen = len;
-        }
+    foreach (const QString &keyword, list) {
+        m_keywords.insert(_insensitive ? keyword.toLower() : keyword);
+    }
 
-        if (maxLen < len) {
-            maxLen = len;
-        }
+    // rebuild the trie from the sorted keywords
+    QStringList words = m_keywords.toList();
+    words.sort();
+    m_trieNodes.clear();
+    m_trieEdges.clear();
+    buildTrie(words, 0, words.size(), 0);
+    m_trieNodes.squeeze();
+    m_trieEdges.squeeze();
+}
 
-        if (len >= dict.size()) {
-            uint oldSize = dict.size();
-            dict.resize(len + 1);
+int KateHlKeyword::buildTrie(const QStringList &words, int begin, int end, int depth)
+{
+    const int node = m_trieNodes.size();
+    TrieNode trieNode = { m_trieEdges.size(), 0, false };
+
+    // a word ending here comes first, the words are sorted
+    int i = begin;
+    if ((i < end) && (words[i].size() == depth)) {
+        trieNode.keyword = true;
+        ++i;
+    }
 
-            for (int m = oldSize; m < dict.size(); ++m) {
-                dict[m] = 0;
-            }
+    // one edge per next char, consecutive, the child nodes come behind
+    for (int j = i; j < end; ++j) {
+        if ((j == i) || (words[j][depth] != words[j - 1][depth])) {
+            const TrieEdge edge = { words[j][depth].unicode(), -1 };
+            m_trieEdges.append(edge);
+            ++trieNode.edgeCount;
         }
+    }
+    m_trieNodes.append(trieNode);
 
-        if (!dict[len]) {
-            dict[len] = new QSet<QString> ();
+    int edge = trieNode.firstEdge;
+    while (i < end) {
+        int j = i + 1;
+        while ((j < end) && (words[j][depth] == words[i][depth])) {
+            ++j;
         }
 
-        if (!_insensitive) {
-            dict[len]->insert(list[i]);
-        } else {
-            dict[len]->insert(list[i].toLower());
-        }
+        const int child = buildTrie(words, i, j, depth + 1);
+        m_trieEdges[edge++].node = child;
+        i = j;
     }
+
+    return node;
 }
 
-int KateHlKeyword::checkHgl(const QString &text, int offset, int len)
+static bool trieEdgeLessThan(const KateHlKeyword::TrieEdge &edge, ushort c)
 {
-    int offset2 = offset;
-    int wordLen = 0;
-
-    while ((len > wordLen) && !deliminators.contains(text[offset2])) {
-        offset2++;
-        wordLen++;
+    return edge.c < c;
+}
 
-        if (wordLen > maxLen) {
+int KateHlKeyword::checkHgl(const QString &text, int offset, int len)
+{
+    /**
+     * walk the trie up to the next delimiter, without an edge for a char no keyword fits
+     */
+    const QChar *unicode = text.unicode();
+    const TrieNode *nodes = m_trieNodes.constData();
+    const TrieEdge *edges = m_trieEdges.constData();
+    const int end = offset + len;
+    int node = 0;
+    for (; (offset < end) && !isDeliminator(unicode[offset]); ++offset) {
+        const ushort c = _insensitive ? unicode[offset].toLower().unicode() : unicode[offset].unicode();
+        const TrieEdge *first = edges + nodes[node].firstEdge;
+        const TrieEdge *last = first + nodes[node].edgeCount;
+        const TrieEdge *edge = std::lower_bound(first, last, c, trieEdgeLessThan);
+        if ((edge == last) || (edge->c != c)) {
             return 0;
         }
+
+        node = edge->node;
     }
 
-    if (wordLen < minLen || !dict[wordLen]) {
-        return 0;
+    return nodes[node].keyword ? offset : 0;
+}
+
+bool KateHlKeyword::startChars(QBitArray &latin1) const
+{
+    // an empty keyword matches at any delimiter
+    const TrieNode &root = m_trieNodes.at(0);
+    if (root.keyword) {
+        return KateHlItem::startChars(latin1);
+    }
+
+    QString firstChars;
+    for (int i = root.firstEdge; i < root.firstEdge + root.edgeCount; ++i) {
+        firstChars += QChar(m_trieEdges.at(i).c);
     }
 
     if (!_insensitive) {
-        if (dict[wordLen]->contains(QString::fromRawData(text.unicode() + offset, wordLen))) {
-            return offset2;
-        }
-    } else {
-        if (dict[wordLen]->contains(QString::fromRawData(text.unicode() + offset, wordLen).toLower())) {
-            return offset2;
-        }
+        return setStartChars(latin1, firstChars);
     }
 
-    return 0;
+    // keywords are lower case, chars outside of Latin-1 might be lower cased to their first chars, too
+    for (int c = 0; c < 256; ++c) {
+        if (firstChars.contains(QChar(c).toLower())) {
+            latin1.setBit(c);
+        }
+    }
+    return true;
 }
 //END
 
@@ -396,6 +493,16 @@ int KateHlInt::checkHgl(const QString &text, int offset, int len)
 
     return 0;
 }
+
+bool KateHlInt::startChars(QBitArray &latin1) const
+{
+    for (int c = '0'; c <= '9'; ++c) {
+        latin1.setBit(c);
+    }
+
+    // isDigit() is true for the decimal digits of other scripts, too
+    return true;
+}
 //END
 
 //BEGIN KateHlFloat
@@ -481,6 +588,17 @@ int KateHlFloat::checkHgl(const QString &text, int offset, int len)
 
     return 0;
 }
+
+bool KateHlFloat::startChars(QBitArray &latin1) const
+{
+    for (int c = '0'; c <= '9'; ++c) {
+        latin1.setBit(c);
+    }
+    latin1.setBit('.');
+
+    // isDigit() is true for the decimal digits of other scripts, too
+    return true;
+}
 //END
 
 //BEGIN KateHlCOct
@@ -514,6 +632,12 @@ int KateHlCOct::checkHgl(const QString &text, int offset, int len)
 
     return 0;
 }
+
+bool KateHlCOct::startChars(QBitArray &latin1) const
+{
+    latin1.setBit('0');
+    return false;
+}
 //END
 
 //BEGIN KateHlCHex
@@ -546,6 +670,12 @@ int KateHlCHex::checkHgl(const QString &text, int offset, int len)
 
     return 0;
 }
+
+bool KateHlCHex::startChars(QBitArray &latin1) const
+{
+    latin1.setBit('0');
+    return false;
+}
 //END
 
 //BEGIN KateHlCFloat
@@ -608,14 +738,118 @@ int KateHlAnyChar::checkHgl(const QString &text, int offset, int)
 
     return 0;
 }
+
+bool KateHlAnyChar::startChars(QBitArray &latin1) const
+{
+    return setStartChars(latin1, _charList);
+}
 //END
 
 //BEGIN KateHlRegExpr
+bool KateHlRegExpr::startDerivable(const QString &pattern)
+{
+    if (pattern.contains(QLatin1String("\\K")) || pattern.contains(QLatin1String("\\G")) || pattern.contains(QLatin1String("\\Q"))) {
+        return false;
+    }
+
+    int depth = 0;
+    for (int i = 0; i < pattern.size(); ++i) {
+        const QChar c = pattern[i];
+        if (c == QLatin1Char('\\')) {
+            ++i;
+        } else if (c == QLatin1Char('[')) {
+            // skip the class, a ] right at its start is a literal
+            ++i;
+            if ((i < pattern.size()) && (pattern[i] == QLatin1Char('^'))) {
+                ++i;
+            }
+            if ((i < pattern.size()) && (pattern[i] == QLatin1Char(']'))) {
+                ++i;
+            }
+            while ((i < pattern.size()) && (pattern[i] != QLatin1Char(']'))) {
+                if (pattern[i] == QLatin1Char('\\')) {
+                    ++i;
+                }
+                ++i;
+            }
+        } else if (c == QLatin1Char('(')) {
+            ++depth;
+        } else if (c == QLatin1Char(')')) {
+            --depth;
+        } else if ((c == QLatin1Char('|')) && (depth == 0)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+QString KateHlRegExpr::literalPrefix(const QString &pattern)
+{
+    if (!startDerivable(pattern)) {
+        return QString();
+    }
+
+    QString prefix;
+    int i = pattern.startsWith(QLatin1Char('^')) ? 1 : 0;
+    while (i < pattern.size()) {
+        QChar c = pattern[i];
+        int next = i + 1;
+        if (c == QLatin1Char('\\')) {
+            // escaped punctuation is a literal, escaped letters and digits are classes, anchors or back references
+            if ((next >= pattern.size()) || (pattern[next].unicode() >= 128) || pattern[next].isLetterOrNumber() || pattern[next].isSpace()) {
+                break;
+            }
+
+            c = pattern[next++];
+        } else if (QStringLiteral("^$.|?*+()[]{}").contains(c)) {
+            break;
+        }
+
+        // an optional char ends the prefix, a repeated one is still needed once
+        const QChar quantifier = (next < pattern.size()) ? pattern[next] : QChar();
+        if (quantifier == QLatin1Char('?') || quantifier == QLatin1Char('*') || quantifier == QLatin1Char('{')) {
+            break;
+        }
+
+        prefix += c;
+        if (quantifier == QLatin1Char('+')) {
+            break;
+        }
+
+        i = next;
+    }
+
+    return prefix;
+}
+
+/**
+ * Pattern options for the rules.
+ */
+static QRegularExpression::PatternOptions regularExpressionOptions(bool insensitive, bool minimal)
+{
+    QRegularExpression::PatternOptions options = QRegularExpression::NoPatternOption;
+    if (insensitive) {
+        options |= QRegularExpression::CaseInsensitiveOption;
+    }
+    if (minimal) {
+        options |= QRegularExpression::InvertedGreedinessOption;
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 4, 0) && QT_VERSION < QT_VERSION_CHECK(5, 12, 0)
+    // rules are matched over and over, JIT compile them at once, not only after some matches
+    // the option is deprecated since Qt 5.12, patterns get optimized at their first usage anyway
+    options |= QRegularExpression::OptimizeOnFirstUsageOption;
+#endif
+
+    return options;
+}
+
 KateHlRegExpr::KateHlRegExpr(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2, const QString &regexp, bool insensitive, bool minimal)
     : KateHlItem(attribute, context, regionId, regionId2)
-    , m_regularExpression (regexp, (insensitive ? QRegularExpression::CaseInsensitiveOption : QRegularExpression::NoPatternOption)
-                 | (minimal ? QRegularExpression::InvertedGreedinessOption : QRegularExpression::NoPatternOption))
+    , m_regularExpression (regexp, regularExpressionOptions(insensitive, minimal))
     , m_handlesLineStart (regexp.startsWith(QLatin1Char('^')))
+    , m_literalPrefix (insensitive ? QString() : literalPrefix(regexp))
 {
 }
 
@@ -641,7 +875,21 @@ int KateHlRegExpr::checkHgl(const QString &text, int offset, int /*len*/)
      * store result in member variable for later reuse
      */
     if (!haveCache) {
-        m_lastMatch = m_regularExpression.match(text, offset);
+        /**
+         * all matches start with the literal prefix, skip PCRE up to its next occurrence
+         * without one, cache that nothing matches in the rest of the line
+         */
+        int matchOffset = offset;
+        if (!m_literalPrefix.isEmpty()) {
+            matchOffset = text.indexOf(m_literalPrefix, offset);
+            if (matchOffset < 0) {
+                m_lastMatch = QRegularExpressionMatch();
+                haveCache = true;
+                return 0;
+            }
+        }
+
+        m_lastMatch = m_regularExpression.match(text, matchOffset);
         haveCache = true;
     }
 
@@ -659,6 +907,107 @@ int KateHlRegExpr::checkHgl(const QString &text, int offset, int /*len*/)
     return m_lastMatch.capturedEnd();
 }
 
+/**
+ * Derive the chars all matches of a regular expression start with.
+ * Only works for expressions starting with a literal char or a simple char class.
+ * @param pattern regular expression
+ * @param chars set to the chars a match may start with
+ * @return success, false if the chars can't be derived
+ */
+static bool regularExpressionStartChars(const QString &pattern, QString &chars)
+{
+    if (!KateHlRegExpr::startDerivable(pattern)) {
+        return false;
+    }
+
+    int i = pattern.startsWith(QLatin1Char('^')) ? 1 : 0;
+    if (i >= pattern.size()) {
+        return false;
+    }
+
+    const QChar first = pattern[i];
+    if (first == QLatin1Char('\\')) {
+        // escaped punctuation is a literal, escaped letters and digits are classes, anchors or back references
+        if ((i + 1 >= pattern.size()) || (pattern[i + 1].unicode() >= 128) || pattern[i + 1].isLetterOrNumber() || pattern[i + 1].isSpace()) {
+            return false;
+        }
+
+        chars = pattern[i + 1];
+        i += 2;
+    } else if (first == QLatin1Char('[')) {
+        // only classes of plain chars and ranges, no negation, escapes or posix classes
+        ++i;
+        if ((i < pattern.size()) && (pattern[i] == QLatin1Char('^'))) {
+            return false;
+        }
+
+        while ((i < pattern.size()) && (pattern[i] != QLatin1Char(']'))) {
+            if (pattern[i] == QLatin1Char('\\') || pattern[i] == QLatin1Char('[')) {
+                return false;
+            }
+
+            if ((i + 2 < pattern.size()) && (pattern[i + 1] == QLatin1Char('-')) && (pattern[i + 2] != QLatin1Char(']'))) {
+                if (pattern[i + 2] == QLatin1Char('\\') || pattern[i + 2] == QLatin1Char('[') || pattern[i + 2] < pattern[i]) {
+                    return false;
+                }
+
+                // chars behind Latin-1 are all alike for the dispatch, one of them is enough
+                const int last = qMin(int(pattern[i + 2].unicode()), 256);
+                for (int c = qMin(int(pattern[i].unicode()), 256); c <= last; ++c) {
+                    chars += QChar(c);
+                }
+                i += 3;
+            } else {
+                chars += pattern[i];
+                ++i;
+            }
+        }
+
+        if (i >= pattern.size()) {
+            return false;
+        }
+        ++i;
+    } else if (QStringLiteral("^$.|?*+()[]{}").contains(first)) {
+        return false;
+    } else {
+        chars = first;
+        ++i;
+    }
+
+    // the first atom must not be optional
+    if ((i < pattern.size()) && (pattern[i] == QLatin1Char('?') || pattern[i] == QLatin1Char('*') || pattern[i] == QLatin1Char('{'))) {
+        return false;
+    }
+
+    return !chars.isEmpty();
+}
+
+bool KateHlRegExpr::startChars(QBitArray &latin1) const
+{
+    QString chars;
+    if (!regularExpressionStartChars(m_regularExpression.pattern(), chars)) {
+        return KateHlItem::startChars(latin1);
+    }
+
+    if (!(m_regularExpression.patternOptions() & QRegularExpression::CaseInsensitiveOption)) {
+        return setStartChars(latin1, chars);
+    }
+
+    // ignoring case, chars outside of Latin-1 might match Latin-1 ones and the other way around
+    foreach (const QChar &c, chars) {
+        if (c.unicode() >= 256) {
+            return KateHlItem::startChars(latin1);
+        }
+    }
+
+    for (int c = 0; c < 256; ++c) {
+        if (chars.contains(QChar(c), Qt::CaseInsensitive)) {
+            latin1.setBit(c);
+        }
+    }
+    return true;
+}
+
 void KateHlRegExpr::capturedTexts(QStringList &list)
 {
     /**
@@ -707,6 +1056,11 @@ int KateHlLineContinue::checkHgl(const QString &text, int offset, int len)
 
     return 0;
 }
+
+bool KateHlLineContinue::startChars(QBitArray &latin1) const
+{
+    return setStartChars(latin1, QString(m_trailer));
+}
 //END
 
 //BEGIN KateHlCStringChar
@@ -786,6 +1140,12 @@ int KateHlCStringChar::checkHgl(const QString &text, int offset, int len)
 {
     return checkEscapedChar(text, offset, len);
 }
+
+bool KateHlCStringChar::startChars(QBitArray &latin1) const
+{
+    latin1.setBit('\\');
+    return false;
+}
 //END
 
 //BEGIN KateHlCChar
@@ -820,6 +1180,12 @@ int KateHlCChar::checkHgl(const QString &text, int offset, int len)
 
     return 0;
 }
+
+bool KateHlCChar::startChars(QBitArray &latin1) const
+{
+    latin1.setBit('\'');
+    return false;
+}
 //END
 
 //BEGIN KateHl2CharDetect
@@ -850,6 +1216,7 @@ KateHlContext::KateHlContext(const QString &_hlId, int attribute, KateHlContextM
         qCDebug(LOG_KTE) << "**********************_noIndentationBasedFolding is TRUE*****************";
     }
 
+    buildDispatch();
 }
 
 KateHlContext *KateHlContext::clone(const QStringList *args)
@@ -865,10 +1232,64 @@ KateHlContext *KateHlContext::clone(const QStringList *args)
     }
 
     ret->dynamicChild = true;
+    ret->buildDispatch();
 
     return ret;
 }
 
+void KateHlContext::buildDispatch()
+{
+    /**
+     * start chars of all items, items of dynamic models get theirs only once cloned
+     */
+    QVector<QBitArray> itemChars;
+    itemChars.reserve(items.size());
+    m_otherItems.clear();
+    foreach (KateHlItem *item, items) {
+        QBitArray latin1(256);
+        if (item->dynamic ? item->KateHlItem::startChars(latin1) : item->startChars(latin1)) {
+            m_otherItems.append(item);
+        }
+        itemChars.append(latin1);
+    }
+
+    /**
+     * candidates for each Latin-1 char, share equal lists, most chars have the same candidates
+     */
+    m_dispatchLists.clear();
+    for (int c = 0; c < 256; ++c) {
+        QVector<KateHlItem *> candidates;
+        for (int i = 0; i < items.size(); ++i) {
+            if (itemChars[i].testBit(c)) {
+                candidates.append(items[i]);
+            }
+        }
+
+        int list = m_dispatchLists.indexOf(candidates);
+        if (list < 0) {
+            list = m_dispatchLists.size();
+            m_dispatchLists.append(candidates);
+        }
+        m_dispatch[c] = list;
+    }
+}
+
+KateHlItem *KateHlContext::firstMatchingItem(const QString &text, int offset, bool allItems)
+{
+    foreach (KateHlItem *item, allItems ? items : itemsForChar(text[offset])) {
+        // matches cached for other offsets or lines don't count
+        item->haveCache = false;
+        const int end = item->checkHgl(text, offset, text.length() - offset);
+        item->haveCache = false;
+
+        if (end > offset) {
+            return item;
+        }
+    }
+
+    return 0;
+}
+
 KateHlContext::~KateHlContext()
 {
     if (dynamicChild) {
@@ -24,6 +24,7 @@
 
 #include "katehighlight.h"
 
+#include <QBitArray>
 #include <QRegularExpression>
 
 class KateHlItem
@@ -49,6 +50,14 @@ public:
         return this;
     }
 
+    /**
+     * Chars a match of this item may start with, for the first char dispatch of KateHlContext.
+     * The default is any char.
+     * @param latin1 256 bits, to set for the Latin-1 chars a match may start with
+     * @return true if a match may start with chars outside of Latin-1, too
+     */
+    virtual bool startChars(QBitArray &latin1) const;
+
     static void dynamicSubstitute(QString &str, const QStringList *args);
 
     QVector<KateHlItem *> subItems;
@@ -86,6 +95,33 @@ public:
     virtual ~KateHlContext();
     KateHlContext *clone(const QStringList *args);
 
+    /**
+     * Build the first char dispatch for the items, see itemsForChar().
+     * Must be called again after the items changed.
+     */
+    void buildDispatch();
+
+    /**
+     * Items that may match at the given char, in the order of items.
+     * All other items can't match there, no need to try them.
+     * @param c char to match at
+     * @return candidate items
+     */
+    const QVector<KateHlItem *> &itemsForChar(QChar c) const
+    {
+        return (c.unicode() < 256) ? m_dispatchLists.at(m_dispatch[c.unicode()]) : m_otherItems;
+    }
+
+    /**
+     * First item matching at the given offset, without the checks for columns and delimiters.
+     * Not used by the highlighting, trying all items is the reference for tests of itemsForChar().
+     * @param text text to match in
+     * @param offset offset to match at
+     * @param allItems try all items, else only the ones of itemsForChar()
+     * @return first matching item, 0 if none
+     */
+    KTEXTEDITOR_EXPORT KateHlItem *firstMatchingItem(const QString &text, int offset, bool allItems);
+
     QVector<KateHlItem *> items;
     QString hlId; ///< A unique highlight identifier. Used to look up correct properties.
     int attr;
@@ -104,6 +140,18 @@ public:
 
     bool emptyLineContext;
     KateHlContextModification emptyLineContextModification;
+
+private:
+    /**
+     * index into m_dispatchLists for each Latin-1 char, chars with equal candidates share a list
+     */
+    quint8 m_dispatch[256];
+    QVector<QVector<KateHlItem *> > m_dispatchLists;
+
+    /**
+     * candidates for all chars outside of Latin-1
+     */
+    QVector<KateHlItem *> m_otherItems;
 };
 
 class KateHlIncludeRule
@@ -133,6 +181,7 @@ public:
     KateHlCharDetect(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2, QChar);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
     KateHlItem *clone(const QStringList *args) Q_DECL_OVERRIDE;
 
 private:
@@ -146,6 +195,7 @@ public:
     KateHl2CharDetect(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2,  const QChar *ch);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
     KateHlItem *clone(const QStringList *args) Q_DECL_OVERRIDE;
 
 private:
@@ -159,6 +209,7 @@ public:
     KateHlStringDetect(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2, const QString &, bool inSensitive = false);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
     KateHlItem *clone(const QStringList *args) Q_DECL_OVERRIDE;
 
 protected:
@@ -182,6 +233,7 @@ public:
     KateHlRangeDetect(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2, QChar ch1, QChar ch2);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
 
 private:
     QChar sChar1;
@@ -192,18 +244,60 @@ class KateHlKeyword : public KateHlItem
 {
 public:
     KateHlKeyword(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2, bool insensitive, const QString &delims);
-    virtual ~KateHlKeyword();
     QSet<QString> allKeywords() const;
 
     void addList(const QStringList &);
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
+
+    /**
+     * Node of the keyword trie, its edges are consecutive and sorted by char.
+     */
+    struct TrieNode {
+        int firstEdge;
+        int edgeCount;
+        bool keyword; ///< a keyword ends here
+    };
+
+    /**
+     * Edge of the keyword trie, to the node for the next UTF-16 char.
+     */
+    struct TrieEdge {
+        ushort c;
+        int node;
+    };
 
 private:
-    QVector< QSet<QString>* > dict;
+    bool isDeliminator(QChar c) const
+    {
+        return (c.unicode() < 256) ? m_latin1Deliminators.testBit(c.unicode()) : deliminators.contains(c);
+    }
+
+    /**
+     * Append the trie node for the given words and all nodes below it.
+     * @param words sorted words, the ones in [begin, end) share their first depth chars
+     * @return index of the node
+     */
+    int buildTrie(const QStringList &words, int begin, int end, int depth);
+
+private:
+    /**
+     * all keywords, lower case if insensitive
+     */
+    QSet<QString> m_keywords;
     bool _insensitive;
+
+    /**
+     * delimiters of keywords, a bitmap for Latin-1 and a set for all others
+     */
+    QBitArray m_latin1Deliminators;
     QSet<QChar> deliminators;
-    int minLen;
-    int maxLen;
+
+    /**
+     * trie of the keywords, node 0 is the root
+     */
+    QVector<TrieNode> m_trieNodes;
+    QVector<TrieEdge> m_trieEdges;
 };
 
 class KateHlInt : public KateHlItem
@@ -212,6 +306,7 @@ public:
     KateHlInt(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
 };
 
 class KateHlFloat : public KateHlItem
@@ -221,6 +316,7 @@ public:
     virtual ~KateHlFloat() {}
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
 };
 
 class KateHlCFloat : public KateHlFloat
@@ -238,6 +334,7 @@ public:
     KateHlCOct(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
 };
 
 class KateHlCHex : public KateHlItem
@@ -246,6 +343,7 @@ public:
     KateHlCHex(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
 };
 
 class KateHlLineContinue : public KateHlItem
@@ -258,6 +356,7 @@ public:
         return c == QLatin1Char('\0');
     }
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
     bool lineContinue() Q_DECL_OVERRIDE
     {
         return true;
@@ -272,6 +371,7 @@ public:
     KateHlCStringChar(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
 };
 
 class KateHlCChar : public KateHlItem
@@ -280,6 +380,7 @@ public:
     KateHlCChar(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
 };
 
 class KateHlAnyChar : public KateHlItem
@@ -288,6 +389,7 @@ public:
     KateHlAnyChar(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2, const QString &charList);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
 
 private:
     const QString _charList;
@@ -299,11 +401,27 @@ public:
     KateHlRegExpr(int attribute, KateHlContextModification context, signed char regionId, signed char regionId2, const QString &expr, bool insensitive, bool minimal);
 
     int checkHgl(const QString &text, int offset, int len) Q_DECL_OVERRIDE;
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE;
 
     void capturedTexts(QStringList &) Q_DECL_OVERRIDE;
 
     KateHlItem *clone(const QStringList *args) Q_DECL_OVERRIDE;
 
+    /**
+     * Can the start of the matches of a regular expression be derived from its first atoms?
+     * Not if there are alternatives on the top level, or escapes that move or quote the start.
+     * @param pattern regular expression
+     * @return start derivable
+     */
+    KTEXTEDITOR_EXPORT static bool startDerivable(const QString &pattern);
+
+    /**
+     * Derive the literal prefix all matches of a case sensitive regular expression start with.
+     * @param pattern regular expression
+     * @return literal prefix, empty if there is none
+     */
+    KTEXTEDITOR_EXPORT static QString literalPrefix(const QString &pattern);
+
 private:
     /**
      * regular expression to match
@@ -315,6 +433,12 @@ private:
      * allows to skip for any offset > 0
      */
     const bool m_handlesLineStart;
+
+    /**
+     * literal prefix all matches start with, empty if unknown
+     * allows to skip PCRE up to the next occurrence of it
+     */
+    const QString m_literalPrefix;
     
     /**
      * last match, if any
@@ -336,6 +460,16 @@ public:
         }
         return offset;
     }
+
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE
+    {
+        for (int c = 0; c < 256; ++c) {
+            if (QChar(c).isSpace()) {
+                latin1.setBit(c);
+            }
+        }
+        return true;
+    }
 };
 
 class KateHlDetectIdentifier : public KateHlItem
@@ -370,6 +504,16 @@ public:
 
         return 0;
     }
+
+    bool startChars(QBitArray &latin1) const Q_DECL_OVERRIDE
+    {
+        for (int c = 0; c < 256; ++c) {
+            if (QChar(c).isLetter() || c == '_') {
+                latin1.setBit(c);
+            }
+        }
+        return true;
+    }
 };
 
 //END
@@ -140,21 +140,20 @@ KateModifiedUnWrapLine::KateModifiedUnWrapLine(KTextEditor::DocumentPrivate *doc
     }
 }
 
-KateModifiedInsertLine::KateModifiedInsertLine(KTextEditor::DocumentPrivate *document, int line, const QString &text)
-    : KateEditInsertLineUndo(document, line, text)
+KateModifiedInsertLine::KateModifiedInsertLine(KTextEditor::DocumentPrivate *document, int line, const QStringList &lines)
+    : KateEditInsertLineUndo(document, line, lines)
+    , m_redoLinesSaved(lines.size())
 {
-    setFlag(RedoLine1Modified);
 }
 
-KateModifiedRemoveLine::KateModifiedRemoveLine(KTextEditor::DocumentPrivate *document, int line, const QString &text)
-    : KateEditRemoveLineUndo(document, line, text)
+KateModifiedRemoveLine::KateModifiedRemoveLine(KTextEditor::DocumentPrivate *document, int line, const QStringList &lines)
+    : KateEditRemoveLineUndo(document, line, lines)
+    , m_undoLinesSaved(lines.size())
 {
-    Kate::TextLine tl = document->plainKateTextLine(line);
-    Q_ASSERT(tl);
-    if (tl->markedAsModified()) {
-        setFlag(UndoLine1Modified);
-    } else {
-        setFlag(UndoLine1Saved);
+    for (int i = 0; i < lines.size(); ++i) {
+        Kate::TextLine tl = document->plainKateTextLine(line + i);
+        Q_ASSERT(tl);
+        m_undoLinesSaved.setBit(i, !tl->markedAsModified());
     }
 }
 
@@ -223,11 +222,13 @@ void KateModifiedRemoveLine::undo()
     KateEditRemoveLineUndo::undo();
 
     KTextEditor::DocumentPrivate *doc = document();
-    Kate::TextLine tl = doc->plainKateTextLine(line());
-    Q_ASSERT(tl);
+    for (int i = 0; i < lineCount(); ++i) {
+        Kate::TextLine tl = doc->plainKateTextLine(line() + i);
+        Q_ASSERT(tl);
 
-    tl->markAsModified(isFlagSet(UndoLine1Modified));
-    tl->markAsSavedOnDisk(isFlagSet(UndoLine1Saved));
+        tl->markAsModified(!m_undoLinesSaved.testBit(i));
+        tl->markAsSavedOnDisk(m_undoLinesSaved.testBit(i));
+    }
 }
 
 void KateModifiedRemoveText::redo()
@@ -296,11 +297,13 @@ void KateModifiedInsertLine::redo()
     KateEditInsertLineUndo::redo();
 
     KTextEditor::DocumentPrivate *doc = document();
-    Kate::TextLine tl = doc->plainKateTextLine(line());
-    Q_ASSERT(tl);
+    for (int i = 0; i < lineCount(); ++i) {
+        Kate::TextLine tl = doc->plainKateTextLine(line() + i);
+        Q_ASSERT(tl);
 
-    tl->markAsModified(isFlagSet(RedoLine1Modified));
-    tl->markAsSavedOnDisk(isFlagSet(RedoLine1Saved));
+        tl->markAsModified(!m_redoLinesSaved.testBit(i));
+        tl->markAsSavedOnDisk(m_redoLinesSaved.testBit(i));
+    }
 }
 
 void KateModifiedInsertText::updateRedoSavedOnDiskFlag(QBitArray &lines)
@@ -429,31 +432,43 @@ void KateModifiedUnWrapLine::updateUndoSavedOnDiskFlag(QBitArray &lines)
     }
 }
 
+void KateModifiedInsertLine::flagSavedAsModified()
+{
+    KateEditInsertLineUndo::flagSavedAsModified();
+    m_redoLinesSaved.fill(false);
+}
+
 void KateModifiedInsertLine::updateRedoSavedOnDiskFlag(QBitArray &lines)
 {
-    if (line() >= lines.size()) {
-        lines.resize(line() + 1);
+    if (line() + lineCount() > lines.size()) {
+        lines.resize(line() + lineCount());
     }
 
-    if (!lines.testBit(line())) {
-        lines.setBit(line());
-
-        unsetFlag(RedoLine1Modified);
-        setFlag(RedoLine1Saved);
+    for (int i = 0; i < lineCount(); ++i) {
+        if (!lines.testBit(line() + i)) {
+            lines.setBit(line() + i);
+            m_redoLinesSaved.setBit(i);
+        }
     }
 }
 
+void KateModifiedRemoveLine::flagSavedAsModified()
+{
+    KateEditRemoveLineUndo::flagSavedAsModified();
+    m_undoLinesSaved.fill(false);
+}
+
 void KateModifiedRemoveLine::updateUndoSavedOnDiskFlag(QBitArray &lines)
 {
-    if (line() >= lines.size()) {
-        lines.resize(line() + 1);
+    if (line() + lineCount() > lines.size()) {
+        lines.resize(line() + lineCount());
     }
 
-    if (!lines.testBit(line())) {
-        lines.setBit(line());
-
-        unsetFlag(UndoLine1Modified);
-        setFlag(UndoLine1Saved);
+    for (int i = 0; i < lineCount(); ++i) {
+        if (!lines.testBit(line() + i)) {
+            lines.setBit(line() + i);
+            m_undoLinesSaved.setBit(i);
+        }
     }
 }
 
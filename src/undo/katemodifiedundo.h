@@ -102,7 +102,7 @@ public:
 class KateModifiedInsertLine : public KateEditInsertLineUndo
 {
 public:
-    KateModifiedInsertLine(KTextEditor::DocumentPrivate *document, int line, const QString &text);
+    KateModifiedInsertLine(KTextEditor::DocumentPrivate *document, int line, const QStringList &lines);
 
     /**
      * @copydoc KateUndo::undo()
@@ -114,13 +114,20 @@ public:
      */
     void redo() Q_DECL_OVERRIDE;
 
+    void flagSavedAsModified() Q_DECL_OVERRIDE;
     void updateRedoSavedOnDiskFlag(QBitArray &lines) Q_DECL_OVERRIDE;
+
+private:
+    /**
+     * per inserted line: saved on disk after redo, else modified
+     */
+    QBitArray m_redoLinesSaved;
 };
 
 class KateModifiedRemoveLine : public KateEditRemoveLineUndo
 {
 public:
-    KateModifiedRemoveLine(KTextEditor::DocumentPrivate *document, int line, const QString &text);
+    KateModifiedRemoveLine(KTextEditor::DocumentPrivate *document, int line, const QStringList &lines);
 
     /**
      * @copydoc KateUndo::undo()
@@ -132,7 +139,14 @@ public:
      */
     void redo() Q_DECL_OVERRIDE;
 
+    void flagSavedAsModified() Q_DECL_OVERRIDE;
     void updateUndoSavedOnDiskFlag(QBitArray &lines) Q_DECL_OVERRIDE;
+
+private:
+    /**
+     * per removed line: saved on disk after undo, else modified
+     */
+    QBitArray m_undoLinesSaved;
 };
 
 #endif // KATE_MODIFIED_UNDO_H
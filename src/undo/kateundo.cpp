@@ -73,18 +73,41 @@ KateEditUnWrapLineUndo::KateEditUnWrapLineUndo(KTextEditor::DocumentPrivate *doc
 {
 }
 
-KateEditInsertLineUndo::KateEditInsertLineUndo(KTextEditor::DocumentPrivate *document, int line, const QString &text)
+KateEditInsertLineUndo::KateEditInsertLineUndo(KTextEditor::DocumentPrivate *document, int line, const QStringList &lines)
     : KateUndo(document)
     , m_line(line)
-    , m_text(text)
+    , m_lines(lines)
 {
 }
 
-KateEditRemoveLineUndo::KateEditRemoveLineUndo(KTextEditor::DocumentPrivate *document, int line, const QString &text)
+KateEditRemoveLineUndo::KateEditRemoveLineUndo(KTextEditor::DocumentPrivate *document, int line, const QStringList &lines)
     : KateUndo(document)
     , m_line(line)
-    , m_text(text)
+    , m_lines(lines)
+{
+}
+
+void KateUndo::flagSavedAsModified()
 {
+    if (isFlagSet(UndoLine1Saved)) {
+        unsetFlag(UndoLine1Saved);
+        setFlag(UndoLine1Modified);
+    }
+
+    if (isFlagSet(UndoLine2Saved)) {
+        unsetFlag(UndoLine2Saved);
+        setFlag(UndoLine2Modified);
+    }
+
+    if (isFlagSet(RedoLine1Saved)) {
+        unsetFlag(RedoLine1Saved);
+        setFlag(RedoLine1Modified);
+    }
+
+    if (isFlagSet(RedoLine2Saved)) {
+        unsetFlag(RedoLine2Saved);
+        setFlag(RedoLine2Modified);
+    }
 }
 
 bool KateUndo::isEmpty() const
@@ -102,6 +125,40 @@ bool KateEditRemoveTextUndo::isEmpty() const
     return len() == 0;
 }
 
+qint64 KateUndo::memoryUsage() const
+{
+    // items without text just store some positions and flags
+    return sizeof(KateUndo) + 4 * sizeof(int);
+}
+
+qint64 KateEditInsertTextUndo::memoryUsage() const
+{
+    return sizeof(KateEditInsertTextUndo) + qint64(m_text.capacity()) * sizeof(QChar);
+}
+
+qint64 KateEditRemoveTextUndo::memoryUsage() const
+{
+    return sizeof(KateEditRemoveTextUndo) + qint64(m_text.capacity()) * sizeof(QChar);
+}
+
+qint64 KateEditInsertLineUndo::memoryUsage() const
+{
+    qint64 usage = sizeof(KateEditInsertLineUndo);
+    foreach (const QString &line, m_lines) {
+        usage += sizeof(QString) + qint64(line.capacity()) * sizeof(QChar);
+    }
+    return usage;
+}
+
+qint64 KateEditRemoveLineUndo::memoryUsage() const
+{
+    qint64 usage = sizeof(KateEditRemoveLineUndo);
+    foreach (const QString &line, m_lines) {
+        usage += sizeof(QString) + qint64(line.capacity()) * sizeof(QChar);
+    }
+    return usage;
+}
+
 bool KateUndo::mergeWith(const KateUndo * /*undo*/)
 {
     return false;
@@ -167,14 +224,14 @@ void KateEditInsertLineUndo::undo()
 {
     KTextEditor::DocumentPrivate *doc = document();
 
-    doc->editRemoveLine(m_line);
+    doc->editRemoveLines(m_line, m_line + m_lines.size() - 1);
 }
 
 void KateEditRemoveLineUndo::undo()
 {
     KTextEditor::DocumentPrivate *doc = document();
 
-    doc->editInsertLine(m_line, m_text);
+    doc->editInsertLines(m_line, m_lines);
 }
 
 void KateEditMarkLineAutoWrappedUndo::undo()
@@ -216,14 +273,14 @@ void KateEditRemoveLineUndo::redo()
 {
     KTextEditor::DocumentPrivate *doc = document();
 
-    doc->editRemoveLine(m_line);
+    doc->editRemoveLines(m_line, m_line + m_lines.size() - 1);
 }
 
 void KateEditInsertLineUndo::redo()
 {
     KTextEditor::DocumentPrivate *doc = document();
 
-    doc->editInsertLine(m_line, m_text);
+    doc->editInsertLines(m_line, m_lines);
 }
 
 void KateEditMarkLineAutoWrappedUndo::redo()
@@ -346,6 +403,15 @@ bool KateUndoGroup::merge(KateUndoGroup *newGroup, bool complex)
     return false;
 }
 
+qint64 KateUndoGroup::memoryUsage() const
+{
+    qint64 usage = sizeof(KateUndoGroup) + qint64(m_items.size()) * sizeof(KateUndo *);
+    foreach (const KateUndo *item, m_items) {
+        usage += item->memoryUsage();
+    }
+    return usage;
+}
+
 void KateUndoGroup::safePoint(bool safePoint)
 {
     m_safePoint = safePoint;
@@ -354,25 +420,7 @@ void KateUndoGroup::safePoint(bool safePoint)
 void KateUndoGroup::flagSavedAsModified()
 {
     foreach (KateUndo *item, m_items) {
-        if (item->isFlagSet(KateUndo::UndoLine1Saved)) {
-            item->unsetFlag(KateUndo::UndoLine1Saved);
-            item->setFlag(KateUndo::UndoLine1Modified);
-        }
-
-        if (item->isFlagSet(KateUndo::UndoLine2Saved)) {
-            item->unsetFlag(KateUndo::UndoLine2Saved);
-            item->setFlag(KateUndo::UndoLine2Modified);
-        }
-
-        if (item->isFlagSet(KateUndo::RedoLine1Saved)) {
-            item->unsetFlag(KateUndo::RedoLine1Saved);
-            item->setFlag(KateUndo::RedoLine1Modified);
-        }
-
-        if (item->isFlagSet(KateUndo::RedoLine2Saved)) {
-            item->unsetFlag(KateUndo::RedoLine2Saved);
-            item->setFlag(KateUndo::RedoLine2Modified);
-        }
+        item->flagSavedAsModified();
     }
 }
 
@@ -25,6 +25,7 @@
 #define kate_undo_h
 
 #include <QList>
+#include <QStringList>
 
 #include <ktexteditor/range.h>
 #include <QBitArray>
@@ -101,6 +102,12 @@ public:
      */
     virtual KateUndo::UndoType type() const = 0;
 
+    /**
+     * Estimate the memory used by this item, for the memory accounting of the documents.
+     * @return bytes used
+     */
+    virtual qint64 memoryUsage() const;
+
 protected:
     /**
      * Return the document the undo item belongs to.
@@ -147,6 +154,12 @@ public:
         return m_lineModFlags & flag;
     }
 
+    /**
+     * The document got saved by someone else or reloaded, flag all lines marked as saved
+     * as modified.
+     */
+    virtual void flagSavedAsModified();
+
     virtual void updateUndoSavedOnDiskFlag(QBitArray &lines)
     {
         Q_UNUSED(lines)
@@ -193,6 +206,11 @@ public:
         return KateUndo::editInsertText;
     }
 
+    /**
+     * @copydoc KateUndo::memoryUsage()
+     */
+    qint64 memoryUsage() const Q_DECL_OVERRIDE;
+
 protected:
     inline int len() const
     {
@@ -242,6 +260,11 @@ public:
         return KateUndo::editRemoveText;
     }
 
+    /**
+     * @copydoc KateUndo::memoryUsage()
+     */
+    qint64 memoryUsage() const Q_DECL_OVERRIDE;
+
 protected:
     inline int len() const
     {
@@ -362,10 +385,13 @@ private:
     const bool m_removeLine;
 };
 
+/**
+ * Undo item for whole lines, one item for all lines inserted or removed at once.
+ */
 class KateEditInsertLineUndo : public KateUndo
 {
 public:
-    KateEditInsertLineUndo(KTextEditor::DocumentPrivate *document, int line, const QString &text);
+    KateEditInsertLineUndo(KTextEditor::DocumentPrivate *document, int line, const QStringList &lines);
 
     /**
      * @copydoc KateUndo::undo()
@@ -385,21 +411,34 @@ public:
         return KateUndo::editInsertLine;
     }
 
+    /**
+     * @copydoc KateUndo::memoryUsage()
+     */
+    qint64 memoryUsage() const Q_DECL_OVERRIDE;
+
 protected:
     inline int line() const
     {
         return m_line;
     }
 
+    inline int lineCount() const
+    {
+        return m_lines.size();
+    }
+
 private:
     const int m_line;
-    const QString m_text;
+    const QStringList m_lines;
 };
 
+/**
+ * Undo item for whole lines, one item for all lines inserted or removed at once.
+ */
 class KateEditRemoveLineUndo : public KateUndo
 {
 public:
-    KateEditRemoveLineUndo(KTextEditor::DocumentPrivate *document, int line, const QString &text);
+    KateEditRemoveLineUndo(KTextEditor::DocumentPrivate *document, int line, const QStringList &lines);
 
     /**
      * @copydoc KateUndo::undo()
@@ -419,15 +458,25 @@ public:
         return KateUndo::editRemoveLine;
     }
 
+    /**
+     * @copydoc KateUndo::memoryUsage()
+     */
+    qint64 memoryUsage() const Q_DECL_OVERRIDE;
+
 protected:
     inline int line() const
     {
         return m_line;
     }
 
+    inline int lineCount() const
+    {
+        return m_lines.size();
+    }
+
 private:
     const int m_line;
-    const QString m_text;
+    const QStringList m_lines;
 };
 
 /**
@@ -473,6 +522,12 @@ public:
      */
     void safePoint(bool safePoint = true);
 
+    /**
+     * Estimate the memory used by this group and its items.
+     * @return bytes used
+     */
+    qint64 memoryUsage() const;
+
     /**
      * is this undogroup empty?
      */
@@ -177,17 +177,17 @@ void KateUndoManager::slotLineUnWrapped(int line, int col, int length, bool line
     }
 }
 
-void KateUndoManager::slotLineInserted(int line, const QString &s)
+void KateUndoManager::slotLinesInserted(int line, const QStringList &lines)
 {
     if (m_editCurrentUndo != 0) { // do we care about notifications?
-        addUndoItem(new KateModifiedInsertLine(m_document, line, s));
+        addUndoItem(new KateModifiedInsertLine(m_document, line, lines));
     }
 }
 
-void KateUndoManager::slotLineRemoved(int line, const QString &s)
+void KateUndoManager::slotLinesRemoved(int line, const QStringList &lines)
 {
     if (m_editCurrentUndo != 0) { // do we care about notifications?
-        addUndoItem(new KateModifiedRemoveLine(m_document, line, s));
+        addUndoItem(new KateModifiedRemoveLine(m_document, line, lines));
     }
 }
 
@@ -381,6 +381,20 @@ void KateUndoManager::clearRedo()
     emit undoChanged();
 }
 
+qint64 KateUndoManager::memoryUsage() const
+{
+    qint64 usage = 0;
+    foreach (const KateUndoGroup *group, undoItems + redoItems) {
+        usage += group->memoryUsage();
+    }
+
+    // group of the running edit, not yet in the undo list
+    if (m_editCurrentUndo) {
+        usage += m_editCurrentUndo->memoryUsage();
+    }
+    return usage;
+}
+
 void KateUndoManager::setModified(bool modified)
 {
     if (!modified) {
@@ -25,6 +25,7 @@
 #include <ktexteditor_export.h>
 
 #include <QList>
+#include <QStringList>
 
 namespace KTextEditor { class DocumentPrivate; }
 class KateUndo;
@@ -114,6 +115,12 @@ public:
      */
     KTextEditor::Cursor lastRedoCursor() const;
 
+    /**
+     * Estimate the memory used by the undo and redo groups, for the memory accounting of the documents.
+     * @return bytes used
+     */
+    qint64 memoryUsage() const;
+
 public Q_SLOTS:
     /**
      * Undo the latest undo group.
@@ -174,14 +181,14 @@ public Q_SLOTS:
     void slotLineUnWrapped(int line, int col, int length, bool lineRemoved);
 
     /**
-     * Notify KateUndoManager that a line was inserted.
+     * Notify KateUndoManager that lines were inserted.
      */
-    void slotLineInserted(int line, const QString &s);
+    void slotLinesInserted(int line, const QStringList &lines);
 
     /**
-     * Notify KateUndoManager that a line was removed.
+     * Notify KateUndoManager that lines are about to be removed.
      */
-    void slotLineRemoved(int line, const QString &s);
+    void slotLinesRemoved(int line, const QStringList &lines);
 
 Q_SIGNALS:
     void undoChanged();
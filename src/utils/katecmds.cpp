@@ -30,6 +30,7 @@
 #include "katerenderer.h"
 #include "katecmd.h"
 #include "katepartdebug.h"
+#include "kateglobal.h"
 
 #include <KLocalizedString>
 
@@ -591,3 +592,31 @@ bool KateCommands::Date::exec(KTextEditor::View *view, const QString &cmd, QStri
 
 //END Date
 
+//BEGIN Memory
+KateCommands::Memory *KateCommands::Memory::m_instance = 0;
+
+bool KateCommands::Memory::help(class KTextEditor::View *, const QString &cmd, QString &msg)
+{
+    if (cmd.trimmed() == QLatin1String("memory")) {
+        msg = i18n("<p>memory</p>"
+                   "<p>Shows the estimated memory usage of all documents and of the largest ones, "
+                   "split into text, highlighting, layouts, undo, editing history and moving ranges.</p>");
+        return true;
+    }
+
+    return false;
+}
+
+bool KateCommands::Memory::exec(KTextEditor::View *, const QString &cmd, QString &msg, const KTextEditor::Range &)
+{
+    if (cmd.trimmed() != QLatin1String("memory")) {
+        return false;
+    }
+
+    // the command line shows one line only, limit the report to the largest documents
+    msg = KTextEditor::EditorPrivate::self()->memoryUsageReport(3).join(QLatin1String("; "));
+    return true;
+}
+
+//END Memory
+
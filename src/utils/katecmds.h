@@ -189,6 +189,46 @@ public:
     }
 };
 
+/**
+ * report the estimated memory usage of the documents
+ */
+class Memory : public KTextEditor::Command
+{
+    Memory()
+        : KTextEditor::Command(QStringList() << QLatin1String("memory"))
+    {
+    }
+
+    static Memory *m_instance;
+
+public:
+    ~Memory()
+    {
+        m_instance = 0;
+    }
+
+    /**
+     * execute command
+     * @param view view to use for execution
+     * @param cmd cmd string
+     * @param msg the report, totals and the largest documents
+     * @return success
+     */
+    bool exec(class KTextEditor::View *view, const QString &cmd, QString &msg,
+              const KTextEditor::Range &range = KTextEditor::Range(-1, -0, -1, 0)) Q_DECL_OVERRIDE;
+
+    /** @see KTextEditor::Command::help */
+    bool help(class KTextEditor::View *, const QString &, QString &) Q_DECL_OVERRIDE;
+
+    static Memory *self()
+    {
+        if (m_instance == 0) {
+            m_instance = new Memory();
+        }
+        return m_instance;
+    }
+};
+
 } // namespace KateCommands
 #endif
 
@@ -201,6 +201,9 @@ KateDocumentConfig::KateDocumentConfig()
       m_swapSyncIntervalSet(false),
       m_onTheFlySpellCheckSet(false),
       m_lineLengthLimitSet(false),
+      m_largeFileLimitSet(false),
+      m_backgroundLoadLimitSet(false),
+      m_compactLineStorageSet(false),
       m_doc(0)
 {
     s_global = this;
@@ -245,6 +248,9 @@ KateDocumentConfig::KateDocumentConfig(const KConfigGroup &cg)
       m_swapSyncIntervalSet(false),
       m_onTheFlySpellCheckSet(false),
       m_lineLengthLimitSet(false),
+      m_largeFileLimitSet(false),
+      m_backgroundLoadLimitSet(false),
+      m_compactLineStorageSet(false),
       m_doc(0)
 {
     // init with defaults from config or really hardcoded ones
@@ -283,6 +289,9 @@ KateDocumentConfig::KateDocumentConfig(KTextEditor::DocumentPrivate *doc)
       m_swapSyncIntervalSet(false),
       m_onTheFlySpellCheckSet(false),
       m_lineLengthLimitSet(false),
+      m_largeFileLimitSet(false),
+      m_backgroundLoadLimitSet(false),
+      m_compactLineStorageSet(false),
       m_doc(doc)
 {
 }
@@ -323,6 +332,9 @@ const char KEY_SWAP_DIRECTORY[] = "Swap Directory";
 const char KEY_SWAP_SYNC_INTERVAL[] = "Swap Sync Interval";
 const char KEY_ON_THE_FLY_SPELLCHECK[] = "On-The-Fly Spellcheck";
 const char KEY_LINE_LENGTH_LIMIT[] = "Line Length Limit";
+const char KEY_LARGE_FILE_LIMIT[] = "Large File Limit";
+const char KEY_BACKGROUND_LOAD_LIMIT[] = "Background Load Limit";
+const char KEY_COMPACT_LINE_STORAGE[] = "Compact Line Storage";
 }
 
 void KateDocumentConfig::readConfig(const KConfigGroup &config)
@@ -374,6 +386,12 @@ void KateDocumentConfig::readConfig(const KConfigGroup &config)
 
     setLineLengthLimit(config.readEntry(KEY_LINE_LENGTH_LIMIT, 4096));
 
+    setLargeFileLimit(config.readEntry(KEY_LARGE_FILE_LIMIT, 0));
+
+    setBackgroundLoadLimit(config.readEntry(KEY_BACKGROUND_LOAD_LIMIT, 0));
+
+    setCompactLineStorage(config.readEntry(KEY_COMPACT_LINE_STORAGE, false));
+
     configEnd();
 }
 
@@ -423,6 +441,12 @@ void KateDocumentConfig::writeConfig(KConfigGroup &config)
     config.writeEntry(KEY_ON_THE_FLY_SPELLCHECK, onTheFlySpellCheck());
 
     config.writeEntry(KEY_LINE_LENGTH_LIMIT, lineLengthLimit());
+
+    config.writeEntry(KEY_LARGE_FILE_LIMIT, largeFileLimit());
+
+    config.writeEntry(KEY_BACKGROUND_LOAD_LIMIT, backgroundLoadLimit());
+
+    config.writeEntry(KEY_COMPACT_LINE_STORAGE, compactLineStorage());
 }
 
 void KateDocumentConfig::updateConfig()
@@ -1197,6 +1221,75 @@ void KateDocumentConfig::setLineLengthLimit(int lineLengthLimit)
     configEnd();
 }
 
+int KateDocumentConfig::largeFileLimit() const
+{
+    if (m_largeFileLimitSet || isGlobal()) {
+        return m_largeFileLimit;
+    }
+
+    return s_global->largeFileLimit();
+}
+
+void KateDocumentConfig::setLargeFileLimit(int largeFileLimit)
+{
+    if (m_largeFileLimitSet && m_largeFileLimit == largeFileLimit) {
+        return;
+    }
+
+    configStart();
+
+    m_largeFileLimitSet = true;
+    m_largeFileLimit = largeFileLimit;
+
+    configEnd();
+}
+
+int KateDocumentConfig::backgroundLoadLimit() const
+{
+    if (m_backgroundLoadLimitSet || isGlobal()) {
+        return m_backgroundLoadLimit;
+    }
+
+    return s_global->backgroundLoadLimit();
+}
+
+void KateDocumentConfig::setBackgroundLoadLimit(int backgroundLoadLimit)
+{
+    if (m_backgroundLoadLimitSet && m_backgroundLoadLimit == backgroundLoadLimit) {
+        return;
+    }
+
+    configStart();
+
+    m_backgroundLoadLimitSet = true;
+    m_backgroundLoadLimit = backgroundLoadLimit;
+
+    configEnd();
+}
+
+bool KateDocumentConfig::compactLineStorage() const
+{
+    if (m_compactLineStorageSet || isGlobal()) {
+        return m_compactLineStorage;
+    }
+
+    return s_global->compactLineStorage();
+}
+
+void KateDocumentConfig::setCompactLineStorage(bool on)
+{
+    if (m_compactLineStorageSet && m_compactLineStorage == on) {
+        return;
+    }
+
+    configStart();
+
+    m_compactLineStorageSet = true;
+    m_compactLineStorage = on;
+
+    configEnd();
+}
+
 //END
 
 //BEGIN KateViewConfig
@@ -318,6 +318,27 @@ public:
     int lineLengthLimit() const;
     void setLineLengthLimit(int limit);
 
+    /**
+     * Files at least this large (in MiB) are memory mapped and decoded lazily on load.
+     * 0 disables this.
+     */
+    int largeFileLimit() const;
+    void setLargeFileLimit(int limit);
+
+    /**
+     * Files at least this large (in MiB) are loaded in a background thread.
+     * 0 disables this.
+     */
+    int backgroundLoadLimit() const;
+    void setBackgroundLoadLimit(int limit);
+
+    /**
+     * Store the lines of loaded files compact, one string per block, lines only get
+     * their own storage on first access.
+     */
+    bool compactLineStorage() const;
+    void setCompactLineStorage(bool on);
+
 private:
     QString m_indentationMode;
     int m_indentationWidth;
@@ -339,6 +360,9 @@ private:
     uint m_swapSyncInterval;
     bool m_onTheFlySpellCheck;
     int m_lineLengthLimit;
+    int m_largeFileLimit;
+    int m_backgroundLoadLimit;
+    bool m_compactLineStorage;
 
     bool m_tabWidthSet : 1;
     bool m_indentationWidthSet : 1;
@@ -382,6 +406,9 @@ private:
     bool m_swapSyncIntervalSet : 1;
     bool m_onTheFlySpellCheckSet : 1;
     bool m_lineLengthLimitSet : 1;
+    bool m_largeFileLimitSet : 1;
+    bool m_backgroundLoadLimitSet : 1;
+    bool m_compactLineStorageSet : 1;
 
 private:
     static KateDocumentConfig *s_global;
@@ -58,6 +58,9 @@
 #include <QClipboard>
 #include <QPushButton>
 #include <QStringListModel>
+#include <QVector>
+
+#include <algorithm>
 
 #ifdef LIBGIT2_FOUND
 #include <git2.h>
@@ -222,6 +225,7 @@ KTextEditor::EditorPrivate::EditorPrivate(QPointer<KTextEditor::EditorPrivate> &
     m_cmds.push_back(KateCommands::CoreCommands::self());
     m_cmds.push_back(KateCommands::Character::self());
     m_cmds.push_back(KateCommands::Date::self());
+    m_cmds.push_back(KateCommands::Memory::self());
     m_cmds.push_back(KateCommands::SedReplace::self());
     m_cmds.push_back(KateCommands::Highlighting::self());
 
@@ -438,6 +442,45 @@ QStringList KTextEditor::EditorPrivate::commandList() const
     return m_cmdManager->commandList();
 }
 
+static QString memoryUsageLine(const QString &name, const KTextEditor::DocumentPrivate::MemoryUsage &usage)
+{
+    return i18n("%1: %2 KiB (text %3, highlighting %4, layouts %5, undo %6, history %7, moving ranges %8)",
+                name, usage.total() / 1024, usage.text / 1024, usage.highlighting / 1024, usage.layouts / 1024,
+                usage.undo / 1024, usage.history / 1024, usage.movingRanges / 1024);
+}
+
+QStringList KTextEditor::EditorPrivate::memoryUsageReport(int maxDocuments) const
+{
+    /**
+     * collect the usage of all documents, sum them up
+     */
+    typedef QPair<KTextEditor::DocumentPrivate::MemoryUsage, KTextEditor::DocumentPrivate *> DocumentUsage;
+    QVector<DocumentUsage> documents;
+    documents.reserve(m_documents.size());
+    KTextEditor::DocumentPrivate::MemoryUsage total;
+    foreach (KTextEditor::DocumentPrivate *doc, m_documents) {
+        const KTextEditor::DocumentPrivate::MemoryUsage usage = doc->memoryUsage();
+        total.text += usage.text;
+        total.highlighting += usage.highlighting;
+        total.layouts += usage.layouts;
+        total.undo += usage.undo;
+        total.history += usage.history;
+        total.movingRanges += usage.movingRanges;
+        documents.append(DocumentUsage(usage, doc));
+    }
+
+    std::sort(documents.begin(), documents.end(), [](const DocumentUsage &a, const DocumentUsage &b) {
+        return a.first.total() > b.first.total();
+    });
+
+    QStringList report;
+    report << memoryUsageLine(i18np("%1 document", "%1 documents", documents.size()), total);
+    for (int i = 0; i < documents.size() && (maxDocuments < 0 || i < maxDocuments); ++i) {
+        report << memoryUsageLine(documents[i].second->documentName(), documents[i].first);
+    }
+    return report;
+}
+
 void KTextEditor::EditorPrivate::updateColorPalette()
 {
     // update default color cache
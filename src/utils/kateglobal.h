@@ -389,6 +389,14 @@ public:
         return m_documents.values();
     }
 
+    /**
+     * Report of the estimated memory usage of all documents, see DocumentPrivate::memoryUsage().
+     * First line are the totals, then one line per document, largest first.
+     * @param maxDocuments limit of documents to report, -1 for all
+     * @return report lines
+     */
+    QStringList memoryUsageReport(int maxDocuments = -1) const;
+
     /**
      * Dummy main window to be null safe.
      * @return dummy main window
@@ -1804,6 +1804,11 @@ KateRenderer *KTextEditor::ViewPrivate::renderer()
     return m_renderer;
 }
 
+qint64 KTextEditor::ViewPrivate::layoutMemoryUsage() const
+{
+    return m_viewInternal->cache()->memoryUsage();
+}
+
 void KTextEditor::ViewPrivate::updateConfig()
 {
     if (m_startingUp) {
@@ -3619,13 +3624,13 @@ QList<KTextEditor::AttributeBlock> KTextEditor::ViewPrivate::lineAttributes(int
         return attribs;
     }
 
-    const QVector<Kate::TextLineData::Attribute> &intAttrs = kateLine->attributesList();
-    for (int i = 0; i < intAttrs.size(); ++i) {
-        if (intAttrs[i].length > 0 && intAttrs[i].attributeValue > 0) {
+    for (Kate::TextLineData::AttributeIterator it(*kateLine); !it.atEnd(); it.next()) {
+        const Kate::TextLineData::Attribute &attribute = it.attribute();
+        if (attribute.length > 0 && attribute.attributeValue > 0) {
             attribs << KTextEditor::AttributeBlock(
-                        intAttrs.at(i).offset,
-                        intAttrs.at(i).length,
-                        renderer()->attribute(intAttrs.at(i).attributeValue)
+                        attribute.offset,
+                        attribute.length,
+                        renderer()->attribute(attribute.attributeValue)
                     );
         }
     }
@@ -536,6 +536,12 @@ public:
 public:
     KateRenderer *renderer();
 
+    /**
+     * Estimate the memory used by the cached line layouts of this view.
+     * @return bytes used, see KateLayoutCache::memoryUsage()
+     */
+    qint64 layoutMemoryUsage() const;
+
     bool iconBorder();
     bool lineNumbersOn();
     bool scrollBarMarks();
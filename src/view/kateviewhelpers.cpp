@@ -122,6 +122,8 @@ void KateScrollBar::setShowMiniMap(bool b)
         connect(m_view, SIGNAL(selectionChanged(KTextEditor::View*)), &m_updateTimer, SLOT(start()), Qt::UniqueConnection);
         connect(m_doc, SIGNAL(textChanged(KTextEditor::Document*)), &m_updateTimer, SLOT(start()), Qt::UniqueConnection);
         connect(m_view, SIGNAL(delayedUpdateOfView()), &m_updateTimer, SLOT(start()), Qt::UniqueConnection);
+        // lines got highlighted, they are no longer drawn as plain text
+        connect(&m_doc->buffer(), SIGNAL(tagLines(int,int)), &m_updateTimer, SLOT(start()), Qt::UniqueConnection);
         connect(&m_updateTimer, SIGNAL(timeout()), this, SLOT(updatePixmap()), Qt::UniqueConnection);
         connect(&(m_view->textFolding()), SIGNAL(foldingRangesChanged()), &m_updateTimer, SLOT(start()), Qt::UniqueConnection);
     } else if (!b) {
@@ -256,7 +258,7 @@ void KateScrollBar::paintEvent(QPaintEvent *e)
 }
 
 // This function is optimized for bing called in sequence.
-const QColor KateScrollBar::charColor(const QVector<Kate::TextLineData::Attribute> &attributes, int &attributeIndex,
+const QColor KateScrollBar::charColor(Kate::TextLineData::AttributeIterator &attributes,
                                       const QList<QTextLayout::FormatRange> &decorations,
                                       const QColor &defaultColor, int x, QChar ch)
 {
@@ -284,12 +286,12 @@ const QColor KateScrollBar::charColor(const QVector<Kate::TextLineData::Attribut
     // plain Kate), query the styles, that is, the default kate syntax highlighting.
     if (!styleFound) {
         // go to the block containing x
-        while ((attributeIndex < attributes.size()) &&
-                ((attributes[attributeIndex].offset + attributes[attributeIndex].length) < x)) {
-            ++attributeIndex;
+        while (!attributes.atEnd() &&
+                ((attributes.attribute().offset + attributes.attribute().length) < x)) {
+            attributes.next();
         }
-        if ((attributeIndex < attributes.size()) && (x < attributes[attributeIndex].offset + attributes[attributeIndex].length)) {
-            color = m_view->renderer()->attribute(attributes[attributeIndex].attributeValue)->foreground().color();
+        if (!attributes.atEnd() && (x < attributes.attribute().offset + attributes.attribute().length)) {
+            color = m_view->renderer()->attribute(attributes.attribute().attributeValue)->foreground().color();
         }
     }
 
@@ -361,9 +363,6 @@ void KateScrollBar::updatePixmap()
 
     QPainter painter;
     if (painter.begin(&m_pixmap)) {
-        // Do not force updates of the highlighting if the document is very large
-        bool simpleMode = m_doc->lines() > 7500;
-
         int pixelY = 0;
         int drawnLines = 0;
 
@@ -376,14 +375,12 @@ void KateScrollBar::updatePixmap()
             // use this to control the offset of the text from the left
             int pixelX = s_pixelMargin;
 
-            if (!simpleMode) {
-                m_doc->buffer().ensureHighlighted(realLineNumber);
-            }
+            // The mini map never asks for highlighting, only the lines shown by the view get it.
+            // Lines without up to date highlighting are drawn as plain text until then.
             const Kate::TextLine &kateline = m_doc->plainKateTextLine(realLineNumber);
 
-            const QVector<Kate::TextLineData::Attribute> &attributes = kateline->attributesList();
+            Kate::TextLineData::AttributeIterator attributes = m_doc->buffer().isLineHighlighted(realLineNumber) ? Kate::TextLineData::AttributeIterator(*kateline) : Kate::TextLineData::AttributeIterator();
             QList< QTextLayout::FormatRange > decorations = m_view->renderer()->decorationsForLine(kateline, realLineNumber);
-            int attributeIndex = 0;
 
             // The color to draw the currently selected text in; change the alpha value to make it
             // more or less intense
@@ -403,7 +400,7 @@ void KateScrollBar::updatePixmap()
                 } else if (lineText[x] == QLatin1Char('\t')) {
                     pixelX += qMax(4 / charIncrement, 1); // FIXME: tab width...
                 } else {
-                    painter.setPen(charColor(attributes, attributeIndex, decorations, defaultTextColor, x, lineText[x]));
+                    painter.setPen(charColor(attributes, decorations, defaultTextColor, x, lineText[x]));
 
                     // Actually draw the pixel with the color queried from the renderer.
                     painter.drawPoint(pixelX, pixelY);
@@ -1697,7 +1694,8 @@ void KateIconBorder::paintBorder(int /*x*/, int y, int /*width*/, int height)
                         anyFolded = true;
                     }
 
-                Kate::TextLine tl = m_doc->kateTextLine(realLine);
+                m_doc->buffer().ensureHighlightedForPainting(realLine);
+                Kate::TextLine tl = m_doc->plainKateTextLine(realLine);
 
                 if (!startingRanges.isEmpty() || tl->markedAsFoldingStart()) {
                     if (anyFolded) {
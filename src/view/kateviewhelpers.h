@@ -141,7 +141,7 @@ private:
 
     int minimapYToStdY(int y);
 
-    const QColor charColor(const QVector<Kate::TextLineData::Attribute> &attributes, int &attributeIndex,
+    const QColor charColor(Kate::TextLineData::AttributeIterator &attributes,
                            const QList<QTextLayout::FormatRange> &decorations,
                            const QColor &defaultColor, int x, QChar ch);
 